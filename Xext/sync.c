@@ -59,6 +59,7 @@ PERFORMANCE OF THIS SOFTWARE.
 #include <X11/extensions/syncproto.h>
 
 #include "dix/dix_priv.h"
+#include "dix/dixstruct_priv.h"
 #include "miext/extinit_priv.h"
 #include "os/bug_priv.h"
 #include "os/osdep.h"
@@ -134,6 +135,139 @@ SyncCheckWarnIsCounter(const SyncObject * pSync, const char *warning)
     return TRUE;
 }
 
+/*  Besides the list, a counter keeps its triggers in one array per test
+ *  type, sorted by test value, so a counter change only needs to look at
+ *  the triggers whose test value it crossed, and the bracket values are
+ *  found by binary search.
+ */
+
+/*  Triggers being fired by SyncChangeCounter().  Firing one trigger may
+ *  destroy others (an Await with several conditions on one counter), so
+ *  deleted triggers are taken out of here too.
+ */
+typedef struct _SyncFiring {
+    SyncTrigger **triggers;
+    int num;
+    struct _SyncFiring *prev;
+} SyncFiring;
+
+static SyncFiring *SyncFiringTriggers;
+
+/* first entry with a test value >= value, or > value if after */
+static int
+SyncTriggerIndexSearch(SyncTriggerIndex *pIndex, int64_t value, Bool after)
+{
+    int lo = 0, hi = pIndex->num;
+
+    while (lo < hi) {
+        int mid = (lo + hi) / 2;
+
+        if (pIndex->entries[mid].value < value ||
+            (after && pIndex->entries[mid].value == value))
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return lo;
+}
+
+static void
+SyncTriggerIndexInsert(SyncTrigger * pTrigger)
+{
+    SyncCounter *pCounter = (SyncCounter *) pTrigger->pSync;
+    SyncTriggerIndex *pIndex;
+    int i;
+
+    if (pTrigger->test_type >= SYNC_TEST_TYPES)
+        return;
+
+    pIndex = &pCounter->triggers[pTrigger->test_type];
+    if (pIndex->num == pIndex->size) {
+        pIndex->size = pIndex->size ? pIndex->size * 2 : 8;
+        pIndex->entries = XNFreallocarray(pIndex->entries, pIndex->size,
+                                          sizeof(*pIndex->entries));
+    }
+
+    i = SyncTriggerIndexSearch(pIndex, pTrigger->test_value, TRUE);
+    memmove(&pIndex->entries[i + 1], &pIndex->entries[i],
+            (pIndex->num - i) * sizeof(*pIndex->entries));
+    pIndex->entries[i].value = pTrigger->test_value;
+    pIndex->entries[i].pTrigger = pTrigger;
+    pIndex->num++;
+
+    pTrigger->indexed = TRUE;
+    pTrigger->index_type = pTrigger->test_type;
+    pTrigger->index_value = pTrigger->test_value;
+}
+
+static void
+SyncTriggerIndexRemove(SyncTrigger * pTrigger)
+{
+    SyncCounter *pCounter = (SyncCounter *) pTrigger->pSync;
+    SyncTriggerIndex *pIndex;
+    int i;
+
+    if (!pTrigger->indexed)
+        return;
+
+    pIndex = &pCounter->triggers[pTrigger->index_type];
+    for (i = SyncTriggerIndexSearch(pIndex, pTrigger->index_value, FALSE);
+         i < pIndex->num; i++) {
+        if (pIndex->entries[i].pTrigger == pTrigger) {
+            pIndex->num--;
+            memmove(&pIndex->entries[i], &pIndex->entries[i + 1],
+                    (pIndex->num - i) * sizeof(*pIndex->entries));
+            break;
+        }
+    }
+    pTrigger->indexed = FALSE;
+}
+
+/*  Call after changing the test type or value of a trigger on a counter. */
+static void
+SyncTriggerIndexUpdate(SyncTrigger * pTrigger)
+{
+    if (!pTrigger->indexed ||
+        (pTrigger->index_type == pTrigger->test_type &&
+         pTrigger->index_value == pTrigger->test_value))
+        return;
+
+    SyncTriggerIndexRemove(pTrigger);
+    SyncTriggerIndexInsert(pTrigger);
+}
+
+/*  Range of the entries of one index whose triggers can have become true
+ *  when the counter changed from oldval to its current value.  Triggers
+ *  which were already true at the last check have been fired then.  The
+ *  counter value may have been updated without a check in between (see
+ *  SyncUpdateCounter()), so the range covers that too.
+ */
+static void
+SyncTriggerIndexRange(SyncCounter * pCounter, int type, int64_t oldval,
+                      int *first, int *last)
+{
+    SyncTriggerIndex *pIndex = &pCounter->triggers[type];
+    int64_t newval = pCounter->value;
+
+    *first = *last = 0;
+    if (type == XSyncPositiveTransition || type == XSyncPositiveComparison) {
+        int64_t from = min(oldval, pCounter->checked_value);
+
+        if (newval > from) {
+            *first = SyncTriggerIndexSearch(pIndex, from, TRUE);
+            *last = SyncTriggerIndexSearch(pIndex, newval, TRUE);
+        }
+    }
+    else {
+        int64_t from = max(oldval, pCounter->checked_value);
+
+        if (newval < from) {
+            *first = SyncTriggerIndexSearch(pIndex, newval, FALSE);
+            *last = SyncTriggerIndexSearch(pIndex, from, FALSE);
+        }
+    }
+}
+
 /*  Each counter maintains a simple linked list of triggers that are
  *  interested in the counter.  The two functions below are used to
  *  delete and add triggers on this list.
@@ -171,6 +305,14 @@ SyncDeleteTriggerFromSyncObject(SyncTrigger * pTrigger)
     if (SYNC_COUNTER == pTrigger->pSync->type) {
         pCounter = (SyncCounter *) pTrigger->pSync;
 
+        SyncTriggerIndexRemove(pTrigger);
+        for (SyncFiring *pFiring = SyncFiringTriggers; pFiring;
+             pFiring = pFiring->prev) {
+            for (int i = 0; i < pFiring->num; i++)
+                if (pFiring->triggers[i] == pTrigger)
+                    pFiring->triggers[i] = NULL;
+        }
+
         if (IsSystemCounter(pCounter))
             SyncComputeBracketValues(pCounter);
     }
@@ -206,6 +348,8 @@ SyncAddTriggerToSyncObject(SyncTrigger * pTrigger)
     if (SYNC_COUNTER == pTrigger->pSync->type) {
         pCounter = (SyncCounter *) pTrigger->pSync;
 
+        SyncTriggerIndexInsert(pTrigger);
+
         if (IsSystemCounter(pCounter))
             SyncComputeBracketValues(pCounter);
     }
@@ -436,8 +580,10 @@ SyncInitTrigger(ClientPtr client, SyncTrigger * pTrigger, XID syncObject,
     if (newSyncObject) {
         SyncAddTriggerToSyncObject(pTrigger);
     }
-    else if (pCounter && IsSystemCounter(pCounter)) {
-        SyncComputeBracketValues(pCounter);
+    else if (pCounter) {
+        SyncTriggerIndexUpdate(pTrigger);
+        if (IsSystemCounter(pCounter))
+            SyncComputeBracketValues(pCounter);
     }
 
     return Success;
@@ -627,6 +773,7 @@ SyncAlarmTriggerFired(SyncTrigger * pTrigger)
      */
     SyncSendAlarmNotifyEvents(pAlarm);
     pTrigger->test_value = new_test_value;
+    SyncTriggerIndexUpdate(pTrigger);
 }
 
 /*  This function is called when an Await unblocks, either as a result
@@ -738,23 +885,67 @@ SyncUpdateCounter(SyncCounter *pCounter, int64_t newval)
 void
 SyncChangeCounter(SyncCounter * pCounter, int64_t newval)
 {
-    SyncTriggerList *ptl, *pnext;
+    SyncTrigger *stack_triggers[16];
+    SyncFiring firing = { stack_triggers, 0, SyncFiringTriggers };
+    int first[SYNC_TEST_TYPES], last[SYNC_TEST_TYPES];
     int64_t oldval;
+    size_t num = 0;
 
     oldval = SyncUpdateCounter(pCounter, newval);
 
-    /* run through triggers to see if any become true */
-    for (ptl = pCounter->sync.pTriglist; ptl; ptl = pnext) {
-        pnext = ptl->next;
-        if ((*ptl->pTrigger->CheckTrigger) (ptl->pTrigger, oldval))
-            (*ptl->pTrigger->TriggerFired) (ptl->pTrigger);
+    /* collect the triggers the change may have made true */
+    for (int type = 0; type < SYNC_TEST_TYPES; type++) {
+        SyncTriggerIndexRange(pCounter, type, oldval, &first[type], &last[type]);
+        num += last[type] - first[type];
     }
+    pCounter->checked_value = newval;
+
+    if (num > ARRAY_SIZE(stack_triggers))
+        firing.triggers = XNFcallocarray(num, sizeof(SyncTrigger *));
+    for (int type = 0; type < SYNC_TEST_TYPES; type++) {
+        for (int i = first[type]; i < last[type]; i++)
+            firing.triggers[firing.num++] =
+                pCounter->triggers[type].entries[i].pTrigger;
+    }
+
+    /* run through them to see if any become true */
+    SyncFiringTriggers = &firing;
+    for (int i = 0; i < firing.num; i++) {
+        SyncTrigger *pTrigger = firing.triggers[i];
+
+        if (pTrigger && (*pTrigger->CheckTrigger) (pTrigger, oldval))
+            (*pTrigger->TriggerFired) (pTrigger);
+    }
+    SyncFiringTriggers = firing.prev;
+
+    if (firing.triggers != stack_triggers)
+        free(firing.triggers);
 
     if (IsSystemCounter(pCounter)) {
         SyncComputeBracketValues(pCounter);
     }
 }
 
+/*  Whether changing the counter from oldval to its current value makes
+ *  any of its triggers true, without firing them.
+ */
+static Bool
+SyncCounterTriggered(SyncCounter * pCounter, int64_t oldval)
+{
+    for (int type = 0; type < SYNC_TEST_TYPES; type++) {
+        int first, last;
+
+        SyncTriggerIndexRange(pCounter, type, oldval, &first, &last);
+        for (int i = first; i < last; i++) {
+            SyncTrigger *pTrigger = pCounter->triggers[type].entries[i].pTrigger;
+
+            if ((*pTrigger->CheckTrigger) (pTrigger, oldval))
+                return TRUE;
+        }
+    }
+    return FALSE;
+}
+
 /* loosely based on dix/events.c/EventSelectForWindow */
 static Bool
 SyncEventSelectForAlarm(SyncAlarm * pAlarm, ClientPtr client, Bool wantevents)
@@ -999,6 +1190,7 @@ SyncCreateCounter(ClientPtr client, XSyncCounter id, int64_t initialvalue)
         return NULL;
 
     pCounter->value = initialvalue;
+    pCounter->checked_value = initialvalue;
     pCounter->pSysCounterInfo = NULL;
 
     pCounter->sync.initialized = TRUE;
@@ -1055,8 +1247,6 @@ SyncDestroySystemCounter(void *pSysCounter)
 static void
 SyncComputeBracketValues(SyncCounter * pCounter)
 {
-    SyncTriggerList *pCur;
-    SyncTrigger *pTrigger;
     SysCounterInfo *psci;
     int64_t *pnewgtval = NULL;
     int64_t *pnewltval = NULL;
@@ -1073,73 +1263,39 @@ SyncComputeBracketValues(SyncCounter * pCounter)
     psci->bracket_greater = LLONG_MAX;
     psci->bracket_less = LLONG_MIN;
 
-    for (pCur = pCounter->sync.pTriglist; pCur; pCur = pCur->next) {
-        pTrigger = pCur->pTrigger;
+    for (int type = 0; type < SYNC_TEST_TYPES; type++) {
+        SyncTriggerIndex *pIndex = &pCounter->triggers[type];
+        int i;
 
-        if (pTrigger->test_type == XSyncPositiveComparison &&
-            ct != XSyncCounterNeverIncreases) {
-            if (pCounter->value < pTrigger->test_value &&
-                pTrigger->test_value < psci->bracket_greater) {
-                psci->bracket_greater = pTrigger->test_value;
-                pnewgtval = &psci->bracket_greater;
-            }
-            else if (pCounter->value > pTrigger->test_value &&
-                     pTrigger->test_value > psci->bracket_less) {
-                    psci->bracket_less = pTrigger->test_value;
-                    pnewltval = &psci->bracket_less;
-            }
-        }
-        else if (pTrigger->test_type == XSyncNegativeComparison &&
-                 ct != XSyncCounterNeverDecreases) {
-            if (pCounter->value > pTrigger->test_value &&
-                pTrigger->test_value > psci->bracket_less) {
-                psci->bracket_less = pTrigger->test_value;
-                pnewltval = &psci->bracket_less;
-            }
-            else if (pCounter->value < pTrigger->test_value &&
-                     pTrigger->test_value < psci->bracket_greater) {
-                    psci->bracket_greater = pTrigger->test_value;
-                    pnewgtval = &psci->bracket_greater;
-            }
-        }
-        else if (pTrigger->test_type == XSyncNegativeTransition &&
-                 ct != XSyncCounterNeverIncreases) {
-            if (pCounter->value >= pTrigger->test_value &&
-                pTrigger->test_value > psci->bracket_less) {
-                    /*
-                     * If the value is exactly equal to our threshold, we want one
-                     * more event in the negative direction to ensure we pick up
-                     * when the value is less than this threshold.
-                     */
-                    psci->bracket_less = pTrigger->test_value;
-                    pnewltval = &psci->bracket_less;
-            }
-            else if (pCounter->value < pTrigger->test_value &&
-                     pTrigger->test_value < psci->bracket_greater) {
-                    psci->bracket_greater = pTrigger->test_value;
-                    pnewgtval = &psci->bracket_greater;
-            }
+        if (((type == XSyncPositiveComparison ||
+              type == XSyncNegativeTransition) &&
+             ct == XSyncCounterNeverIncreases) ||
+            ((type == XSyncNegativeComparison ||
+              type == XSyncPositiveTransition) &&
+             ct == XSyncCounterNeverDecreases))
+            continue;
+
+        /*
+         * The nearest test values on either side.  If the value is exactly
+         * equal to the threshold of a transition, we want one more event
+         * in the direction of the transition, to pick up when the value
+         * goes past it.
+         */
+        i = SyncTriggerIndexSearch(pIndex, pCounter->value,
+                                   type != XSyncPositiveTransition);
+        if (i < pIndex->num &&
+            pIndex->entries[i].value < psci->bracket_greater) {
+            psci->bracket_greater = pIndex->entries[i].value;
+            pnewgtval = &psci->bracket_greater;
         }
-        else if (pTrigger->test_type == XSyncPositiveTransition &&
-                 ct != XSyncCounterNeverDecreases) {
-            if (pCounter->value <= pTrigger->test_value &&
-                pTrigger->test_value < psci->bracket_greater) {
-                    /*
-                     * If the value is exactly equal to our threshold, we
-                     * want one more event in the positive direction to
-                     * ensure we pick up when the value *exceeds* this
-                     * threshold.
-                     */
-                    psci->bracket_greater = pTrigger->test_value;
-                    pnewgtval = &psci->bracket_greater;
-            }
-            else if (pCounter->value > pTrigger->test_value &&
-                     pTrigger->test_value > psci->bracket_less) {
-                    psci->bracket_less = pTrigger->test_value;
-                    pnewltval = &psci->bracket_less;
-            }
+
+        i = SyncTriggerIndexSearch(pIndex, pCounter->value,
+                                   type == XSyncNegativeTransition);
+        if (i > 0 && pIndex->entries[i - 1].value > psci->bracket_less) {
+            psci->bracket_less = pIndex->entries[i - 1].value;
+            pnewltval = &psci->bracket_less;
         }
-    }                           /* end for each trigger */
+    }
 
     (*psci->BracketValues) ((void *) pCounter, pnewltval, pnewgtval);
 
@@ -1186,10 +1342,13 @@ FreeCounter(void *env, XID id)
 
         /* tell all the counter's triggers that counter has been destroyed */
         for (ptl = pCounter->sync.pTriglist; ptl; ptl = pnext) {
+            ptl->pTrigger->indexed = FALSE;
             (*ptl->pTrigger->CounterDestroyed) (ptl->pTrigger);
             pnext = ptl->next;
             free(ptl); /* destroy the trigger list as we go */
         }
+        for (int type = 0; type < SYNC_TEST_TYPES; type++)
+            free(pCounter->triggers[type].entries);
         if (IsSystemCounter(pCounter)) {
             xorg_list_del(&pCounter->pSysCounterInfo->entry);
             free(pCounter->pSysCounterInfo->name);
@@ -1371,6 +1530,7 @@ ProcSyncSetPriority(ClientPtr client)
 
     if (priorityclient->priority != stuff->priority) {
         priorityclient->priority = stuff->priority;
+        mark_client_priority_changed(priorityclient);
 
         /*  The following will force the server back into WaitForSomething
          *  so that the change in this client's priority is immediately
@@ -2655,8 +2815,6 @@ IdleTimeBlockHandler(void *pCounter, void *wt)
     int64_t *less = priv->value_less;
     int64_t *greater = priv->value_greater;
     int64_t idle, old_idle;
-    SyncTriggerList *list = counter->sync.pTriglist;
-    SyncTrigger *trig;
 
     if (!less && !greater)
         return;
@@ -2683,13 +2841,8 @@ IdleTimeBlockHandler(void *pCounter, void *wt)
          * immediately so we can reschedule.
          */
 
-        for (list = counter->sync.pTriglist; list; list = list->next) {
-            trig = list->pTrigger;
-            if (trig->CheckTrigger(trig, old_idle)) {
-                AdjustWaitForDelay(wt, 0);
-                break;
-            }
-        }
+        if (SyncCounterTriggered(counter, old_idle))
+            AdjustWaitForDelay(wt, 0);
         /*
          * We've been called exactly on the idle time, but we have a
          * NegativeTransition trigger which requires a transition from an
@@ -2710,15 +2863,8 @@ IdleTimeBlockHandler(void *pCounter, void *wt)
         if (idle < *greater) {
             AdjustWaitForDelay(wt, *greater - idle);
         }
-        else {
-            for (list = counter->sync.pTriglist; list;
-                 list = list->next) {
-                trig = list->pTrigger;
-                if (trig->CheckTrigger(trig, old_idle)) {
-                    AdjustWaitForDelay(wt, 0);
-                    break;
-                }
-            }
+        else if (SyncCounterTriggered(counter, old_idle)) {
+            AdjustWaitForDelay(wt, 0);
         }
     }
 
@@ -55,6 +55,7 @@ SOFTWARE.
 #include <X11/extensions/XI.h>
 #include <X11/extensions/XIproto.h>
 
+#include "dix/dix_priv.h"
 #include "dix/resource_priv.h"
 
 #include "inputstr.h"           /* DeviceIntPtr      */
@@ -83,6 +84,7 @@ DeleteDeviceEvents(DeviceIntPtr dev, WindowPtr pWin, ClientPtr client)
         for (others = pOthers->inputClients; others; others = others->next)
             if (SameClient(others, client))
                 others->mask[dev->id] = NoEventMask;
+    DeliveryCacheInvalidate(pWin);
 
     for (grab = wPassiveGrabs(pWin); grab; grab = next) {
         next = grab->next;
@@ -2806,6 +2806,7 @@ RecalculateDeviceDeliverableEvents(WindowPtr pWin)
 
     pChild = pWin;
     while (1) {
+        DeliveryCacheInvalidate(pChild);
         if ((inputMasks = wOtherInputMasks(pChild)) != 0) {
             xi2mask_zero(inputMasks->xi2mask, -1);
             for (others = inputMasks->inputClients; others;
@@ -72,6 +72,8 @@ typedef struct PointerBarrierClient *PointerBarrierClientPtr;
 
 struct PointerBarrierDevice {
     struct xorg_list entry;
+    struct xorg_list hit_entry; /* in the screen's hits, while hit */
+    struct PointerBarrierClient *barrier;
     int deviceid;
     Time last_timestamp;
     int barrier_event_id;
@@ -86,6 +88,7 @@ struct PointerBarrierClient {
     Window window;
     struct PointerBarrier barrier;
     struct xorg_list entry;
+    uint64_t serial; /* higher is nearer the head of entry's list */
     /* num_devices/device_ids are devices the barrier applies to */
     int num_devices;
     int *device_ids; /* num_devices */
@@ -94,8 +97,19 @@ struct PointerBarrierClient {
     struct xorg_list per_device;
 };
 
+/* barriers of one orientation, sorted by the coordinate they're at */
+typedef struct _BarrierIndex {
+    struct PointerBarrierClient **barriers;
+    int num, size;
+} BarrierIndexRec, *BarrierIndexPtr;
+
 typedef struct _BarrierScreen {
     struct xorg_list barriers;
+    BarrierIndexRec vertical;   /* by x */
+    BarrierIndexRec horizontal; /* by y */
+    /* the devices of hit barriers, in the order of barriers */
+    struct xorg_list hits;
+    uint64_t serial;
 } BarrierScreenRec, *BarrierScreenPtr;
 
 #define GetBarrierScreen(s) ((BarrierScreenPtr)dixLookupPrivate(&(s)->devPrivates, BarrierScreenPrivateKey))
@@ -114,6 +128,7 @@ static struct PointerBarrierDevice *AllocBarrierDevice(void)
     pbd->hit = FALSE;
     pbd->seen = FALSE;
     xorg_list_init(&pbd->entry);
+    xorg_list_init(&pbd->hit_entry);
 
     return pbd;
 }
@@ -156,6 +171,98 @@ barrier_is_vertical(const struct PointerBarrier *barrier)
     return barrier->x1 == barrier->x2;
 }
 
+/*
+ * Barriers are either vertical or horizontal, so each is in one of two
+ * indexes, sorted by its x or y. Only the ones between the start and the
+ * end of a movement can block it.
+ */
+static BarrierIndexPtr
+barrier_index(BarrierScreenPtr cs, const struct PointerBarrierClient *c)
+{
+    return barrier_is_vertical(&c->barrier) ? &cs->vertical : &cs->horizontal;
+}
+
+static int
+barrier_index_key(const struct PointerBarrierClient *c)
+{
+    return barrier_is_vertical(&c->barrier) ? c->barrier.x1 : c->barrier.y1;
+}
+
+/* where the first barrier at v or beyond is, or would be */
+static int
+barrier_index_find(const BarrierIndexRec *index, int v)
+{
+    int lo = 0, hi = index->num;
+
+    while (lo < hi) {
+        int mid = (lo + hi) / 2;
+
+        if (barrier_index_key(index->barriers[mid]) < v)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return lo;
+}
+
+/* called with the input lock held */
+static Bool
+barrier_index_add(BarrierIndexPtr index, struct PointerBarrierClient *c)
+{
+    int i;
+
+    if (index->num == index->size) {
+        int size = index->size ? index->size * 2 : 16;
+        struct PointerBarrierClient **barriers =
+            reallocarray(index->barriers, size, sizeof(*barriers));
+
+        if (!barriers)
+            return FALSE;
+        index->barriers = barriers;
+        index->size = size;
+    }
+
+    i = barrier_index_find(index, barrier_index_key(c));
+    memmove(&index->barriers[i + 1], &index->barriers[i],
+            (index->num - i) * sizeof(*index->barriers));
+    index->barriers[i] = c;
+    index->num++;
+    return TRUE;
+}
+
+/* called with the input lock held */
+static void
+barrier_index_remove(BarrierIndexPtr index, struct PointerBarrierClient *c)
+{
+    for (int i = barrier_index_find(index, barrier_index_key(c));
+         i < index->num; i++) {
+        if (index->barriers[i] == c) {
+            index->num--;
+            memmove(&index->barriers[i], &index->barriers[i + 1],
+                    (index->num - i) * sizeof(*index->barriers));
+            return;
+        }
+    }
+}
+
+/*
+ * Called with the input lock held, for a device whose barrier isn't hit
+ * yet. The hits are kept in the order of the screen's barriers, newest
+ * first, so leave events go out in the same order as they always did.
+ */
+static void
+barrier_add_hit(BarrierScreenPtr cs, struct PointerBarrierDevice *pbd)
+{
+    struct PointerBarrierDevice *p;
+
+    xorg_list_for_each_entry(p, &cs->hits, hit_entry) {
+        if (p->barrier->serial < pbd->barrier->serial)
+            break;
+    }
+    /* before p, or at the end if there's none */
+    xorg_list_append(&pbd->hit_entry, &p->hit_entry);
+}
+
 /**
  * @return The set of barrier movement directions the movement vector
  * x1/y1 → x2/y2 represents.
@@ -334,12 +441,29 @@ barrier_find_nearest(BarrierScreenPtr cs, DeviceIntPtr dev,
 {
     struct PointerBarrierClient *c, *nearest = NULL;
     double min_distance = INT_MAX;      /* can't get higher than that in X anyway */
+    BarrierIndexPtr index = &cs->vertical;
+    int v1 = min(x1, x2), v2 = max(x1, x2);
+    int i = barrier_index_find(index, v1);
 
-    xorg_list_for_each_entry(c, &cs->barriers, entry) {
-        struct PointerBarrier *b = &c->barrier;
+    for (;;) {
+        struct PointerBarrier *b;
         struct PointerBarrierDevice *pbd;
         double distance;
 
+        /* the vertical ones from x1 to x2, then the horizontal ones
+         * from y1 to y2 */
+        if (i == index->num || barrier_index_key(index->barriers[i]) > v2) {
+            if (index == &cs->horizontal)
+                break;
+            index = &cs->horizontal;
+            v1 = min(y1, y2);
+            v2 = max(y1, y2);
+            i = barrier_index_find(index, v1);
+            continue;
+        }
+        c = index->barriers[i++];
+        b = &c->barrier;
+
         pbd = GetBarrierDevice(c, dev->id);
         if (!pbd)
             continue;
@@ -354,7 +478,10 @@ barrier_find_nearest(BarrierScreenPtr cs, DeviceIntPtr dev,
             continue;
 
         if (barrier_is_blocking(b, x1, y1, x2, y2, &distance)) {
-            if (min_distance > distance) {
+            /* on a tie, the one a walk of all barriers would find first */
+            if (min_distance > distance ||
+                (nearest && min_distance == distance &&
+                 c->serial > nearest->serial)) {
                 min_distance = distance;
                 nearest = c;
             }
@@ -418,6 +545,7 @@ input_constrain_cursor(DeviceIntPtr dev, ScreenPtr screen,
     };
     InternalEvent *barrier_events = events;
     DeviceIntPtr master;
+    struct PointerBarrierDevice *pbd, *tmp;
 
     if (nevents)
         *nevents = 0;
@@ -443,7 +571,6 @@ input_constrain_cursor(DeviceIntPtr dev, ScreenPtr screen,
 
     while (dir != 0) {
         int new_sequence;
-        struct PointerBarrierDevice *pbd;
 
         c = barrier_find_nearest(cs, master, dir, current_x, current_y, x, y);
         if (!c)
@@ -456,6 +583,8 @@ input_constrain_cursor(DeviceIntPtr dev, ScreenPtr screen,
             continue;
 
         new_sequence = !pbd->hit;
+        if (new_sequence)
+            barrier_add_hit(cs, pbd);
 
         pbd->seen = TRUE;
         pbd->hit = TRUE;
@@ -490,22 +619,21 @@ input_constrain_cursor(DeviceIntPtr dev, ScreenPtr screen,
         *nevents += 1;
     }
 
-    xorg_list_for_each_entry(c, &cs->barriers, entry) {
-        struct PointerBarrierDevice *pbd;
+    /* only barriers that were hit can be left, and only those were seen */
+    xorg_list_for_each_entry_safe(pbd, tmp, &cs->hits, hit_entry) {
         int flags = 0;
 
-        pbd = GetBarrierDevice(c, master->id);
-        if (!pbd)
+        if (pbd->deviceid != master->id)
             continue;
 
+        c = pbd->barrier;
         pbd->seen = FALSE;
-        if (!pbd->hit)
-            continue;
 
         if (barrier_inside_hit_box(&c->barrier, x, y))
             continue;
 
         pbd->hit = FALSE;
+        xorg_list_del(&pbd->hit_entry);
 
         ev.type = ET_BarrierLeave;
 
@@ -621,6 +749,7 @@ CreatePointerBarrierClient(ClientPtr client,
             goto error;
         }
         pbd->deviceid = dev->id;
+        pbd->barrier = ret;
 
         input_lock();
         xorg_list_add(&pbd->entry, &ret->per_device);
@@ -640,6 +769,12 @@ CreatePointerBarrierClient(ClientPtr client,
     if (barrier_is_vertical(&ret->barrier))
         ret->barrier.directions &= ~(BarrierPositiveY | BarrierNegativeY);
     input_lock();
+    if (!barrier_index_add(barrier_index(cs, ret), ret)) {
+        input_unlock();
+        err = BadAlloc;
+        goto error;
+    }
+    ret->serial = cs->serial++;
     xorg_list_add(&ret->entry, &cs->barriers);
     input_unlock();
 
@@ -659,12 +794,12 @@ BarrierFreeBarrier(void *data, XID id)
     Time ms = GetTimeInMillis();
     DeviceIntPtr dev = NULL;
     ScreenPtr screen;
+    struct PointerBarrierDevice *pbd;
 
     c = container_of(data, struct PointerBarrierClient, barrier);
     screen = c->screen;
 
     for (dev = inputInfo.devices; dev; dev = dev->next) {
-        struct PointerBarrierDevice *pbd;
         int root_x, root_y;
         BarrierEvent ev = {
             .header = ET_Internal,
@@ -708,6 +843,9 @@ BarrierFreeBarrier(void *data, XID id)
     }
 
     input_lock();
+    barrier_index_remove(barrier_index(GetBarrierScreen(screen), c), c);
+    xorg_list_for_each_entry(pbd, &c->per_device, entry)
+        xorg_list_del(&pbd->hit_entry);
     xorg_list_del(&c->entry);
     input_unlock();
 
@@ -728,6 +866,7 @@ static void add_master_func(void *res, XID id, void *devid)
     if (!pbd)
         return;
     pbd->deviceid = *deviceid;
+    pbd->barrier = barrier;
 
     input_lock();
     xorg_list_add(&pbd->entry, &barrier->per_device);
@@ -777,6 +916,7 @@ static void remove_master_func(void *res, XID id, void *devid)
     }
 
     input_lock();
+    xorg_list_del(&pbd->hit_entry);
     xorg_list_del(&pbd->entry);
     input_unlock();
     free(pbd);
@@ -945,6 +1085,7 @@ XIBarrierInit(void)
         if (!cs)
             return FALSE;
         xorg_list_init(&cs->barriers);
+        xorg_list_init(&cs->hits);
         SetBarrierScreen(pScreen, cs);
     }
 
@@ -961,6 +1102,10 @@ XIBarrierReset(void)
     for (i = 0; i < screenInfo.numScreens; i++) {
         ScreenPtr pScreen = screenInfo.screens[i];
         BarrierScreenPtr cs = GetBarrierScreen(pScreen);
+        if (cs) {
+            free(cs->vertical.barriers);
+            free(cs->horizontal.barriers);
+        }
         free(cs);
         SetBarrierScreen(pScreen, NULL);
     }
@@ -270,6 +270,7 @@ compFreeClientWindow(WindowPtr pWin, XID id)
     Bool anyMarked = FALSE;
     WindowPtr pLayerWin;
     PixmapPtr pPixmap = NULL;
+    CompPixmapSizeRec size = { 0 };
 
     if (!cw)
         return;
@@ -287,6 +288,7 @@ compFreeClientWindow(WindowPtr pWin, XID id)
 
         if (pWin->redirectDraw != RedirectDrawNone) {
             pPixmap = (*pScreen->GetWindowPixmap) (pWin);
+            size = cw->pixmapSize;
             compSetParentPixmap(pWin);
         }
 
@@ -313,7 +315,7 @@ compFreeClientWindow(WindowPtr pWin, XID id)
 
     if (pPixmap) {
         compRestoreWindow(pWin, pPixmap);
-        dixDestroyPixmap(pPixmap, 0);
+        compReleasePixmap(pScreen, pPixmap, &size);
     }
 }
 
@@ -529,21 +531,200 @@ compUnredirectOneSubwindow(WindowPtr pParent, WindowPtr pWin)
     return Success;
 }
 
+/*
+ * With plain memory pixmaps, backing pixmaps get some slack, rounded up
+ * to 64 pixels, so that a window being resized a little can keep its
+ * pixmap, and the pixmaps of unmapped and resized windows are pooled for
+ * new windows of about the same size.
+ */
+static int
+compPixmapBucket(int size)
+{
+    return min((size + size / 8 + 63) & ~63, 32767);
+}
+
+/* two screenfuls at 32bpp */
+static size_t
+compPixmapPoolLimit(ScreenPtr pScreen)
+{
+    return (size_t) pScreen->width * pScreen->height * 4 * 2;
+}
+
 static PixmapPtr
-compNewPixmap(WindowPtr pWin, int x, int y, int w, int h)
+compTakePooledPixmap(CompScreenPtr cs, int i, CompPixmapSizePtr size)
 {
-    ScreenPtr pScreen = pWin->drawable.pScreen;
-    WindowPtr pParent = pWin->parent;
+    CompPooledPixmapPtr pooled = &cs->pooledPixmaps[i];
+    PixmapPtr pPixmap = pooled->pPixmap;
+
+    size->width = pooled->width;
+    size->height = pooled->height;
+    cs->pooledPixmapBytes -= (size_t) pPixmap->devKind * pooled->height;
+    *pooled = cs->pooledPixmaps[--cs->numPooledPixmaps];
+    return pPixmap;
+}
+
+static void
+compDropPooledPixmap(CompScreenPtr cs, int i)
+{
+    CompPixmapSizeRec size;
+
+    dixDestroyPixmap(compTakePooledPixmap(cs, i, &size), 0);
+}
+
+void
+compFlushPixmapPool(ScreenPtr pScreen)
+{
+    CompScreenPtr cs = GetCompScreen(pScreen);
+
+    while (cs->numPooledPixmaps)
+        compDropPooledPixmap(cs, cs->numPooledPixmaps - 1);
+    TimerCancel(cs->pixmapPoolTimer);
+}
+
+/* drop pooled pixmaps which have not been reused for a while */
+static CARD32
+compPixmapPoolTimeout(OsTimerPtr timer, CARD32 now, void *arg)
+{
+    CompScreenPtr cs = GetCompScreen((ScreenPtr) arg);
+    CARD32 next = 0;
+    int i = 0;
+
+    while (i < cs->numPooledPixmaps) {
+        CARD32 idle = now - cs->pooledPixmaps[i].time;
+
+        if (idle >= COMP_PIXMAP_POOL_TIMEOUT) {
+            compDropPooledPixmap(cs, i);
+            continue;
+        }
+        if (!next || COMP_PIXMAP_POOL_TIMEOUT - idle < next)
+            next = COMP_PIXMAP_POOL_TIMEOUT - idle;
+        i++;
+    }
+    return next;
+}
+
+/*
+ * Done with a backing pixmap: pool it, unless somebody else holds on to
+ * it or it is not one of ours (size is NULL or out of date). Least
+ * recently pooled pixmaps make room.
+ */
+void
+compReleasePixmap(ScreenPtr pScreen, PixmapPtr pPixmap, CompPixmapSizePtr size)
+{
+    CompScreenPtr cs = GetCompScreen(pScreen);
+    size_t limit = compPixmapPoolLimit(pScreen);
+    CompPooledPixmapPtr pooled;
+    size_t bytes;
+
+    if (!cs->poolPixmaps || !size || pPixmap->refcnt != 1 ||
+        pPixmap->drawable.serialNumber != size->serialNumber ||
+        (bytes = (size_t) pPixmap->devKind * size->height) > limit) {
+        dixDestroyPixmap(pPixmap, 0);
+        return;
+    }
+
+    while (cs->numPooledPixmaps == COMP_PIXMAP_POOL_SIZE ||
+           cs->pooledPixmapBytes + bytes > limit) {
+        int oldest = 0;
+
+        for (int i = 1; i < cs->numPooledPixmaps; i++)
+            if ((int) (cs->pooledPixmaps[i].time -
+                       cs->pooledPixmaps[oldest].time) < 0)
+                oldest = i;
+        compDropPooledPixmap(cs, oldest);
+    }
+
+    pooled = &cs->pooledPixmaps[cs->numPooledPixmaps++];
+    pooled->pPixmap = pPixmap;
+    pooled->width = size->width;
+    pooled->height = size->height;
+    pooled->time = GetTimeInMillis();
+    cs->pooledPixmapBytes += bytes;
+
+    if (cs->numPooledPixmaps == 1)
+        cs->pixmapPoolTimer = TimerSet(cs->pixmapPoolTimer, 0,
+                                       COMP_PIXMAP_POOL_TIMEOUT,
+                                       compPixmapPoolTimeout, pScreen);
+}
+
+/*
+ * Smallest pooled pixmap the size of the window fits in, wasting no more
+ * than twice the slack a new one would have.
+ */
+static PixmapPtr
+compGetPooledPixmap(ScreenPtr pScreen, int w, int h, int depth,
+                    CompPixmapSizePtr size)
+{
+    CompScreenPtr cs = GetCompScreen(pScreen);
+    long best_area = 2L * compPixmapBucket(w) * compPixmapBucket(h);
+    int best = -1;
+
+    for (int i = 0; i < cs->numPooledPixmaps; i++) {
+        CompPooledPixmapPtr pooled = &cs->pooledPixmaps[i];
+        long area = (long) pooled->width * pooled->height;
+
+        if (pooled->pPixmap->drawable.depth == depth &&
+            pooled->width >= w && pooled->height >= h && area <= best_area) {
+            best = i;
+            best_area = area;
+        }
+    }
+
+    if (best < 0)
+        return NullPixmap;
+    return compTakePooledPixmap(cs, best, size);
+}
+
+static PixmapPtr
+compCreatePixmap(ScreenPtr pScreen, int w, int h, int depth,
+                 CompPixmapSizePtr size)
+{
+    CompScreenPtr cs = GetCompScreen(pScreen);
     PixmapPtr pPixmap;
 
-    pPixmap = (*pScreen->CreatePixmap) (pScreen, w, h, pWin->drawable.depth,
+    size->width = cs->poolPixmaps ? compPixmapBucket(w) : w;
+    size->height = cs->poolPixmaps ? compPixmapBucket(h) : h;
+    if (size->width < w || size->height < h) {
+        /* beyond what a pixmap can be: ask for the exact size, which
+         * fails just as it would without pooling */
+        size->width = w;
+        size->height = h;
+    }
+    pPixmap = (*pScreen->CreatePixmap) (pScreen, size->width, size->height,
+                                        depth,
                                         CREATE_PIXMAP_USAGE_BACKING_PIXMAP);
+    if (!pPixmap && (cs->numPooledPixmaps || cs->poolPixmaps)) {
+        /* short on memory: give back the pool and do without slack */
+        compFlushPixmapPool(pScreen);
+        size->width = w;
+        size->height = h;
+        pPixmap = (*pScreen->CreatePixmap) (pScreen, w, h, depth,
+                                            CREATE_PIXMAP_USAGE_BACKING_PIXMAP);
+    }
+    if (pPixmap && cs->poolPixmaps && !pPixmap->devPrivate.ptr) {
+        /* not in memory (e.g. glamor), its size can't be changed */
+        cs->poolPixmaps = FALSE;
+        dixDestroyPixmap(pPixmap, 0);
+        return compCreatePixmap(pScreen, w, h, depth, size);
+    }
+    return pPixmap;
+}
 
-    if (!pPixmap)
-        return 0;
+/*
+ * Fill the w x h area at x, y in the pixmap of pWin with what is on
+ * the screen in its parent
+ */
+static void
+compCopyFromParent(WindowPtr pWin, PixmapPtr pPixmap, int x, int y, int w,
+                   int h)
+{
+    ScreenPtr pScreen = pWin->drawable.pScreen;
+    WindowPtr pParent = pWin->parent;
+    int src_x = pPixmap->screen_x + x - pParent->drawable.x;
+    int src_y = pPixmap->screen_y + y - pParent->drawable.y;
 
-    pPixmap->screen_x = x;
-    pPixmap->screen_y = y;
+    if (w <= 0 || h <= 0)
+        return;
 
     if (pParent->drawable.depth == pWin->drawable.depth) {
         GCPtr pGC = GetScratchGC(pWin->drawable.depth, pScreen);
@@ -556,10 +737,7 @@ compNewPixmap(WindowPtr pWin, int x, int y, int w, int h)
             ValidateGC(&pPixmap->drawable, pGC);
             (void) (*pGC->ops->CopyArea) (&pParent->drawable,
                                           &pPixmap->drawable,
-                                          pGC,
-                                          x - pParent->drawable.x,
-                                          y - pParent->drawable.y,
-                                          w, h, 0, 0);
+                                          pGC, src_x, src_y, w, h, x, y);
             FreeScratchGC(pGC);
         }
     }
@@ -587,14 +765,39 @@ compNewPixmap(WindowPtr pWin, int x, int y, int w, int h)
                              pSrcPicture,
                              NULL,
                              pDstPicture,
-                             x - pParent->drawable.x,
-                             y - pParent->drawable.y, 0, 0, 0, 0, w, h);
+                             src_x, src_y, 0, 0, x, y, w, h);
         }
         if (pSrcPicture)
             FreePicture(pSrcPicture, 0);
         if (pDstPicture)
             FreePicture(pDstPicture, 0);
     }
+}
+
+static PixmapPtr
+compNewPixmap(WindowPtr pWin, int x, int y, int w, int h,
+              CompPixmapSizePtr size)
+{
+    ScreenPtr pScreen = pWin->drawable.pScreen;
+    PixmapPtr pPixmap = NullPixmap;
+
+    if (GetCompScreen(pScreen)->poolPixmaps)
+        pPixmap = compGetPooledPixmap(pScreen, w, h, pWin->drawable.depth,
+                                      size);
+    if (!pPixmap)
+        pPixmap = compCreatePixmap(pScreen, w, h, pWin->drawable.depth, size);
+
+    if (!pPixmap)
+        return 0;
+
+    if (pPixmap->drawable.width != w || pPixmap->drawable.height != h)
+        (*pScreen->ModifyPixmapHeader) (pPixmap, w, h, 0, 0, 0, NULL);
+    size->serialNumber = pPixmap->drawable.serialNumber;
+
+    pPixmap->screen_x = x;
+    pPixmap->screen_y = y;
+
+    compCopyFromParent(pWin, pPixmap, 0, 0, w, h);
     return pPixmap;
 }
 
@@ -606,8 +809,8 @@ compAllocPixmap(WindowPtr pWin)
     int y = pWin->drawable.y - bw;
     int w = pWin->drawable.width + (bw << 1);
     int h = pWin->drawable.height + (bw << 1);
-    PixmapPtr pPixmap = compNewPixmap(pWin, x, y, w, h);
     CompWindowPtr cw = GetCompWindow(pWin);
+    PixmapPtr pPixmap = compNewPixmap(pWin, x, y, w, h, &cw->pixmapSize);
     Bool status;
 
     if (!pPixmap) {
@@ -664,9 +867,41 @@ compSetParentPixmap(WindowPtr pWin)
 }
 
 /*
- * Make sure the pixmap is the right size and offset.  Allocate a new
- * pixmap to change size, adjust origin to change offset, leaving the
- * old pixmap in cw->pOldPixmap so bits can be recovered
+ * Grow the window pixmap into its slack when it stays at the same place
+ * on the screen. Shrinking waits for compFinishReallocPixmap(), bit
+ * gravity may still copy from all of the old window until then.
+ */
+static Bool
+compGrowPixmap(WindowPtr pWin, PixmapPtr pPixmap, int x, int y, int w, int h)
+{
+    ScreenPtr pScreen = pWin->drawable.pScreen;
+    CompWindowPtr cw = GetCompWindow(pWin);
+    int old_w = pPixmap->drawable.width;
+    int old_h = pPixmap->drawable.height;
+
+    if (!GetCompScreen(pScreen)->poolPixmaps || pPixmap->refcnt != 1 ||
+        pPixmap->drawable.serialNumber != cw->pixmapSize.serialNumber ||
+        x != pPixmap->screen_x || y != pPixmap->screen_y ||
+        w > cw->pixmapSize.width || h > cw->pixmapSize.height)
+        return FALSE;
+
+    w = max(w, old_w);
+    h = max(h, old_h);
+    if (w == old_w && h == old_h)
+        return TRUE;
+
+    (*pScreen->ModifyPixmapHeader) (pPixmap, w, h, 0, 0, 0, NULL);
+    cw->pixmapSize.serialNumber = pPixmap->drawable.serialNumber;
+    compCopyFromParent(pWin, pPixmap, old_w, 0, w - old_w, h);
+    compCopyFromParent(pWin, pPixmap, 0, old_h, old_w, h - old_h);
+    return TRUE;
+}
+
+/*
+ * Make sure the pixmap is the right size and offset.  Grow the pixmap
+ * in place or allocate a new pixmap to change size, adjust origin to
+ * change offset, leaving the old pixmap in cw->pOldPixmap so bits can be
+ * recovered
  */
 Bool
 compReallocPixmap(WindowPtr pWin, int draw_x, int draw_y,
@@ -687,11 +922,16 @@ compReallocPixmap(WindowPtr pWin, int draw_x, int draw_y,
     pix_y = draw_y - bw;
     pix_w = w + (bw << 1);
     pix_h = h + (bw << 1);
-    if (pix_w != pOld->drawable.width || pix_h != pOld->drawable.height) {
-        pNew = compNewPixmap(pWin, pix_x, pix_y, pix_w, pix_h);
+    if ((pix_w != pOld->drawable.width || pix_h != pOld->drawable.height) &&
+        !compGrowPixmap(pWin, pOld, pix_x, pix_y, pix_w, pix_h)) {
+        CompPixmapSizeRec size;
+
+        pNew = compNewPixmap(pWin, pix_x, pix_y, pix_w, pix_h, &size);
         if (!pNew)
             return FALSE;
         cw->pOldPixmap = pOld;
+        cw->oldPixmapSize = cw->pixmapSize;
+        cw->pixmapSize = size;
         compSetPixmap(pWin, pNew, bw);
     }
     else {
@@ -702,3 +942,26 @@ compReallocPixmap(WindowPtr pWin, int draw_x, int draw_y,
     pNew->screen_y = pix_y;
     return TRUE;
 }
+
+/*
+ * Once the window is configured, trim a pixmap grown in place to the
+ * window size
+ */
+void
+compFinishReallocPixmap(WindowPtr pWin)
+{
+    ScreenPtr pScreen = pWin->drawable.pScreen;
+    PixmapPtr pPixmap = (*pScreen->GetWindowPixmap) (pWin);
+    CompWindowPtr cw = GetCompWindow(pWin);
+    int bw = (int) pWin->borderWidth;
+    int w = pWin->drawable.width + (bw << 1);
+    int h = pWin->drawable.height + (bw << 1);
+
+    if (pPixmap->drawable.serialNumber != cw->pixmapSize.serialNumber ||
+        (pPixmap->drawable.width == w && pPixmap->drawable.height == h) ||
+        w > cw->pixmapSize.width || h > cw->pixmapSize.height)
+        return;
+
+    (*pScreen->ModifyPixmapHeader) (pPixmap, w, h, 0, 0, 0, NULL);
+    cw->pixmapSize.serialNumber = pPixmap->drawable.serialNumber;
+}
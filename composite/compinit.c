@@ -61,6 +61,8 @@ static void compCloseScreen(CallbackListPtr *pcbl, ScreenPtr pScreen, void *unus
 {
     CompScreenPtr cs = GetCompScreen(pScreen);
 
+    compFlushPixmapPool(pScreen);
+    TimerFree(cs->pixmapPoolTimer);
     free(cs->alternateVisuals);
     free(cs->implicitRedirectExceptions);
 
@@ -334,6 +336,9 @@ compScreenInit(ScreenPtr pScreen)
     cs->numImplicitRedirectExceptions = 0;
     cs->implicitRedirectExceptions = NULL;
 
+    /* pixmaps the DDX can resize get slack and are pooled */
+    cs->poolPixmaps = pScreen->ModifyPixmapHeader == miModifyPixmapHeader;
+
     if (!compAddAlternateVisuals(pScreen, cs)) {
         free(cs);
         return FALSE;
@@ -86,6 +86,16 @@ typedef struct _CompClientWindow {
     int update;
 } CompClientWindowRec, *CompClientWindowPtr;
 
+/*
+ * Allocated size of a backing pixmap, which can be larger than the
+ * window. Only valid while the pixmap keeps this serial number.
+ */
+typedef struct _CompPixmapSize {
+    unsigned long serialNumber;
+    int width;
+    int height;
+} CompPixmapSizeRec, *CompPixmapSizePtr;
+
 typedef struct _CompWindow {
     RegionRec borderClip;
     DamagePtr damage;           /* for automatic update mode */
@@ -97,6 +107,8 @@ typedef struct _CompWindow {
     int oldy;
     PixmapPtr pOldPixmap;
     int borderClipX, borderClipY;
+    CompPixmapSizeRec pixmapSize;
+    CompPixmapSizeRec oldPixmapSize;
 } CompWindowRec, *CompWindowPtr;
 
 #define COMP_ORIGIN_INVALID	    0x80000000
@@ -119,6 +131,19 @@ typedef struct _CompOverlayClientRec {
     XID resource;
 } CompOverlayClientRec;
 
+/*
+ * Backing pixmaps of unmapped and resized windows, kept for reuse
+ */
+#define COMP_PIXMAP_POOL_SIZE       8
+#define COMP_PIXMAP_POOL_TIMEOUT    5000        /* ms */
+
+typedef struct _CompPooledPixmap {
+    PixmapPtr pPixmap;
+    int width;
+    int height;
+    CARD32 time;
+} CompPooledPixmapRec, *CompPooledPixmapPtr;
+
 typedef struct _CompImplicitRedirectException {
     XID parentVisual;
     XID winVisual;
@@ -166,6 +191,12 @@ typedef struct _CompScreen {
     CompOverlayClientPtr pOverlayClients;
 
     SourceValidateProcPtr SourceValidate;
+
+    Bool poolPixmaps;           /* plain memory pixmaps, which can be resized */
+    int numPooledPixmaps;
+    CompPooledPixmapRec pooledPixmaps[COMP_PIXMAP_POOL_SIZE];
+    size_t pooledPixmapBytes;
+    OsTimerPtr pixmapPoolTimer;
 } CompScreenRec, *CompScreenPtr;
 
 extern DevPrivateKeyRec CompScreenPrivateKeyRec;
@@ -232,6 +263,16 @@ Bool
 compReallocPixmap(WindowPtr pWin, int x, int y,
                   unsigned int w, unsigned int h, int bw);
 
+void
+ compFinishReallocPixmap(WindowPtr pWin);
+
+void
+ compReleasePixmap(ScreenPtr pScreen, PixmapPtr pPixmap,
+                   CompPixmapSizePtr size);
+
+void
+ compFlushPixmapPool(ScreenPtr pScreen);
+
 void compMarkAncestors(WindowPtr pWin);
 
 /*
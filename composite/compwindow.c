@@ -178,7 +178,7 @@ compCheckRedirect(WindowPtr pWin)
 
             compSetParentPixmap(pWin);
             compRestoreWindow(pWin, pPixmap);
-            dixDestroyPixmap(pPixmap, 0);
+            compReleasePixmap(pScreen, pPixmap, cw ? &cw->pixmapSize : NULL);
         }
     }
     else if (should) {
@@ -369,9 +369,11 @@ compFreeOldPixmap(WindowPtr pWin)
         CompWindowPtr cw = GetCompWindow(pWin);
 
         if (cw->pOldPixmap) {
-            dixDestroyPixmap(cw->pOldPixmap, 0);
+            compReleasePixmap(pWin->drawable.pScreen, cw->pOldPixmap,
+                              &cw->oldPixmapSize);
             cw->pOldPixmap = NullPixmap;
         }
+        compFinishReallocPixmap(pWin);
     }
 }
 
@@ -67,6 +67,7 @@ DamageNoteCritical(ClientPtr pClient)
     if (pDamageClient->critical > 0) {
         SetCriticalOutputPending();
         pClient->smart_priority = SMART_MAX_PRIORITY;
+        mark_client_priority_changed(pClient);
     }
 }
 
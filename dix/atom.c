@@ -46,6 +46,7 @@ SOFTWARE.
 
 #include <dix-config.h>
 
+#include <stdint.h>
 #include <stdio.h>
 #include <string.h>
 #include <X11/X.h>
@@ -53,136 +54,242 @@ SOFTWARE.
 
 #include "dix/atom_priv.h"
 #include "dix/dix_priv.h"
+#include "os/osdep.h"
 
 #include "misc.h"
 #include "resource.h"
 #include "dix.h"
 
-#define InitialTableSize 256
+/*
+ * Atom names are kept in two tables:
+ *
+ * - atomNames maps atom -> name. It is split into chunks doubling in size
+ *   (the first one holding AtomChunkSize atoms), which never move once
+ *   allocated. A new atom's name is stored before lastAtom is published,
+ *   so NameForAtom() never needs a lock, even while MakeAtom() appends.
+ *
+ * - atomSlots maps name -> atom, open addressed and linearly probed. The
+ *   slots carry the full hash and the name length, so probing rarely needs
+ *   to look at names.
+ *
+ * The names themselves (except the predefined ones, which are static
+ * strings) live in arena blocks which are only freed all at once.
+ */
 
-typedef struct _Node {
-    struct _Node *left, *right;
-    Atom a;
-    unsigned int fingerPrint;
-    const char *string;
-} NodeRec, *NodePtr;
+#define AtomChunkShift  8
+#define AtomChunkSize   (1 << AtomChunkShift)
+#define AtomChunks      (32 - AtomChunkShift + 1)
+
+#define InitialSlots    1024
+#define ArenaBlockSize  16384
+
+typedef struct _AtomSlot {
+    uint32_t hash;
+    unsigned len;
+    Atom a;                     /* None if slot is empty */
+} AtomSlotRec, *AtomSlotPtr;
+
+typedef struct _AtomArena {
+    struct _AtomArena *next;
+    size_t used, size;
+    char data[];
+} AtomArenaRec, *AtomArenaPtr;
 
 static Atom lastAtom = None;
-static NodePtr atomRoot = NULL;
-static unsigned long tableLength;
-static NodePtr *nodeTable;
+static const char **atomNames[AtomChunks];
 
-Atom
-MakeAtom(const char *string, unsigned len, Bool makeit)
+static AtomSlotPtr atomSlots;
+static unsigned int atomMask;
+
+static AtomArenaPtr atomArena;
+
+/* FNV-1a */
+static inline uint32_t
+HashAtomName(const char *string, unsigned len)
 {
-    NodePtr *np;
-    int comp;
-    unsigned int fp = 0;
-
-    np = &atomRoot;
-    for (unsigned int i = 0; i < (len + 1) / 2; i++) {
-        fp = fp * 27 + string[i];
-        fp = fp * 27 + string[len - 1 - i];
+    uint32_t hash = 2166136261U;
+
+    for (unsigned i = 0; i < len; i++) {
+        hash ^= (unsigned char) string[i];
+        hash *= 16777619U;
     }
-    while (*np != NULL) {
-        if (fp < (*np)->fingerPrint)
-            np = &((*np)->left);
-        else if (fp > (*np)->fingerPrint)
-            np = &((*np)->right);
-        else {                  /* now start testing the strings */
-            comp = strncmp(string, (*np)->string, (int) len);
-            if ((comp < 0) || ((comp == 0) && (len < strlen((*np)->string))))
-                np = &((*np)->left);
-            else if (comp > 0)
-                np = &((*np)->right);
-            else
-                return (*np)->a;
-        }
+    return hash;
+}
+
+static inline int
+AtomChunk(unsigned long n)
+{
+#if __has_builtin(__builtin_clzl)
+    return (int) (sizeof(long) * 8 - 1) - __builtin_clzl(n) - AtomChunkShift;
+#else
+    int bit = 0;
+
+    while (n >>= 1)
+        bit++;
+    return bit - AtomChunkShift;
+#endif
+}
+
+/* chunk c holds atoms [AtomChunkSize * (2^c - 1), AtomChunkSize * (2^(c+1) - 1)) */
+static inline const char **
+AtomNameSlot(Atom atom, Bool alloc)
+{
+    unsigned long n = (unsigned long) atom + AtomChunkSize;
+    int chunk = AtomChunk(n);
+
+    if (chunk >= AtomChunks)
+        return NULL;
+    if (!atomNames[chunk]) {
+        if (!alloc)
+            return NULL;
+        atomNames[chunk] = calloc((size_t) AtomChunkSize << chunk,
+                                  sizeof(const char *));
+        if (!atomNames[chunk])
+            return NULL;
     }
-    if (makeit) {
-        NodePtr nd = calloc(1, sizeof(NodeRec));
-        if (!nd)
-            return BAD_RESOURCE;
-        if (lastAtom < XA_LAST_PREDEFINED) {
-            nd->string = string;
+    return &atomNames[chunk][n - ((unsigned long) AtomChunkSize << chunk)];
+}
+
+static const char *
+ArenaStrndup(const char *string, unsigned len)
+{
+    AtomArenaPtr arena = atomArena;
+    char *copy;
+
+    if (!arena || arena->size - arena->used < (size_t) len + 1) {
+        size_t size = ArenaBlockSize;
+
+        /* long names get a block of their own, keep filling the current one */
+        if ((size_t) len + 1 > ArenaBlockSize / 4)
+            size = (size_t) len + 1;
+
+        arena = malloc(sizeof(AtomArenaRec) + size);
+        if (!arena)
+            return NULL;
+        arena->used = 0;
+        arena->size = size;
+        if (size != ArenaBlockSize && atomArena) {
+            arena->next = atomArena->next;
+            atomArena->next = arena;
         }
         else {
-            nd->string = strndup(string, len);
-            if (!nd->string) {
-                free(nd);
-                return BAD_RESOURCE;
-            }
+            arena->next = atomArena;
+            atomArena = arena;
         }
-        if ((lastAtom + 1) >= tableLength) {
-            NodePtr *table;
-
-            table = reallocarray(nodeTable, tableLength, 2 * sizeof(NodePtr));
-            if (!table) {
-                if (nd->string != string) {
-                    /* nd->string has been strdup'ed */
-                    free((char *) nd->string);
-                }
-                free(nd);
-                return BAD_RESOURCE;
-            }
-            tableLength <<= 1;
-            nodeTable = table;
-        }
-        *np = nd;
-        nd->left = nd->right = NULL;
-        nd->fingerPrint = fp;
-        nd->a = ++lastAtom;
-        nodeTable[lastAtom] = nd;
-        return nd->a;
     }
-    else
+
+    copy = arena->data + arena->used;
+    memcpy(copy, string, len);
+    copy[len] = '\0';
+    arena->used += (size_t) len + 1;
+    return copy;
+}
+
+static Bool
+GrowAtomSlots(void)
+{
+    unsigned int mask = atomMask * 2 + 1;
+    AtomSlotPtr slots = calloc((size_t) mask + 1, sizeof(AtomSlotRec));
+
+    if (!slots)
+        return FALSE;
+
+    for (unsigned int i = 0; i <= atomMask; i++) {
+        unsigned int s;
+
+        if (atomSlots[i].a == None)
+            continue;
+        for (s = atomSlots[i].hash & mask; slots[s].a != None; s = (s + 1) & mask)
+            ;
+        slots[s] = atomSlots[i];
+    }
+
+    free(atomSlots);
+    atomSlots = slots;
+    atomMask = mask;
+    return TRUE;
+}
+
+Atom
+MakeAtom(const char *string, unsigned len, Bool makeit)
+{
+    uint32_t hash = HashAtomName(string, len);
+    const char **name;
+    unsigned int s;
+
+    if (!atomSlots)
+        return makeit ? BAD_RESOURCE : None;
+
+    for (s = hash & atomMask; atomSlots[s].a != None; s = (s + 1) & atomMask) {
+        const char *other;
+
+        if (atomSlots[s].hash != hash || atomSlots[s].len != len)
+            continue;
+        other = *AtomNameSlot(atomSlots[s].a, FALSE);
+        if (memcmp(other, string, len) == 0)
+            return atomSlots[s].a;
+    }
+
+    if (!makeit)
         return None;
+
+    /* keep the table at most half full */
+    if (2 * (lastAtom + 1) > atomMask) {
+        if (!GrowAtomSlots())
+            return BAD_RESOURCE;
+        for (s = hash & atomMask; atomSlots[s].a != None; s = (s + 1) & atomMask)
+            ;
+    }
+
+    name = AtomNameSlot(lastAtom + 1, TRUE);
+    if (!name)
+        return BAD_RESOURCE;
+
+    if (lastAtom < XA_LAST_PREDEFINED)
+        *name = string;
+    else {
+        *name = ArenaStrndup(string, len);
+        if (!*name)
+            return BAD_RESOURCE;
+    }
+
+    atomSlots[s].hash = hash;
+    atomSlots[s].len = len;
+    atomSlots[s].a = lastAtom + 1;
+    StoreRelease(&lastAtom, lastAtom + 1);
+    return lastAtom;
 }
 
 Bool
 ValidAtom(Atom atom)
 {
-    return (atom != None) && (atom <= lastAtom);
+    return (atom != None) && (atom <= LoadAcquire(&lastAtom));
 }
 
 const char *
 NameForAtom(Atom atom)
 {
-    NodePtr node;
-
-    if (atom > lastAtom)
-        return 0;
-    if ((node = nodeTable[atom]) == NULL)
+    if (atom == None || atom > LoadAcquire(&lastAtom))
         return 0;
-    return node->string;
-}
-
-static void
-FreeAtom(NodePtr patom)
-{
-    if (patom->left)
-        FreeAtom(patom->left);
-    if (patom->right)
-        FreeAtom(patom->right);
-    if (patom->a > XA_LAST_PREDEFINED) {
-        /*
-         * All strings above XA_LAST_PREDEFINED are strdup'ed, so it's safe to
-         * cast here
-         */
-        free((char *) patom->string);
-    }
-    free(patom);
+    return *AtomNameSlot(atom, FALSE);
 }
 
 void
 FreeAllAtoms(void)
 {
-    if (atomRoot == NULL)
-        return;
-    FreeAtom(atomRoot);
-    atomRoot = NULL;
-    free(nodeTable);
-    nodeTable = NULL;
+    while (atomArena) {
+        AtomArenaPtr next = atomArena->next;
+
+        free(atomArena);
+        atomArena = next;
+    }
+    for (int i = 0; i < AtomChunks; i++) {
+        free(atomNames[i]);
+        atomNames[i] = NULL;
+    }
+    free(atomSlots);
+    atomSlots = NULL;
+    atomMask = 0;
     lastAtom = None;
 }
 
@@ -190,11 +297,10 @@ void
 InitAtoms(void)
 {
     FreeAllAtoms();
-    tableLength = InitialTableSize;
-    nodeTable = calloc(InitialTableSize, sizeof(NodePtr));
-    if (!nodeTable)
+    atomSlots = calloc(InitialSlots, sizeof(AtomSlotRec));
+    if (!atomSlots)
         FatalError("creating atom table");
-    nodeTable[None] = NULL;
+    atomMask = InitialSlots - 1;
     MakePredeclaredAtoms();
     if (lastAtom != XA_LAST_PREDEFINED)
         FatalError("builtin atom number mismatch");
@@ -53,6 +53,9 @@ typedef struct _OFclosure {
     char *fontname;
     int fnamelen;
     FontPtr non_cachable_font;
+    Bool name_cached;           /* fontname and current_fpe from the cache */
+    unsigned long generation;   /* of the font path, when opened */
+    CARD64 start;
 } OFclosureRec;
 
 /* ListFontsWithInfo */
@@ -92,6 +95,12 @@ typedef struct _LFclosure {
     Bool haveSaved;
     char *savedName;
     int savedNameLen;
+    char origPattern[XLFDMAXFONTNAMELEN];
+    int origPatlen;
+    int origMaxNames;
+    Bool slept;                 /* waited for an FPE, so not cachable */
+    unsigned long generation;   /* of the font path, when listed */
+    CARD64 start;
 } LFclosureRec;
 
 /* PolyText */
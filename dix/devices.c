@@ -184,6 +184,13 @@ DeviceSetProperty(DeviceIntPtr dev, Atom property, XIPropertyValuePtr prop,
         if (!checkonly)
             DeviceSetTransform(dev, f);
     }
+    else if (property == XIGetKnownProperty(XI_PROP_COALESCE_MOTION)) {
+        if (prop->format != 8 || prop->type != XA_INTEGER || prop->size != 1)
+            return BadValue;
+
+        if (!checkonly)
+            dev->coalesceMotion = *(CARD8 *) prop->data != 0;
+    }
 
     return Success;
 }
@@ -242,7 +249,7 @@ AddInputDevice(ClientPtr client, DeviceProc deviceProc, Bool autoStart)
     DeviceIntPtr dev, *prev;    /* not a typo */
     int devid;
     char devind[MAXDEVICES];
-    BOOL enabled;
+    BOOL enabled, coalesce = FALSE;
     float transform[9];
 
     /* Find next available id, 0 and 1 are reserved */
@@ -328,6 +335,12 @@ AddInputDevice(ClientPtr client, DeviceProc deviceProc, Bool autoStart)
     XISetDevicePropertyDeletable(dev, XIGetKnownProperty(XI_PROP_TRANSFORM),
                                  FALSE);
 
+    XIChangeDeviceProperty(dev, XIGetKnownProperty(XI_PROP_COALESCE_MOTION),
+                           XA_INTEGER, 8, PropModeReplace, 1, &coalesce, FALSE);
+    XISetDevicePropertyDeletable(dev,
+                                 XIGetKnownProperty(XI_PROP_COALESCE_MOTION),
+                                 FALSE);
+
     XIRegisterPropertyHandler(dev, DeviceSetProperty, NULL, NULL);
 
     return dev;
@@ -995,6 +1008,10 @@ CloseDevice(DeviceIntPtr dev)
 
     XIDeleteAllDeviceProperties(dev);
 
+    if (dev->coalescedMotion)
+        LogMessageVerb(X_INFO, 3, "%s: %llu motion events coalesced\n",
+                       dev->name, (unsigned long long) dev->coalescedMotion);
+
     if (dev->inited)
         (void) (*dev->deviceProc) (dev, DEVICE_CLOSE);
 
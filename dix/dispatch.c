@@ -108,6 +108,7 @@ Equipment Corporation.
 #include "dix/dix_priv.h"
 #include "dix/input_priv.h"
 #include "dix/gc_priv.h"
+#include "dix/readyqueue_priv.h"
 #include "dix/registry_priv.h"
 #include "dix/resource_priv.h"
 #include "dix/screenint_priv.h"
@@ -266,6 +267,7 @@ init_client_ready(void)
     xorg_list_init(&ready_clients);
     xorg_list_init(&saved_ready_clients);
     xorg_list_init(&output_pending_clients);
+    ready_queue_init();
 }
 
 Bool
@@ -278,8 +280,10 @@ clients_are_ready(void)
 void
 mark_client_ready(ClientPtr client)
 {
-    if (xorg_list_is_empty(&client->ready))
+    if (xorg_list_is_empty(&client->ready)) {
         xorg_list_append(&client->ready, &ready_clients);
+        ready_queue_add(client);
+    }
 }
 
 /*
@@ -297,6 +301,14 @@ void
 mark_client_not_ready(ClientPtr client)
 {
     xorg_list_del(&client->ready);
+    ready_queue_remove(client);
+}
+
+/* Client's scheduling priority or idle time changed */
+void
+mark_client_priority_changed(ClientPtr client)
+{
+    ready_queue_update(client);
 }
 
 static void
@@ -308,6 +320,7 @@ mark_client_grab(ClientPtr grab)
         if (client != grab) {
             xorg_list_del(&client->ready);
             xorg_list_append(&client->ready, &saved_ready_clients);
+            ready_queue_remove(client);
         }
     }
 }
@@ -320,54 +333,22 @@ mark_client_ungrab(void)
     xorg_list_for_each_entry_safe(client, tmp, &saved_ready_clients, ready) {
         xorg_list_del(&client->ready);
         xorg_list_append(&client->ready, &ready_clients);
+        ready_queue_add(client);
     }
 }
 
 static ClientPtr
 SmartScheduleClient(void)
 {
-    ClientPtr pClient, best = NULL;
-    int bestRobin, robin;
+    ClientPtr best;
     long now = SmartScheduleTime;
-    long idle;
-    int nready = 0;
-
-    bestRobin = 0;
-    idle = 2 * SmartScheduleSlice;
+    int nready = ready_queue_count();
 
-    xorg_list_for_each_entry(pClient, &ready_clients, ready) {
-        nready++;
-
-        /* Praise clients which haven't run in a while */
-        if ((now - pClient->smart_stop_tick) >= idle) {
-            if (pClient->smart_priority < 0)
-                pClient->smart_priority++;
-        }
-
-        /* check priority to select best client */
-        robin =
-            (pClient->index -
-             SmartLastIndex[pClient->smart_priority -
-                            SMART_MIN_PRIORITY]) & 0xff;
-
-        /* pick the best client */
-        if (!best ||
-            pClient->priority > best->priority ||
-            (pClient->priority == best->priority &&
-             (pClient->smart_priority > best->smart_priority ||
-              (pClient->smart_priority == best->smart_priority && robin > bestRobin))))
-        {
-            best = pClient;
-            bestRobin = robin;
-        }
-#ifdef SMART_DEBUG
-        if ((now - SmartLastPrint) >= 5000)
-            fprintf(stderr, " %2d: %3d", pClient->index, pClient->smart_priority);
-#endif
-    }
+    best = ready_queue_select(now, 2 * SmartScheduleSlice, SmartLastIndex);
 #ifdef SMART_DEBUG
     if ((now - SmartLastPrint) >= 5000) {
-        fprintf(stderr, " use %2d\n", best->index);
+        fprintf(stderr, " %d ready, use %2d: %3d\n", nready, best->index,
+                best->smart_priority);
         SmartLastPrint = now;
     }
 #endif
@@ -507,8 +488,10 @@ Dispatch(void)
                 if ((SmartScheduleTime - start_tick) >= SmartScheduleSlice)
                 {
                     /* Penalize clients which consume ticks */
-                    if (client->smart_priority > SMART_MIN_PRIORITY)
+                    if (client->smart_priority > SMART_MIN_PRIORITY) {
                         client->smart_priority--;
+                        mark_client_priority_changed(client);
+                    }
                     break;
                 }
 
@@ -571,8 +554,10 @@ Dispatch(void)
                 }
             }
             FlushAllOutput();
-            if (client == SmartLastClient)
+            if (client == SmartLastClient) {
                 client->smart_stop_tick = SmartScheduleTime;
+                mark_client_priority_changed(client);
+            }
         }
         dispatchException &= ~DE_PRIORITYCHANGE;
     }
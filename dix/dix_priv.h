@@ -20,6 +20,7 @@
 #include "dix/input_priv.h"
 #include "dix/resource_priv.h"
 #include "dix/rpcbuf_priv.h"
+#include "os/client_priv.h"
 
 #include "include/callback.h"
 #include "include/cursor.h"
@@ -62,6 +63,15 @@ extern HWEventQueuePtr checkForInput[2];
  /* -retro mode */
 extern Bool party_like_its_1989;
 
+/* -glyphcache: memory budget of fb's glyph cache in kilobytes, 0 for none */
+_X_EXPORT /* used by in-tree libwfb.so module */
+extern unsigned int glyphCacheSize;
+
+/* -fontprewarm: fonts to open at startup, one name per line */
+extern const char *fontPrewarmFile;
+
+void PrewarmFonts(void);
+
 /*
  * @brief callback right after one screen's root window has been initialized
  *
@@ -215,6 +225,14 @@ void FixKeyState(DeviceEvent *event, DeviceIntPtr keybd);
 
 void RecalculateDeliverableEvents(WindowPtr pWin);
 
+/*
+ * The clients selecting for an event on a window, cached for windows with
+ * many of them. To be invalidated whenever a selection on it changes, the
+ * Recalculate*DeliverableEvents() functions do that for their subtree.
+ */
+void DeliveryCacheInvalidate(WindowPtr pWin);
+void DeliveryCacheFree(WindowPtr pWin);
+
 void DoFocusEvents(DeviceIntPtr dev,
                    WindowPtr fromWin,
                    WindowPtr toWin,
@@ -700,13 +718,17 @@ static inline ClientPtr dixLookupXIDOwner(XID xid)
 /*
  * @brief write rpc buffer to client and then clear it
  *
+ * The buffer is handed over to the output queue, so large replies are
+ * sent without copying them again.
+ *
  * @param pClient the client to write buffer to
  * @param rpcbuf  the buffer whose contents will be written
- * @return the result of WriteToClient() call
+ * @return the result of WriteToClientBuffer() call
  */
 static inline int WriteRpcbufToClient(ClientPtr pClient,
                                       x_rpcbuf_t *rpcbuf) {
-    int ret = WriteToClient(pClient, rpcbuf->wpos, rpcbuf->buffer);
+    int ret = WriteToClientBuffer(pClient, rpcbuf->wpos, rpcbuf->buffer, free);
+    rpcbuf->buffer = NULL;
     x_rpcbuf_clear(rpcbuf);
     return ret;
 }
@@ -50,7 +50,10 @@ Equipment Corporation.
 
 #include <dix-config.h>
 
+#include <errno.h>
 #include <stddef.h>
+#include <stdio.h>
+#include <string.h>
 #include <X11/X.h>
 #include <X11/Xmd.h>
 #include <X11/Xproto.h>
@@ -155,6 +158,68 @@ SetDefaultFont(const char *defaultfontname)
     return TRUE;
 }
 
+/*
+ * Open the fonts named in fontPrewarmFile, one per line, and keep them open
+ * until the server resets, so clients find them in the pattern cache.
+ */
+void
+PrewarmFonts(void)
+{
+    char line[XLFDMAXFONTNAMELEN + 2];
+    int opened = 0, missing = 0;
+    CARD64 start;
+    FILE *file;
+
+    if (!fontPrewarmFile)
+        return;
+    if (PrivsElevated()) {
+        LogMessage(X_WARNING, "Not prewarming fonts with elevated "
+                   "privileges\n");
+        return;
+    }
+    file = fopen(fontPrewarmFile, "r");
+    if (!file) {
+        LogMessage(X_ERROR, "Could not open font prewarm list %s: %s\n",
+                   fontPrewarmFile, strerror(errno));
+        return;
+    }
+
+    start = GetTimeInMicros();
+    while (fgets(line, sizeof(line), file)) {
+        size_t len = strcspn(line, "\r\n");
+        FontPtr pf;
+        XID fid;
+
+        if (!line[len] && !feof(file)) {
+            /* too long to be a font name: skip the rest of the line */
+            int ch;
+
+            while ((ch = getc(file)) != EOF && ch != '\n')
+                ;
+            continue;
+        }
+        if (!len || line[0] == '#')
+            continue;
+        line[len] = '\0';
+
+        fid = dixAllocServerXID();
+        if (OpenFont(serverClient, fid, FontLoadAll | FontOpenSync, len,
+                     line) == Success &&
+            dixLookupResourceByType((void **) &pf, fid, X11_RESTYPE_FONT,
+                                    serverClient, DixReadAccess) == Success)
+            opened++;
+        else {
+            LogMessage(X_WARNING, "Could not prewarm font %s\n", line);
+            missing++;
+        }
+    }
+    fclose(file);
+
+    LogMessageVerb(X_INFO, 3, "Prewarmed %d fonts from %s in %.1f ms, "
+                   "%d not found\n", opened, fontPrewarmFile,
+                   (GetTimeInMicros() - start) / 1000.0, missing);
+}
+
 /*
  * note that the font wakeup queue is not refcounted.  this is because
  * an fpe needs to be added when it's inited, and removed when it's finally
@@ -232,6 +297,193 @@ FreeFPE(FontPathElementPtr fpe)
     }
 }
 
+/*
+ * Caches in front of the font path. The name cache remembers what a font
+ * name resolved to, after aliases, and which FPE had it, so OpenFont of a
+ * font that isn't open anymore goes straight there. The list cache keeps
+ * the replies to ListFonts. Both only depend on the font path, so they are
+ * dropped whenever it is set, except for what a font server says: lists
+ * that had to wait for one are never cached, and a name the cache sent to
+ * the wrong place is looked up all over again.
+ */
+#define FONT_NAME_CACHE_SIZE    256             /* a power of two */
+#define FONT_LIST_CACHE_SIZE    32              /* a power of two */
+#define FONT_LIST_CACHE_BYTES   (4 * 1024 * 1024)
+
+typedef struct {
+    char *name;                 /* as opened, NULL if unused */
+    int namelen;
+    char *resolved;
+    int resolvedlen;
+    int fpe;                    /* index into font_path_elements */
+} FontNameCacheRec;
+
+typedef struct {
+    char *pattern;              /* NULL if unused */
+    int patlen;
+    int max_names;
+    char *data;                 /* the STRs of the reply */
+    int length;
+    int nnames;
+} FontListCacheRec;
+
+static FontNameCacheRec fontNameCache[FONT_NAME_CACHE_SIZE];
+static FontListCacheRec fontListCache[FONT_LIST_CACHE_SIZE];
+static int fontListCacheBytes;
+static unsigned long fontPathGeneration;
+
+static struct {
+    unsigned long name_hits, name_misses, name_stale;
+    unsigned long list_hits, list_misses;
+    CARD64 name_hit_us, name_miss_us, list_hit_us, list_miss_us;
+} fontCacheStats;
+
+static uint32_t
+FontCacheHash(const char *name, int len, uint32_t seed)
+{
+    uint32_t hash = 2166136261u ^ seed;
+
+    for (int i = 0; i < len; i++)
+        hash = (hash ^ (unsigned char) name[i]) * 16777619u;
+    return hash;
+}
+
+static FontNameCacheRec *
+FontNameCacheEntry(const char *name, int namelen)
+{
+    return &fontNameCache[FontCacheHash(name, namelen, 0) &
+                          (FONT_NAME_CACHE_SIZE - 1)];
+}
+
+static FontNameCacheRec *
+FontNameCacheFind(const char *name, int namelen)
+{
+    FontNameCacheRec *entry = FontNameCacheEntry(name, namelen);
+
+    if (entry->name && entry->namelen == namelen &&
+        !memcmp(entry->name, name, namelen) && entry->fpe < num_fpes)
+        return entry;
+    return NULL;
+}
+
+static void
+FontNameCacheClear(FontNameCacheRec *entry)
+{
+    free(entry->name);
+    free(entry->resolved);
+    memset(entry, 0, sizeof(*entry));
+}
+
+static void
+FontNameCacheAdd(const char *name, int namelen, const char *resolved,
+                 int resolvedlen, int fpe)
+{
+    FontNameCacheRec *entry = FontNameCacheEntry(name, namelen);
+
+    FontNameCacheClear(entry);
+    entry->name = malloc(namelen);
+    entry->resolved = malloc(resolvedlen);
+    if (!entry->name || !entry->resolved) {
+        FontNameCacheClear(entry);
+        return;
+    }
+    memcpy(entry->name, name, namelen);
+    entry->namelen = namelen;
+    memcpy(entry->resolved, resolved, resolvedlen);
+    entry->resolvedlen = resolvedlen;
+    entry->fpe = fpe;
+}
+
+static FontListCacheRec *
+FontListCacheEntry(const char *pattern, int patlen, int max_names)
+{
+    return &fontListCache[FontCacheHash(pattern, patlen, max_names) &
+                          (FONT_LIST_CACHE_SIZE - 1)];
+}
+
+static FontListCacheRec *
+FontListCacheFind(const char *pattern, int patlen, int max_names)
+{
+    FontListCacheRec *entry = FontListCacheEntry(pattern, patlen, max_names);
+
+    if (entry->pattern && entry->patlen == patlen &&
+        entry->max_names == max_names &&
+        !memcmp(entry->pattern, pattern, patlen))
+        return entry;
+    return NULL;
+}
+
+static void
+FontListCacheClear(FontListCacheRec *entry)
+{
+    fontListCacheBytes -= entry->length;
+    free(entry->pattern);
+    free(entry->data);
+    memset(entry, 0, sizeof(*entry));
+}
+
+static void
+FontListCacheAdd(const char *pattern, int patlen, int max_names,
+                 const char *data, int length, int nnames)
+{
+    FontListCacheRec *entry = FontListCacheEntry(pattern, patlen, max_names);
+
+    FontListCacheClear(entry);
+    if (fontListCacheBytes + length > FONT_LIST_CACHE_BYTES)
+        return;
+    entry->pattern = malloc(patlen);
+    entry->data = malloc(length);
+    if (!entry->pattern || (!entry->data && length)) {
+        FontListCacheClear(entry);
+        return;
+    }
+    memcpy(entry->pattern, pattern, patlen);
+    entry->patlen = patlen;
+    entry->max_names = max_names;
+    memcpy(entry->data, data, length);
+    entry->length = length;
+    entry->nnames = nnames;
+    fontListCacheBytes += length;
+}
+
+static double
+FontCacheAverage(CARD64 us, unsigned long count)
+{
+    return count ? (double) us / count : 0.0;
+}
+
+/* drop everything the font path led to, with the stats since last time */
+static void
+FontCacheInvalidate(void)
+{
+    unsigned long names, lists;
+
+    names = fontCacheStats.name_hits + fontCacheStats.name_misses;
+    lists = fontCacheStats.list_hits + fontCacheStats.list_misses;
+    if (names || lists)
+        LogMessageVerb(X_INFO, 3, "Font caches: %lu of %lu opens hit "
+                       "(%lu stale), %.1f us vs. %.1f us a miss; %lu of %lu "
+                       "lists hit, %.1f us vs. %.1f us a miss\n",
+                       fontCacheStats.name_hits, names,
+                       fontCacheStats.name_stale,
+                       FontCacheAverage(fontCacheStats.name_hit_us,
+                                        fontCacheStats.name_hits),
+                       FontCacheAverage(fontCacheStats.name_miss_us,
+                                        fontCacheStats.name_misses),
+                       fontCacheStats.list_hits, lists,
+                       FontCacheAverage(fontCacheStats.list_hit_us,
+                                        fontCacheStats.list_hits),
+                       FontCacheAverage(fontCacheStats.list_miss_us,
+                                        fontCacheStats.list_misses));
+    memset(&fontCacheStats, 0, sizeof(fontCacheStats));
+
+    for (int i = 0; i < FONT_NAME_CACHE_SIZE; i++)
+        FontNameCacheClear(&fontNameCache[i]);
+    for (int i = 0; i < FONT_LIST_CACHE_SIZE; i++)
+        FontListCacheClear(&fontListCache[i]);
+    fontPathGeneration++;
+}
+
 static Bool
 doOpenFont(ClientPtr client, OFclosurePtr c)
 {
@@ -299,6 +551,7 @@ doOpenFont(ClientPtr client, OFclosurePtr c)
             c->fontname = newname;
             c->fnamelen = newlen;
             c->current_fpe = 0;
+            c->name_cached = FALSE;
             if (--aliascount <= 0) {
                 /* We've tried resolving this alias 20 times, we're
                  * probably stuck in an infinite loop of aliases pointing
@@ -309,6 +562,26 @@ doOpenFont(ClientPtr client, OFclosurePtr c)
             }
             continue;
         }
+        if (err == BadFontName && c->name_cached) {
+            /* not there anymore: look for the name as given */
+            FontNameCacheRec *entry = FontNameCacheFind(c->origFontName,
+                                                        c->origFontNameLen);
+
+            if (entry)
+                FontNameCacheClear(entry);
+            fontCacheStats.name_stale++;
+            c->name_cached = FALSE;
+            newname = realloc(c->fontname, c->origFontNameLen);
+            if (!newname) {
+                err = AllocError;
+                break;
+            }
+            memcpy(newname, c->origFontName, c->origFontNameLen);
+            c->fontname = newname;
+            c->fnamelen = c->origFontNameLen;
+            c->current_fpe = 0;
+            continue;
+        }
         if (err == BadFontName) {
             c->current_fpe++;
             continue;
@@ -357,6 +630,17 @@ doOpenFont(ClientPtr client, OFclosurePtr c)
     if (patternCache && pfont != c->non_cachable_font)
         xfont2_cache_font_pattern(patternCache, c->origFontName, c->origFontNameLen,
                                   pfont);
+    if (c->name_cached) {
+        fontCacheStats.name_hits++;
+        fontCacheStats.name_hit_us += GetTimeInMicros() - c->start;
+    }
+    else {
+        if (c->generation == fontPathGeneration)
+            FontNameCacheAdd(c->origFontName, c->origFontNameLen,
+                             c->fontname, c->fnamelen, c->current_fpe);
+        fontCacheStats.name_misses++;
+        fontCacheStats.name_miss_us += GetTimeInMicros() - c->start;
+    }
  bail:
     if (err != Successful && c->client != serverClient) {
         SendErrorToClient(c->client, X_OpenFont, 0,
@@ -439,6 +723,21 @@ OpenFont(ClientPtr client, XID fid, Mask flags, unsigned lenfname,
     c->fnamelen = lenfname;
     c->flags = flags;
     c->non_cachable_font = cached;
+    c->generation = fontPathGeneration;
+    c->start = GetTimeInMicros();
+
+    FontNameCacheRec *entry = FontNameCacheFind(pfontname, lenfname);
+    if (entry) {
+        char *resolved = realloc(c->fontname, entry->resolvedlen);
+
+        if (resolved) {
+            memcpy(resolved, entry->resolved, entry->resolvedlen);
+            c->fontname = resolved;
+            c->fnamelen = entry->resolvedlen;
+            c->current_fpe = entry->fpe;
+            c->name_cached = TRUE;
+        }
+    }
 
     (void) doOpenFont(client, c);
     return Success;
@@ -547,6 +846,26 @@ QueryFont(FontPtr pFont, xQueryFontReply * pReply, int nProtoCCIStructs)
     return;
 }
 
+static void
+WriteListFontsReply(ClientPtr client, int nnames, int length, char *data)
+{
+    xListFontsReply rep = {
+        .type = X_Reply,
+        .length = bytes_to_int32(length),
+        .nFonts = nnames,
+        .sequenceNumber = client->sequence
+    };
+
+    if (client->swapped) {
+        swaps(&rep.sequenceNumber);
+        swapl(&rep.length);
+        swaps(&rep.nFonts);
+    }
+
+    WriteToClient(client, sizeof(rep), &rep);
+    WriteToClient(client, length, data);
+}
+
 static Bool
 doListFontsAndAliases(ClientPtr client, LFclosurePtr c)
 {
@@ -587,6 +906,7 @@ doListFontsAndAliases(ClientPtr client, LFclosurePtr c)
                 if (!ClientIsAsleep(client))
                     ClientSleep(client,
                                 (ClientSleepProcPtr) doListFontsAndAliases, c);
+                c->slept = TRUE;
                 return TRUE;
             }
 
@@ -612,6 +932,7 @@ doListFontsAndAliases(ClientPtr client, LFclosurePtr c)
                         ClientSleep(client,
                                     (ClientSleepProcPtr) doListFontsAndAliases,
                                     c);
+                    c->slept = TRUE;
                     return TRUE;
                 }
                 if (err == Successful)
@@ -629,6 +950,7 @@ doListFontsAndAliases(ClientPtr client, LFclosurePtr c)
                         ClientSleep(client,
                                     (ClientSleepProcPtr) doListFontsAndAliases,
                                     c);
+                    c->slept = TRUE;
                     return TRUE;
                 }
                 if (err == FontNameAlias) {
@@ -738,17 +1060,10 @@ doListFontsAndAliases(ClientPtr client, LFclosurePtr c)
     for (int i = 0; i < nnames; i++)
         stringLens += (names->length[i] <= 255) ? names->length[i] : 0;
 
-    xListFontsReply rep = {
-        .type = X_Reply,
-        .length = bytes_to_int32(stringLens + nnames),
-        .nFonts = nnames,
-        .sequenceNumber = client->sequence
-    };
-
-    char *bufferStart = calloc(1, rep.length << 2);
+    char *bufferStart = calloc(1, pad_to_int32(stringLens + nnames));
     char *bufptr = bufferStart;
 
-    if (!bufptr && rep.length) {
+    if (!bufptr && nnames) {
         SendErrorToClient(client, X_ListFonts, 0, 0, BadAlloc);
         goto bail;
     }
@@ -758,24 +1073,21 @@ doListFontsAndAliases(ClientPtr client, LFclosurePtr c)
      */
     for (int i = 0; i < nnames; i++) {
         if (names->length[i] > 255)
-            rep.nFonts--;
+            nnames--;
         else {
             *bufptr++ = names->length[i];
             memcpy(bufptr, names->names[i], names->length[i]);
             bufptr += names->length[i];
         }
     }
-    nnames = rep.nFonts;
-    rep.length = bytes_to_int32(stringLens + nnames);
 
-    if (client->swapped) {
-        swaps(&rep.sequenceNumber);
-        swapl(&rep.length);
-        swaps(&rep.nFonts);
-    }
+    if (!c->slept && c->generation == fontPathGeneration)
+        FontListCacheAdd(c->origPattern, c->origPatlen, c->origMaxNames,
+                         bufferStart, stringLens + nnames, nnames);
+    fontCacheStats.list_misses++;
+    fontCacheStats.list_miss_us += GetTimeInMicros() - c->start;
 
-    WriteToClient(client, sizeof(rep), &rep);
-    WriteToClient(client, stringLens + nnames, bufferStart);
+    WriteListFontsReply(client, nnames, stringLens + nnames, bufferStart);
     free(bufferStart);
 
  bail:
@@ -810,6 +1122,18 @@ ListFonts(ClientPtr client, unsigned char *pattern, unsigned length,
     if (access != Success)
         return access;
 
+    FontListCacheRec *cached = FontListCacheFind((char *) pattern, length,
+                                                 max_names);
+    if (cached) {
+        CARD64 start = GetTimeInMicros();
+
+        WriteListFontsReply(client, cached->nnames, cached->length,
+                            cached->data);
+        fontCacheStats.list_hits++;
+        fontCacheStats.list_hit_us += GetTimeInMicros() - start;
+        return Success;
+    }
+
     if (!(c = calloc(1, sizeof *c)))
         return BadAlloc;
     c->fpe_list = calloc(num_fpes, sizeof(FontPathElementPtr));
@@ -837,6 +1161,11 @@ ListFonts(ClientPtr client, unsigned char *pattern, unsigned length,
     c->current.private = 0;
     c->haveSaved = FALSE;
     c->savedName = 0;
+    memcpy(c->origPattern, pattern, length);
+    c->origPatlen = length;
+    c->origMaxNames = max_names;
+    c->generation = fontPathGeneration;
+    c->start = GetTimeInMicros();
     doListFontsAndAliases(client, c);
     return Success;
 }
@@ -1585,6 +1914,7 @@ SetFontPathElements(int npaths, unsigned char *paths, int *bad, Bool persist)
         *bad = 0;
         return BadAlloc;
     }
+    FontCacheInvalidate();
     for (i = 0; i < num_fpe_types; i++) {
         if (fpe_functions[i]->set_path_hook)
             (*fpe_functions[i]->set_path_hook) ();
@@ -1871,6 +2201,7 @@ get_client_resolutions(int *num)
 void
 FreeFonts(void)
 {
+    FontCacheInvalidate();
     if (patternCache) {
         xfont2_free_font_pattern_cache(patternCache);
         patternCache = 0;
@@ -168,4 +168,45 @@ int AddPassiveGrabToList(ClientPtr client, GrabPtr pGrab);
  */
 Bool DeletePassiveGrabFromList(GrabPtr pMinuendGrab);
 
+/* a grab of a window's passive grab index, where it is on the list */
+typedef struct _PassiveGrabIndexEntry {
+    GrabPtr grab;
+    int pos;
+} PassiveGrabIndexEntry;
+
+/* passive grabs of a window, see ::PassiveGrabsFirst() */
+typedef struct _PassiveGrabIter {
+    GrabPtr next;               /* without an index */
+    const PassiveGrabIndexEntry *exact, *exactEnd;
+    const PassiveGrabIndexEntry *any, *anyEnd;
+} PassiveGrabIter;
+
+/**
+ * @brief start a walk of the passive grabs that may match a detail
+ *
+ * Windows with many passive grabs have them indexed by their key or button,
+ * so the walk only gets to those for the detail and for any key or button,
+ * in the order of the window's list. A detail of AnyKey (0), which may
+ * match all of them, walks the whole list. Adding or deleting a grab on the
+ * window ends all walks of it.
+ *
+ * @param pWin the window whose passive grabs to walk
+ * @param detail key or button of the event
+ * @param iter set up for ::PassiveGrabsNext()
+ */
+void PassiveGrabsFirst(WindowPtr pWin, unsigned int detail,
+                       PassiveGrabIter *iter);
+
+/**
+ * @brief the next passive grab of a walk, NULL at the end
+ */
+GrabPtr PassiveGrabsNext(PassiveGrabIter *iter);
+
+/**
+ * @brief free the passive grab index of a window
+ *
+ * @param pWin the window being destroyed
+ */
+void PassiveGrabIndexFree(WindowPtr pWin);
+
 #endif /* _XSERVER_DIXGRABS_PRIV_H_ */
@@ -50,6 +50,12 @@ void mark_client_saved_ready(ClientPtr client);
 /* Client has no requests queued and no data on network */
 void mark_client_not_ready(ClientPtr client);
 
+/*
+ * Client's priority, smart_priority or smart_stop_tick changed, so it
+ * needs to be re-filed in the ready queue
+ */
+void mark_client_priority_changed(ClientPtr client);
+
 static inline Bool client_is_ready(ClientPtr client)
 {
     return !xorg_list_is_empty(&client->ready);
@@ -2121,8 +2121,10 @@ TryClientEvents(ClientPtr client, DeviceIntPtr dev, xEvent *pEvents,
     }
 
     if (BitIsOn(criticalEvents, type)) {
-        if (client->smart_priority < SMART_MAX_PRIORITY)
+        if (client->smart_priority < SMART_MAX_PRIORITY) {
             client->smart_priority++;
+            mark_client_priority_changed(client);
+        }
         SetCriticalOutputPending();
     }
 
@@ -2247,6 +2249,52 @@ GetClientsForDelivery(DeviceIntPtr dev, WindowPtr win,
     return rc;
 }
 
+/**
+ * Try delivery on one client with the given event mask, provided there is no
+ * interfering core grab. Updates rc and the returns as
+ * DeliverEventToInputClients() documents.
+ */
+static void
+DeliverEventToInputClient(DeviceIntPtr dev, ClientPtr client, Mask mask,
+                          WindowPtr win, xEvent *events, int count,
+                          Mask filter, GrabPtr grab,
+                          enum EventDeliveryState *rc,
+                          Bool *have_device_button_grab_class_client,
+                          ClientPtr *client_return, Mask *mask_return)
+{
+    int attempt;
+
+    if (IsInterferingGrab(client, dev, events))
+        return;
+
+    if (IsWrongPointerBarrierClient(client, dev, events))
+        return;
+
+    if (XaceHookReceiveAccess(client, win, events, count))
+        /* do nothing */ ;
+    else if ((attempt = TryClientEvents(client, dev,
+                                        events, count,
+                                        mask, filter, grab))) {
+        if (attempt > 0) {
+            /*
+             * The order of clients is arbitrary therefore if one
+             * client belongs to DeviceButtonGrabClass make sure to
+             * catch it.
+             */
+            if (!*have_device_button_grab_class_client) {
+                *rc = EVENT_DELIVERED;
+                *client_return = client;
+                *mask_return = mask;
+                /* Success overrides non-success, so if we've been
+                 * successful on one client, return that */
+                if (mask & DeviceButtonGrabMask)
+                    *have_device_button_grab_class_client = TRUE;
+            }
+        } else if (*rc == EVENT_NOT_DELIVERED)
+            *rc = EVENT_REJECTED;
+    }
+}
+
 /**
  * Try delivery on each client in inputclients, provided the event mask
  * accepts it and there is no interfering core grab..
@@ -2257,48 +2305,133 @@ DeliverEventToInputClients(DeviceIntPtr dev, InputClients * inputclients,
                            int count, Mask filter, GrabPtr grab,
                            ClientPtr *client_return, Mask *mask_return)
 {
-    int attempt;
     enum EventDeliveryState rc = EVENT_NOT_DELIVERED;
     Bool have_device_button_grab_class_client = FALSE;
 
-    for (; inputclients; inputclients = inputclients->next) {
+    for (; inputclients; inputclients = inputclients->next)
+        DeliverEventToInputClient(dev, dixClientForInputClients(inputclients),
+                                  GetEventMask(dev, events, inputclients),
+                                  win, events, count, filter, grab, &rc,
+                                  &have_device_button_grab_class_client,
+                                  client_return, mask_return);
+
+    return rc;
+}
+
+#define DELIVERY_CACHE_MIN      8       /* selecting clients to have one */
+#define DELIVERY_CACHE_SETS     8
+
+/*
+ * The clients of a window whose mask for one event from one device has the
+ * filter set, in the order of the list they're on, with that mask. Most
+ * events a window gets are the same few over and over again, so a window
+ * keeps a handful of these, by the level of the event, the device, the XI2
+ * type and the filter. Any change of a selection on the window drops them
+ * all, and they're found again on the next event.
+ */
+typedef struct _DeliverySet {
+    Bool valid;
+    enum InputLevel level;
+    int deviceid;
+    int evtype;                 /* XI2 only */
+    Mask filter;
+    int num, size;
+    struct {
+        ClientPtr client;
         Mask mask;
-        ClientPtr client = dixClientForInputClients(inputclients);
+    } *entries;
+} DeliverySetRec, *DeliverySetPtr;
 
-        if (IsInterferingGrab(client, dev, events))
-            continue;
+typedef struct _DeliveryCache {
+    DeliverySetRec sets[DELIVERY_CACHE_SETS];
+} DeliveryCacheRec, *DeliveryCachePtr;
 
-        if (IsWrongPointerBarrierClient(client, dev, events))
-            continue;
+void
+DeliveryCacheInvalidate(WindowPtr pWin)
+{
+    DeliveryCachePtr cache = wDeliveryCache(pWin);
 
-        mask = GetEventMask(dev, events, inputclients);
-
-        if (XaceHookReceiveAccess(client, win, events, count))
-            /* do nothing */ ;
-        else if ((attempt = TryClientEvents(client, dev,
-                                            events, count,
-                                            mask, filter, grab))) {
-            if (attempt > 0) {
-                /*
-                 * The order of clients is arbitrary therefore if one
-                 * client belongs to DeviceButtonGrabClass make sure to
-                 * catch it.
-                 */
-                if (!have_device_button_grab_class_client) {
-                    rc = EVENT_DELIVERED;
-                    *client_return = client;
-                    *mask_return = mask;
-                    /* Success overrides non-success, so if we've been
-                     * successful on one client, return that */
-                    if (mask & DeviceButtonGrabMask)
-                        have_device_button_grab_class_client = TRUE;
-                }
-            } else if (rc == EVENT_NOT_DELIVERED)
-                rc = EVENT_REJECTED;
-        }
+    if (cache)
+        for (int i = 0; i < DELIVERY_CACHE_SETS; i++)
+            cache->sets[i].valid = FALSE;
+}
+
+void
+DeliveryCacheFree(WindowPtr pWin)
+{
+    DeliveryCachePtr cache = wDeliveryCache(pWin);
+
+    if (cache) {
+        for (int i = 0; i < DELIVERY_CACHE_SETS; i++)
+            free(cache->sets[i].entries);
+        free(cache);
+        pWin->optional->deliveryCache = NULL;
     }
+}
 
-    return rc;
+/* the clients of iclients that want the event, NULL for a walk of them */
+static DeliverySetPtr
+DeliveryCacheLookup(DeviceIntPtr dev, WindowPtr win, xEvent *events,
+                    Mask filter, InputClients * iclients)
+{
+    DeliveryCachePtr cache = wDeliveryCache(win);
+    DeliverySetPtr set;
+    enum InputLevel level = XI;
+    int deviceid = dev->id, evtype;
+
+    if (!cache) {
+        int n = 0;
+
+        for (InputClients *ic = iclients; ic && n < DELIVERY_CACHE_MIN;
+             ic = ic->next)
+            n++;
+        if (n < DELIVERY_CACHE_MIN || !MakeWindowOptional(win))
+            return NULL;
+        cache = win->optional->deliveryCache =
+            calloc(1, sizeof(DeliveryCacheRec));
+        if (!cache)
+            return NULL;
+    }
+
+    if ((evtype = xi2_get_type(events)))
+        level = XI2;
+    else if (core_get_type(events) != 0) {
+        level = CORE;
+        deviceid = XIAllDevices;
+    }
+
+    set = &cache->sets[(level * 7 + deviceid * 3 + evtype + filter % 31) %
+                       DELIVERY_CACHE_SETS];
+    if (set->valid && set->level == level && set->deviceid == deviceid &&
+        set->evtype == evtype && set->filter == filter)
+        return set;
+
+    set->valid = FALSE;
+    set->num = 0;
+    for (InputClients *ic = iclients; ic; ic = ic->next) {
+        Mask mask = GetEventMask(dev, events, ic);
+
+        if (!(mask & filter))
+            continue;
+        if (set->num == set->size) {
+            int size = set->size ? set->size * 2 : DELIVERY_CACHE_MIN;
+            void *entries = reallocarray(set->entries, size,
+                                         sizeof(*set->entries));
+
+            if (!entries)
+                return NULL;
+            set->entries = entries;
+            set->size = size;
+        }
+        set->entries[set->num].client = dixClientForInputClients(ic);
+        set->entries[set->num++].mask = mask;
+    }
+    set->level = level;
+    set->deviceid = deviceid;
+    set->evtype = evtype;
+    set->filter = filter;
+    set->valid = TRUE;
+    return set;
 }
 
 /**
@@ -2314,13 +2447,27 @@ DeliverEventToWindowMask(DeviceIntPtr dev, WindowPtr win, xEvent *events,
                          ClientPtr *client_return, Mask *mask_return)
 {
     InputClients *iclients;
+    DeliverySetPtr set;
+    enum EventDeliveryState rc = EVENT_NOT_DELIVERED;
+    Bool have_device_button_grab_class_client = FALSE;
 
     if (!GetClientsForDelivery(dev, win, events, filter, &iclients))
         return EVENT_SKIP;
 
-    return DeliverEventToInputClients(dev, iclients, win, events, count, filter,
-                                      grab, client_return, mask_return);
-
+    set = DeliveryCacheLookup(dev, win, events, filter, iclients);
+    if (!set)
+        return DeliverEventToInputClients(dev, iclients, win, events, count,
+                                          filter, grab, client_return,
+                                          mask_return);
+
+    /* the others would all be filtered */
+    for (int i = 0; i < set->num; i++)
+        DeliverEventToInputClient(dev, set->entries[i].client,
+                                  set->entries[i].mask, win, events, count,
+                                  filter, grab, &rc,
+                                  &have_device_button_grab_class_client,
+                                  client_return, mask_return);
+    return rc;
 }
 
 /**
@@ -2481,11 +2628,30 @@ DeliverRawEvent(RawDeviceEvent *ev, DeviceIntPtr device)
     for (int i = 0; i < screenInfo.numScreens; i++) {
         WindowPtr root;
         InputClients *inputclients;
+        DeliverySetPtr set;
 
         root = screenInfo.screens[i]->root;
         if (!GetClientsForDelivery(device, root, xi, filter, &inputclients))
             continue;
 
+        set = DeliveryCacheLookup(device, root, xi, filter, inputclients);
+        for (int j = 0; set && j < set->num; j++) {
+            ClientPtr client = set->entries[j].client;
+            enum EventDeliveryState state = EVENT_NOT_DELIVERED;
+            Bool have_grab_client = FALSE;  /* unused */
+            ClientPtr c;        /* unused */
+            Mask m;             /* unused */
+
+            /* one by one, as below */
+            if (!FilterRawEvents(client, grab, root))
+                DeliverEventToInputClient(device, client,
+                                          set->entries[j].mask, root, xi, 1,
+                                          filter, NULL, &state,
+                                          &have_grab_client, &c, &m);
+        }
+        if (set)
+            continue;
+
         for (; inputclients; inputclients = inputclients->next) {
             ClientPtr c;        /* unused */
             Mask m;             /* unused */
@@ -4038,6 +4204,7 @@ CheckPassiveGrabsOnWindow(WindowPtr pWin,
 {
     GrabPtr grab = wPassiveGrabs(pWin);
     GrabPtr tempGrab;
+    PassiveGrabIter iter;
 
     if (!grab)
         return NULL;
@@ -4069,7 +4236,8 @@ CheckPassiveGrabsOnWindow(WindowPtr pWin,
     tempGrab->modifiersDetail.pMask = NULL;
     tempGrab->next = NULL;
 
-    for (; grab; grab = grab->next) {
+    PassiveGrabsFirst(pWin, tempGrab->detail.exact, &iter);
+    while ((grab = PassiveGrabsNext(&iter))) {
         if (!CheckPassiveGrab(device, grab, event, checkCore, tempGrab))
             continue;
 
@@ -4473,6 +4641,7 @@ RecalculateDeliverableEvents(WindowPtr pWin)
 
     pChild = pWin;
     while (1) {
+        DeliveryCacheInvalidate(pChild);
         if (pChild->optional) {
             pChild->optional->otherEventMasks = 0;
             for (OtherClients *others = wOtherClients(pChild); others; others = others->next) {
@@ -115,6 +115,8 @@ TimeStamp currentTime;
 
 int defaultColorVisualClass = -1;
 int monitorResolution = 0;
+unsigned int glyphCacheSize = 8192;
+const char *fontPrewarmFile = NULL;
 
 Bool explicit_display = FALSE;
 char *ConnectionInfo;
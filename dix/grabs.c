@@ -321,14 +321,157 @@ CopyGrab(GrabPtr dst, const GrabPtr src)
     return TRUE;
 }
 
+#define GRAB_INDEX_MIN          16      /* grabs to have one */
+#define GRAB_INDEX_BUCKETS      256     /* by key or button, 0 for any */
+
+/*
+ * The passive grabs of a window by their detail, each bucket in list order.
+ * A grab of a key or button only matches events of that key or button, one
+ * of any key or button matches all of them, so that's two buckets to look
+ * at for an event instead of the whole list. Window managers and hotkey
+ * daemons grab hundreds of keys on the root window, with every combination
+ * of the lock modifiers, and every key press goes through them.
+ *
+ * Adding or deleting a grab marks the index stale, and it's rebuilt on the
+ * next lookup.
+ */
+typedef struct _PassiveGrabIndex {
+    Bool valid;
+    int start[GRAB_INDEX_BUCKETS + 2];  /* where each bucket starts */
+    PassiveGrabIndexEntry *entries;
+    int size;
+} PassiveGrabIndexRec, *PassiveGrabIndexPtr;
+
+static void
+PassiveGrabIndexInvalidate(WindowPtr pWin)
+{
+    if (pWin && wPassiveGrabIndex(pWin))
+        wPassiveGrabIndex(pWin)->valid = FALSE;
+}
+
+void
+PassiveGrabIndexFree(WindowPtr pWin)
+{
+    PassiveGrabIndexPtr idx = wPassiveGrabIndex(pWin);
+
+    if (idx) {
+        free(idx->entries);
+        free(idx);
+        pWin->optional->grabIndex = NULL;
+    }
+}
+
+/* (re)build the index of a window, FALSE leaves it to the list walk */
+static Bool
+PassiveGrabIndexBuild(WindowPtr pWin)
+{
+    PassiveGrabIndexPtr idx = wPassiveGrabIndex(pWin);
+    GrabPtr grab;
+    int n = 0;
+
+    memset(idx->start, 0, sizeof(idx->start));
+    for (grab = wPassiveGrabs(pWin); grab; grab = grab->next) {
+        idx->start[grab->detail.exact % GRAB_INDEX_BUCKETS + 2]++;
+        n++;
+    }
+
+    if (n < GRAB_INDEX_MIN) {
+        PassiveGrabIndexFree(pWin);
+        return FALSE;
+    }
+    if (n > idx->size) {
+        PassiveGrabIndexEntry *entries = reallocarray(idx->entries, n,
+                                                      sizeof(*entries));
+
+        if (!entries)
+            return FALSE;
+        idx->entries = entries;
+        idx->size = n;
+    }
+
+    /* filled in list order, with start[b + 1] where the next of b goes */
+    for (int b = 2; b < GRAB_INDEX_BUCKETS + 2; b++)
+        idx->start[b] += idx->start[b - 1];
+    n = 0;
+    for (grab = wPassiveGrabs(pWin); grab; grab = grab->next) {
+        int b = grab->detail.exact % GRAB_INDEX_BUCKETS;
+
+        idx->entries[idx->start[b + 1]++] = (PassiveGrabIndexEntry) {
+            .grab = grab, .pos = n++
+        };
+    }
+
+    idx->valid = TRUE;
+    return TRUE;
+}
+
+/* whether the window has enough passive grabs for an index */
+static inline Bool
+PassiveGrabIndexWanted(WindowPtr pWin)
+{
+    return wPassiveGrabCount(pWin) >= GRAB_INDEX_MIN;
+}
+
+void
+PassiveGrabsFirst(WindowPtr pWin, unsigned int detail, PassiveGrabIter *iter)
+{
+    PassiveGrabIndexPtr idx = wPassiveGrabIndex(pWin);
+    int b = detail % GRAB_INDEX_BUCKETS;
+
+    memset(iter, 0, sizeof(*iter));
+
+    if (detail != AnyKey) {
+        /* with passive grabs there is an optional record to hang it off */
+        if (!idx && PassiveGrabIndexWanted(pWin))
+            idx = pWin->optional->grabIndex =
+                calloc(1, sizeof(PassiveGrabIndexRec));
+        if (idx && !idx->valid && !PassiveGrabIndexBuild(pWin))
+            idx = wPassiveGrabIndex(pWin);
+    }
+
+    if (detail == AnyKey || !idx || !idx->valid) {
+        iter->next = wPassiveGrabs(pWin);
+        return;
+    }
+
+    iter->exact = idx->entries + idx->start[b];
+    iter->exactEnd = idx->entries + idx->start[b + 1];
+    if (b != 0) {
+        iter->any = idx->entries + idx->start[0];
+        iter->anyEnd = idx->entries + idx->start[1];
+    }
+}
+
+GrabPtr
+PassiveGrabsNext(PassiveGrabIter *iter)
+{
+    GrabPtr grab = iter->next;
+
+    if (grab) {
+        iter->next = grab->next;
+        return grab;
+    }
+
+    /* the two buckets merged back into list order */
+    if (iter->exact < iter->exactEnd &&
+        (iter->any == iter->anyEnd || iter->exact->pos < iter->any->pos))
+        return (iter->exact++)->grab;
+    if (iter->any < iter->anyEnd)
+        return (iter->any++)->grab;
+    return NULL;
+}
+
 int
 DeletePassiveGrab(void *value, XID id)
 {
     GrabPtr pGrab = (GrabPtr) value;
 
+    PassiveGrabIndexInvalidate(pGrab->window);
+
     /* it is OK if the grab isn't found */
     for (GrabPtr g = (wPassiveGrabs(pGrab->window)), prev = 0; g; g = g->next) {
         if (pGrab == g) {
+            pGrab->window->optional->passiveGrabCount--;
             if (prev)
                 prev->next = g->next;
             else if (!(pGrab->window->optional->passiveGrabs = g->next))
@@ -563,6 +706,8 @@ AddPassiveGrabToList(ClientPtr client, GrabPtr pGrab)
 
     pGrab->next = pGrab->window->optional->passiveGrabs;
     pGrab->window->optional->passiveGrabs = pGrab;
+    pGrab->window->optional->passiveGrabCount++;
+    PassiveGrabIndexInvalidate(pGrab->window);
     if (AddResource(pGrab->resource, X11_RESTYPE_PASSIVEGRAB, (void *) pGrab))
         return Success;
     return BadAlloc;
@@ -686,6 +831,8 @@ DeletePassiveGrabFromList(GrabPtr pMinuendGrab)
             GrabPtr grab = adds[j];
             grab->next = grab->window->optional->passiveGrabs;
             grab->window->optional->passiveGrabs = grab;
+            grab->window->optional->passiveGrabCount++;
+            PassiveGrabIndexInvalidate(grab->window);
         }
         for (int j = 0; j < nups; j++) {
             free(*updates[j]);
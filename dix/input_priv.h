@@ -372,6 +372,15 @@ int InputThreadRegisterDev(int fd,
 
 int InputThreadUnregisterDev(int fd);
 
+/*
+ * @brief time the input thread started the device read it's in
+ *
+ * Only meaningful with input_lock held.
+ *
+ * @return time in microseconds, 0 if no device read is going on
+ */
+CARD64 InputThreadReadTime(void);
+
 /*
  * @brief get current sprite cursor for input device
  *
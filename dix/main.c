@@ -232,6 +232,7 @@ dix_main(int argc, char *argv[], char *envp[])
         if (!SetDefaultFont("fixed")) {
             FatalError("could not open default font");
         }
+        PrewarmFonts();
 
         if (!(rootCursor = CreateRootCursor())) {
             FatalError("could not open default cursor font");
@@ -73,6 +73,208 @@ SOFTWARE.
  *
  *****************************************************************/
 
+/*
+ * Windows with many properties (the root window usually carries hundreds)
+ * get an atom keyed index on top of the property list. The list stays the
+ * authoritative storage, so its order is unchanged for ListProperties and
+ * RotateProperties.
+ *
+ * Each index slot points to the link (&pWin->properties or &prev->next)
+ * referencing the first property of that name, which makes both lookup
+ * and unlinking O(1). Several properties of the same name only exist with
+ * XACE polyinstantiation, those fall back to walking the list.
+ */
+
+#define PROPERTY_INDEX_MIN  16      /* build index when reaching this many */
+#define PROPERTY_INDEX_DROP 8       /* drop it again when falling below */
+
+typedef struct _PropertyIndexSlot {
+    Atom name;                  /* None if empty */
+    PropertyPtr *link;
+} PropertyIndexSlotRec, *PropertyIndexSlotPtr;
+
+typedef struct _PropertyIndex {
+    unsigned int count;         /* properties on the window */
+    unsigned int mask;
+    int shift;                  /* 32 - log2(number of slots) */
+    Bool duplicates;            /* some name appears more than once */
+    PropertyIndexSlotRec slots[];
+} PropertyIndexRec, *PropertyIndexPtr;
+
+static inline unsigned int
+PropertyIndexHome(PropertyIndexPtr idx, Atom name)
+{
+    return ((CARD32) name * 0x9e3779b1U) >> idx->shift;
+}
+
+static PropertyIndexSlotPtr
+PropertyIndexFind(PropertyIndexPtr idx, Atom name)
+{
+    for (unsigned int i = PropertyIndexHome(idx, name);
+         idx->slots[i].name != None; i = (i + 1) & idx->mask)
+        if (idx->slots[i].name == name)
+            return &idx->slots[i];
+    return NULL;
+}
+
+static void
+PropertyIndexInsert(PropertyIndexPtr idx, Atom name, PropertyPtr *link)
+{
+    unsigned int i;
+
+    for (i = PropertyIndexHome(idx, name); idx->slots[i].name != None;
+         i = (i + 1) & idx->mask)
+        ;
+    idx->slots[i].name = name;
+    idx->slots[i].link = link;
+}
+
+static void
+PropertyIndexRemove(PropertyIndexPtr idx, PropertyIndexSlotPtr slot)
+{
+    unsigned int i = slot - idx->slots;
+
+    /* backward shift, so probe sequences never need tombstones */
+    for (unsigned int j = (i + 1) & idx->mask; idx->slots[j].name != None;
+         j = (j + 1) & idx->mask) {
+        unsigned int home = PropertyIndexHome(idx, idx->slots[j].name);
+
+        if (((j - home) & idx->mask) >= ((j - i) & idx->mask)) {
+            idx->slots[i] = idx->slots[j];
+            i = j;
+        }
+    }
+    idx->slots[i].name = None;
+}
+
+/* (re)build the index of a window, failing just leaves it unindexed */
+static void
+PropertyIndexBuild(WindowPtr pWin)
+{
+    unsigned int count = 0, size = 32;
+    int shift = 32 - 5;
+    PropertyIndexPtr idx;
+
+    /* the index hangs off the optional record */
+    if (!MakeWindowOptional(pWin))
+        return;
+
+    for (PropertyPtr pProp = pWin->properties; pProp; pProp = pProp->next)
+        count++;
+
+    /* keep it at most half full */
+    while (size < 2 * (count + 1)) {
+        size <<= 1;
+        shift--;
+    }
+
+    idx = calloc(1, sizeof(PropertyIndexRec) + size * sizeof(PropertyIndexSlotRec));
+    if (idx) {
+        idx->mask = size - 1;
+        idx->shift = shift;
+    }
+
+    free(pWin->optional->propertyIndex);
+    pWin->optional->propertyIndex = idx;
+    if (!idx)
+        return;
+
+    for (PropertyPtr *link = &pWin->properties; *link; link = &(*link)->next) {
+        if (PropertyIndexFind(idx, (*link)->propertyName))
+            idx->duplicates = TRUE;
+        else
+            PropertyIndexInsert(idx, (*link)->propertyName, link);
+        idx->count++;
+    }
+}
+
+/* prepend a new property to the window's list */
+static void
+LinkProperty(WindowPtr pWin, PropertyPtr pProp)
+{
+    PropertyIndexPtr idx = wPropertyIndex(pWin);
+    PropertyIndexSlotPtr slot;
+    PropertyPtr head = pWin->properties;
+    unsigned int count = 1;
+
+    pProp->next = head;
+    pWin->properties = pProp;
+
+    if (!idx) {
+        while (head && count < PROPERTY_INDEX_MIN) {
+            head = head->next;
+            count++;
+        }
+        if (count >= PROPERTY_INDEX_MIN)
+            PropertyIndexBuild(pWin);
+        return;
+    }
+
+    if (head && (slot = PropertyIndexFind(idx, head->propertyName)) &&
+        slot->link == &pWin->properties)
+        slot->link = &pProp->next;
+
+    idx->count++;
+    if ((slot = PropertyIndexFind(idx, pProp->propertyName))) {
+        slot->link = &pWin->properties;
+        idx->duplicates = TRUE;
+    }
+    else if (2 * (idx->count + 1) > idx->mask + 1)
+        PropertyIndexBuild(pWin);
+    else
+        PropertyIndexInsert(idx, pProp->propertyName, &pWin->properties);
+}
+
+/* take a property out of the window's list, without freeing it */
+static void
+UnlinkProperty(WindowPtr pWin, PropertyPtr pProp)
+{
+    PropertyIndexPtr idx = wPropertyIndex(pWin);
+    PropertyIndexSlotPtr slot, next_slot;
+    PropertyPtr *link = &pWin->properties;
+    PropertyPtr next = pProp->next;
+    Bool first;
+
+    if (!idx) {
+        while (*link != pProp)
+            link = &(*link)->next;
+        *link = next;
+        if (!pWin->properties)
+            CheckWindowOptionalNeed(pWin);
+        return;
+    }
+
+    slot = PropertyIndexFind(idx, pProp->propertyName);
+    link = slot->link;
+    first = (*link == pProp);
+    while (*link != pProp)
+        link = &(*link)->next;
+    *link = next;
+
+    /* the next property is now referenced from pProp's old link */
+    if (next && (next_slot = PropertyIndexFind(idx, next->propertyName)) &&
+        next_slot->link == &pProp->next)
+        next_slot->link = link;
+
+    if (first) {
+        PropertyPtr *other = link;
+
+        if (idx->duplicates)
+            while (*other && (*other)->propertyName != pProp->propertyName)
+                other = &(*other)->next;
+
+        if (idx->duplicates && *other)
+            slot->link = other;
+        else
+            PropertyIndexRemove(idx, slot);
+    }
+
+    if (--idx->count < PROPERTY_INDEX_DROP) {
+        free(idx);
+        pWin->optional->propertyIndex = NULL;
+    }
+}
+
 #ifdef notdef
 static void
 PrintPropertys(WindowPtr pWin)
@@ -95,14 +297,22 @@ int
 dixLookupProperty(PropertyPtr *result, WindowPtr pWin, Atom propertyName,
                   ClientPtr client, Mask access_mode)
 {
+    PropertyIndexPtr idx = wPropertyIndex(pWin);
     PropertyPtr pProp;
     int rc = BadMatch;
 
     client->errorValue = propertyName;
 
-    for (pProp = pWin->properties; pProp; pProp = pProp->next)
-        if (pProp->propertyName == propertyName)
-            break;
+    if (idx) {
+        PropertyIndexSlotPtr slot = PropertyIndexFind(idx, propertyName);
+
+        pProp = slot ? *slot->link : NULL;
+    }
+    else {
+        for (pProp = pWin->properties; pProp; pProp = pProp->next)
+            if (pProp->propertyName == propertyName)
+                break;
+    }
 
     if (pProp)
         rc = XaceHookPropertyAccess(client, pWin, &pProp, access_mode);
@@ -361,8 +571,7 @@ dixChangeWindowProperty(ClientPtr pClient, WindowPtr pWin, Atom property,
             pClient->errorValue = property;
             return rc;
         }
-        pProp->next = pWin->properties;
-        pWin->properties = pProp;
+        LinkProperty(pWin, pProp);
     }
     else if (rc == Success) {
         /* To append or prepend to a property the request format and type
@@ -440,7 +649,7 @@ dixChangeWindowProperty(ClientPtr pClient, WindowPtr pWin, Atom property,
 int
 DeleteProperty(ClientPtr client, WindowPtr pWin, Atom propName)
 {
-    PropertyPtr pProp, prevProp;
+    PropertyPtr pProp;
     int rc;
 
     rc = dixLookupProperty(&pProp, pWin, propName, client, DixDestroyAccess);
@@ -448,18 +657,7 @@ DeleteProperty(ClientPtr client, WindowPtr pWin, Atom propName)
         return Success;         /* Succeed if property does not exist */
 
     if (rc == Success) {
-        if (pWin->properties == pProp) {
-            /* Takes care of head */
-            if (!(pWin->properties = pProp->next))
-                CheckWindowOptionalNeed(pWin);
-        }
-        else {
-            /* Need to traverse to find the previous element */
-            prevProp = pWin->properties;
-            while (prevProp->next != pProp)
-                prevProp = prevProp->next;
-            prevProp->next = pProp->next;
-        }
+        UnlinkProperty(pWin, pProp);
 
         deliverPropertyNotifyEvent(pWin, PropertyDelete, pProp);
         notifyVRRMode(client, pWin, PropertyDelete, pProp);
@@ -483,6 +681,10 @@ DeleteAllWindowProperties(WindowPtr pWin)
     }
 
     pWin->properties = NULL;
+    if (pWin->optional) {
+        free(pWin->optional->propertyIndex);
+        pWin->optional->propertyIndex = NULL;
+    }
 }
 
 /*****************
@@ -498,7 +700,7 @@ DeleteAllWindowProperties(WindowPtr pWin)
 int
 ProcGetProperty(ClientPtr client)
 {
-    PropertyPtr pProp, prevProp;
+    PropertyPtr pProp;
     unsigned long n, len, ind;
     int rc;
     Mask win_mode = DixGetPropAccess, prop_mode = DixReadAccess;
@@ -618,18 +820,7 @@ ProcGetProperty(ClientPtr client)
 
     if (p.delete && (rep.bytesAfter == 0)) {
         /* Delete the Property */
-        if (pWin->properties == pProp) {
-            /* Takes care of head */
-            if (!(pWin->properties = pProp->next))
-                CheckWindowOptionalNeed(pWin);
-        }
-        else {
-            /* Need to traverse to find the previous element */
-            prevProp = pWin->properties;
-            while (prevProp->next != pProp)
-                prevProp = prevProp->next;
-            prevProp->next = pProp->next;
-        }
+        UnlinkProperty(pWin, pProp);
 
         free(pProp->data);
         dixFreeObjectWithPrivates(pProp, PRIVATE_PROPERTY);
@@ -648,8 +839,7 @@ ProcGetProperty(ClientPtr client)
     }
 
     WriteToClient(client, sizeof(rep), &rep);
-    WriteToClient(client, len, payload);
-    free(payload);
+    WriteToClientBuffer(client, len, payload, free);
     return Success;
 }
 
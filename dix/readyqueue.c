@@ -0,0 +1,406 @@
+/* SPDX-License-Identifier: MIT OR X11
+ *
+ * Priority indexed queue of clients ready to run, backing the smart scheduler
+ */
+#include <dix-config.h>
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "dix/dixstruct_priv.h"
+#include "dix/readyqueue_priv.h"
+#include "include/dix.h"
+#include "include/list.h"
+
+#define READY_SMART_LEVELS  (SMART_MAX_PRIORITY - SMART_MIN_PRIORITY + 1)
+#define READY_WORDS         ((MAXCLIENTS + 63) / 64)
+
+/* round-robin only looks at the low 8 bits of the client index */
+#define READY_ROBIN_SLOTS   256
+#define READY_ROBIN_WORDS   (READY_ROBIN_SLOTS / 64)
+
+typedef struct _ReadyBucket {
+    int count;
+    uint64_t clients[READY_WORDS];  /* bitmap of client indices */
+} ReadyBucketRec, *ReadyBucketPtr;
+
+typedef struct _ReadyLevel {
+    struct xorg_list entry;     /* in ready_levels, highest priority first */
+    int priority;               /* client->priority of all clients in here */
+    int count;
+    uint64_t nonempty;          /* bit n set when buckets[n].count != 0 */
+    ReadyBucketRec buckets[READY_SMART_LEVELS];
+} ReadyLevelRec, *ReadyLevelPtr;
+
+/* where a client has been filed, indexed by client->index */
+typedef struct _ReadyClient {
+    ReadyLevelPtr level;        /* NULL if not queued */
+    int bucket;
+    int stop_tick;
+    int heap_index;             /* position in aging heap, -1 if not there */
+} ReadyClientRec, *ReadyClientPtr;
+
+static ReadyClientRec ready_clients[MAXCLIENTS];
+
+/* priority 0 is by far the most common one, so never free it */
+static ReadyLevelRec default_level;
+static struct xorg_list ready_levels;
+static int ready_count;
+
+/*
+ * Clients with negative smart priority, as min-heap on their stop tick.
+ * The ones which have been idle long enough to get praised are always
+ * a subtree at the top of the heap.
+ */
+static short aging_heap[MAXCLIENTS];
+static int aging_size;
+static short aging_scratch[MAXCLIENTS];
+
+static inline Bool
+tick_before(int a, int b)
+{
+    return (int) ((unsigned int) a - (unsigned int) b) < 0;
+}
+
+static inline int
+highest_bit(uint64_t word)
+{
+#if __has_builtin(__builtin_clzll)
+    return 63 - __builtin_clzll(word);
+#else
+    int bit = 0;
+
+    while (word >>= 1)
+        bit++;
+    return bit;
+#endif
+}
+
+static void
+aging_heap_set(int pos, short idx)
+{
+    aging_heap[pos] = idx;
+    ready_clients[idx].heap_index = pos;
+}
+
+static void
+aging_heap_sift_up(int pos)
+{
+    short idx = aging_heap[pos];
+    int tick = ready_clients[idx].stop_tick;
+
+    while (pos > 0) {
+        int parent = (pos - 1) / 2;
+
+        if (!tick_before(tick, ready_clients[aging_heap[parent]].stop_tick))
+            break;
+        aging_heap_set(pos, aging_heap[parent]);
+        pos = parent;
+    }
+    aging_heap_set(pos, idx);
+}
+
+static void
+aging_heap_sift_down(int pos)
+{
+    short idx = aging_heap[pos];
+    int tick = ready_clients[idx].stop_tick;
+
+    for (;;) {
+        int child = 2 * pos + 1;
+
+        if (child >= aging_size)
+            break;
+        if (child + 1 < aging_size &&
+            tick_before(ready_clients[aging_heap[child + 1]].stop_tick,
+                        ready_clients[aging_heap[child]].stop_tick))
+            child++;
+        if (!tick_before(ready_clients[aging_heap[child]].stop_tick, tick))
+            break;
+        aging_heap_set(pos, aging_heap[child]);
+        pos = child;
+    }
+    aging_heap_set(pos, idx);
+}
+
+static void
+aging_heap_insert(short idx)
+{
+    aging_heap_set(aging_size++, idx);
+    aging_heap_sift_up(aging_size - 1);
+}
+
+static void
+aging_heap_remove(short idx)
+{
+    int pos = ready_clients[idx].heap_index;
+    short moved;
+
+    ready_clients[idx].heap_index = -1;
+    if (--aging_size == pos)
+        return;
+
+    moved = aging_heap[aging_size];
+    aging_heap_set(pos, moved);
+    aging_heap_sift_up(pos);
+    aging_heap_sift_down(ready_clients[moved].heap_index);
+}
+
+static ReadyLevelPtr
+ready_level_get(int priority)
+{
+    ReadyLevelPtr level, new;
+
+    if (priority == default_level.priority) {
+        if (xorg_list_is_empty(&default_level.entry))
+            goto insert;
+        return &default_level;
+    }
+
+    xorg_list_for_each_entry(level, &ready_levels, entry) {
+        if (level->priority == priority)
+            return level;
+        if (level->priority < priority)
+            break;
+    }
+
+    new = calloc(1, sizeof(ReadyLevelRec));
+    if (!new) {
+        /* rather lose priority ordering than a ready client */
+        priority = default_level.priority;
+        if (xorg_list_is_empty(&default_level.entry))
+            goto insert;
+        return &default_level;
+    }
+    new->priority = priority;
+    xorg_list_append(&new->entry, &level->entry);
+    return new;
+
+insert:
+    /* link default level in front of the first lower priority one */
+    xorg_list_for_each_entry(level, &ready_levels, entry) {
+        if (level->priority < priority)
+            break;
+    }
+    xorg_list_append(&default_level.entry, &level->entry);
+    return &default_level;
+}
+
+static void
+ready_level_put(ReadyLevelPtr level)
+{
+    if (level->count)
+        return;
+
+    xorg_list_del(&level->entry);
+    if (level != &default_level)
+        free(level);
+}
+
+static void
+ready_queue_file(ClientPtr client)
+{
+    ReadyClientPtr rc = &ready_clients[client->index];
+    ReadyLevelPtr level = ready_level_get(client->priority);
+    int bucket = client->smart_priority - SMART_MIN_PRIORITY;
+    ReadyBucketPtr b = &level->buckets[bucket];
+
+    rc->level = level;
+    rc->bucket = bucket;
+    rc->stop_tick = client->smart_stop_tick;
+
+    b->clients[client->index / 64] |= (uint64_t) 1 << (client->index % 64);
+    b->count++;
+    level->nonempty |= (uint64_t) 1 << bucket;
+    level->count++;
+    ready_count++;
+
+    if (client->smart_priority < 0)
+        aging_heap_insert(client->index);
+}
+
+static void
+ready_queue_unfile(ClientPtr client)
+{
+    ReadyClientPtr rc = &ready_clients[client->index];
+    ReadyLevelPtr level = rc->level;
+    ReadyBucketPtr b = &level->buckets[rc->bucket];
+
+    b->clients[client->index / 64] &= ~((uint64_t) 1 << (client->index % 64));
+    if (--b->count == 0)
+        level->nonempty &= ~((uint64_t) 1 << rc->bucket);
+    level->count--;
+    ready_count--;
+
+    if (rc->heap_index >= 0)
+        aging_heap_remove(client->index);
+
+    rc->level = NULL;
+    ready_level_put(level);
+}
+
+void
+ready_queue_init(void)
+{
+    ReadyLevelPtr level, tmp;
+
+    if (ready_levels.next) {
+        xorg_list_for_each_entry_safe(level, tmp, &ready_levels, entry) {
+            xorg_list_del(&level->entry);
+            if (level != &default_level)
+                free(level);
+        }
+    }
+
+    memset(&default_level, 0, sizeof(default_level));
+    xorg_list_init(&default_level.entry);
+    xorg_list_init(&ready_levels);
+
+    memset(ready_clients, 0, sizeof(ready_clients));
+    for (int i = 0; i < MAXCLIENTS; i++)
+        ready_clients[i].heap_index = -1;
+
+    ready_count = 0;
+    aging_size = 0;
+}
+
+void
+ready_queue_add(ClientPtr client)
+{
+    if (ready_clients[client->index].level)
+        return;
+
+    ready_queue_file(client);
+}
+
+void
+ready_queue_remove(ClientPtr client)
+{
+    if (!ready_clients[client->index].level)
+        return;
+
+    ready_queue_unfile(client);
+}
+
+void
+ready_queue_update(ClientPtr client)
+{
+    ReadyClientPtr rc = &ready_clients[client->index];
+
+    if (!rc->level)
+        return;
+
+    if (rc->level->priority == client->priority &&
+        rc->bucket == client->smart_priority - SMART_MIN_PRIORITY &&
+        rc->stop_tick == client->smart_stop_tick)
+        return;
+
+    ready_queue_unfile(client);
+    ready_queue_file(client);
+}
+
+int
+ready_queue_count(void)
+{
+    return ready_count;
+}
+
+/* praise clients which haven't run in a while */
+static void
+ready_queue_age(long now, long idle)
+{
+    int stack_size = 0, naged = 0;
+    int threshold = (int) (now - idle);
+
+    if (!aging_size ||
+        tick_before(threshold, ready_clients[aging_heap[0]].stop_tick))
+        return;
+
+    /*
+     * collect the stale subtree first, re-filing moves clients around
+     * in the heap. aging_scratch holds the DFS stack at the front and
+     * the collected clients at the back, both together never exceed
+     * the heap size.
+     */
+    aging_scratch[stack_size++] = 0;
+    while (stack_size) {
+        int pos = aging_scratch[--stack_size];
+        short idx = aging_heap[pos];
+
+        if (tick_before(threshold, ready_clients[idx].stop_tick))
+            continue;
+
+        aging_scratch[MAXCLIENTS - 1 - naged++] = idx;
+        if (2 * pos + 1 < aging_size)
+            aging_scratch[stack_size++] = 2 * pos + 1;
+        if (2 * pos + 2 < aging_size)
+            aging_scratch[stack_size++] = 2 * pos + 2;
+    }
+
+    while (naged) {
+        ClientPtr client = clients[aging_scratch[MAXCLIENTS - naged--]];
+
+        if (client->smart_priority < 0)
+            client->smart_priority++;
+        ready_queue_update(client);
+    }
+}
+
+/* highest set bit in a 256 bit map below `limit`, or -1 if none */
+static int
+robin_highest_below(const uint64_t *map, int limit)
+{
+    for (int w = (limit - 1) / 64; w >= 0 && limit > 0; w--) {
+        uint64_t word = map[w];
+
+        if (limit < (w + 1) * 64)
+            word &= ((uint64_t) 1 << (limit % 64)) - 1;
+        if (word)
+            return w * 64 + highest_bit(word);
+    }
+    return -1;
+}
+
+static ClientPtr
+ready_bucket_pick(ReadyBucketPtr b, int last)
+{
+    uint64_t slots[READY_ROBIN_WORDS] = { 0 };
+    int slot;
+
+    for (int w = 0; w < READY_WORDS; w++)
+        slots[w % READY_ROBIN_WORDS] |= b->clients[w];
+
+    /*
+     * robin = (index - last) & 0xff, so the highest robin is found just
+     * below the last picked slot, wrapping around to the top.
+     */
+    slot = robin_highest_below(slots, last & 0xff);
+    if (slot < 0)
+        slot = robin_highest_below(slots, READY_ROBIN_SLOTS);
+
+    /* several clients may share the slot, take the lowest index one */
+    for (int w = slot / 64; w < READY_WORDS; w += READY_ROBIN_WORDS) {
+        if (b->clients[w] & ((uint64_t) 1 << (slot % 64)))
+            return clients[w * 64 + slot % 64];
+    }
+    return NULL;
+}
+
+ClientPtr
+ready_queue_select(long now, long idle, const int *last_index)
+{
+    ReadyLevelPtr level;
+    int bucket;
+
+    if (!ready_count)
+        return NULL;
+
+    ready_queue_age(now, idle);
+
+    /* empty levels are unlinked, so the first one is the best one */
+    level = xorg_list_first_entry(&ready_levels, ReadyLevelRec, entry);
+    bucket = highest_bit(level->nonempty);
+
+    return ready_bucket_pick(&level->buckets[bucket], last_index[bucket]);
+}
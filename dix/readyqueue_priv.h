@@ -0,0 +1,73 @@
+/* SPDX-License-Identifier: MIT OR X11
+ *
+ * Priority indexed queue of clients ready to run, backing the smart scheduler
+ */
+#ifndef _XSERVER_DIX_READYQUEUE_PRIV_H
+#define _XSERVER_DIX_READYQUEUE_PRIV_H
+
+#include "include/dixstruct.h"
+
+/*
+ * The ready queue files each ready client under its sync priority
+ * (client->priority) and smart scheduler priority (client->smart_priority),
+ * so selecting the next client to run doesn't need to look at every ready
+ * client. Selection implements exactly the rules of the old linear scan:
+ *
+ *   - ready clients with negative smart priority which haven't run for
+ *     `idle` ticks get their smart priority raised by one per selection
+ *   - highest sync priority wins, then highest smart priority
+ *   - within the same priorities, clients are picked round-robin relative
+ *     to the last picked client index of that smart priority
+ *
+ * Whenever client->priority, client->smart_priority or
+ * client->smart_stop_tick change for a queued client, ready_queue_update()
+ * must be called so the client gets filed in the right place.
+ */
+
+/*
+ * drop all queued clients and reset to initial state.
+ */
+void ready_queue_init(void);
+
+/*
+ * add client to the ready queue. no-op if it's already queued.
+ *
+ * @param client    the client which became ready
+ */
+void ready_queue_add(ClientPtr client)
+    _X_ATTRIBUTE_NONNULL_ARG(1);
+
+/*
+ * remove client from the ready queue. no-op if it isn't queued.
+ *
+ * @param client    the client which isn't ready anymore
+ */
+void ready_queue_remove(ClientPtr client)
+    _X_ATTRIBUTE_NONNULL_ARG(1);
+
+/*
+ * re-file a queued client after its priorities or stop tick changed.
+ * no-op if the client isn't queued.
+ *
+ * @param client    the client whose scheduling attributes changed
+ */
+void ready_queue_update(ClientPtr client)
+    _X_ATTRIBUTE_NONNULL_ARG(1);
+
+/*
+ * @return          number of clients currently in the ready queue
+ */
+int ready_queue_count(void);
+
+/*
+ * age idle clients and pick the best client to run next.
+ *
+ * @param now           current scheduler time (SmartScheduleTime)
+ * @param idle          ticks after which a waiting client gets praised
+ * @param last_index    last picked client index, per smart priority
+ * @return              the client to run next, NULL if queue is empty
+ */
+ClientPtr ready_queue_select(long now, long idle, const int *last_index)
+    _X_ATTRIBUTE_NONNULL_ARG(3);
+
+#endif /* _XSERVER_DIX_READYQUEUE_PRIV_H */
@@ -105,8 +105,8 @@ Equipment Corporation.
  *      A resource ID is a 32 bit quantity, the upper 2 bits of which are
  *	off-limits for client-visible resources.  The next 8 bits are
  *      used as client ID, and the low 22 bits come from the client.
- *	A resource ID is "hashed" by extracting and xoring subfields
- *      (varying with the size of the hash table).
+ *	A resource ID is hashed multiplicatively into a per-client open
+ *      addressed table (see ClientResourceRec below).
  *
  *      It is sometimes necessary for the server to create an ID that looks
  *      like it belongs to a client.  This ID, however,  must not be one
@@ -144,6 +144,8 @@ Equipment Corporation.
 #include "cursor.h"
 #include "xace.h"
 #include <assert.h>
+#include <limits.h>
+#include <stdint.h>
 #include "gcstruct.h"
 
 #ifdef XSERVER_DTRACE
@@ -151,27 +153,66 @@ Equipment Corporation.
 #define TypeNameString(t) LookupResourceName(t)
 #endif
 
-static void RebuildTable(int    /*client */
-    );
-
 #define SERVER_MINID 32
 
-#define INITBUCKETS 64
+/*
+ * Each client's resources live in an open addressed hash table (linear
+ * probing) with the id, type and value inline in the slots, so lookups
+ * don't have to chase pointers. The table is kept at most half full.
+ *
+ * Several resources may share an id. They are kept in the opposite order
+ * they were added along the probe sequence of the id, so lookups return
+ * the first match, and resources sharing an id still shadow and get freed
+ * newest first, like with the old hash chains.
+ *
+ * Growing doesn't rehash everything at once: a new table is allocated
+ * and the old one is drained a few slots at a time by subsequent
+ * AddResource/FreeResource calls. Until then, lookups check both, the new
+ * one first.
+ *
+ * Slots never move while something walks the table (iterating != 0),
+ * so resource callbacks may add and free resources while we're walking.
+ * Resources added then which would make slots move, because the table is
+ * full or they share an id with one in front of their slot, go to a stack
+ * of deferred tables instead. Those are walked and looked up too, newest
+ * first and before the table, and never rehashed: when the top one fills
+ * up, a bigger one is pushed. The table takes them in, with the grow it
+ * put off, once the outermost walk is done.
+ */
+
+#define INITSLOTS 64
 #define INITHASHSIZE 6
-#define MAXHASHSIZE 16
+
+/* old table slots moved over per add/free while growing */
+#define RESOURCE_MIGRATE_STEP 8
+
+/* slot states, kept in the type, which no resource has */
+#define RESOURCE_SLOT_EMPTY   X11_RESTYPE_NONE
+#define RESOURCE_SLOT_DELETED RC_ANY
 
 typedef struct _Resource {
-    struct _Resource *next;
     XID id;
-    RESTYPE type;
+    RESTYPE type;               /* or RESOURCE_SLOT_* */
     void *value;
 } ResourceRec, *ResourcePtr;
 
+typedef struct _DeferredResources {
+    struct _DeferredResources *older;
+    int hashsize;
+    int used;
+    ResourceRec slots[];
+} DeferredResourcesRec, *DeferredResourcesPtr;
+
 typedef struct _ClientResource {
-    ResourcePtr *resources;
-    int elements;
-    int buckets;
-    int hashsize;               /* log(2)(buckets) */
+    ResourcePtr slots;          /* NULL if client not in use */
+    int hashsize;               /* log(2)(number of slots) */
+    int used;                   /* live + deleted slots in slots */
+    int elements;               /* live resources, in all tables */
+    ResourcePtr old_slots;      /* table still being drained, or NULL */
+    int old_hashsize;
+    int migrated;               /* old_slots below this are drained */
+    int iterating;              /* > 0 while walking, no slot moves then */
+    DeferredResourcesPtr deferred;      /* added while walking, newest first */
     XID fakeID;
     XID endFakeID;
 } ClientResourceRec;
@@ -654,12 +695,11 @@ InitClientResources(ClientPtr client)
             return FALSE;
         memcpy(resourceTypes, predefTypes, sizeof(predefTypes));
     }
-    clientTable[i = client->index].resources =
-        calloc(INITBUCKETS, sizeof(ResourcePtr));
-    if (!clientTable[i].resources)
+    i = client->index;
+    memset(&clientTable[i], 0, sizeof(ClientResourceRec));
+    clientTable[i].slots = calloc(INITSLOTS, sizeof(ResourceRec));
+    if (!clientTable[i].slots)
         return FALSE;
-    clientTable[i].buckets = INITBUCKETS;
-    clientTable[i].elements = 0;
     clientTable[i].hashsize = INITHASHSIZE;
     /* Many IDs allocated from the server client are visible to clients,
      * so we don't use the SERVER_BIT for them, but we have to start
@@ -669,9 +709,6 @@ InitClientResources(ClientPtr client)
     clientTable[i].fakeID = client->clientAsMask |
         (client->index ? SERVER_BIT : SERVER_MINID);
     clientTable[i].endFakeID = (clientTable[i].fakeID | RESOURCE_ID_MASK) + 1;
-    for (int j = 0; j < INITBUCKETS; j++) {
-        clientTable[i].resources[j] = NULL;
-    }
     return TRUE;
 }
 
@@ -688,18 +725,384 @@ HashResourceID(XID id, unsigned int numBits)
     return (id ^ (id >> numBits)) & ~((~0U) << numBits);
 }
 
-static XID
-AvailableID(int client, XID id, XID maxid, XID goodid)
+/*
+ * Only even slots are home slots. XIDs are mostly handed out sequentially,
+ * so a client's resources fill the table front to back, without touching
+ * more cache lines and pages than needed, and as it is at most half full,
+ * the odd slots in between keep runs of occupied slots short. Without
+ * them, sequential ids would form one long run, and lookups of ids that
+ * aren't there always probe up to an empty slot.
+ */
+static inline unsigned int
+ResourceSlot(XID id, int hashsize)
+{
+    return HashResourceID(id, hashsize - 1) << 1;
+}
+
+static inline Bool
+ResourceSlotLive(const ResourceRec *res)
+{
+    return res->type != RESOURCE_SLOT_EMPTY &&
+        res->type != RESOURCE_SLOT_DELETED;
+}
+
+typedef enum {
+    MATCH_ID,                   /* any resource with that id */
+    MATCH_TYPE,                 /* resource type equal */
+    MATCH_CLASS,                /* resource type has any of the class bits */
+} ResourceMatch;
+
+static inline Bool
+ResourceMatches(const ResourceRec *res, RESTYPE type, ResourceMatch match)
+{
+    switch (match) {
+    case MATCH_TYPE:
+        return res->type == type;
+    case MATCH_CLASS:
+        return (res->type & type) != 0;
+    default:
+        return TRUE;
+    }
+}
+
+/* newest matching resource in a table, the first one on the way */
+static ResourcePtr
+FindResourceInSlots(ResourcePtr slots, int hashsize, XID id,
+                    RESTYPE type, ResourceMatch match)
+{
+    unsigned int mask = (1U << hashsize) - 1;
+
+    for (unsigned int i = ResourceSlot(id, hashsize); ; i = (i + 1) & mask) {
+        ResourcePtr res = &slots[i];
+
+        if (res->type == RESOURCE_SLOT_EMPTY)
+            return NULL;
+        if (res->id == id && ResourceSlotLive(res) &&
+            ResourceMatches(res, type, match))
+            return res;
+    }
+}
+
+/* the most recently added resource matching id and type */
+static ResourcePtr
+FindResource(ClientResourceRec *rrec, XID id, RESTYPE type, ResourceMatch match)
 {
     ResourcePtr res;
 
+    for (DeferredResourcesPtr d = rrec->deferred; d; d = d->older)
+        if ((res = FindResourceInSlots(d->slots, d->hashsize, id, type, match)))
+            return res;
+
+    res = FindResourceInSlots(rrec->slots, rrec->hashsize, id, type, match);
+    if (!res && rrec->old_slots)
+        res = FindResourceInSlots(rrec->old_slots, rrec->old_hashsize,
+                                  id, type, match);
+    return res;
+}
+
+/*
+ * Add a resource in front of all with the same id: into the first free
+ * slot on the way, where the ones in front of that shift one down along
+ * the way. Returns FALSE, with nothing changed, if that would move slots
+ * and move isn't set.
+ */
+static Bool
+InsertNewest(ResourcePtr slots, int hashsize, int *used, Bool move,
+             const ResourceRec *add)
+{
+    unsigned int mask = (1U << hashsize) - 1;
+    unsigned int i = ResourceSlot(add->id, hashsize);
+    ResourceRec carry = *add;
+
+    for (; ResourceSlotLive(&slots[i]); i = (i + 1) & mask) {
+        if (slots[i].id == add->id) {
+            ResourceRec older = slots[i];
+
+            if (!move)
+                return FALSE;
+            slots[i] = carry;
+            carry = older;
+        }
+    }
+
+    if (slots[i].type == RESOURCE_SLOT_EMPTY)
+        (*used)++;
+    slots[i] = carry;
+    return TRUE;
+}
+
+/* Add a resource behind all with the same id. */
+static void
+InsertOldest(ResourcePtr slots, int hashsize, int *used, const ResourceRec *add)
+{
+    unsigned int mask = (1U << hashsize) - 1;
+    unsigned int i = ResourceSlot(add->id, hashsize), last = i;
+
+    for (; slots[i].type != RESOURCE_SLOT_EMPTY; i = (i + 1) & mask)
+        if (slots[i].id == add->id && ResourceSlotLive(&slots[i]))
+            last = (i + 1) & mask;
+
+    for (i = last; ResourceSlotLive(&slots[i]); i = (i + 1) & mask);
+
+    if (slots[i].type == RESOURCE_SLOT_EMPTY)
+        (*used)++;
+    slots[i] = *add;
+}
+
+static inline Bool
+ResourceTableFull(int used, int hashsize)
+{
+    return 2 * (used + 1) > (1 << hashsize);
+}
+
+/*
+ * Keep a resource aside, in the top deferred table, or a new one if it's
+ * full or slots would move there.
+ */
+static Bool
+DeferResource(ClientResourceRec *rrec, const ResourceRec *add)
+{
+    DeferredResourcesPtr top = rrec->deferred;
+    int hashsize;
+
+    if (top && !ResourceTableFull(top->used, top->hashsize) &&
+        InsertNewest(top->slots, top->hashsize, &top->used, !rrec->iterating,
+                     add))
+        return TRUE;
+
+    hashsize = !top ? INITHASHSIZE :
+        top->hashsize + ResourceTableFull(top->used, top->hashsize);
+    top = calloc(1, sizeof(DeferredResourcesRec) +
+                 sizeof(ResourceRec) * (1 << hashsize));
+    if (!top)
+        return FALSE;
+    top->hashsize = hashsize;
+    top->older = rrec->deferred;
+    rrec->deferred = top;
+    InsertNewest(top->slots, top->hashsize, &top->used, FALSE, add);
+    return TRUE;
+}
+
+/*
+ * Move up to count slots from the old table over to the current one.
+ * When not growing, the old table is as big or bigger, so drain it
+ * proportionally faster to be done before the new table fills up.
+ */
+static inline int
+MigrateStep(ClientResourceRec *rrec)
+{
+    int ratio = rrec->old_hashsize - rrec->hashsize;
+
+    return RESOURCE_MIGRATE_STEP << (ratio >= 0 ? ratio + 1 : 0);
+}
+
+static void
+MigrateResources(ClientResourceRec *rrec, int count)
+{
+    unsigned int old_mask;
+
+    if (!rrec->old_slots || rrec->iterating)
+        return;
+
+    old_mask = (1U << rrec->old_hashsize) - 1;
+    while (count > 0 && rrec->migrated <= old_mask) {
+        ResourcePtr res = &rrec->old_slots[rrec->migrated];
+        XID id = res->id;
+
+        if (!ResourceSlotLive(res)) {
+            rrec->migrated++;
+            count--;
+            continue;
+        }
+
+        /* all with the same id, newest first, each behind the one before,
+         * and behind any added to the new table since */
+        for (unsigned int i = ResourceSlot(id, rrec->old_hashsize);
+             rrec->old_slots[i].type != RESOURCE_SLOT_EMPTY;
+             i = (i + 1) & old_mask) {
+            res = &rrec->old_slots[i];
+            if (res->id != id || !ResourceSlotLive(res))
+                continue;
+            if (rrec->used + 1 >= (1 << rrec->hashsize))
+                return;
+            InsertOldest(rrec->slots, rrec->hashsize, &rrec->used, res);
+            /* keep probe chains of not yet drained slots intact */
+            res->type = RESOURCE_SLOT_DELETED;
+            count--;
+        }
+    }
+
+    if (rrec->migrated > old_mask) {
+        free(rrec->old_slots);
+        rrec->old_slots = NULL;
+    }
+}
+
+/*
+ * Start moving to a fresh table sized for the current element count.
+ * That's growing in most cases, but also gets rid of deleted slots.
+ */
+static Bool
+ResizeResources(ClientResourceRec *rrec)
+{
+    int hashsize = INITHASHSIZE;
+    ResourcePtr slots;
+
+    /* previous resize should be long done, but just in case */
+    MigrateResources(rrec, INT_MAX);
+    if (rrec->old_slots)
+        return FALSE;
+
+    /* at most 40% full afterwards, so the old table drains in time */
+    while ((1 << hashsize) < 5 * (rrec->elements + 1) / 2)
+        hashsize++;
+
+    slots = calloc(1 << hashsize, sizeof(ResourceRec));
+    if (!slots)
+        return FALSE;
+
+    rrec->old_slots = rrec->slots;
+    rrec->old_hashsize = rrec->hashsize;
+    rrec->migrated = 0;
+    rrec->slots = slots;
+    rrec->hashsize = hashsize;
+    rrec->used = 0;
+    return TRUE;
+}
+
+static void
+RemoveResourceSlot(ClientResourceRec *rrec, ResourcePtr res)
+{
+    res->type = RESOURCE_SLOT_DELETED;
+    rrec->elements--;
+}
+
+/*
+ * Take in the deferred tables, oldest first, growing the table as needed.
+ * Each id's resources go in oldest first, each in front of the ones before.
+ * Whatever doesn't fit for lack of memory stays deferred, where lookups
+ * still find it, and new resources keep going there meanwhile.
+ */
+static void
+TakeDeferredResources(ClientResourceRec *rrec)
+{
+    while (rrec->deferred) {
+        DeferredResourcesPtr *link = &rrec->deferred, d;
+        unsigned int mask;
+
+        while ((*link)->older)
+            link = &(*link)->older;
+        d = *link;
+        mask = (1U << d->hashsize) - 1;
+
+        for (unsigned int s = 0; s <= mask; s++) {
+            XID id = d->slots[s].id;
+
+            if (!ResourceSlotLive(&d->slots[s]))
+                continue;
+
+            for (;;) {
+                ResourcePtr last = NULL;
+
+                for (unsigned int i = ResourceSlot(id, d->hashsize);
+                     d->slots[i].type != RESOURCE_SLOT_EMPTY;
+                     i = (i + 1) & mask)
+                    if (d->slots[i].id == id && ResourceSlotLive(&d->slots[i]))
+                        last = &d->slots[i];
+                if (!last)
+                    break;
+
+                if (ResourceTableFull(rrec->used, rrec->hashsize))
+                    ResizeResources(rrec);
+                if (rrec->used + 1 >= (1 << rrec->hashsize))
+                    return;
+                InsertNewest(rrec->slots, rrec->hashsize, &rrec->used, TRUE,
+                             last);
+                last->type = RESOURCE_SLOT_DELETED;
+            }
+        }
+
+        *link = NULL;
+        free(d);
+    }
+}
+
+/* Done walking. After the outermost walk, take in the deferred tables. */
+static void
+EndResourceWalk(ClientResourceRec *rrec)
+{
+    if (--rrec->iterating == 0)
+        TakeDeferredResources(rrec);
+}
+
+/*
+ * Walks all live slots of a client: in the old table, the table and the
+ * deferred tables. Callers which may run arbitrary code per resource must
+ * bracket the walk with rrec->iterating++ and EndResourceWalk(), so slots
+ * stay where they are.
+ */
+typedef struct {
+    ClientResourceRec *rrec;
+    enum { ITER_OLD, ITER_TABLE, ITER_DEFERRED } table;
+    DeferredResourcesPtr deferred;
+    int pos;
+} ResourceIter;
+
+static void
+ResourceIterInit(ResourceIter *iter, ClientResourceRec *rrec)
+{
+    iter->rrec = rrec;
+    iter->table = rrec->old_slots ? ITER_OLD : ITER_TABLE;
+    iter->deferred = NULL;
+    iter->pos = rrec->old_slots ? rrec->migrated : 0;
+}
+
+static ResourcePtr
+ResourceIterNext(ResourceIter *iter)
+{
+    ClientResourceRec *rrec = iter->rrec;
+
+    switch (iter->table) {
+    case ITER_OLD:
+        for (; iter->pos < (1 << rrec->old_hashsize); iter->pos++) {
+            if (ResourceSlotLive(&rrec->old_slots[iter->pos]))
+                return &rrec->old_slots[iter->pos++];
+        }
+        iter->table = ITER_TABLE;
+        iter->pos = 0;
+        /* fall through */
+    case ITER_TABLE:
+        if (!rrec->slots)
+            return NULL;
+        for (; iter->pos < (1 << rrec->hashsize); iter->pos++) {
+            if (ResourceSlotLive(&rrec->slots[iter->pos]))
+                return &rrec->slots[iter->pos++];
+        }
+        iter->table = ITER_DEFERRED;
+        iter->deferred = rrec->deferred;
+        iter->pos = 0;
+        /* fall through */
+    case ITER_DEFERRED:
+        for (; iter->deferred; iter->deferred = iter->deferred->older,
+             iter->pos = 0) {
+            DeferredResourcesPtr d = iter->deferred;
+
+            for (; iter->pos < (1 << d->hashsize); iter->pos++) {
+                if (ResourceSlotLive(&d->slots[iter->pos]))
+                    return &d->slots[iter->pos++];
+            }
+        }
+    }
+    return NULL;
+}
+
+static XID
+AvailableID(int client, XID id, XID maxid, XID goodid)
+{
     if ((goodid >= id) && (goodid <= maxid))
         return goodid;
     for (; id <= maxid; id++) {
-        res = clientTable[client].resources[HashResourceID(id, clientTable[client].hashsize)];
-        while (res && (res->id != id))
-            res = res->next;
-        if (!res)
+        if (!FindResource(&clientTable[client], id, X11_RESTYPE_NONE, MATCH_ID))
             return id;
     }
     return 0;
@@ -710,24 +1113,24 @@ GetXIDRange(int client, Bool server, XID *minp, XID *maxp)
 {
     XID id, maxid;
     XID goodid;
+    ResourceIter iter;
+    ResourcePtr res;
 
     id = (Mask) client << CLIENTOFFSET;
     if (server)
         id |= client ? SERVER_BIT : SERVER_MINID;
     maxid = id | RESOURCE_ID_MASK;
     goodid = 0;
-    ResourcePtr *resp = clientTable[client].resources;
-    for (int i = clientTable[client].buckets; --i >= 0;) {
-        for (ResourcePtr res = *resp++; res; res = res->next) {
-            if ((res->id < id) || (res->id > maxid))
-                continue;
-            if (((res->id - id) >= (maxid - res->id)) ?
-                (goodid = AvailableID(client, id, res->id - 1, goodid)) :
-                !(goodid = AvailableID(client, res->id + 1, maxid, goodid)))
-                maxid = res->id - 1;
-            else
-                id = res->id + 1;
-        }
+    ResourceIterInit(&iter, &clientTable[client]);
+    while ((res = ResourceIterNext(&iter))) {
+        if ((res->id < id) || (res->id > maxid))
+            continue;
+        if (((res->id - id) >= (maxid - res->id)) ?
+            (goodid = AvailableID(client, id, res->id - 1, goodid)) :
+            !(goodid = AvailableID(client, res->id + 1, maxid, goodid)))
+            maxid = res->id - 1;
+        else
+            id = res->id + 1;
     }
     if (id > maxid)
         id = maxid = 0;
@@ -815,120 +1218,78 @@ AddResource(XID id, RESTYPE type, void *value)
 {
     int client;
     ClientResourceRec *rrec;
-    ResourcePtr *head;
+    ResourceRec res = { .id = id, .type = type, .value = value };
+    Bool added;
 
 #ifdef XSERVER_DTRACE
     XSERVER_RESOURCE_ALLOC(id, type, value, TypeNameString(type));
 #endif
     client = dixClientIdForXID(id);
     rrec = &clientTable[client];
-    if (!rrec->buckets) {
+    if (!rrec->slots) {
         ErrorF("[dix] AddResource(%lx, %x, %lx), client=%d \n",
                (unsigned long) id, type, (unsigned long) value, client);
         FatalError("client not in use\n");
     }
-    if ((rrec->elements >= 4 * rrec->buckets) && (rrec->hashsize < MAXHASHSIZE))
-        RebuildTable(client);
-    head = &rrec->resources[HashResourceID(id, clientTable[client].hashsize)];
-    ResourcePtr res = calloc(1, sizeof(ResourceRec));
-    if (!res) {
+    if (!rrec->iterating) {
+        MigrateResources(rrec, MigrateStep(rrec));
+        TakeDeferredResources(rrec);
+        if (ResourceTableFull(rrec->used, rrec->hashsize))
+            ResizeResources(rrec);
+    }
+    /* the slot states aren't resource types */
+    if (type == RESOURCE_SLOT_EMPTY || type == RESOURCE_SLOT_DELETED)
+        added = FALSE;
+    /* always keep an empty slot, that's what terminates the probing */
+    else if (!rrec->deferred && rrec->used + 1 < (1 << rrec->hashsize) &&
+             InsertNewest(rrec->slots, rrec->hashsize, &rrec->used,
+                          !rrec->iterating, &res))
+        added = TRUE;
+    else
+        added = DeferResource(rrec, &res);
+    if (!added) {
         (*resourceTypes[type & TypeMask].deleteFunc) (value, id);
         return FALSE;
     }
-    res->next = *head;
-    res->id = id;
-    res->type = type;
-    res->value = value;
-    *head = res;
     rrec->elements++;
-    CallResourceStateCallback(ResourceStateAdding, res);
+    CallResourceStateCallback(ResourceStateAdding, &res);
     return TRUE;
 }
 
+/*
+ * takes a copy, the slot itself may get reused by what the callback
+ * or the delete function do
+ */
 static void
-RebuildTable(int client)
-{
-    int j;
-    ResourcePtr **tails, *resources;
-
-    /*
-     * For now, preserve insertion order, since some ddx layers depend
-     * on resources being free in the opposite order they are added.
-     */
-
-    j = 2 * clientTable[client].buckets;
-    tails =  calloc(j, sizeof(ResourcePtr *));
-    if (!tails)
-        return;
-    resources =  calloc(j, sizeof(ResourcePtr));
-    if (!resources) {
-        free(tails);
-        return;
-    }
-    for (ResourcePtr *rptr = resources, **tptr = tails; --j >= 0; rptr++, tptr++) {
-        *rptr = NULL;
-        *tptr = rptr;
-    }
-    clientTable[client].hashsize++;
-    j = clientTable[client].buckets;
-    for (ResourcePtr *rptr = clientTable[client].resources, **tptr; --j >= 0; rptr++) {
-        for (ResourcePtr res = *rptr, next; res; res = next) {
-            next = res->next;
-            res->next = NULL;
-            tptr = &tails[HashResourceID(res->id, clientTable[client].hashsize)];
-            **tptr = res;
-            *tptr = &res->next;
-        }
-    }
-    free(tails);
-    clientTable[client].buckets *= 2;
-    free(clientTable[client].resources);
-    clientTable[client].resources = resources;
-}
-
-static void
-doFreeResource(ResourcePtr res, Bool skip)
+doFreeResource(ResourceRec res, Bool skip)
 {
-    CallResourceStateCallback(ResourceStateFreeing, res);
+#ifdef XSERVER_DTRACE
+    XSERVER_RESOURCE_FREE(res.id, res.type,
+                          res.value, TypeNameString(res.type));
+#endif
+    CallResourceStateCallback(ResourceStateFreeing, &res);
 
     if (!skip)
-        resourceTypes[res->type & TypeMask].deleteFunc(res->value, res->id);
-
-    free(res);
+        resourceTypes[res.type & TypeMask].deleteFunc(res.value, res.id);
 }
 
 void
 FreeResource(XID id, RESTYPE skipDeleteFuncType)
 {
     int cid;
+    ClientResourceRec *rrec;
     ResourcePtr res;
-    ResourcePtr *prev, *head;
-    int *eltptr;
-    int elements;
-
-    if (((cid = dixClientIdForXID(id)) < LimitClients) && clientTable[cid].buckets) {
-        head = &clientTable[cid].resources[HashResourceID(id, clientTable[cid].hashsize)];
-        eltptr = &clientTable[cid].elements;
 
-        prev = head;
-        while ((res = *prev)) {
-            if (res->id == id) {
-                RESTYPE rtype = res->type;
+    if (((cid = dixClientIdForXID(id)) < LimitClients) && clientTable[cid].slots) {
+        rrec = &clientTable[cid];
+        MigrateResources(rrec, MigrateStep(rrec));
 
-#ifdef XSERVER_DTRACE
-                XSERVER_RESOURCE_FREE(res->id, res->type,
-                                      res->value, TypeNameString(res->type));
-#endif
-                *prev = res->next;
-                elements = --*eltptr;
+        /* delete functions may change the table, so search again each time */
+        while ((res = FindResource(rrec, id, X11_RESTYPE_NONE, MATCH_ID))) {
+            ResourceRec copy = *res;
 
-                doFreeResource(res, rtype == skipDeleteFuncType);
-
-                if (*eltptr != elements)
-                    prev = head;        /* prev may no longer be valid */
-            }
-            else
-                prev = &res->next;
+            RemoveResourceSlot(rrec, res);
+            doFreeResource(copy, copy.type == skipDeleteFuncType);
         }
     }
 }
@@ -937,28 +1298,18 @@ void
 FreeResourceByType(XID id, RESTYPE type, Bool skipFree)
 {
     int cid;
+    ClientResourceRec *rrec;
     ResourcePtr res;
-    ResourcePtr *prev, *head;
 
-    if (((cid = dixClientIdForXID(id)) < LimitClients) && clientTable[cid].buckets) {
-        head = &clientTable[cid].resources[HashResourceID(id, clientTable[cid].hashsize)];
+    if (((cid = dixClientIdForXID(id)) < LimitClients) && clientTable[cid].slots) {
+        rrec = &clientTable[cid];
+        MigrateResources(rrec, MigrateStep(rrec));
 
-        prev = head;
-        while ((res = *prev)) {
-            if (res->id == id && res->type == type) {
-#ifdef XSERVER_DTRACE
-                XSERVER_RESOURCE_FREE(res->id, res->type,
-                                      res->value, TypeNameString(res->type));
-#endif
-                *prev = res->next;
-                clientTable[cid].elements--;
+        if ((res = FindResource(rrec, id, type, MATCH_TYPE))) {
+            ResourceRec copy = *res;
 
-                doFreeResource(res, skipFree);
-
-                break;
-            }
-            else
-                prev = &res->next;
+            RemoveResourceSlot(rrec, res);
+            doFreeResource(copy, skipFree);
         }
     }
 }
@@ -973,48 +1324,41 @@ Bool
 ChangeResourceValue(XID id, RESTYPE rtype, void *value)
 {
     int cid;
+    ResourcePtr res;
 
-    if (((cid = dixClientIdForXID(id)) < LimitClients) && clientTable[cid].buckets) {
-        for (ResourcePtr res = clientTable[cid].resources[HashResourceID(id, clientTable[cid].hashsize)];
-            res; res = res->next)
-            if ((res->id == id) && (res->type == rtype)) {
-                res->value = value;
-                return TRUE;
-            }
+    if (((cid = dixClientIdForXID(id)) < LimitClients) && clientTable[cid].slots) {
+        res = FindResource(&clientTable[cid], id, rtype, MATCH_TYPE);
+        if (res) {
+            res->value = value;
+            return TRUE;
+        }
     }
     return FALSE;
 }
 
-/* Note: if func adds or deletes resources, then func can get called
- * more than once for some resources.  If func adds new resources,
- * func might or might not get called for them.  func cannot both
- * add and delete an equal number of resources!
+/* Note: if func adds resources, func might or might not get called for
+ * them. Resources freed by func before they were reached aren't visited.
  */
 
 void
 FindClientResourcesByType(ClientPtr client,
                           RESTYPE type, FindResType func, void *cdata)
 {
-    ResourcePtr *resources;
-    int elements;
-    int *eltptr;
+    ClientResourceRec *rrec;
+    ResourceIter iter;
+    ResourcePtr this;
 
     if (!client)
         client = serverClient;
 
-    resources = clientTable[client->index].resources;
-    eltptr = &clientTable[client->index].elements;
-    for (int i = 0; i < clientTable[client->index].buckets; i++) {
-        for (ResourcePtr this = resources[i], next; this; this = next) {
-            next = this->next;
-            if (!type || this->type == type) {
-                elements = *eltptr;
-                (*func) (this->value, this->id, cdata);
-                if (*eltptr != elements)
-                    next = resources[i];        /* start over */
-            }
-        }
+    rrec = &clientTable[client->index];
+    rrec->iterating++;
+    ResourceIterInit(&iter, rrec);
+    while ((this = ResourceIterNext(&iter))) {
+        if (!type || this->type == type)
+            (*func) (this->value, this->id, cdata);
     }
+    EndResourceWalk(rrec);
 }
 
 void FindSubResources(void *resource,
@@ -1029,24 +1373,19 @@ void FindSubResources(void *resource,
 void
 FindAllClientResources(ClientPtr client, FindAllRes func, void *cdata)
 {
-    ResourcePtr *resources;
-    int elements;
-    int *eltptr;
+    ClientResourceRec *rrec;
+    ResourceIter iter;
+    ResourcePtr this;
 
     if (!client)
         client = serverClient;
 
-    resources = clientTable[client->index].resources;
-    eltptr = &clientTable[client->index].elements;
-    for (int i = 0; i < clientTable[client->index].buckets; i++) {
-        for (ResourcePtr this = resources[i], next; this; this = next) {
-            next = this->next;
-            elements = *eltptr;
-            (*func) (this->value, this->id, this->type, cdata);
-            if (*eltptr != elements)
-                next = resources[i];    /* start over */
-        }
-    }
+    rrec = &clientTable[client->index];
+    rrec->iterating++;
+    ResourceIterInit(&iter, rrec);
+    while ((this = ResourceIterNext(&iter)))
+        (*func) (this->value, this->id, this->type, cdata);
+    EndResourceWalk(rrec);
 }
 
 void *
@@ -1054,70 +1393,79 @@ LookupClientResourceComplex(ClientPtr client,
                             RESTYPE type,
                             FindComplexResType func, void *cdata)
 {
-    ResourcePtr *resources;
-    void *value;
+    ClientResourceRec *rrec;
+    ResourceIter iter;
+    ResourcePtr this;
+    void *value = NULL;
 
     if (!client)
         client = serverClient;
 
-    resources = clientTable[client->index].resources;
-    for (int i = 0; i < clientTable[client->index].buckets; i++) {
-        for (ResourcePtr this = resources[i], next; this; this = next) {
-            next = this->next;
-            if (!type || this->type == type) {
-                /* workaround func freeing the type as DRI1 does */
-                value = this->value;
-                if ((*func) (value, this->id, cdata))
-                    return value;
-            }
+    rrec = &clientTable[client->index];
+    rrec->iterating++;
+    ResourceIterInit(&iter, rrec);
+    while ((this = ResourceIterNext(&iter))) {
+        if (!type || this->type == type) {
+            /* workaround func freeing the type as DRI1 does */
+            value = this->value;
+            if ((*func) (value, this->id, cdata))
+                break;
+            value = NULL;
         }
     }
-    return NULL;
+    EndResourceWalk(rrec);
+    return value;
+}
+
+/*
+ * Free all resources of a client matching the class (or all of them),
+ * for each id in the opposite order they were added.
+ */
+static void
+FreeClientResourcesByClass(ClientResourceRec *rrec, RESTYPE rclass)
+{
+    ResourceMatch match = rclass ? MATCH_CLASS : MATCH_ID;
+    ResourceIter iter;
+    ResourcePtr this, res;
+    Bool again;
+
+    do {
+        again = FALSE;
+        rrec->iterating++;
+        ResourceIterInit(&iter, rrec);
+        while ((this = ResourceIterNext(&iter))) {
+            if (rclass && !(this->type & rclass))
+                continue;
+
+            /* this may be refilled by what the delete functions add */
+            while (ResourceSlotLive(this) &&
+                   (!rclass || (this->type & rclass)) &&
+                   (res = FindResource(rrec, this->id, rclass, match))) {
+                ResourceRec copy = *res;
+
+                RemoveResourceSlot(rrec, res);
+                doFreeResource(copy, FALSE);
+                again = TRUE;
+            }
+        }
+        /* delete functions may have added resources we already passed */
+        EndResourceWalk(rrec);
+    } while (again && rrec->elements);
 }
 
 void
 FreeClientNeverRetainResources(ClientPtr client)
 {
-    ResourcePtr *resources;
-    ResourcePtr this;
-    ResourcePtr *prev;
-    int elements;
-    int *eltptr;
-
     if (!client)
         return;
 
-    resources = clientTable[client->index].resources;
-    eltptr = &clientTable[client->index].elements;
-    for (int j = 0; j < clientTable[client->index].buckets; j++) {
-        prev = &resources[j];
-        while ((this = *prev)) {
-            RESTYPE rtype = this->type;
-
-            if (rtype & RC_NEVERRETAIN) {
-#ifdef XSERVER_DTRACE
-                XSERVER_RESOURCE_FREE(this->id, this->type,
-                                      this->value, TypeNameString(this->type));
-#endif
-                *prev = this->next;
-                clientTable[client->index].elements--;
-                elements = *eltptr;
-
-                doFreeResource(this, FALSE);
-
-                if (*eltptr != elements)
-                    prev = &resources[j];       /* prev may no longer be valid */
-            }
-            else
-                prev = &this->next;
-        }
-    }
+    FreeClientResourcesByClass(&clientTable[client->index], RC_NEVERRETAIN);
 }
 
 void
 FreeClientResources(ClientPtr client)
 {
-    ResourcePtr *resources;
+    ClientResourceRec *rrec;
 
     /* This routine shouldn't be called with a null client, but just in
        case ... */
@@ -1127,42 +1475,33 @@ FreeClientResources(ClientPtr client)
 
     HandleSaveSet(client);
 
-    resources = clientTable[client->index].resources;
-    for (int j = 0; j < clientTable[client->index].buckets; j++) {
-        /* It may seem silly to update the head of this resource list as
-           we delete the members, since the entire list will be deleted any way,
-           but there are some resource deletion functions "FreeClientPixels" for
-           one which do a LookupID on another resource id (a Colormap id in this
-           case), so the resource list must be kept valid up to the point that
-           it is deleted, so every time we delete a resource, we must update the
-           head, just like in FreeResource. I hope that this doesn't slow down
-           mass deletion appreciably. PRH */
+    /* Resources are removed from the table before their delete function
+       is called, since some of them, e.g. "FreeClientPixels", do a LookupID
+       on another resource id (a Colormap id in this case), so the table
+       must be kept valid up to the point that everything is deleted. */
 
-        ResourcePtr *head;
+    rrec = &clientTable[client->index];
+    FreeClientResourcesByClass(rrec, 0);
 
-        head = &resources[j];
+    free(rrec->slots);
+    free(rrec->old_slots);
+    while (rrec->deferred) {
+        DeferredResourcesPtr d = rrec->deferred;
 
-        for (ResourcePtr this = *head; this; this = *head) {
-#ifdef XSERVER_DTRACE
-            XSERVER_RESOURCE_FREE(this->id, this->type,
-                                  this->value, TypeNameString(this->type));
-#endif
-            *head = this->next;
-            clientTable[client->index].elements--;
-
-            doFreeResource(this, FALSE);
-        }
+        rrec->deferred = d->older;
+        free(d);
     }
-    free(clientTable[client->index].resources);
-    clientTable[client->index].resources = NULL;
-    clientTable[client->index].buckets = 0;
+    rrec->slots = NULL;
+    rrec->old_slots = NULL;
+    rrec->elements = 0;
+    rrec->used = 0;
 }
 
 void
 FreeAllResources(void)
 {
     for (int i = currentMaxClients; --i >= 0;) {
-        if (clientTable[i].buckets)
+        if (clientTable[i].slots)
             FreeClientResources(clients[i]);
     }
 }
@@ -1203,13 +1542,8 @@ dixLookupResourceByType(void **result, XID id, RESTYPE rtype,
     if ((rtype & TypeMask) > lastResourceType)
         return BadImplementation;
 
-    if ((cid < LimitClients) && clientTable[cid].buckets) {
-        res = clientTable[cid].resources[HashResourceID(id, clientTable[cid].hashsize)];
-
-        for (; res; res = res->next)
-            if (res->id == id && res->type == rtype)
-                break;
-    }
+    if ((cid < LimitClients) && clientTable[cid].slots)
+        res = FindResource(&clientTable[cid], id, rtype, MATCH_TYPE);
     if (client) {
         client->errorValue = id;
     }
@@ -1238,13 +1572,8 @@ dixLookupResourceByClass(void **result, XID id, RESTYPE rclass,
 
     *result = NULL;
 
-    if ((cid < LimitClients) && clientTable[cid].buckets) {
-        res = clientTable[cid].resources[HashResourceID(id, clientTable[cid].hashsize)];
-
-        for (; res; res = res->next)
-            if (res->id == id && (res->type & rclass))
-                break;
-    }
+    if ((cid < LimitClients) && clientTable[cid].slots)
+        res = FindResource(&clientTable[cid], id, rclass, MATCH_CLASS);
     if (client) {
         client->errorValue = id;
     }
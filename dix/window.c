@@ -102,6 +102,7 @@ Equipment Corporation.
 #include "dix/cursor_priv.h"
 #include "dix/dispatch.h"
 #include "dix/dix_priv.h"
+#include "dix/dixgrabs_priv.h"
 #include "dix/exevents_priv.h"
 #include "dix/input_priv.h"
 #include "dix/inpututils_priv.h"
@@ -848,6 +849,13 @@ dixCreateWindow(Window wid, WindowPtr pParent, int x, int y, unsigned w,
         return NullWindow;
     }
 
+    /* the parent counts its children in its optional record */
+    if (!MakeWindowOptional(pParent)) {
+        dixFreeObjectWithPrivates(pWin, PRIVATE_WINDOW);
+        *error = BadAlloc;
+        return NullWindow;
+    }
+
     pWin->backgroundState = XaceBackgroundNoneState(pWin);
     pWin->background.pixel = pScreen->whitePixel;
 
@@ -887,6 +895,7 @@ dixCreateWindow(Window wid, WindowPtr pParent, int x, int y, unsigned w,
             pParent->lastChild = pWin;
         pParent->firstChild = pWin;
     }
+    pParent->optional->childCount++;
 
     SetWinSize(pWin);
     SetBorderSize(pWin);
@@ -990,6 +999,9 @@ FreeWindowResources(WindowPtr pWin)
 
     /* We SHOULD check for an error value here XXX */
     dixScreenRaiseWindowDestroy(pWin);
+    miChildIndexFree(pWin);
+    DeliveryCacheFree(pWin);
+    PassiveGrabIndexFree(pWin);
     DisposeWindowOptional(pWin);
 }
 
@@ -1059,6 +1071,7 @@ DeleteWindow(void *value, XID wid)
 
     FreeWindowResources(pWin);
     if (pParent) {
+        miChildIndexInvalidate(pParent);
         if (pParent->firstChild == pWin)
             pParent->firstChild = pWin->nextSib;
         if (pParent->lastChild == pWin)
@@ -1067,6 +1080,7 @@ DeleteWindow(void *value, XID wid)
             pWin->nextSib->prevSib = pWin->prevSib;
         if (pWin->prevSib)
             pWin->prevSib->nextSib = pWin->nextSib;
+        pParent->optional->childCount--;
     }
     else
         pWin->drawable.pScreen->root = NULL;
@@ -1623,6 +1637,7 @@ MoveWindowInStack(WindowPtr pWin, WindowPtr pNextSib)
     if (pWin->nextSib != pNextSib) {
         WindowPtr pOldNextSib = pWin->nextSib;
 
+        miChildIndexInvalidate(pParent);
         if (!pNextSib) {        /* move to bottom */
             if (pParent->firstChild == pWin)
                 pParent->firstChild = pWin->nextSib;
@@ -1829,6 +1844,10 @@ ResizeChildrenWinSize(WindowPtr pWin, int dx, int dy, int dw, int dh)
     WindowPtr pChild;
     Bool resized = (dw || dh);
 
+    /* pWin moved or changed size, and with it maybe its children */
+    miChildIndexInvalidate(pWin->parent);
+    miChildIndexInvalidate(pWin);
+
     for (WindowPtr pSib = pWin->firstChild; pSib; pSib = pSib->nextSib) {
         if (resized && (pSib->winGravity > NorthWestGravity)) {
             int cwsx, cwsy;
@@ -2335,6 +2354,7 @@ ConfigureWindow(WindowPtr pWin, Mask mask, XID *vlist, ClientPtr client)
     return Success;
 
  ActuallyDoSomething:
+    miChildIndexInvalidate(pParent);
     if (pWin->drawable.pScreen->ConfigNotify) {
         int ret;
 
@@ -2490,7 +2510,7 @@ ReparentWindow(WindowPtr pWin, WindowPtr pParent,
     if (TraverseTree(pWin, CompareWIDs, (void *) &pParent->drawable.id) ==
         WT_STOPWALKING)
         return BadMatch;
-    if (!MakeWindowOptional(pWin))
+    if (!MakeWindowOptional(pWin) || !MakeWindowOptional(pParent))
         return BadAlloc;
 
     if (WasMapped)
@@ -2515,6 +2535,8 @@ ReparentWindow(WindowPtr pWin, WindowPtr pParent,
     /* take out of sibling chain */
 
     pPriorParent = pPrev = pWin->parent;
+    miChildIndexInvalidate(pPriorParent);
+    miChildIndexInvalidate(pParent);
     if (pPrev->firstChild == pWin)
         pPrev->firstChild = pWin->nextSib;
     if (pPrev->lastChild == pWin)
@@ -2524,6 +2546,7 @@ ReparentWindow(WindowPtr pWin, WindowPtr pParent,
         pWin->nextSib->prevSib = pWin->prevSib;
     if (pWin->prevSib)
         pWin->prevSib->nextSib = pWin->nextSib;
+    pPriorParent->optional->childCount--;
 
     /* insert at beginning of pParent */
     pWin->parent = pParent;
@@ -2546,6 +2569,7 @@ ReparentWindow(WindowPtr pWin, WindowPtr pParent,
             pParent->lastChild = pWin;
         pParent->firstChild = pWin;
     }
+    pParent->optional->childCount++;
 
     pWin->origin.x = x + bw;
     pWin->origin.y = y + bw;
@@ -2654,6 +2678,7 @@ MapWindow(WindowPtr pWin, ClientPtr client)
                 return Success;
 
         pWin->mapped = TRUE;
+        miChildIndexInvalidate(pParent);
         if (SubStrSend(pWin, pParent))
             DeliverMapNotify(pWin);
 
@@ -2721,6 +2746,7 @@ MapSubwindows(WindowPtr pParent, ClientPtr client)
                     continue;
 
             pWin->mapped = TRUE;
+            miChildIndexInvalidate(pParent);
             if (parentNotify || StrSend(pWin))
                 DeliverMapNotify(pWin);
 
@@ -2837,6 +2863,7 @@ UnmapWindow(WindowPtr pWin, Bool fromConfigure)
         (*pScreen->MarkWindow) (pLayerWin->parent);
     }
     pWin->mapped = FALSE;
+    miChildIndexInvalidate(pParent);
     if (wasRealized)
         UnrealizeTree(pWin, fromConfigure);
     if (wasViewable && !fromConfigure) {
@@ -2886,6 +2913,7 @@ UnmapSubwindows(WindowPtr pWin)
                 anyMarked = TRUE;
             }
             pChild->mapped = FALSE;
+            miChildIndexInvalidate(pWin);
             if (pChild->realized)
                 UnrealizeTree(pChild, FALSE);
         }
@@ -3332,6 +3360,11 @@ CheckWindowOptionalNeed(WindowPtr w)
         return;
     if (optional->inputMasks != NULL)
         return;
+    if (optional->propertyIndex != NULL || optional->childIndex != NULL ||
+        optional->deliveryCache != NULL || optional->grabIndex != NULL)
+        return;
+    if (optional->childCount != 0)
+        return;
     if (optional->deviceCursors != NULL) {
         DevCursNodePtr pNode = optional->deviceCursors;
 
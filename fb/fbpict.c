@@ -25,9 +25,12 @@
 
 #include <dix-config.h>
 
+#include <stdint.h>
 #include <string.h>
 
+#include "dix/dix_priv.h"
 #include "fb/fbpict_priv.h"
+#include "include/list.h"
 
 #include "fb.h"
 #include "glyphstr_priv.h"
@@ -69,11 +72,254 @@ fbComposite(CARD8 op,
     free_pixman_pict(pDst, dest);
 }
 
+/*
+ * Glyphs are rendered out of one pixman glyph cache, keyed by glyph format
+ * and glyph. pixman only bounds it by glyph count, so we keep our own LRU
+ * of what's in there with the memory each glyph takes, and evict down to
+ * glyphCacheSize kilobytes whenever a glyph run is done.
+ *
+ * Both LRUs are kept in the same order, and ours never holds more glyphs
+ * than pixman keeps on thaw, so pixman doesn't drop any by itself. It
+ * still drops all of them once removals leave too many tombstones in its
+ * table, which we notice by the most recently used glyph being gone.
+ */
+typedef struct _FbGlyphEntry {
+    GlyphPtr glyph;
+    PictFormatPtr format;
+    size_t bytes;
+    struct xorg_list lru;       /* most recently used first */
+} FbGlyphEntryRec, *FbGlyphEntryPtr;
+
+/* pixman's glyph and image headers, roughly */
+#define FB_GLYPH_OVERHEAD   256
+
+/* pixman evicts glyphs beyond this on thaw (N_GLYPHS_LOW_WATER) */
+#define FB_GLYPH_MAX_COUNT  8192
+
 static pixman_glyph_cache_t *glyphCache;
 
+static FbGlyphEntryPtr *glyphSlots;     /* open addressed, by glyph pointer */
+static unsigned int glyphMask;
+static unsigned int glyphCount;
+static struct xorg_list glyphLru = { &glyphLru, &glyphLru };
+static size_t glyphBytes;
+static FbGlyphCacheStatsRec glyphStats;
+
+/* for glyph runs which don't fit on the stack */
+static pixman_glyph_t *glyphScratch;
+static int glyphScratchSize;
+
+static inline unsigned int
+GlyphSlot(GlyphPtr glyph)
+{
+    uint64_t key = (uintptr_t) glyph;
+
+    return (unsigned int) ((key * 0x9e3779b97f4a7c15ULL) >> 32) & glyphMask;
+}
+
+/* the slot holding glyph, or the empty one it would go into */
+static FbGlyphEntryPtr *
+GlyphEntryFind(GlyphPtr glyph)
+{
+    unsigned int i = GlyphSlot(glyph);
+
+    while (glyphSlots[i] && glyphSlots[i]->glyph != glyph)
+        i = (i + 1) & glyphMask;
+    return &glyphSlots[i];
+}
+
+static Bool
+GlyphSlotsResize(unsigned int size)
+{
+    FbGlyphEntryPtr *old = glyphSlots;
+    unsigned int oldSize = old ? glyphMask + 1 : 0;
+
+    if (!(glyphSlots = calloc(size, sizeof(FbGlyphEntryPtr)))) {
+        glyphSlots = old;
+        return FALSE;
+    }
+    glyphMask = size - 1;
+
+    for (unsigned int i = 0; i < oldSize; i++)
+        if (old[i])
+            *GlyphEntryFind(old[i]->glyph) = old[i];
+    free(old);
+    return TRUE;
+}
+
+static void
+GlyphEntryRemove(FbGlyphEntryPtr *slot)
+{
+    FbGlyphEntryPtr entry = *slot;
+    unsigned int hole = slot - glyphSlots, i = hole;
+
+    /* shift back whatever probed past the slot we're emptying */
+    for (;;) {
+        unsigned int home;
+
+        i = (i + 1) & glyphMask;
+        if (!glyphSlots[i])
+            break;
+        home = GlyphSlot(glyphSlots[i]->glyph);
+        if (((i - home) & glyphMask) >= ((i - hole) & glyphMask)) {
+            glyphSlots[hole] = glyphSlots[i];
+            hole = i;
+        }
+    }
+    glyphSlots[hole] = NULL;
+
+    pixman_glyph_cache_remove(glyphCache, entry->format, entry->glyph);
+    xorg_list_del(&entry->lru);
+    glyphBytes -= entry->bytes;
+    glyphCount--;
+    free(entry);
+}
+
+/* pixman dropped all of its glyphs, forget ours */
+static void
+GlyphEntriesFree(void)
+{
+    FbGlyphEntryPtr entry, tmp;
+
+    xorg_list_for_each_entry_safe(entry, tmp, &glyphLru, lru)
+        free(entry);
+    xorg_list_init(&glyphLru);
+    if (glyphSlots)
+        memset(glyphSlots, 0, (glyphMask + 1) * sizeof(FbGlyphEntryPtr));
+    glyphCount = 0;
+    glyphBytes = 0;
+}
+
+pixman_glyph_cache_t *
+fbGlyphCacheFreeze(void)
+{
+    if (!glyphCache && !(glyphCache = pixman_glyph_cache_create()))
+        return NULL;
+
+    pixman_glyph_cache_freeze(glyphCache);
+    return glyphCache;
+}
+
+void
+fbGlyphCacheThaw(void)
+{
+    size_t budget = (size_t) glyphCacheSize * 1024;
+    FbGlyphEntryPtr entry;
+
+    /* before pixman's thaw, which would evict glyphs behind our back */
+    while ((budget && glyphBytes > budget) ||
+           glyphCount > FB_GLYPH_MAX_COUNT) {
+        entry = xorg_list_last_entry(&glyphLru, FbGlyphEntryRec, lru);
+        GlyphEntryRemove(GlyphEntryFind(entry->glyph));
+        glyphStats.evictions++;
+    }
+
+    pixman_glyph_cache_thaw(glyphCache);
+
+    if (glyphCount) {
+        entry = xorg_list_first_entry(&glyphLru, FbGlyphEntryRec, lru);
+        if (!pixman_glyph_cache_lookup(glyphCache, entry->format,
+                                       entry->glyph))
+            GlyphEntriesFree();
+    }
+}
+
+const void *
+fbGlyphCacheLookup(GlyphPtr glyph)
+{
+    FbGlyphEntryPtr *slot, entry;
+    const void *g;
+
+    if (!glyphSlots || !(entry = *(slot = GlyphEntryFind(glyph)))) {
+        glyphStats.misses++;
+        return NULL;
+    }
+    if (!(g = pixman_glyph_cache_lookup(glyphCache, entry->format, glyph))) {
+        /* pixman dropped it on its own */
+        GlyphEntryRemove(slot);
+        glyphStats.misses++;
+        return NULL;
+    }
+
+    xorg_list_del(&entry->lru);
+    xorg_list_add(&entry->lru, &glyphLru);
+    glyphStats.hits++;
+    return g;
+}
+
+const void *
+fbGlyphCacheInsert(GlyphPtr glyph, PictFormatPtr format, pixman_image_t *image)
+{
+    FbGlyphEntryPtr *slot, entry;
+    const void *g;
+
+    if (!glyphSlots && !GlyphSlotsResize(256))
+        return NULL;
+
+    slot = GlyphEntryFind(glyph);
+    if (!(entry = *slot)) {
+        if ((glyphCount + 1) * 2 > glyphMask + 1) {
+            if (!GlyphSlotsResize((glyphMask + 1) * 2))
+                return NULL;
+            slot = GlyphEntryFind(glyph);
+        }
+        if (!(entry = calloc(1, sizeof(FbGlyphEntryRec))))
+            return NULL;
+        entry->glyph = glyph;
+        *slot = entry;
+        glyphCount++;
+    }
+    else {
+        /* pixman dropped it on its own, make sure it's really gone */
+        pixman_glyph_cache_remove(glyphCache, entry->format, glyph);
+        xorg_list_del(&entry->lru);
+        glyphBytes -= entry->bytes;
+    }
+    xorg_list_add(&entry->lru, &glyphLru);
+    entry->format = format;
+    entry->bytes = 0;
+
+    g = pixman_glyph_cache_insert(glyphCache, format, glyph,
+                                  glyph->info.x, glyph->info.y, image);
+    if (!g) {
+        GlyphEntryRemove(slot);
+        return NULL;
+    }
+
+    entry->bytes = (size_t) pixman_image_get_stride(image) *
+        pixman_image_get_height(image) + FB_GLYPH_OVERHEAD;
+    glyphBytes += entry->bytes;
+    return g;
+}
+
+void
+fbGlyphCacheGetStats(FbGlyphCacheStatsRec *stats)
+{
+    *stats = glyphStats;
+    stats->bytes = glyphBytes;
+    stats->glyphs = glyphCount;
+}
+
 void
 fbDestroyGlyphCache(void)
 {
+    if (glyphStats.hits || glyphStats.misses)
+        LogMessageVerb(X_INFO, 3, "fb: glyph cache: %llu hits, %llu misses, "
+                       "%llu evictions, %zu KB in %u glyphs\n",
+                       (unsigned long long) glyphStats.hits,
+                       (unsigned long long) glyphStats.misses,
+                       (unsigned long long) glyphStats.evictions,
+                       glyphBytes / 1024, glyphCount);
+
+    GlyphEntriesFree();
+    free(glyphSlots);
+    glyphSlots = NULL;
+    glyphMask = 0;
+
+    free(glyphScratch);
+    glyphScratch = NULL;
+    glyphScratchSize = 0;
+
     if (glyphCache)
     {
 	pixman_glyph_cache_destroy (glyphCache);
@@ -85,8 +331,10 @@ static void
 fbUnrealizeGlyph(ScreenPtr pScreen,
 		 GlyphPtr pGlyph)
 {
-    if (glyphCache)
-	pixman_glyph_cache_remove (glyphCache, pGlyph, NULL);
+    FbGlyphEntryPtr *slot;
+
+    if (glyphSlots && *(slot = GlyphEntryFind(pGlyph)))
+	GlyphEntryRemove(slot);
 }
 
 static void
@@ -117,14 +365,20 @@ fbGlyphs(CARD8 op,
     for (i = 0; i < nlist; ++i)
 	n_glyphs += list[i].len;
 
-    if (!glyphCache)
-	glyphCache = pixman_glyph_cache_create();
-
-    pixman_glyph_cache_freeze (glyphCache);
+    if (!fbGlyphCacheFreeze())
+	return;
 
     if (n_glyphs > N_STACK_GLYPHS) {
-	if (!(pglyphs = calloc(n_glyphs, sizeof(pixman_glyph_t))))
-	    goto out;
+	if (n_glyphs > glyphScratchSize) {
+	    pixman_glyph_t *scratch = reallocarray(glyphScratch, n_glyphs,
+						   sizeof(pixman_glyph_t));
+
+	    if (!scratch)
+		goto out;
+	    glyphScratch = scratch;
+	    glyphScratchSize = n_glyphs;
+	}
+	pglyphs = glyphScratch;
     }
 
     i = 0;
@@ -138,7 +392,7 @@ fbGlyphs(CARD8 op,
 
             glyph = *glyphs++;
 
-	    if (!(g = pixman_glyph_cache_lookup (glyphCache, glyph, NULL))) {
+	    if (!(g = fbGlyphCacheLookup(glyph))) {
 		pixman_image_t *glyphImage;
 		PicturePtr pPicture;
 		int xoff, yoff;
@@ -152,10 +406,7 @@ fbGlyphs(CARD8 op,
 		if (!(glyphImage = image_from_pict(pPicture, FALSE, &xoff, &yoff)))
 		    goto out;
 
-		g = pixman_glyph_cache_insert(glyphCache, glyph, NULL,
-					      glyph->info.x,
-					      glyph->info.y,
-					      glyphImage);
+		g = fbGlyphCacheInsert(glyph, pPicture->pFormat, glyphImage);
 
 		free_pixman_pict(pPicture, glyphImage);
 
@@ -210,9 +461,7 @@ out_free_src:
     free_pixman_pict(pSrc, srcImage);
 
 out:
-    pixman_glyph_cache_thaw(glyphCache);
-    if (pglyphs != stack_glyphs)
-	free(pglyphs);
+    fbGlyphCacheThaw();
 }
 
 static pixman_image_t *
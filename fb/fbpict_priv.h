@@ -5,9 +5,12 @@
 #ifndef XORG_FBPICT_PRIV_H
 #define XORG_FBPICT_PRIV_H
 
+#include <stdint.h>
+#include <pixman.h>
 #include <X11/extensions/renderproto.h>
 
 #include "fb/fbpict.h"
+#include "render/glyphstr.h"
 #include "render/picture.h"
 
 void fbRasterizeTrapezoid(PicturePtr alpha, xTrapezoid *trap,
@@ -25,4 +28,35 @@ void fbTriangles(CARD8 op, PicturePtr pSrc, PicturePtr pDst,
                  PictFormatPtr maskFormat, INT16 xSrc, INT16 ySrc,
                  int ntris, xTriangle *tris);
 
+typedef struct _FbGlyphCacheStats {
+    uint64_t hits;
+    uint64_t misses;
+    uint64_t evictions;
+    size_t bytes;               /* memory held by cached glyphs, estimated */
+    unsigned int glyphs;
+} FbGlyphCacheStatsRec;
+
+/*
+ * Glyph runs are rendered out of one pixman glyph cache, bounded to
+ * glyphCacheSize kilobytes. Lookups and inserts for a run go between
+ * fbGlyphCacheFreeze() and fbGlyphCacheThaw(); glyphs are evicted only on
+ * thaw, so the ones returned stay valid until then.
+ */
+pixman_glyph_cache_t *fbGlyphCacheFreeze(void);
+void fbGlyphCacheThaw(void);
+
+/* @return the cached glyph, NULL on a miss */
+const void *fbGlyphCacheLookup(GlyphPtr glyph);
+
+/*
+ * cache the glyph as rendered in image
+ *
+ * @param format    format of the glyph's picture
+ * @return the cached glyph, NULL on allocation failure
+ */
+const void *fbGlyphCacheInsert(GlyphPtr glyph, PictFormatPtr format,
+                               pixman_image_t *image);
+
+void fbGlyphCacheGetStats(FbGlyphCacheStatsRec *stats);
+
 #endif /* XORG_FBPICT_PRIV_H */
@@ -60,6 +60,11 @@
 #define fbGetSpans wfbGetSpans
 #define _fbGetWindowPixmap _wfbGetWindowPixmap
 #define fbGlyph16 wfbGlyph16
+#define fbGlyphCacheFreeze wfbGlyphCacheFreeze
+#define fbGlyphCacheGetStats wfbGlyphCacheGetStats
+#define fbGlyphCacheInsert wfbGlyphCacheInsert
+#define fbGlyphCacheLookup wfbGlyphCacheLookup
+#define fbGlyphCacheThaw wfbGlyphCacheThaw
 #define fbGlyph32 wfbGlyph32
 #define fbGlyph8 wfbGlyph8
 #define fbImageGlyphBlt wfbImageGlyphBlt
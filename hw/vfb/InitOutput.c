@@ -74,6 +74,12 @@ from The Open Group.
 #include "miline.h"
 #include "glx_extinit.h"
 #include "randrstr.h"
+#if defined(HAVE_MEMFD_CREATE) && defined(HAVE_MMAP)
+#define VFB_MEMFD
+#include <fcntl.h>
+#include "damage.h"
+#include "vfbmemfd.h"
+#endif
 
 #define VFB_DEFAULT_WIDTH      1280
 #define VFB_DEFAULT_HEIGHT     1024
@@ -119,6 +125,13 @@ typedef struct {
 #ifdef CONFIG_MITSHM
     int shmid;
 #endif /* CONFIG_MITSHM */
+
+#ifdef VFB_MEMFD
+    int memfd;
+    vfbMemfdHeader *pMemfdHeader;
+    DamagePtr pDamage;
+    CreateScreenResourcesProcPtr createScreenResources;
+#endif
 } vfbScreenInfo, *vfbScreenInfoPtr;
 
 static int vfbNumScreens;
@@ -138,7 +151,8 @@ static Bool vfbPixmapDepths[33];
 #ifdef HAVE_MMAP
 static char *pfbdir = NULL;
 #endif
-typedef enum { NORMAL_MEMORY_FB, SHARED_MEMORY_FB, MMAPPED_FILE_FB } fbMemType;
+typedef enum { NORMAL_MEMORY_FB, SHARED_MEMORY_FB, MMAPPED_FILE_FB,
+               MEMFD_FB } fbMemType;
 static fbMemType fbmemtype = NORMAL_MEMORY_FB;
 static char needswap = 0;
 static Bool Render = TRUE;
@@ -240,6 +254,18 @@ freeScreenInfo(vfbScreenInfoPtr pvfb)
         break;
 #endif /* CONFIG_MITSHM */
 
+#ifdef VFB_MEMFD
+    case MEMFD_FB:
+        if (pvfb->pMemfdHeader)
+            munmap(pvfb->pMemfdHeader, pvfb->pMemfdHeader->header_size +
+                   pvfb->sizeInBytes);
+        close(pvfb->memfd);
+        break;
+#else
+    case MEMFD_FB:
+        break;
+#endif
+
     case NORMAL_MEMORY_FB:
         free(pvfb->pXWDHeader);
         break;
@@ -298,6 +324,10 @@ ddxUseMsg(void)
     ErrorF("-shmem                 put framebuffers in shared memory\n");
 #endif /* CONFIG_MITSHM */
 
+#ifdef VFB_MEMFD
+    ErrorF("-memfd                 put framebuffers in memfds, with damage\n");
+#endif
+
     ErrorF("-crtcs n               number of CRTCs per screen (default: %d)\n",
            VFB_DEFAULT_NUM_CRTCS);
 }
@@ -418,6 +448,13 @@ ddxProcessArgument(int argc, char *argv[], int i)
     }
 #endif /* CONFIG_MITSHM */
 
+#ifdef VFB_MEMFD
+    if (strcmp(argv[i], "-memfd") == 0) {       /* -memfd */
+        fbmemtype = MEMFD_FB;
+        return 1;
+    }
+#endif
+
     if (strcmp(argv[i], "-crtcs") == 0) {       /* -crtcs n */
         int numCrtcs;
 
@@ -629,6 +666,142 @@ vfbAllocateSharedMemoryFramebuffer(vfbScreenInfoPtr pvfb)
 }
 #endif /* CONFIG_MITSHM */
 
+#ifdef VFB_MEMFD
+static void
+vfbAllocateMemfdFramebuffer(vfbScreenInfoPtr pvfb)
+{
+    long pagesize = sysconf(_SC_PAGESIZE);
+    size_t headerSize = (sizeof(vfbMemfdHeader) + pagesize - 1) & ~(pagesize - 1);
+    vfbMemfdHeader *header;
+
+    pvfb->memfd = memfd_create("Xvfb", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+    if (pvfb->memfd < 0) {
+        perror("memfd_create");
+        ErrorF("memfd_create failed, %s", strerror(errno));
+        return;
+    }
+
+    /* consumers must not get SIGBUS */
+    if (-1 == ftruncate(pvfb->memfd, headerSize + pvfb->sizeInBytes) ||
+        -1 == fcntl(pvfb->memfd, F_ADD_SEALS, F_SEAL_SHRINK)) {
+        perror("ftruncate");
+        ErrorF("ftruncate %zu bytes failed, %s",
+               headerSize + pvfb->sizeInBytes, strerror(errno));
+        return;
+    }
+
+    header = mmap(NULL, headerSize + pvfb->sizeInBytes, PROT_READ | PROT_WRITE,
+                  MAP_SHARED, pvfb->memfd, 0);
+    if (header == MAP_FAILED) {
+        perror("mmap");
+        ErrorF("mmap failed, %s", strerror(errno));
+        return;
+    }
+
+    header->magic = VFB_MEMFD_MAGIC;
+    header->version = VFB_MEMFD_VERSION;
+    header->header_size = headerSize;
+    header->ring_size = VFB_DAMAGE_RING_SIZE;
+    pvfb->pMemfdHeader = header;
+    pvfb->pXWDHeader = (XWDFileHeader *) ((char *) header + headerSize);
+
+    ErrorF("screen %d memfd /proc/%ld/fd/%d\n", (int) (pvfb - vfbScreens),
+           (long) getpid(), pvfb->memfd);
+}
+
+/* publish what was drawn since the last time */
+static void
+vfbMemfdBlockHandler(void *blockData, void *timeout)
+{
+    vfbScreenInfoPtr pvfb = blockData;
+    vfbMemfdHeader *header = pvfb->pMemfdHeader;
+    RegionPtr pRegion;
+    BoxPtr pBox;
+    int nBox;
+    uint64_t head;
+
+    if (!pvfb->pDamage)
+        return;
+
+    pRegion = DamageRegion(pvfb->pDamage);
+    if (!RegionNotEmpty(pRegion))
+        return;
+
+    /* the boxes, unless they would push most of the ring out */
+    pBox = RegionRects(pRegion);
+    nBox = RegionNumRects(pRegion);
+    if (nBox > VFB_DAMAGE_RING_SIZE / 4) {
+        pBox = RegionExtents(pRegion);
+        nBox = 1;
+    }
+
+    /* readers copying the slots about to be overwritten see this */
+    head = header->head;
+    StoreRelease(&header->reserved, head + nBox);
+    ReleaseFence();
+
+    for (int i = 0; i < nBox; i++, head++) {
+        vfbDamageBox *box = &header->boxes[head & (VFB_DAMAGE_RING_SIZE - 1)];
+
+        box->x1 = pBox[i].x1;
+        box->y1 = pBox[i].y1;
+        box->x2 = pBox[i].x2;
+        box->y2 = pBox[i].y2;
+    }
+    StoreRelease(&header->head, head);
+
+    DamageEmpty(pvfb->pDamage);
+}
+
+static Bool
+vfbMemfdCreateScreenResources(ScreenPtr pScreen)
+{
+    vfbScreenInfoPtr pvfb = &vfbScreens[pScreen->myNum];
+    PixmapPtr pPixmap;
+    Bool ret;
+
+    pScreen->CreateScreenResources = pvfb->createScreenResources;
+    ret = pScreen->CreateScreenResources(pScreen);
+    pScreen->CreateScreenResources = vfbMemfdCreateScreenResources;
+    if (!ret)
+        return FALSE;
+
+    pvfb->pDamage = DamageCreate(NULL, NULL, DamageReportNone, TRUE,
+                                 pScreen, pScreen);
+    if (!pvfb->pDamage)
+        return FALSE;
+
+    /* destroyed along with the screen pixmap */
+    pPixmap = pScreen->GetScreenPixmap(pScreen);
+    DamageRegister(&pPixmap->drawable, pvfb->pDamage);
+    return TRUE;
+}
+
+static Bool
+vfbMemfdScreenInit(ScreenPtr pScreen)
+{
+    vfbScreenInfoPtr pvfb = &vfbScreens[pScreen->myNum];
+    vfbMemfdHeader *header = pvfb->pMemfdHeader;
+
+    header->pixels_offset = pvfb->pfbMemory - (char *) header;
+    header->width = pvfb->width;
+    header->height = pvfb->height;
+    header->bytes_per_line = pvfb->paddedBytesWidth;
+    header->bits_per_pixel = pvfb->bitsPerPixel;
+    header->depth = pvfb->depth;
+
+    if (!DamageSetup(pScreen))
+        return FALSE;
+
+    pvfb->createScreenResources = pScreen->CreateScreenResources;
+    pScreen->CreateScreenResources = vfbMemfdCreateScreenResources;
+
+    return RegisterBlockAndWakeupHandlers(vfbMemfdBlockHandler,
+                                          (ServerWakeupHandlerProcPtr) NoopDDA,
+                                          pvfb);
+}
+#endif /* VFB_MEMFD */
+
 static char *
 vfbAllocateFramebufferMemory(vfbScreenInfoPtr pvfb)
 {
@@ -679,6 +852,15 @@ vfbAllocateFramebufferMemory(vfbScreenInfoPtr pvfb)
         break;
 #endif /* CONFIG_MITSHM */
 
+#ifdef VFB_MEMFD
+    case MEMFD_FB:
+        vfbAllocateMemfdFramebuffer(pvfb);
+        break;
+#else
+    case MEMFD_FB:
+        break;
+#endif
+
     case NORMAL_MEMORY_FB:
         pvfb->pXWDHeader = (XWDFileHeader *) calloc(1, pvfb->sizeInBytes);
         break;
@@ -784,6 +966,16 @@ vfbCloseScreen(ScreenPtr pScreen)
 
     pScreen->CloseScreen = pvfb->closeScreen;
 
+#ifdef VFB_MEMFD
+    if (fbmemtype == MEMFD_FB) {
+        RemoveBlockAndWakeupHandlers(vfbMemfdBlockHandler,
+                                     (ServerWakeupHandlerProcPtr) NoopDDA,
+                                     pvfb);
+        pScreen->CreateScreenResources = pvfb->createScreenResources;
+        pvfb->pDamage = NULL;
+    }
+#endif
+
     /*
      * fb overwrites miCloseScreen, so do this here
      */
@@ -1033,6 +1225,11 @@ vfbScreenInit(ScreenPtr pScreen, int argc, char **argv)
 
     vfbWriteXWDFileHeader(pScreen);
 
+#ifdef VFB_MEMFD
+    if (fbmemtype == MEMFD_FB && !vfbMemfdScreenInit(pScreen))
+        return FALSE;
+#endif
+
     pScreen->blackPixel = pvfb->blackPixel;
     pScreen->whitePixel = pvfb->whitePixel;
 
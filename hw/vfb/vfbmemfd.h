@@ -0,0 +1,63 @@
+/* SPDX-License-Identifier: MIT OR X11
+ *
+ * @brief layout of the framebuffer Xvfb shares with -memfd
+ *
+ * The memfd starts with this header, followed at header_size by the
+ * screen in xwd format, just like the -fbdir files and -shmem segments.
+ * The pixels themselves are at pixels_offset.
+ *
+ * After rendering, the server appends the damaged boxes to the ring,
+ * seqlock style:
+ *
+ *   1. stores reserved = head + n, then a release fence
+ *   2. writes the n boxes, at boxes[head % ring_size] and on
+ *   3. stores head = head + n, with release semantics
+ *
+ * A consumer keeps its own count of the boxes it has seen, starting from
+ * head after reading the whole screen once, and then repeatedly:
+ *
+ *   1. loads head, with acquire semantics
+ *   2. if head - seen > ring_size, boxes were lost: reads the whole screen
+ *   3. otherwise copies boxes[seen % ring_size] up to head
+ *   4. issues an acquire fence and loads reserved: if reserved - seen >
+ *      ring_size, the server may have been overwriting boxes while we were
+ *      copying them, so reads the whole screen
+ *   5. reads the pixels of the boxes copied and sets seen to the head of 1.
+ *
+ * With the GCC builtins, the loads are __atomic_load_n(&h->head,
+ * __ATOMIC_ACQUIRE), __atomic_thread_fence(__ATOMIC_ACQUIRE) and
+ * __atomic_load_n(&h->reserved, __ATOMIC_RELAXED).
+ *
+ * Pixels may change again while they are read, but then their boxes come
+ * up again the next time around.
+ */
+#ifndef _XSERVER_VFB_MEMFD_H
+#define _XSERVER_VFB_MEMFD_H
+
+#include <stdint.h>
+
+#define VFB_MEMFD_MAGIC         0x62667658      /* "Xvfb" */
+#define VFB_MEMFD_VERSION       2
+#define VFB_DAMAGE_RING_SIZE    1024            /* a power of two */
+
+typedef struct {
+    int16_t x1, y1, x2, y2;
+} vfbDamageBox;
+
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t header_size;       /* offset of the xwd header */
+    uint32_t pixels_offset;
+    uint32_t width;
+    uint32_t height;
+    uint32_t bytes_per_line;
+    uint32_t bits_per_pixel;
+    uint32_t depth;
+    uint32_t ring_size;
+    uint64_t reserved;          /* boxes ever started to be written */
+    uint64_t head;              /* boxes ever added to the ring */
+    vfbDamageBox boxes[VFB_DAMAGE_RING_SIZE];
+} vfbMemfdHeader;
+
+#endif /* _XSERVER_VFB_MEMFD_H */
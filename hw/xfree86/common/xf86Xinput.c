@@ -329,6 +329,23 @@ ApplyTransformationMatrix(DeviceIntPtr dev)
                            PropModeReplace, 9, matrix, FALSE);
 }
 
+static void
+ApplyCoalesceMotion(DeviceIntPtr dev)
+{
+    InputInfoPtr pInfo = (InputInfoPtr) dev->public.devicePrivate;
+    BOOL coalesce;
+
+    if (!dev->valuator)
+        return;
+
+    coalesce = xf86SetBoolOption(pInfo->options, "CoalesceMotion", FALSE);
+    if (!coalesce)
+        return;
+
+    XIChangeDeviceProperty(dev, XIGetKnownProperty(XI_PROP_COALESCE_MOTION),
+                           XA_INTEGER, 8, PropModeReplace, 1, &coalesce, FALSE);
+}
+
 static void
 ApplyAutoRepeat(DeviceIntPtr dev)
 {
@@ -891,6 +908,7 @@ xf86InputDevicePostInit(DeviceIntPtr dev)
 {
     ApplyAccelerationSettings(dev);
     ApplyTransformationMatrix(dev);
+    ApplyCoalesceMotion(dev);
     ApplyAutoRepeat(dev);
     return Success;
 }
@@ -142,6 +142,7 @@ static const OptionInfoRec Options[] = {
     {OPTION_USE_GAMMA_LUT, "UseGammaLUT", OPTV_BOOLEAN, {0}, FALSE},
     {OPTION_ASYNC_FLIP_SECONDARIES, "AsyncFlipSecondaries", OPTV_BOOLEAN, {0}, FALSE},
     {OPTION_TEARFREE, "TearFree", OPTV_BOOLEAN, {0}, FALSE},
+    {OPTION_SHADOW_THREADS, "ShadowThreads", OPTV_INTEGER, {0}, FALSE},
     {-1, NULL, OPTV_NONE, {0}, FALSE}
 };
 
@@ -1265,6 +1266,16 @@ PreInit(ScrnInfoPtr pScrn, int flags)
                    ms->drmmode.shadow_enable ? "YES" : "NO");
 
         ms->drmmode.shadow_enable2 = msShouldDoubleShadow(pScrn, ms);
+
+        ms->drmmode.shadow_threads = 1;
+        if (ms->drmmode.shadow_enable &&
+            xf86GetOptValInteger(ms->drmmode.Options, OPTION_SHADOW_THREADS,
+                                 &ms->drmmode.shadow_threads)) {
+            ms->drmmode.shadow_threads = max(ms->drmmode.shadow_threads, 1);
+            xf86DrvMsg(pScrn->scrnIndex, X_CONFIG,
+                       "Shadow updates on up to %d threads\n",
+                       ms->drmmode.shadow_threads);
+        }
     } else {
         if (!pScrn->is_gpu) {
             MessageType from = xf86GetOptValBool(ms->drmmode.Options, OPTION_VARIABLE_REFRESH,
@@ -1384,6 +1395,8 @@ PreInit(ScrnInfoPtr pScrn, int flags)
         ms->shadow.Remove       = LoaderSymbolFromModule(mod, "shadowRemove");
         ms->shadow.Update32to24 = LoaderSymbolFromModule(mod, "shadowUpdate32to24");
         ms->shadow.UpdatePacked = LoaderSymbolFromModule(mod, "shadowUpdatePacked");
+        ms->shadow.CopyChanged  = LoaderSymbolFromModule(mod, "shadowCopyChanged");
+        ms->shadow.SetThreads   = LoaderSymbolFromModule(mod, "shadowSetThreads");
     }
 
     return TRUE;
@@ -1424,7 +1437,11 @@ msUpdateIntersect(modesettingPtr ms, shadowBufPtr pBuf, BoxPtr box,
     for (i = box->y2 - box->y1 - 1; i >= 0; i--) {
         unsigned char *o = old + i * stride,
                       *n = new + i * stride;
-        if (memcmp(o, n, width) != 0) {
+        if (ms->shadow.CopyChanged) {
+            if (ms->shadow.CopyChanged(o, n, width))
+                dirty = 1;
+        }
+        else if (memcmp(o, n, width) != 0) {
             dirty = 1;
             memcpy(o, n, width);
         }
@@ -1941,6 +1958,10 @@ ScreenInit(ScreenPtr pScreen, int argc, char **argv)
         return FALSE;
     }
 
+    /* msUpdatePacked() and msShadowWindow() are fine with that */
+    if (ms->drmmode.shadow_enable && ms->shadow.SetThreads)
+        ms->shadow.SetThreads(pScreen, ms->drmmode.shadow_threads);
+
     pScreen->CreateScreenResources = modesetCreateScreenResources;
 
     xf86SetBlackWhitePixels(pScreen);
@@ -65,6 +65,7 @@ typedef enum {
     OPTION_USE_GAMMA_LUT,
     OPTION_ASYNC_FLIP_SECONDARIES,
     OPTION_TEARFREE,
+    OPTION_SHADOW_THREADS,
 } modesettingOpts;
 
 typedef struct
@@ -154,6 +155,8 @@ typedef struct _modesettingRec {
         void (*Remove)(ScreenPtr, PixmapPtr);
         void (*Update32to24)(ScreenPtr, shadowBufPtr);
         void (*UpdatePacked)(ScreenPtr, shadowBufPtr);
+        Bool (*CopyChanged)(void *, const void *, int);
+        void (*SetThreads)(ScreenPtr, int);
     } shadow;
 
 #ifdef GLAMOR_HAS_GBM
@@ -109,6 +109,8 @@ typedef struct {
     Bool glamor;
     Bool shadow_enable;
     Bool shadow_enable2;
+    /** Option "ShadowThreads" */
+    int shadow_threads;
     /** Is Option "PageFlip" enabled? */
     Bool pageflip;
     Bool force_24_32;
@@ -599,6 +599,9 @@ typedef struct _DeviceIntRec {
     struct _SyncCounter *idle_counter;
 
     Bool ignoreXkbActionsBehaviors; /* TRUE if keys don't trigger behaviors and actions */
+
+    Bool coalesceMotion;        /* XI_PROP_COALESCE_MOTION, see mieq.c */
+    uint64_t coalescedMotion;   /* motion events merged into later ones */
 } DeviceIntRec;
 
 typedef struct {
@@ -92,6 +92,12 @@ typedef struct _WindowOpt {
     RegionPtr inputShape;       /* default: NULL */
     struct _OtherInputMasks *inputMasks;        /* default: NULL */
     DevCursorList deviceCursors;        /* default: NULL */
+    struct _PropertyIndex *propertyIndex;       /* default: NULL */
+    struct _ChildIndex *childIndex;     /* default: NULL */
+    int childCount;             /* default: 0, any child makes one */
+    struct _DeliveryCache *deliveryCache;       /* default: NULL */
+    struct _PassiveGrabIndex *grabIndex;        /* default: NULL */
+    int passiveGrabCount;       /* default: 0 */
 } WindowOptRec, *WindowOptPtr;
 
 #define BackgroundPixel	    2L
@@ -193,6 +199,12 @@ extern _X_EXPORT Mask DontPropagateMasks[];
 #define wBoundingShape(w)	wUseDefault(w, boundingShape, NULL)
 #define wClipShape(w)		wUseDefault(w, clipShape, NULL)
 #define wInputShape(w)          wUseDefault(w, inputShape, NULL)
+#define wPropertyIndex(w)	wUseDefault(w, propertyIndex, NULL)
+#define wChildIndex(w)		wUseDefault(w, childIndex, NULL)
+#define wChildCount(w)		wUseDefault(w, childCount, 0)
+#define wDeliveryCache(w)	wUseDefault(w, deliveryCache, NULL)
+#define wPassiveGrabIndex(w)	wUseDefault(w, grabIndex, NULL)
+#define wPassiveGrabCount(w)	wUseDefault(w, passiveGrabCount, 0)
 #define wBorderWidth(w)		((int) (w)->borderWidth)
 
 static inline PropertyPtr wUserProps(WindowPtr pWin) { return pWin->properties; }
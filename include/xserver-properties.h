@@ -49,6 +49,10 @@
  * [c6 c7 c8]   [1] */
 #define XI_PROP_TRANSFORM "Coordinate Transformation Matrix"
 
+/* BOOL. 1 - motion of this device still queued is merged into the next
+ * motion, when only raw events came in between */
+#define XI_PROP_COALESCE_MOTION "Coalesce Motion"
+
 /* STRING. Device node path of device */
 #define XI_PROP_DEVICE_NODE "Device Node"
 
@@ -5,6 +5,7 @@
 #ifndef _XSERVER_MI_PRIV_H
 #define _XSERVER_MI_PRIV_H
 
+#include <stdint.h>
 #include <X11/Xdefs.h>
 #include <X11/Xproto.h>
 #include <X11/Xprotostr.h>
@@ -45,6 +46,10 @@ void mieqProcessInputEvents(void);
 void mieqAddCallbackOnDrained(CallbackProcPtr callback, void *param);
 void mieqRemoveCallbackOnDrained(CallbackProcPtr callback, void *param);
 
+/* events delivered so far, and their total and worst time from being read
+ * off the device to being delivered, in microseconds */
+void mieqGetLatencyStats(uint64_t *count, uint64_t *total_us, uint64_t *max_us);
+
 /**
  * Custom input event handler. If you need to process input events in some
  * other way than the default path, register an input event handler for the
@@ -84,6 +89,13 @@ void miSetShape(WindowPtr pWin, int kind);
 void miChangeBorderWidth(WindowPtr pWin, unsigned int width);
 void miMarkUnrealizedWindow(WindowPtr pChild, WindowPtr pWin, Bool fromConfigure);
 WindowPtr miSpriteTrace(SpritePtr pSprite, int x, int y);
+
+/* topmost child of pParent that x, y (in screen coordinates) hits, or
+ * NullWindow; see miwinindex.c */
+WindowPtr miChildAt(WindowPtr pParent, int x, int y);
+/* after a child was mapped, unmapped, moved, resized or restacked */
+void miChildIndexInvalidate(WindowPtr pParent);
+void miChildIndexFree(WindowPtr pWin);
 WindowPtr miXYToWindow(ScreenPtr pScreen, SpritePtr pSprite, int x, int y);
 
 _X_EXPORT /* used by in-tree libwfb.so module */
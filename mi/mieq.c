@@ -48,6 +48,7 @@ in this Software without prior written authorization from The Open Group.
 #include   "mi/mi_priv.h"
 #include   "mi/mipointer_priv.h"
 #include   "os/bug_priv.h"
+#include   "os/osdep.h"
 #include   "os/screensaver.h"
 
 #include   "misc.h"
@@ -65,105 +66,191 @@ in this Software without prior written authorization from The Open Group.
 #endif
 
 /* Maximum size should be initial size multiplied by a power of 2 */
-#define QUEUE_INITIAL_SIZE                 512
-#define QUEUE_RESERVED_SIZE                 64
+#define QUEUE_INITIAL_SIZE                  64
 #define QUEUE_MAXIMUM_SIZE                4096
 #define QUEUE_DROP_BACKTRACE_FREQUENCY     100
 #define QUEUE_DROP_BACKTRACE_MAX            10
+#define COALESCE_MAX_RAW                     4  /* raw events between motions */
 
 #define EnqueueScreen(dev) dev->spriteInfo->sprite->pEnqueueScreen
 #define DequeueScreen(dev) dev->spriteInfo->sprite->pDequeueScreen
 
 typedef struct _Event {
-    InternalEvent *events;
+    InternalEvent event;
     ScreenPtr pScreen;
     DeviceIntPtr pDev;          /* device this event _originated_ from */
+    HWEventQueueType sequence;  /* position among the events of all devices */
+    CARD64 stamp;               /* when the device was read, in us */
 } EventRec, *EventPtr;
 
+/*
+ * Events are queued in one ring per device id (0 for events without a
+ * device). Writers are serialized by input_lock, the main thread takes
+ * events out without it, so it never waits for the input thread reading
+ * a device. A full ring isn't reallocated but chained to a twice as
+ * large successor, which the reader moves on to once it has drained the
+ * old one.
+ */
+typedef struct _EventRing {
+    struct _EventRing *next;    /* set once the writer moved on */
+    unsigned int size;          /* number of events, power of two */
+    unsigned int head;          /* free running, advanced by the reader */
+    unsigned int tail;          /* free running, advanced by the writer */
+    EventRec events[];
+} EventRingRec, *EventRingPtr;
+
+typedef struct _EventSource {
+    EventRingPtr write;         /* ring the writer fills */
+    EventRingPtr read;          /* ring the reader drains */
+    unsigned int pushed;        /* events queued, written by the writer */
+    unsigned int popped;        /* events taken out, written by the reader */
+} EventSourceRec, *EventSourcePtr;
+
 typedef struct _EventQueue {
-    HWEventQueueType head, tail;        /* long for SetInputCheck */
+    HWEventQueueType head, tail;        /* events taken out and queued, for SetInputCheck */
     CARD32 lastEventTime;       /* to avoid time running backwards */
-    int lastMotion;             /* device ID if last event motion? */
-    EventRec *events;           /* our queue as an array */
-    size_t nevents;             /* the number of buckets in our queue */
     size_t dropped;             /* counter for number of consecutive dropped events */
+    EventSourceRec sources[MAXDEVICES];
+    unsigned char active[MAXDEVICES];   /* ids of the sources with a ring */
+    int nactive;
+    int last;                   /* index into active the reader last took from */
     mieqHandler handlers[128];  /* custom event handler */
 } EventQueueRec, *EventQueuePtr;
 
 static EventQueueRec miEventQueue;
 
+/* time from reading the device to delivering its events */
+static struct {
+    uint64_t count;
+    uint64_t total;
+    uint64_t max;
+} miEventLatency;
+
 static CallbackListPtr miCallbacksWhenDrained = NULL;
 
-static size_t
-mieqNumEnqueued(EventQueuePtr eventQueue)
+static inline HWEventQueueType
+mieqNextSequence(HWEventQueueType sequence)
 {
-    size_t n_enqueued = 0;
+    return (HWEventQueueType) ((unsigned int) sequence + 1);
+}
 
-    if (eventQueue->nevents) {
-        /* % is not well-defined with negative numbers... sigh */
-        n_enqueued = eventQueue->tail - eventQueue->head + eventQueue->nevents;
-        if (n_enqueued >= eventQueue->nevents)
-            n_enqueued -= eventQueue->nevents;
-    }
-    return n_enqueued;
+static EventRingPtr
+mieqAllocRing(unsigned int size)
+{
+    EventRingPtr ring = calloc(1, sizeof(EventRingRec) + size * sizeof(EventRec));
+
+    if (ring)
+        ring->size = size;
+    return ring;
 }
 
 /* Pre-condition: Called with input_lock held */
 static Bool
-mieqGrowQueue(EventQueuePtr eventQueue, size_t new_nevents)
+mieqGrowSource(EventQueuePtr eventQueue, int id)
 {
-    size_t i, n_enqueued, first_hunk;
-    EventRec *new_events;
+    EventSourcePtr src = &eventQueue->sources[id];
+    EventRingPtr ring, old = src->write;
 
-    if (!eventQueue) {
-        ErrorF("[mi] mieqGrowQueue called with a NULL eventQueue\n");
+    if (old && src->pushed - LoadAcquire(&src->popped) >= QUEUE_MAXIMUM_SIZE)
         return FALSE;
-    }
 
-    if (new_nevents <= eventQueue->nevents)
+    ring = mieqAllocRing(old ? min(old->size << 1, QUEUE_MAXIMUM_SIZE)
+                             : QUEUE_INITIAL_SIZE);
+    if (!ring) {
+        ErrorF("[mi] mieqGrowSource memory allocation error.\n");
         return FALSE;
+    }
 
-    new_events = calloc(new_nevents, sizeof(EventRec));
-    if (new_events == NULL) {
-        ErrorF("[mi] mieqGrowQueue memory allocation error.\n");
-        return FALSE;
+    src->write = ring;
+    if (old) {
+        StoreRelease(&old->next, ring);
+    }
+    else {
+        src->read = ring;
+        eventQueue->active[eventQueue->nactive] = id;
+        StoreRelease(&eventQueue->nactive, eventQueue->nactive + 1);
     }
 
-    n_enqueued = mieqNumEnqueued(eventQueue);
+    return TRUE;
+}
+
+/* The oldest event still queued for src, NULL if there is none */
+static EventPtr
+mieqPeek(EventSourcePtr src)
+{
+    EventRingPtr ring = src->read, next;
+
+    for (;;) {
+        if (ring->head != LoadAcquire(&ring->tail))
+            return &ring->events[ring->head & (ring->size - 1)];
+
+        next = LoadAcquire(&ring->next);
+        if (!next)
+            return NULL;
+
+        /* the writer was done with this ring before linking the next one,
+         * so whatever tail we see now is final */
+        if (ring->head != LoadAcquire(&ring->tail))
+            continue;
 
-    /* First copy the existing events */
-    first_hunk = eventQueue->nevents - eventQueue->head;
-    if (eventQueue->events) {
-        memcpy(new_events,
-               &eventQueue->events[eventQueue->head],
-               first_hunk * sizeof(EventRec));
-        memcpy(&new_events[first_hunk],
-               eventQueue->events, eventQueue->head * sizeof(EventRec));
+        src->read = next;
+        free(ring);
+        ring = next;
     }
+}
 
-    /* Initialize the new portion */
-    for (i = eventQueue->nevents; i < new_nevents; i++) {
-        InternalEvent *evlist = InitEventList(1);
+/*
+ * The event n places behind the one mieqPeek() returned last, NULL if it
+ * isn't queued yet or is in the next ring. Events up to the tail are the
+ * reader's, so it may change them too.
+ */
+static EventPtr
+mieqPeekAhead(EventSourcePtr src, unsigned int n)
+{
+    EventRingPtr ring = src->read;
 
-        if (!evlist) {
-            size_t j;
+    if (LoadAcquire(&ring->tail) - ring->head <= n)
+        return NULL;
+    return &ring->events[(ring->head + n) & (ring->size - 1)];
+}
 
-            for (j = 0; j < i; j++)
-                FreeEventList(new_events[j].events, 1);
-            free(new_events);
-            return FALSE;
+/* Hand the slot of the event returned by mieqPeek() back to the writer */
+static void
+mieqPop(EventSourcePtr src)
+{
+    EventRingPtr ring = src->read;
+
+    StoreRelease(&ring->head, ring->head + 1);
+    StoreRelease(&src->popped, src->popped + 1);
+    miEventQueue.head = mieqNextSequence(miEventQueue.head);
+}
+
+/* The next event in the order they were queued, NULL if there is none */
+static EventPtr
+mieqNext(EventSourcePtr *source)
+{
+    HWEventQueueType sequence = miEventQueue.head;
+    int nactive, i;
+
+    if (sequence == LoadAcquire(&miEventQueue.tail))
+        return NULL;
+
+    /* events come in bursts from one device, start looking there */
+    nactive = LoadAcquire(&miEventQueue.nactive);
+    for (i = 0; i < nactive; i++) {
+        int n = (miEventQueue.last + i) % nactive;
+        EventSourcePtr src = &miEventQueue.sources[miEventQueue.active[n]];
+        EventPtr e = mieqPeek(src);
+
+        if (e && e->sequence == sequence) {
+            miEventQueue.last = n;
+            *source = src;
+            return e;
         }
-        new_events[i].events = evlist;
     }
 
-    /* And update our record */
-    eventQueue->tail = n_enqueued;
-    eventQueue->head = 0;
-    eventQueue->nevents = new_nevents;
-    free(eventQueue->events);
-    eventQueue->events = new_events;
-
-    return TRUE;
+    BUG_WARN_MSG(TRUE, "[mi] event %d missing from the queue\n", sequence);
+    return NULL;
 }
 
 Bool
@@ -172,11 +259,6 @@ mieqInit(void)
     memset(&miEventQueue, 0, sizeof(miEventQueue));
     miEventQueue.lastEventTime = GetTimeInMillis();
 
-    input_lock();
-    if (!mieqGrowQueue(&miEventQueue, QUEUE_INITIAL_SIZE))
-        FatalError("Could not allocate event queue.\n");
-    input_unlock();
-
     SetInputCheck(&miEventQueue.head, &miEventQueue.tail);
     return TRUE;
 }
@@ -186,13 +268,34 @@ mieqFini(void)
 {
     int i;
 
-    for (i = 0; i < miEventQueue.nevents; i++) {
-        if (miEventQueue.events[i].events != NULL) {
-            FreeEventList(miEventQueue.events[i].events, 1);
-            miEventQueue.events[i].events = NULL;
+    for (i = 0; i < MAXDEVICES; i++) {
+        EventRingPtr ring = miEventQueue.sources[i].read, next;
+
+        while (ring) {
+            next = ring->next;
+            free(ring);
+            ring = next;
         }
+        miEventQueue.sources[i].read = NULL;
+        miEventQueue.sources[i].write = NULL;
     }
-    free(miEventQueue.events);
+    miEventQueue.nactive = 0;
+
+    if (miEventLatency.count)
+        LogMessageVerb(X_INFO, 3, "[mi] input latency: %llu events, "
+                       "%llu us average, %llu us max\n",
+                       (unsigned long long) miEventLatency.count,
+                       (unsigned long long) (miEventLatency.total /
+                                             miEventLatency.count),
+                       (unsigned long long) miEventLatency.max);
+}
+
+void
+mieqGetLatencyStats(uint64_t *count, uint64_t *total_us, uint64_t *max_us)
+{
+    *count = miEventLatency.count;
+    *total_us = miEventLatency.total;
+    *max_us = miEventLatency.max;
 }
 
 /*
@@ -203,27 +306,17 @@ mieqFini(void)
 void
 mieqEnqueue(DeviceIntPtr pDev, InternalEvent *e)
 {
-    unsigned int oldtail = miEventQueue.tail;
-    InternalEvent *evt;
-    int isMotion = 0;
-    int evlen;
+    int id = pDev ? pDev->id : 0;
+    EventSourcePtr src = &miEventQueue.sources[id];
+    EventRingPtr ring = src->write;
+    EventPtr evt;
     Time time;
-    size_t n_enqueued;
+    CARD64 stamp;
 
     verify_internal_event(e);
 
-    n_enqueued = mieqNumEnqueued(&miEventQueue);
-
-    /* avoid merging events from different devices */
-    if (e->any.type == ET_Motion)
-        isMotion = pDev->id;
-
-    if (isMotion && isMotion == miEventQueue.lastMotion &&
-        oldtail != miEventQueue.head) {
-        oldtail = (oldtail - 1) % miEventQueue.nevents;
-    }
-    else if (n_enqueued + 1 == miEventQueue.nevents) {
-        if (!mieqGrowQueue(&miEventQueue, miEventQueue.nevents << 1)) {
+    if (!ring || ring->tail - LoadAcquire(&ring->head) == ring->size) {
+        if (!mieqGrowSource(&miEventQueue, id)) {
             /* Toss events which come in late.  Usually this means your server's
              * stuck in an infinite loop in the main thread.
              */
@@ -250,12 +343,11 @@ mieqEnqueue(DeviceIntPtr pDev, InternalEvent *e)
             }
             return;
         }
-        oldtail = miEventQueue.tail;
+        ring = src->write;
     }
 
-    evlen = e->any.length;
-    evt = miEventQueue.events[oldtail].events;
-    memcpy(evt, e, evlen);
+    evt = &ring->events[ring->tail & (ring->size - 1)];
+    memcpy(&evt->event, e, e->any.length);
 
     time = e->any.time;
     /* Make sure that event times don't go backwards - this
@@ -264,12 +356,18 @@ mieqEnqueue(DeviceIntPtr pDev, InternalEvent *e)
         miEventQueue.lastEventTime - time < 10000)
         e->any.time = miEventQueue.lastEventTime;
 
-    miEventQueue.lastEventTime = evt->any.time;
-    miEventQueue.events[oldtail].pScreen = pDev ? EnqueueScreen(pDev) : NULL;
-    miEventQueue.events[oldtail].pDev = pDev;
+    miEventQueue.lastEventTime = evt->event.any.time;
+    evt->pScreen = pDev ? EnqueueScreen(pDev) : NULL;
+    evt->pDev = pDev;
+    evt->sequence = miEventQueue.tail;
+
+    /* events generated outside of a device read are stamped right here */
+    stamp = InputThreadReadTime();
+    evt->stamp = stamp ? stamp : GetTimeInMicros();
 
-    miEventQueue.lastMotion = isMotion;
-    miEventQueue.tail = (oldtail + 1) % miEventQueue.nevents;
+    src->pushed++;
+    StoreRelease(&ring->tail, ring->tail + 1);
+    StoreRelease(&miEventQueue.tail, mieqNextSequence(miEventQueue.tail));
 }
 
 /**
@@ -514,18 +612,76 @@ mieqProcessDeviceEvent(DeviceIntPtr dev, InternalEvent *event, ScreenPtr screen)
     }
 }
 
+/*
+ * For devices with XI_PROP_COALESCE_MOTION set: merge the motion event just
+ * taken out of src into the next motion of the device, if nothing but raw
+ * events of the device were queued in between, on the same screen. The
+ * raw events still go out as they are, for XI2 clients selecting them.
+ * Valuators the later motion doesn't have are taken over, so none of the
+ * axes' changes are lost. Crossing events are generated from where the
+ * later motion ends up, as for any other motion.
+ *
+ * @return TRUE if the event was merged and is not to be processed
+ */
+static Bool
+mieqCoalesceMotion(EventSourcePtr src, DeviceIntPtr dev, ScreenPtr screen,
+                   DeviceEvent *event)
+{
+    HWEventQueueType sequence = miEventQueue.head;
+    EventPtr next;
+
+    if (!mieqPeek(src))
+        return FALSE;
+
+    for (unsigned int n = 0; n <= COALESCE_MAX_RAW; n++) {
+        DeviceEvent *motion;
+
+        next = mieqPeekAhead(src, n);
+        if (!next || next->sequence != sequence || next->pScreen != screen)
+            return FALSE;
+        sequence = mieqNextSequence(sequence);
+
+        if (next->event.any.type == ET_RawMotion)
+            continue;
+        if (next->event.any.type != ET_Motion)
+            return FALSE;
+
+        motion = &next->event.device_event;
+        if (motion->sourceid != event->sourceid ||
+            motion->flags != event->flags)
+            return FALSE;
+
+        for (int i = 0; i < MAX_VALUATORS; i++) {
+            if (!BitIsOn(event->valuators.mask, i) ||
+                BitIsOn(motion->valuators.mask, i))
+                continue;
+            SetBit(motion->valuators.mask, i);
+            if (BitIsOn(event->valuators.mode, i))
+                SetBit(motion->valuators.mode, i);
+            else
+                ClearBit(motion->valuators.mode, i);
+            motion->valuators.data[i] = event->valuators.data[i];
+        }
+
+        dev->coalescedMotion++;
+        return TRUE;
+    }
+    return FALSE;
+}
+
 /* Call this from ProcessInputEvents(). */
 void
 mieqProcessInputEvents(void)
 {
-    EventRec *e = NULL;
+    EventSourcePtr src;
+    EventPtr e, next;
     ScreenPtr screen;
     InternalEvent event;
     DeviceIntPtr dev = NULL, master = NULL;
+    CARD64 stamp, latency;
+    size_t dropped;
     static Bool inProcessInputEvents = FALSE;
 
-    input_lock();
-
     /*
      * report an error if mieqProcessInputEvents() is called recursively;
      * this can happen, e.g., if something in the mieqProcessDeviceEvent()
@@ -535,23 +691,36 @@ mieqProcessInputEvents(void)
     inProcessInputEvents = TRUE;
 
     if (miEventQueue.dropped) {
+        input_lock();
+        dropped = miEventQueue.dropped;
+        miEventQueue.dropped = 0;
+        input_unlock();
+
         ErrorF("[mi] EQ processing has resumed after %lu dropped events.\n",
-               (unsigned long) miEventQueue.dropped);
+               (unsigned long) dropped);
         ErrorF
             ("[mi] This may be caused by a misbehaving driver monopolizing the server's resources.\n");
-        miEventQueue.dropped = 0;
     }
 
-    while (miEventQueue.head != miEventQueue.tail) {
-        e = &miEventQueue.events[miEventQueue.head];
-
-        event = *e->events;
+    while ((e = mieqNext(&src)) != NULL) {
+        event = e->event;
         dev = e->pDev;
         screen = e->pScreen;
+        stamp = e->stamp;
 
-        miEventQueue.head = (miEventQueue.head + 1) % miEventQueue.nevents;
+        mieqPop(src);
 
-        input_unlock();
+        /* A newer motion of the same device was queued right behind this
+         * one, which makes this one obsolete. */
+        if (dev && event.any.type == ET_Motion &&
+            (next = mieqPeek(src)) != NULL &&
+            next->sequence == miEventQueue.head &&
+            next->pDev == dev && next->event.any.type == ET_Motion)
+            continue;
+
+        if (dev && dev->coalesceMotion && event.any.type == ET_Motion &&
+            mieqCoalesceMotion(src, dev, screen, &event.device_event))
+            continue;
 
         master = (dev) ? GetMaster(dev, MASTER_ATTACHED) : NULL;
 
@@ -575,13 +744,17 @@ mieqProcessInputEvents(void)
               event.device_event.flags & TOUCH_POINTER_EMULATED)))
             miPointerUpdateSprite(dev);
 
-        input_lock();
+        latency = GetTimeInMicros() - stamp;
+        miEventLatency.count++;
+        miEventLatency.total += latency;
+        if (latency > miEventLatency.max)
+            miEventLatency.max = latency;
     }
 
     inProcessInputEvents = FALSE;
 
+    input_lock();
     CallCallbacks(&miCallbacksWhenDrained, NULL);
-
     input_unlock();
 }
 
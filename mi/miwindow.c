@@ -745,43 +745,16 @@ miMarkUnrealizedWindow(WindowPtr pChild, WindowPtr pWin, Bool fromConfigure)
 WindowPtr
 miSpriteTrace(SpritePtr pSprite, int x, int y)
 {
-    WindowPtr pWin;
-    BoxRec box;
-
-    pWin = DeepestSpriteWin(pSprite)->firstChild;
-    while (pWin) {
-        if ((pWin->mapped) &&
-            (x >= pWin->drawable.x - wBorderWidth(pWin)) &&
-            (x < pWin->drawable.x + (int) pWin->drawable.width +
-             wBorderWidth(pWin)) &&
-            (y >= pWin->drawable.y - wBorderWidth(pWin)) &&
-            (y < pWin->drawable.y + (int) pWin->drawable.height +
-             wBorderWidth(pWin))
-            /* When a window is shaped, a further check
-             * is made to see if the point is inside
-             * borderSize
-             */
-            && (!wBoundingShape(pWin) || PointInBorderSize(pWin, x, y))
-            && (!wInputShape(pWin) ||
-                RegionContainsPoint(wInputShape(pWin),
-                                    x - pWin->drawable.x,
-                                    y - pWin->drawable.y, &box))
-            /* In rootless mode windows may be offscreen, even when
-             * they're in X's stack. (E.g. if the native window system
-             * implements some form of virtual desktop system).
-             */
-            && !pWin->unhittable) {
-            if (pSprite->spriteTraceGood >= pSprite->spriteTraceSize) {
-                pSprite->spriteTraceSize += 10;
-                pSprite->spriteTrace = reallocarray(pSprite->spriteTrace,
-                                                    pSprite->spriteTraceSize,
-                                                    sizeof(WindowPtr));
-            }
-            pSprite->spriteTrace[pSprite->spriteTraceGood++] = pWin;
-            pWin = pWin->firstChild;
+    WindowPtr pWin = DeepestSpriteWin(pSprite);
+
+    while ((pWin = miChildAt(pWin, x, y))) {
+        if (pSprite->spriteTraceGood >= pSprite->spriteTraceSize) {
+            pSprite->spriteTraceSize += 10;
+            pSprite->spriteTrace = reallocarray(pSprite->spriteTrace,
+                                                pSprite->spriteTraceSize,
+                                                sizeof(WindowPtr));
         }
-        else
-            pWin = pWin->nextSib;
+        pSprite->spriteTrace[pSprite->spriteTraceGood++] = pWin;
     }
     return DeepestSpriteWin(pSprite);
 }
@@ -0,0 +1,267 @@
+/* SPDX-License-Identifier: MIT OR X11
+ *
+ * @brief grid index of mapped children, for pointer hit testing
+ *
+ * miSpriteTrace() looks for the topmost mapped child under the pointer on
+ * every level, for every motion event. Under a compositing manager the
+ * root easily has hundreds of children, most of them nowhere near the
+ * pointer, so windows with many children get a uniform grid over the
+ * border boxes of their mapped children. Each cell lists the children
+ * overlapping it in stacking order, topmost first, so the first one of a
+ * cell passing the full hit test is the one the sibling walk would find.
+ *
+ * Boxes are relative to the parent, so moving the parent leaves its index
+ * alone. Anything that maps, unmaps, moves, resizes or restacks a child
+ * marks the index stale, and it's rebuilt on the next hit test. Shapes,
+ * which only ever cut into the border box, and unhittable are tested on
+ * the candidates, as before.
+ */
+#include <dix-config.h>
+
+#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "dix/input_priv.h"
+#include "dix/window_priv.h"
+#include "mi/mi_priv.h"
+
+#include "windowstr.h"
+
+#define CHILD_INDEX_MIN         16      /* children to have one */
+#define CHILD_INDEX_MAX_CELLS   32      /* per side */
+
+typedef struct _ChildIndex {
+    Bool valid;
+    int x1, y1, x2, y2;         /* all mapped children, relative */
+    int cols, rows;
+    int cellWidth, cellHeight;
+    int *cells;                 /* where each cell starts in windows */
+    WindowPtr *windows;         /* of all cells, topmost first in each */
+    int cellsSize, windowsSize;
+} ChildIndexRec, *ChildIndexPtr;
+
+/* whether x, y (in screen coordinates) is in the window, as far as input
+ * goes */
+static inline Bool
+miChildHit(WindowPtr pWin, int x, int y)
+{
+    BoxRec box;
+
+    return (pWin->mapped) &&
+        (x >= pWin->drawable.x - wBorderWidth(pWin)) &&
+        (x < pWin->drawable.x + (int) pWin->drawable.width +
+         wBorderWidth(pWin)) &&
+        (y >= pWin->drawable.y - wBorderWidth(pWin)) &&
+        (y < pWin->drawable.y + (int) pWin->drawable.height +
+         wBorderWidth(pWin))
+        /* When a window is shaped, a further check
+         * is made to see if the point is inside
+         * borderSize
+         */
+        && (!wBoundingShape(pWin) || PointInBorderSize(pWin, x, y))
+        && (!wInputShape(pWin) ||
+            RegionContainsPoint(wInputShape(pWin),
+                                x - pWin->drawable.x,
+                                y - pWin->drawable.y, &box))
+        /* In rootless mode windows may be offscreen, even when
+         * they're in X's stack. (E.g. if the native window system
+         * implements some form of virtual desktop system).
+         */
+        && !pWin->unhittable;
+}
+
+/* the border box of a child, relative to its parent */
+static inline void
+miChildBox(WindowPtr pChild, BoxPtr box)
+{
+    int bw = wBorderWidth(pChild);
+
+    box->x1 = pChild->origin.x - bw;
+    box->y1 = pChild->origin.y - bw;
+    box->x2 = pChild->origin.x + (int) pChild->drawable.width + bw;
+    box->y2 = pChild->origin.y + (int) pChild->drawable.height + bw;
+}
+
+/* windows in each cell, with side cells per side, and in all of them */
+static int
+miChildIndexCount(ChildIndexPtr idx, WindowPtr pParent, int side)
+{
+    int total = 0;
+
+    idx->cols = idx->rows = side;
+    idx->cellWidth = max((idx->x2 - idx->x1 + side - 1) / side, 1);
+    idx->cellHeight = max((idx->y2 - idx->y1 + side - 1) / side, 1);
+    memset(idx->cells, 0, (side * side + 1) * sizeof(int));
+
+    for (WindowPtr pChild = pParent->firstChild; pChild;
+         pChild = pChild->nextSib) {
+        BoxRec box;
+
+        if (!pChild->mapped)
+            continue;
+        miChildBox(pChild, &box);
+        if (box.x1 >= box.x2 || box.y1 >= box.y2)
+            continue;
+        for (int cy = (box.y1 - idx->y1) / idx->cellHeight;
+             cy <= (box.y2 - 1 - idx->y1) / idx->cellHeight; cy++)
+            for (int cx = (box.x1 - idx->x1) / idx->cellWidth;
+                 cx <= (box.x2 - 1 - idx->x1) / idx->cellWidth; cx++) {
+                idx->cells[cy * side + cx]++;
+                total++;
+            }
+    }
+    return total;
+}
+
+/* (re)build the index of a window, FALSE leaves it to the sibling walk */
+static Bool
+miChildIndexBuild(WindowPtr pParent)
+{
+    ChildIndexPtr idx = wChildIndex(pParent);
+    int children = 0, mapped = 0, side = 1, total, ncells;
+
+    idx->x1 = idx->y1 = INT_MAX;
+    idx->x2 = idx->y2 = INT_MIN;
+    for (WindowPtr pChild = pParent->firstChild; pChild;
+         pChild = pChild->nextSib) {
+        BoxRec box;
+
+        children++;
+        if (!pChild->mapped)
+            continue;
+        miChildBox(pChild, &box);
+        idx->x1 = min(idx->x1, box.x1);
+        idx->y1 = min(idx->y1, box.y1);
+        idx->x2 = max(idx->x2, box.x2);
+        idx->y2 = max(idx->y2, box.y2);
+        mapped++;
+    }
+
+    if (children < CHILD_INDEX_MIN) {
+        miChildIndexFree(pParent);
+        return FALSE;
+    }
+    if (!mapped) {
+        idx->x2 = idx->x1;
+        idx->valid = TRUE;
+        return TRUE;
+    }
+
+    /* about a window per cell, if they were spread evenly */
+    while (side < CHILD_INDEX_MAX_CELLS && side * side < mapped)
+        side <<= 1;
+    ncells = side * side + 1;
+    if (ncells > idx->cellsSize) {
+        int *cells = reallocarray(idx->cells, ncells, sizeof(int));
+
+        if (!cells)
+            return FALSE;
+        idx->cells = cells;
+        idx->cellsSize = ncells;
+    }
+
+    /* coarser, when large windows would be in too many cells */
+    total = miChildIndexCount(idx, pParent, side);
+    while (side > 1 && total > 8 * mapped + side * side)
+        total = miChildIndexCount(idx, pParent, side >>= 1);
+
+    if (total > idx->windowsSize) {
+        WindowPtr *windows = reallocarray(idx->windows, total,
+                                          sizeof(WindowPtr));
+
+        if (!windows)
+            return FALSE;
+        idx->windows = windows;
+        idx->windowsSize = total;
+    }
+
+    /* where each cell ends, then filled from the bottom of the stack up */
+    ncells = side * side;
+    for (int c = 0, end = 0; c <= ncells; c++) {
+        end += idx->cells[c];
+        idx->cells[c] = end;
+    }
+    for (WindowPtr pChild = pParent->lastChild; pChild;
+         pChild = pChild->prevSib) {
+        BoxRec box;
+
+        if (!pChild->mapped)
+            continue;
+        miChildBox(pChild, &box);
+        if (box.x1 >= box.x2 || box.y1 >= box.y2)
+            continue;
+        for (int cy = (box.y1 - idx->y1) / idx->cellHeight;
+             cy <= (box.y2 - 1 - idx->y1) / idx->cellHeight; cy++)
+            for (int cx = (box.x1 - idx->x1) / idx->cellWidth;
+                 cx <= (box.x2 - 1 - idx->x1) / idx->cellWidth; cx++)
+                idx->windows[--idx->cells[cy * side + cx]] = pChild;
+    }
+
+    idx->valid = TRUE;
+    return TRUE;
+}
+
+void
+miChildIndexInvalidate(WindowPtr pParent)
+{
+    if (pParent && wChildIndex(pParent))
+        wChildIndex(pParent)->valid = FALSE;
+}
+
+void
+miChildIndexFree(WindowPtr pWin)
+{
+    ChildIndexPtr idx = wChildIndex(pWin);
+
+    if (idx) {
+        free(idx->cells);
+        free(idx->windows);
+        free(idx);
+        pWin->optional->childIndex = NULL;
+    }
+}
+
+/* whether the window has enough children for an index */
+static inline Bool
+miChildIndexWanted(WindowPtr pParent)
+{
+    return wChildCount(pParent) >= CHILD_INDEX_MIN;
+}
+
+WindowPtr
+miChildAt(WindowPtr pParent, int x, int y)
+{
+    ChildIndexPtr idx = wChildIndex(pParent);
+    WindowPtr pWin;
+    int cx, cy, c;
+
+    /* the index hangs off the optional record */
+    if (!idx && miChildIndexWanted(pParent) && MakeWindowOptional(pParent))
+        idx = pParent->optional->childIndex =
+            calloc(1, sizeof(ChildIndexRec));
+    if (idx && !idx->valid && !miChildIndexBuild(pParent))
+        idx = wChildIndex(pParent);
+
+    if (!idx || !idx->valid) {
+        for (pWin = pParent->firstChild; pWin; pWin = pWin->nextSib)
+            if (miChildHit(pWin, x, y))
+                return pWin;
+        return NullWindow;
+    }
+
+    x -= pParent->drawable.x;
+    y -= pParent->drawable.y;
+    if (x < idx->x1 || x >= idx->x2 || y < idx->y1 || y >= idx->y2)
+        return NullWindow;
+    cx = (x - idx->x1) / idx->cellWidth;
+    cy = (y - idx->y1) / idx->cellHeight;
+    c = cy * idx->cols + cx;
+    x += pParent->drawable.x;
+    y += pParent->drawable.y;
+
+    for (int i = idx->cells[c]; i < idx->cells[c + 1]; i++)
+        if (miChildHit(idx->windows[i], x, y))
+            return idx->windows[i];
+    return NullWindow;
+}
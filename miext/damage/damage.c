@@ -123,6 +123,120 @@ getDrawableDamageRef(DrawablePtr pDrawable)
     DamagePtr	*pPrev = (DamagePtr *) \
 	dixLookupPrivateAddr(&(pWindow)->devPrivates, damageWinPrivateKey)
 
+#define DAMAGE_COALESCE_TILE 32
+
+static inline int
+damageTileFloor(int v, int tile)
+{
+    return v >= 0 ? v / tile * tile : -((tile - 1 - v) / tile * tile);
+}
+
+static inline int
+damageTileCeil(int v, int tile)
+{
+    return -damageTileFloor(-v, tile);
+}
+
+/*
+ * Snap every box of pRegion out to the tile grid, clipped to the region
+ * extents, and merge. The tile size doubles until at most half of the box
+ * limit is left, so following ops have room to accumulate before the next
+ * round. Already snapped boxes stay put, which keeps repeated rounds cheap.
+ */
+static void
+damageCoalesce(DamagePtr pDamage, RegionPtr pRegion)
+{
+    int target = max(pDamage->coalesceBoxes / 2, 1);
+    int span, nbox = RegionNumRects(pRegion);
+    BoxRec extents = *RegionExtents(pRegion);
+    BoxPtr boxes;
+
+    span = max(extents.x2 - extents.x1, extents.y2 - extents.y1);
+    boxes = calloc(nbox, sizeof(BoxRec));
+    if (!boxes)
+        goto bounds;
+
+    for (int tile = pDamage->coalesceTile; tile < span; tile *= 2) {
+        BoxPtr pBox = RegionRects(pRegion);
+        RegionRec tiled;
+        int n = 0;
+
+        for (int i = 0; i < nbox; i++) {
+            BoxRec b;
+
+            b.x1 = max(damageTileFloor(pBox[i].x1, tile), extents.x1);
+            b.y1 = max(damageTileFloor(pBox[i].y1, tile), extents.y1);
+            b.x2 = min(damageTileCeil(pBox[i].x2, tile), extents.x2);
+            b.y2 = min(damageTileCeil(pBox[i].y2, tile), extents.y2);
+
+            /* neighbours within a band mostly land in the same tile */
+            if (n && BOX_SAME(&boxes[n - 1], &b))
+                continue;
+            boxes[n++] = b;
+        }
+
+        if (!RegionInitBoxes(&tiled, boxes, n)) {
+            RegionUninit(&tiled);
+            break;
+        }
+        RegionCopy(pRegion, &tiled);
+        RegionUninit(&tiled);
+
+        if (RegionNumRects(pRegion) <= target) {
+            free(boxes);
+            return;
+        }
+
+        /* snapping may split bands, so the box count can go up */
+        if (RegionNumRects(pRegion) > nbox) {
+            BoxPtr grown = reallocarray(boxes, RegionNumRects(pRegion),
+                                        sizeof(BoxRec));
+
+            if (!grown)
+                break;
+            boxes = grown;
+        }
+        nbox = RegionNumRects(pRegion);
+    }
+    free(boxes);
+
+ bounds:
+    RegionReset(pRegion, &extents);
+}
+
+static inline Bool
+damageNeedsCoalesce(DamagePtr pDamage, RegionPtr pRegion)
+{
+    return pDamage->coalesceBoxes &&
+        RegionNumRects(pRegion) > pDamage->coalesceBoxes;
+}
+
+static void
+damageUnion(DamagePtr pDamage, RegionPtr pDst, RegionPtr pSrc)
+{
+    RegionUnion(pDst, pDst, pSrc);
+    if (damageNeedsCoalesce(pDamage, pDst))
+        damageCoalesce(pDamage, pDst);
+}
+
+/*
+ * Coalesce the accumulated damage of a DeltaRegion report, adding what
+ * that grew it by to pDelta. Its client is only told about damage that
+ * isn't accumulated yet, so it has to hear about the slack too.
+ */
+static void
+damageCoalesceDelta(DamagePtr pDamage, RegionPtr pDelta)
+{
+    RegionRec before;
+
+    RegionNull(&before);
+    RegionCopy(&before, &pDamage->damage);
+    damageCoalesce(pDamage, &pDamage->damage);
+    RegionSubtract(&before, &pDamage->damage, &before);
+    RegionUnion(pDelta, pDelta, &before);
+    RegionUninit(&before);
+}
+
 #if DAMAGE_DEBUG_ENABLE
 static void
 _damageRegionAppend(DrawablePtr pDrawable, RegionPtr pRegion, Bool clip,
@@ -253,15 +367,14 @@ damageRegionAppend(DrawablePtr pDrawable, RegionPtr pRegion, Bool clip,
 
         /* Store damage region if needed after submission. */
         if (pDamage->reportAfter)
-            RegionUnion(&pDamage->pendingDamage,
-                        &pDamage->pendingDamage, pDamageRegion);
+            damageUnion(pDamage, &pDamage->pendingDamage, pDamageRegion);
 
         /* Report damage now, if desired. */
         if (!pDamage->reportAfter) {
             if (pDamage->damageReport)
                 DamageReportDamage(pDamage, pDamageRegion);
             else
-                RegionUnion(&pDamage->damage, &pDamage->damage, pDamageRegion);
+                damageUnion(pDamage, &pDamage->damage, pDamageRegion);
         }
 
         /*
@@ -287,7 +400,7 @@ damageRegionProcessPending(DrawablePtr pDrawable)
             if (pDamage->damageReport)
                 DamageReportDamage(pDamage, &pDamage->pendingDamage);
             else
-                RegionUnion(&pDamage->damage, &pDamage->damage,
+                damageUnion(pDamage, &pDamage->damage,
                             &pDamage->pendingDamage);
         }
 
@@ -1709,6 +1822,8 @@ DamageCreate(DamageReportFunc damageReport,
     pDamage->isWindow = FALSE;
     pDamage->pDrawable = 0;
     pDamage->reportAfter = FALSE;
+    pDamage->coalesceBoxes = 0;
+    pDamage->coalesceTile = DAMAGE_COALESCE_TILE;
 
     pDamage->damageReport = damageReport;
     pDamage->damageDestroy = damageDestroy;
@@ -1908,6 +2023,29 @@ DamageSetReportAfterOp(DamagePtr pDamage, Bool reportAfter)
     pDamage->reportAfter = reportAfter;
 }
 
+void
+DamageSetCoalesce(DamagePtr pDamage, int maxBoxes, int tileSize)
+{
+    pDamage->coalesceBoxes = max(maxBoxes, 0);
+    pDamage->coalesceTile = tileSize > 0 ? tileSize : DAMAGE_COALESCE_TILE;
+
+    if (!damageNeedsCoalesce(pDamage, &pDamage->damage))
+        return;
+
+    if (pDamage->damageLevel == DamageReportDeltaRegion &&
+        pDamage->damageReport) {
+        RegionRec delta;
+
+        RegionNull(&delta);
+        damageCoalesceDelta(pDamage, &delta);
+        if (RegionNotEmpty(&delta))
+            (*pDamage->damageReport) (pDamage, &delta, pDamage->closure);
+        RegionUninit(&delta);
+    }
+    else
+        damageCoalesce(pDamage, &pDamage->damage);
+}
+
 DamageScreenFuncsPtr
 DamageGetScreenFuncs(ScreenPtr pScreen)
 {
@@ -1924,7 +2062,7 @@ DamageReportDamage(DamagePtr pDamage, RegionPtr pDamageRegion)
 
     switch (pDamage->damageLevel) {
     case DamageReportRawRegion:
-        RegionUnion(&pDamage->damage, &pDamage->damage, pDamageRegion);
+        damageUnion(pDamage, &pDamage->damage, pDamageRegion);
         (*pDamage->damageReport) (pDamage, pDamageRegion, pDamage->closure);
         break;
     case DamageReportDeltaRegion:
@@ -1932,13 +2070,15 @@ DamageReportDamage(DamagePtr pDamage, RegionPtr pDamageRegion)
         RegionSubtract(&tmpRegion, pDamageRegion, &pDamage->damage);
         if (RegionNotEmpty(&tmpRegion)) {
             RegionUnion(&pDamage->damage, &pDamage->damage, pDamageRegion);
+            if (damageNeedsCoalesce(pDamage, &pDamage->damage))
+                damageCoalesceDelta(pDamage, &tmpRegion);
             (*pDamage->damageReport) (pDamage, &tmpRegion, pDamage->closure);
         }
         RegionUninit(&tmpRegion);
         break;
     case DamageReportBoundingBox:
         tmpBox = *RegionExtents(&pDamage->damage);
-        RegionUnion(&pDamage->damage, &pDamage->damage, pDamageRegion);
+        damageUnion(pDamage, &pDamage->damage, pDamageRegion);
         if (!BOX_SAME(&tmpBox, RegionExtents(&pDamage->damage))) {
             (*pDamage->damageReport) (pDamage, &pDamage->damage,
                                       pDamage->closure);
@@ -1946,14 +2086,14 @@ DamageReportDamage(DamagePtr pDamage, RegionPtr pDamageRegion)
         break;
     case DamageReportNonEmpty:
         was_empty = !RegionNotEmpty(&pDamage->damage);
-        RegionUnion(&pDamage->damage, &pDamage->damage, pDamageRegion);
+        damageUnion(pDamage, &pDamage->damage, pDamageRegion);
         if (was_empty && RegionNotEmpty(&pDamage->damage)) {
             (*pDamage->damageReport) (pDamage, &pDamage->damage,
                                       pDamage->closure);
         }
         break;
     case DamageReportNone:
-        RegionUnion(&pDamage->damage, &pDamage->damage, pDamageRegion);
+        damageUnion(pDamage, &pDamage->damage, pDamageRegion);
         break;
     }
 }
@@ -125,6 +125,15 @@ extern _X_EXPORT void
 extern _X_EXPORT void
  DamageSetReportAfterOp(DamagePtr pDamage, Bool reportAfter);
 
+/*
+ * Keep the accumulated damage below maxBoxes rectangles: once it grows past
+ * that, boxes are snapped out to a tileSize grid and merged, trading some
+ * overdraw for bounded region complexity. maxBoxes 0 (the default) keeps
+ * full precision, tileSize <= 0 picks a default grid.
+ */
+extern _X_EXPORT void
+ DamageSetCoalesce(DamagePtr pDamage, int maxBoxes, int tileSize);
+
 extern _X_EXPORT DamageScreenFuncsPtr DamageGetScreenFuncs(ScreenPtr);
 
 #endif                          /* _DAMAGE_H_ */
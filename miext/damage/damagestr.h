@@ -49,6 +49,9 @@ typedef struct _damage {
     Bool reportAfter;
     RegionRec pendingDamage;    /* will be flushed post submission at the latest */
     ScreenPtr pScreen;
+
+    int coalesceBoxes;          /* 0: keep full precision */
+    int coalesceTile;           /* grid boxes get snapped to when coalescing */
 } DamageRec;
 
 typedef struct _damageScrPriv {
@@ -24,6 +24,7 @@
 
 #include "shadow.h"
 #include "fb.h"
+#include "shsimd.h"
 
 #define Get8(a)	((CARD32) READ(a))
 
@@ -39,17 +40,15 @@
 		     (WRITE((a+2), (CARD8) ((p) >> 16))))
 #endif
 
-static void
-sh24_32BltLine(CARD8 *srcLine,
-               CARD8 *dstLine,
-               int width)
+void
+shadowConvert32to24C(CARD8 *dstLine, const CARD32 *srcLine, int width)
 {
-    CARD32 *src;
+    const CARD32 *src;
     CARD8 *dst;
     int w;
     CARD32 pixel;
 
-    src = (CARD32 *) srcLine;
+    src = srcLine;
     dst = dstLine;
     w = width;
 
@@ -98,6 +97,7 @@ sh24_32BltLine(CARD8 *srcLine,
 void
 shadowUpdate32to24(ScreenPtr pScreen, shadowBufPtr pBuf)
 {
+    const ShadowKernelsRec *kernels = shadowGetKernels();
     RegionPtr damage = DamageRegion(pBuf->pDamage);
     PixmapPtr pShadow = pBuf->pPixmap;
     int nbox = RegionNumRects(damage);
@@ -127,7 +127,7 @@ shadowUpdate32to24(ScreenPtr pScreen, shadowBufPtr pBuf)
         shaLine = shaBase + y * shaStride + ((x * shaBpp) >> FB_SHIFT);
 
         while (h--) {
-	    sh24_32BltLine((CARD8 *)shaLine, (CARD8 *)winLine, w);
+	    (*kernels->convert32to24) (winLine, (CARD32 *) shaLine, w);
 	    winLine += winSize;
             shaLine += shaStride;
         }
@@ -35,6 +35,13 @@
 #include    "globals.h"
 #include    "gcstruct.h"
 #include    "shadow.h"
+#include    "shthread.h"
+
+/* the screen's buffer, and what shadowBufRec has no room for */
+typedef struct {
+    shadowBufRec buf;
+    int threads;
+} shadowScrPrivRec, *shadowScrPrivPtr;
 
 static DevPrivateKeyRec shadowScrPrivateKeyRec;
 #define shadowScrPrivateKey (&shadowScrPrivateKeyRec)
@@ -62,7 +69,8 @@ shadowRedisplay(ScreenPtr pScreen)
         return;
     pRegion = DamageRegion(pBuf->pDamage);
     if (RegionNotEmpty(pRegion)) {
-        (*pBuf->update) (pScreen, pBuf);
+        shadowUpdateThreaded(pScreen, pBuf,
+                             ((shadowScrPrivPtr) pBuf)->threads);
         DamageEmpty(pBuf->pDamage);
     }
 }
@@ -118,7 +126,7 @@ shadowSetup(ScreenPtr pScreen)
     if (!DamageSetup(pScreen))
         return FALSE;
 
-    shadowBufPtr pBuf = calloc(1, sizeof(shadowBufRec));
+    shadowBufPtr pBuf = calloc(1, sizeof(shadowScrPrivRec));
     if (!pBuf)
         return FALSE;
     pBuf->pDamage = DamageCreate((DamageReportFunc) NULL,
@@ -176,6 +184,14 @@ shadowAdd(ScreenPtr pScreen, PixmapPtr pPixmap, ShadowUpdateProc update,
     return TRUE;
 }
 
+void
+shadowSetThreads(ScreenPtr pScreen, int threads)
+{
+    shadowBuf(pScreen);
+
+    ((shadowScrPrivPtr) pBuf)->threads = threads;
+}
+
 void
 shadowRemove(ScreenPtr pScreen, PixmapPtr pPixmap)
 {
@@ -81,6 +81,13 @@ shadowAdd(ScreenPtr pScreen,
 extern _X_EXPORT void
  shadowRemove(ScreenPtr pScreen, PixmapPtr pPixmap);
 
+/*
+ * run updates on up to threads threads, for update and window procs that
+ * can be called concurrently on different rows of the damage
+ */
+extern _X_EXPORT void
+ shadowSetThreads(ScreenPtr pScreen, int threads);
+
 extern _X_EXPORT void
  shadowUpdateAfb4(ScreenPtr pScreen, shadowBufPtr pBuf);
 
@@ -150,6 +157,10 @@ extern _X_EXPORT void
 extern _X_EXPORT void
  shadowUpdate32to24(ScreenPtr pScreen, shadowBufPtr pBuf);
 
+/* make dst the same as src, for double shadows: TRUE if it wasn't */
+extern _X_EXPORT Bool
+ shadowCopyChanged(void *dst, const void *src, int bytes);
+
 typedef void (*shadowUpdateProc) (ScreenPtr, shadowBufPtr);
 
 #endif                          /* _SHADOW_H_ */
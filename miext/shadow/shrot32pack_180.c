@@ -23,6 +23,7 @@
 #define FUNC	shadowUpdateRotate32_180
 #define Data	CARD32
 #define ROTATE	180
+#define ROTATE_LINEAR	SHADOW_ROTATE_180
 
 #include <dix-config.h>
 
@@ -23,6 +23,7 @@
 #define FUNC	shadowUpdateRotate32_270
 #define Data	CARD32
 #define ROTATE	270
+#define ROTATE_LINEAR	SHADOW_ROTATE_270
 
 #include <dix-config.h>
 
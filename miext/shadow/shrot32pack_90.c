@@ -23,6 +23,7 @@
 #define FUNC	shadowUpdateRotate32_90
 #define Data	CARD32
 #define ROTATE	90
+#define ROTATE_LINEAR	SHADOW_ROTATE_90
 
 #include <dix-config.h>
 
@@ -35,6 +35,7 @@
 #include    "gcstruct.h"
 #include    "shadow.h"
 #include    "fb.h"
+#include    "shsimd.h"
 
 /*
  * These indicate which way the source (shadow) is scanned when
@@ -76,6 +77,12 @@ shadowUpdateRotatePacked(ScreenPtr pScreen, shadowBufPtr pBuf)
     int x_dir;
     int y_dir;
 
+    if (pShadow->drawable.bitsPerPixel == 32 &&
+        !(pBuf->randr & SHADOW_REFLECT_ALL) &&
+        shadowUpdateRotate32Linear(pScreen, pBuf,
+                                   pBuf->randr & SHADOW_ROTATE_ALL))
+        return;
+
     fbGetDrawable(&pShadow->drawable, shaBits, shaStride, shaBpp, shaXoff,
                   shaYoff);
     pixelsPerBits = (sizeof(FbBits) * 8) / shaBpp;
@@ -44,6 +44,9 @@
 #include    "gcstruct.h"
 #include    "shadow.h"
 #include    "fb.h"
+#ifdef ROTATE_LINEAR
+#include    "shsimd.h"
+#endif
 
 #define DANDEBUG         0
 
@@ -111,6 +114,10 @@ FUNC(ScreenPtr pScreen, shadowBufPtr pBuf)
     Data *winBase = NULL, *win;
     CARD32 winSize;
 
+#ifdef ROTATE_LINEAR
+    if (shadowUpdateRotate32Linear(pScreen, pBuf, ROTATE_LINEAR))
+        return;
+#endif
     fbGetDrawable(&pShadow->drawable, shaBits, shaStride, shaBpp, shaXoff,
                   shaYoff);
     shaBase = (Data *) shaBits;
@@ -0,0 +1,553 @@
+/* SPDX-License-Identifier: MIT OR X11
+ *
+ * @brief vectorized kernels of the shadow update functions
+ *
+ * On ShadowFB screens all drawing goes to memory first and the damaged
+ * boxes are copied to the framebuffer on every block handler, so at 4K
+ * these copies are where the CPU goes. Packed copies are memcpy() and
+ * already as fast as libc makes them; the pixel shuffling of 32 to 24 bpp
+ * conversion and rotation, and the double shadow compare of drivers, are
+ * done here a vector at a time.
+ */
+#include <dix-config.h>
+
+#include <string.h>
+
+#include "shadow.h"
+#include "fb.h"
+#include "shsimd.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define SHADOW_X86
+#include <immintrin.h>
+#elif defined(__aarch64__) && defined(__ARM_NEON) && !defined(__ARM_BIG_ENDIAN)
+#define SHADOW_NEON
+#include <arm_neon.h>
+#endif
+
+static void
+shadowReverse32C(CARD32 *dst, const CARD32 *src, int width)
+{
+    for (int i = 0; i < width; i++)
+        dst[i] = src[-i];
+}
+
+static void
+shadowTranspose32C(CARD32 *dst, long dstStride, const CARD32 *src,
+                   long srcStride, int width)
+{
+    for (int i = 0; i < width; i++, src += srcStride)
+        for (int k = 0; k < 4; k++)
+            dst[k * dstStride + i] = src[k];
+}
+
+static Bool
+shadowCopyChangedC(CARD8 *dst, const CARD8 *src, int bytes)
+{
+    if (!memcmp(dst, src, bytes))
+        return FALSE;
+    memcpy(dst, src, bytes);
+    return TRUE;
+}
+
+static const ShadowKernelsRec shadowKernelsC = {
+    .name = "c",
+    .convert32to24 = shadowConvert32to24C,
+    .reverse32 = shadowReverse32C,
+    .transpose32 = shadowTranspose32C,
+    .copyChanged = shadowCopyChangedC,
+};
+
+#ifdef SHADOW_X86
+
+/* the low 3 bytes of each of the 4 pixels, packed into the low 12 */
+__attribute__((target("sse2")))
+static inline __m128i
+shadowPack24SSE2(__m128i v)
+{
+    const __m128i rgb = _mm_setr_epi32(0xffffff, 0, 0, 0);
+
+    return _mm_or_si128(
+        _mm_or_si128(_mm_and_si128(v, rgb),
+                     _mm_srli_si128(_mm_and_si128(v, _mm_slli_si128(rgb, 4)), 1)),
+        _mm_or_si128(_mm_srli_si128(_mm_and_si128(v, _mm_slli_si128(rgb, 8)), 2),
+                     _mm_srli_si128(_mm_and_si128(v, _mm_slli_si128(rgb, 12)), 3)));
+}
+
+__attribute__((target("sse2")))
+static void
+shadowConvert32to24SSE2(CARD8 *dst, const CARD32 *src, int width)
+{
+    int i = 0;
+
+    /* 16 pixels into 48 bytes */
+    for (; i + 16 <= width; i += 16) {
+        const __m128i *s = (const __m128i *) (src + i);
+        __m128i *d = (__m128i *) (dst + 3 * i);
+        __m128i p0 = shadowPack24SSE2(_mm_loadu_si128(s + 0));
+        __m128i p1 = shadowPack24SSE2(_mm_loadu_si128(s + 1));
+        __m128i p2 = shadowPack24SSE2(_mm_loadu_si128(s + 2));
+        __m128i p3 = shadowPack24SSE2(_mm_loadu_si128(s + 3));
+
+        _mm_storeu_si128(d + 0, _mm_or_si128(p0, _mm_slli_si128(p1, 12)));
+        _mm_storeu_si128(d + 1, _mm_or_si128(_mm_srli_si128(p1, 4),
+                                             _mm_slli_si128(p2, 8)));
+        _mm_storeu_si128(d + 2, _mm_or_si128(_mm_srli_si128(p2, 8),
+                                             _mm_slli_si128(p3, 4)));
+    }
+    shadowConvert32to24C(dst + 3 * i, src + i, width - i);
+}
+
+__attribute__((target("sse2")))
+static void
+shadowReverse32SSE2(CARD32 *dst, const CARD32 *src, int width)
+{
+    int i = 0;
+
+    for (; i + 4 <= width; i += 4) {
+        __m128i v = _mm_loadu_si128((const __m128i *) (src - i - 3));
+
+        _mm_storeu_si128((__m128i *) (dst + i),
+                         _mm_shuffle_epi32(v, _MM_SHUFFLE(0, 1, 2, 3)));
+    }
+    shadowReverse32C(dst + i, src - i, width - i);
+}
+
+__attribute__((target("sse2")))
+static void
+shadowTranspose32SSE2(CARD32 *dst, long dstStride, const CARD32 *src,
+                      long srcStride, int width)
+{
+    int i = 0;
+
+    /* 4x4 pixels at a time */
+    for (; i + 4 <= width; i += 4) {
+        const CARD32 *s = src + i * srcStride;
+        __m128i r0 = _mm_loadu_si128((const __m128i *) s);
+        __m128i r1 = _mm_loadu_si128((const __m128i *) (s + srcStride));
+        __m128i r2 = _mm_loadu_si128((const __m128i *) (s + 2 * srcStride));
+        __m128i r3 = _mm_loadu_si128((const __m128i *) (s + 3 * srcStride));
+        __m128i t0 = _mm_unpacklo_epi32(r0, r1);
+        __m128i t1 = _mm_unpacklo_epi32(r2, r3);
+        __m128i t2 = _mm_unpackhi_epi32(r0, r1);
+        __m128i t3 = _mm_unpackhi_epi32(r2, r3);
+
+        _mm_storeu_si128((__m128i *) (dst + i), _mm_unpacklo_epi64(t0, t1));
+        _mm_storeu_si128((__m128i *) (dst + dstStride + i),
+                         _mm_unpackhi_epi64(t0, t1));
+        _mm_storeu_si128((__m128i *) (dst + 2 * dstStride + i),
+                         _mm_unpacklo_epi64(t2, t3));
+        _mm_storeu_si128((__m128i *) (dst + 3 * dstStride + i),
+                         _mm_unpackhi_epi64(t2, t3));
+    }
+    shadowTranspose32C(dst + i, dstStride, src + i * srcStride, srcStride,
+                       width - i);
+}
+
+__attribute__((target("sse2")))
+static Bool
+shadowCopyChangedSSE2(CARD8 *dst, const CARD8 *src, int bytes)
+{
+    Bool changed = FALSE;
+    int i = 0;
+
+    /* only what changed is written back, 64 bytes at a time */
+    for (; i + 64 <= bytes; i += 64) {
+        const __m128i *s = (const __m128i *) (src + i);
+        __m128i *d = (__m128i *) (dst + i);
+        __m128i s0 = _mm_loadu_si128(s + 0), s1 = _mm_loadu_si128(s + 1);
+        __m128i s2 = _mm_loadu_si128(s + 2), s3 = _mm_loadu_si128(s + 3);
+        __m128i eq;
+
+        eq = _mm_and_si128(
+            _mm_and_si128(_mm_cmpeq_epi8(s0, _mm_loadu_si128(d + 0)),
+                          _mm_cmpeq_epi8(s1, _mm_loadu_si128(d + 1))),
+            _mm_and_si128(_mm_cmpeq_epi8(s2, _mm_loadu_si128(d + 2)),
+                          _mm_cmpeq_epi8(s3, _mm_loadu_si128(d + 3))));
+        if (_mm_movemask_epi8(eq) != 0xffff) {
+            _mm_storeu_si128(d + 0, s0);
+            _mm_storeu_si128(d + 1, s1);
+            _mm_storeu_si128(d + 2, s2);
+            _mm_storeu_si128(d + 3, s3);
+            changed = TRUE;
+        }
+    }
+    if (shadowCopyChangedC(dst + i, src + i, bytes - i))
+        changed = TRUE;
+    return changed;
+}
+
+static const ShadowKernelsRec shadowKernelsSSE2 = {
+    .name = "sse2",
+    .convert32to24 = shadowConvert32to24SSE2,
+    .reverse32 = shadowReverse32SSE2,
+    .transpose32 = shadowTranspose32SSE2,
+    .copyChanged = shadowCopyChangedSSE2,
+};
+
+__attribute__((target("avx2")))
+static void
+shadowConvert32to24AVX2(CARD8 *dst, const CARD32 *src, int width)
+{
+    /* 12 bytes out of each lane, then the two lanes' together */
+    const __m256i shuffle = _mm256_setr_epi8(0, 1, 2, 4, 5, 6, 8, 9, 10,
+                                             12, 13, 14, -1, -1, -1, -1,
+                                             0, 1, 2, 4, 5, 6, 8, 9, 10,
+                                             12, 13, 14, -1, -1, -1, -1);
+    const __m256i permute = _mm256_setr_epi32(0, 1, 2, 4, 5, 6, 3, 7);
+    int i = 0;
+
+    for (; i + 8 <= width; i += 8) {
+        __m256i v = _mm256_loadu_si256((const __m256i *) (src + i));
+
+        v = _mm256_permutevar8x32_epi32(_mm256_shuffle_epi8(v, shuffle),
+                                        permute);
+        _mm_storeu_si128((__m128i *) (dst + 3 * i), _mm256_castsi256_si128(v));
+        _mm_storel_epi64((__m128i *) (dst + 3 * i + 16),
+                         _mm256_extracti128_si256(v, 1));
+    }
+    shadowConvert32to24C(dst + 3 * i, src + i, width - i);
+}
+
+__attribute__((target("avx2")))
+static void
+shadowReverse32AVX2(CARD32 *dst, const CARD32 *src, int width)
+{
+    const __m256i reverse = _mm256_setr_epi32(7, 6, 5, 4, 3, 2, 1, 0);
+    int i = 0;
+
+    for (; i + 8 <= width; i += 8) {
+        __m256i v = _mm256_loadu_si256((const __m256i *) (src - i - 7));
+
+        _mm256_storeu_si256((__m256i *) (dst + i),
+                            _mm256_permutevar8x32_epi32(v, reverse));
+    }
+    shadowReverse32C(dst + i, src - i, width - i);
+}
+
+__attribute__((target("avx2")))
+static void
+shadowTranspose32AVX2(CARD32 *dst, long dstStride, const CARD32 *src,
+                      long srcStride, int width)
+{
+    int i = 0;
+
+    /*
+     * 8x4 pixels at a time: rows i to i + 3 in the low lanes and i + 4 to
+     * i + 7 in the high ones, so each lane is a 4x4 transpose
+     */
+    for (; i + 8 <= width; i += 8) {
+        const CARD32 *s = src + i * srcStride;
+        __m256i r[4], t0, t1, t2, t3;
+
+        for (int k = 0; k < 4; k++)
+            r[k] = _mm256_inserti128_si256(
+                _mm256_castsi128_si256(
+                    _mm_loadu_si128((const __m128i *) (s + k * srcStride))),
+                _mm_loadu_si128((const __m128i *) (s + (k + 4) * srcStride)),
+                1);
+        t0 = _mm256_unpacklo_epi32(r[0], r[1]);
+        t1 = _mm256_unpacklo_epi32(r[2], r[3]);
+        t2 = _mm256_unpackhi_epi32(r[0], r[1]);
+        t3 = _mm256_unpackhi_epi32(r[2], r[3]);
+
+        _mm256_storeu_si256((__m256i *) (dst + i),
+                            _mm256_unpacklo_epi64(t0, t1));
+        _mm256_storeu_si256((__m256i *) (dst + dstStride + i),
+                            _mm256_unpackhi_epi64(t0, t1));
+        _mm256_storeu_si256((__m256i *) (dst + 2 * dstStride + i),
+                            _mm256_unpacklo_epi64(t2, t3));
+        _mm256_storeu_si256((__m256i *) (dst + 3 * dstStride + i),
+                            _mm256_unpackhi_epi64(t2, t3));
+    }
+    shadowTranspose32SSE2(dst + i, dstStride, src + i * srcStride, srcStride,
+                          width - i);
+}
+
+__attribute__((target("avx2")))
+static Bool
+shadowCopyChangedAVX2(CARD8 *dst, const CARD8 *src, int bytes)
+{
+    Bool changed = FALSE;
+    int i = 0;
+
+    /* only what changed is written back, 128 bytes at a time */
+    for (; i + 128 <= bytes; i += 128) {
+        const __m256i *s = (const __m256i *) (src + i);
+        __m256i *d = (__m256i *) (dst + i);
+        __m256i s0 = _mm256_loadu_si256(s + 0), s1 = _mm256_loadu_si256(s + 1);
+        __m256i s2 = _mm256_loadu_si256(s + 2), s3 = _mm256_loadu_si256(s + 3);
+        __m256i eq;
+
+        eq = _mm256_and_si256(
+            _mm256_and_si256(_mm256_cmpeq_epi8(s0, _mm256_loadu_si256(d + 0)),
+                             _mm256_cmpeq_epi8(s1, _mm256_loadu_si256(d + 1))),
+            _mm256_and_si256(_mm256_cmpeq_epi8(s2, _mm256_loadu_si256(d + 2)),
+                             _mm256_cmpeq_epi8(s3, _mm256_loadu_si256(d + 3))));
+        if (_mm256_movemask_epi8(eq) != -1) {
+            _mm256_storeu_si256(d + 0, s0);
+            _mm256_storeu_si256(d + 1, s1);
+            _mm256_storeu_si256(d + 2, s2);
+            _mm256_storeu_si256(d + 3, s3);
+            changed = TRUE;
+        }
+    }
+    if (shadowCopyChangedSSE2(dst + i, src + i, bytes - i))
+        changed = TRUE;
+    return changed;
+}
+
+static const ShadowKernelsRec shadowKernelsAVX2 = {
+    .name = "avx2",
+    .convert32to24 = shadowConvert32to24AVX2,
+    .reverse32 = shadowReverse32AVX2,
+    .transpose32 = shadowTranspose32AVX2,
+    .copyChanged = shadowCopyChangedAVX2,
+};
+
+#endif /* SHADOW_X86 */
+
+#ifdef SHADOW_NEON
+
+static void
+shadowConvert32to24NEON(CARD8 *dst, const CARD32 *src, int width)
+{
+    int i = 0;
+
+    /* 16 pixels at a time, deinterleaved into bytes and back without X */
+    for (; i + 16 <= width; i += 16) {
+        uint8x16x4_t v = vld4q_u8((const uint8_t *) (src + i));
+        uint8x16x3_t rgb = { { v.val[0], v.val[1], v.val[2] } };
+
+        vst3q_u8(dst + 3 * i, rgb);
+    }
+    shadowConvert32to24C(dst + 3 * i, src + i, width - i);
+}
+
+static void
+shadowReverse32NEON(CARD32 *dst, const CARD32 *src, int width)
+{
+    int i = 0;
+
+    for (; i + 4 <= width; i += 4) {
+        uint32x4_t v = vrev64q_u32(vld1q_u32(src - i - 3));
+
+        vst1q_u32(dst + i, vcombine_u32(vget_high_u32(v), vget_low_u32(v)));
+    }
+    shadowReverse32C(dst + i, src - i, width - i);
+}
+
+static void
+shadowTranspose32NEON(CARD32 *dst, long dstStride, const CARD32 *src,
+                      long srcStride, int width)
+{
+    int i = 0;
+
+    /* 4x4 pixels at a time */
+    for (; i + 4 <= width; i += 4) {
+        const CARD32 *s = src + i * srcStride;
+        uint32x4x2_t t01 = vtrnq_u32(vld1q_u32(s), vld1q_u32(s + srcStride));
+        uint32x4x2_t t23 = vtrnq_u32(vld1q_u32(s + 2 * srcStride),
+                                     vld1q_u32(s + 3 * srcStride));
+
+        vst1q_u32(dst + i, vcombine_u32(vget_low_u32(t01.val[0]),
+                                        vget_low_u32(t23.val[0])));
+        vst1q_u32(dst + dstStride + i, vcombine_u32(vget_low_u32(t01.val[1]),
+                                                    vget_low_u32(t23.val[1])));
+        vst1q_u32(dst + 2 * dstStride + i,
+                  vcombine_u32(vget_high_u32(t01.val[0]),
+                               vget_high_u32(t23.val[0])));
+        vst1q_u32(dst + 3 * dstStride + i,
+                  vcombine_u32(vget_high_u32(t01.val[1]),
+                               vget_high_u32(t23.val[1])));
+    }
+    shadowTranspose32C(dst + i, dstStride, src + i * srcStride, srcStride,
+                       width - i);
+}
+
+static Bool
+shadowCopyChangedNEON(CARD8 *dst, const CARD8 *src, int bytes)
+{
+    Bool changed = FALSE;
+    int i = 0;
+
+    /* only what changed is written back, 64 bytes at a time */
+    for (; i + 64 <= bytes; i += 64) {
+        uint8x16x4_t s = vld1q_u8_x4(src + i);
+        uint8x16x4_t d = vld1q_u8_x4(dst + i);
+        uint8x16_t eq = vandq_u8(vandq_u8(vceqq_u8(s.val[0], d.val[0]),
+                                          vceqq_u8(s.val[1], d.val[1])),
+                                 vandq_u8(vceqq_u8(s.val[2], d.val[2]),
+                                          vceqq_u8(s.val[3], d.val[3])));
+
+        if (vminvq_u8(eq) != 0xff) {
+            vst1q_u8_x4(dst + i, s);
+            changed = TRUE;
+        }
+    }
+    if (shadowCopyChangedC(dst + i, src + i, bytes - i))
+        changed = TRUE;
+    return changed;
+}
+
+static const ShadowKernelsRec shadowKernelsNEON = {
+    .name = "neon",
+    .convert32to24 = shadowConvert32to24NEON,
+    .reverse32 = shadowReverse32NEON,
+    .transpose32 = shadowTranspose32NEON,
+    .copyChanged = shadowCopyChangedNEON,
+};
+
+#endif /* SHADOW_NEON */
+
+const ShadowKernelsRec *const shadowKernelVariants[] = {
+    &shadowKernelsC,
+#ifdef SHADOW_X86
+    &shadowKernelsSSE2,
+    &shadowKernelsAVX2,
+#endif
+#ifdef SHADOW_NEON
+    &shadowKernelsNEON,
+#endif
+    NULL
+};
+
+const ShadowKernelsRec *shadowKernels;
+
+Bool
+shadowKernelsSupported(const ShadowKernelsRec *kernels)
+{
+#ifdef SHADOW_X86
+    if (kernels == &shadowKernelsSSE2)
+        return __builtin_cpu_supports("sse2");
+    if (kernels == &shadowKernelsAVX2)
+        return __builtin_cpu_supports("avx2");
+#endif
+    return TRUE;
+}
+
+const ShadowKernelsRec *
+shadowGetKernels(void)
+{
+    if (!shadowKernels) {
+        for (int i = 0; shadowKernelVariants[i]; i++)
+            if (shadowKernelsSupported(shadowKernelVariants[i]))
+                shadowKernels = shadowKernelVariants[i];
+        LogMessageVerb(X_INFO, 3, "shadow: using %s update kernels\n",
+                       shadowKernels->name);
+    }
+    return shadowKernels;
+}
+
+Bool
+shadowCopyChanged(void *dst, const void *src, int bytes)
+{
+    return shadowGetKernels()->copyChanged(dst, src, bytes);
+}
+
+Bool
+shadowUpdateRotate32Linear(ScreenPtr pScreen, shadowBufPtr pBuf, int rotate)
+{
+    const ShadowKernelsRec *kernels;
+    RegionPtr damage = DamageRegion(pBuf->pDamage);
+    PixmapPtr pShadow = pBuf->pPixmap;
+    int width = pShadow->drawable.width;
+    int height = pShadow->drawable.height;
+    int nbox = RegionNumRects(damage);
+    BoxPtr pbox = RegionRects(damage);
+    BoxPtr extents = RegionExtents(damage);
+    FbBits *shaBits;
+    FbStride shaStride;
+    int shaBpp;
+    _X_UNUSED int shaXoff, shaYoff;
+    CARD32 *sha, *win;
+    CARD32 winSize;
+    long winStride;
+    int x, first, last;
+
+    switch (rotate) {
+    case SHADOW_ROTATE_90:
+        first = width - extents->x2;
+        last = width - 1 - extents->x1;
+        break;
+    case SHADOW_ROTATE_270:
+        first = extents->x1;
+        last = extents->x2 - 1;
+        break;
+    case SHADOW_ROTATE_180:
+        first = height - extents->y2;
+        last = height - 1 - extents->y1;
+        break;
+    default:
+        return FALSE;
+    }
+    if (!nbox)
+        return TRUE;
+
+    /*
+     * The rows of the framebuffer written to must follow each other, a
+     * stride apart. What the window of one row looks like says nothing
+     * about the others, so ask for each of them.
+     */
+    win = (*pBuf->window) (pScreen, 0, 0, SHADOW_WINDOW_WRITE, &winSize,
+                           pBuf->closure);
+    if (!win || winSize % sizeof(CARD32) ||
+        winSize < (rotate == SHADOW_ROTATE_180 ? width : height) *
+                  sizeof(CARD32))
+        return FALSE;
+    for (int row = max(first, 1); row <= last; row++) {
+        CARD32 rowSize;
+        CARD8 *rowBase = (*pBuf->window) (pScreen, row, 0,
+                                          SHADOW_WINDOW_WRITE, &rowSize,
+                                          pBuf->closure);
+
+        if (rowBase != (CARD8 *) win + (size_t) row * winSize ||
+            rowSize < winSize)
+            return FALSE;
+    }
+    winStride = winSize / sizeof(CARD32);
+
+    fbGetDrawable(&pShadow->drawable, shaBits, shaStride, shaBpp, shaXoff,
+                  shaYoff);
+    sha = (CARD32 *) shaBits;
+    shaStride = shaStride * sizeof(FbBits) / sizeof(CARD32);
+    kernels = shadowGetKernels();
+
+    for (; nbox--; pbox++) {
+        int x1 = pbox->x1, y1 = pbox->y1, x2 = pbox->x2, y2 = pbox->y2;
+
+        switch (rotate) {
+        case SHADOW_ROTATE_90:
+            /* column x of the shadow to row width - 1 - x, top first */
+            for (x = x1; x + 4 <= x2; x += 4)
+                kernels->transpose32(win + (width - 1 - x) * winStride + y1,
+                                     -winStride, sha + y1 * shaStride + x,
+                                     shaStride, y2 - y1);
+            for (; x < x2; x++)
+                for (int y = y1; y < y2; y++)
+                    win[(width - 1 - x) * winStride + y] =
+                        sha[y * shaStride + x];
+            break;
+        case SHADOW_ROTATE_270:
+            /* column x of the shadow to row x, bottom first */
+            for (x = x1; x + 4 <= x2; x += 4)
+                kernels->transpose32(win + x * winStride + height - y2,
+                                     winStride,
+                                     sha + (y2 - 1) * shaStride + x,
+                                     -shaStride, y2 - y1);
+            for (; x < x2; x++)
+                for (int y = y1; y < y2; y++)
+                    win[x * winStride + height - 1 - y] =
+                        sha[y * shaStride + x];
+            break;
+        case SHADOW_ROTATE_180:
+            /* row y of the shadow to row height - 1 - y, right first */
+            for (int y = y1; y < y2; y++)
+                kernels->reverse32(win + (height - 1 - y) * winStride +
+                                   width - x2,
+                                   sha + y * shaStride + x2 - 1, x2 - x1);
+            break;
+        }
+    }
+    return TRUE;
+}
@@ -0,0 +1,57 @@
+/* SPDX-License-Identifier: MIT OR X11
+ *
+ * @brief vectorized kernels of the shadow update functions
+ *
+ * Every kernel has a plain C version and, on CPUs that have them, SSE2,
+ * AVX2 or NEON ones. The best the CPU supports is picked the first time
+ * the kernels are asked for.
+ */
+#ifndef _XSERVER_SHADOW_SIMD_H
+#define _XSERVER_SHADOW_SIMD_H
+
+#include <X11/Xmd.h>
+
+#include "shadow.h"
+
+typedef struct {
+    const char *name;
+
+    /* width pixels of depth 24 from 32 bpp to 24 bpp */
+    void (*convert32to24) (CARD8 *dst, const CARD32 *src, int width);
+
+    /* dst[i] = src[-i] */
+    void (*reverse32) (CARD32 *dst, const CARD32 *src, int width);
+
+    /*
+     * four rows of width pixels from four columns, in pixels:
+     * dst[k * dstStride + i] = src[i * srcStride + k], for k in 0..3
+     */
+    void (*transpose32) (CARD32 *dst, long dstStride,
+                         const CARD32 *src, long srcStride, int width);
+
+    /* make dst the same as src, TRUE if it wasn't */
+    Bool (*copyChanged) (CARD8 *dst, const CARD8 *src, int bytes);
+} ShadowKernelsRec;
+
+/* the plain C conversion, in sh3224.c, also for the others' leftovers */
+void shadowConvert32to24C(CARD8 *dst, const CARD32 *src, int width);
+
+/* all versions, plain C first and the best last, NULL terminated */
+extern const ShadowKernelsRec *const shadowKernelVariants[];
+
+/* the ones in use, NULL until first asked for */
+extern const ShadowKernelsRec *shadowKernels;
+
+Bool shadowKernelsSupported(const ShadowKernelsRec *kernels);
+
+const ShadowKernelsRec *shadowGetKernels(void);
+
+/*
+ * Rotated update of a 32 bpp shadow, for rotate one of SHADOW_ROTATE_90,
+ * _180 or _270. FALSE if the rows it writes to aren't one linear
+ * framebuffer, for the generic code to do it.
+ */
+Bool shadowUpdateRotate32Linear(ScreenPtr pScreen, shadowBufPtr pBuf,
+                                int rotate);
+
+#endif /* _XSERVER_SHADOW_SIMD_H */
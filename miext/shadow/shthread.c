@@ -0,0 +1,197 @@
+/* SPDX-License-Identifier: MIT OR X11
+ *
+ * @brief shadow updates on worker threads
+ *
+ * The workers are started the first time an update asks for them and then
+ * wait for the next one for as long as the server runs, with all signals
+ * blocked. One update at a time: the screen's thread hands out the bands
+ * and works on them too, and returns once the last one is done, so what
+ * follows the update (DamageEmpty(), the driver's flush) sees all of it.
+ */
+#include <dix-config.h>
+
+#include <string.h>
+#ifdef INPUTTHREAD
+#include <pthread.h>
+#include <signal.h>
+#endif
+
+#include "shadow.h"
+#include "shsimd.h"
+#include "shthread.h"
+
+#ifdef INPUTTHREAD
+
+typedef struct {
+    ScreenPtr pScreen;
+    shadowBufPtr pBuf;
+    DamageRec damage[SHADOW_MAX_THREADS];   /* just the region of each band */
+} ShadowBandsRec;
+
+static struct {
+    pthread_mutex_t lock;
+    pthread_cond_t work, done;
+    int workers;
+    unsigned int update;        /* bumped for every update handed out */
+    ShadowBandsRec *bands;
+    int nbands, next, finished;
+} pool = {
+    .lock = PTHREAD_MUTEX_INITIALIZER,
+    .work = PTHREAD_COND_INITIALIZER,
+    .done = PTHREAD_COND_INITIALIZER,
+};
+
+/* called with pool.lock held, which is dropped while a band is updated */
+static void
+shadowPoolBands(void)
+{
+    while (pool.next < pool.nbands) {
+        ShadowBandsRec *bands = pool.bands;
+        shadowBufRec buf = *bands->pBuf;
+
+        buf.pDamage = &bands->damage[pool.next++];
+        pthread_mutex_unlock(&pool.lock);
+        (*buf.update) (bands->pScreen, &buf);
+        pthread_mutex_lock(&pool.lock);
+        if (++pool.finished == pool.nbands)
+            pthread_cond_signal(&pool.done);
+    }
+}
+
+static void *
+shadowPoolWork(void *arg)
+{
+    unsigned int update;
+
+#if defined(HAVE_PTHREAD_SETNAME_NP_WITH_TID)
+    pthread_setname_np (pthread_self(), "ShadowThread");
+#elif defined(HAVE_PTHREAD_SETNAME_NP_WITHOUT_TID)
+    pthread_setname_np ("ShadowThread");
+#endif
+
+    pthread_mutex_lock(&pool.lock);
+    update = pool.update;
+    for (;;) {
+        while (pool.update == update)
+            pthread_cond_wait(&pool.work, &pool.lock);
+        update = pool.update;
+        shadowPoolBands();
+    }
+    return NULL;
+}
+
+/* how many of the workers asked for there are */
+static int
+shadowPoolReserve(int workers)
+{
+    sigset_t set, old;
+
+    /* don't handle any signals on the workers, from the start */
+    sigfillset(&set);
+    pthread_sigmask(SIG_BLOCK, &set, &old);
+    while (pool.workers < workers) {
+        pthread_t thread;
+        int err = pthread_create(&thread, NULL, shadowPoolWork, NULL);
+
+        if (err) {
+            LogMessage(X_WARNING, "shadow: can't start a worker thread: %s\n",
+                       strerror(err));
+            break;
+        }
+        pthread_detach(thread);
+        pool.workers++;
+    }
+    pthread_sigmask(SIG_SETMASK, &old, NULL);
+    return pool.workers;
+}
+
+/*
+ * Cut the damage into at most nbands bands of whole rows, of about the same
+ * number of pixels. The number of bands, 1 when it isn't worth it.
+ */
+static int
+shadowCutBands(RegionPtr damage, int nbands, ShadowBandsRec *bands)
+{
+    BoxPtr extents = RegionExtents(damage);
+    BoxPtr pbox = RegionRects(damage);
+    int nbox = RegionNumRects(damage);
+    int cut[SHADOW_MAX_THREADS];
+    long pixels = 0, per, sum = 0;
+    int n = 0, top;
+
+    for (int i = 0; i < nbox; i++)
+        pixels += (long) (pbox[i].x2 - pbox[i].x1) * (pbox[i].y2 - pbox[i].y1);
+    if (pixels < SHADOW_THREAD_MIN_PIXELS)
+        return 1;
+    per = (pixels + nbands - 1) / nbands;
+
+    /* the boxes come in y bands, all boxes of one with the same y1 and y2 */
+    for (int i = 0; i < nbox && n < nbands - 1;) {
+        int y = pbox[i].y1, y2 = pbox[i].y2;
+        long width = 0;
+
+        for (; i < nbox && pbox[i].y1 == y; i++)
+            width += pbox[i].x2 - pbox[i].x1;
+
+        while (n < nbands - 1) {
+            long rows = max((per * (n + 1) - sum + width - 1) / width, 1);
+
+            if (y + rows >= y2) {
+                sum += (y2 - y) * width;
+                break;
+            }
+            y += rows;
+            sum += rows * width;
+            cut[n++] = y;
+        }
+    }
+    cut[n++] = extents->y2;
+
+    top = extents->y1;
+    for (int i = 0; i < n; i++) {
+        BoxRec box = { extents->x1, top, extents->x2, cut[i] };
+
+        RegionInit(&bands->damage[i].damage, &box, 1);
+        RegionIntersect(&bands->damage[i].damage, &bands->damage[i].damage,
+                        damage);
+        top = cut[i];
+    }
+    return n;
+}
+
+#endif /* INPUTTHREAD */
+
+void
+shadowUpdateThreaded(ScreenPtr pScreen, shadowBufPtr pBuf, int threads)
+{
+#ifdef INPUTTHREAD
+    ShadowBandsRec bands = { .pScreen = pScreen, .pBuf = pBuf };
+    int nbands;
+
+    threads = min(threads, SHADOW_MAX_THREADS);
+    if (threads > 1)
+        threads = min(threads, shadowPoolReserve(threads - 1) + 1);
+    if (threads > 1 &&
+        (nbands = shadowCutBands(DamageRegion(pBuf->pDamage), threads,
+                                 &bands)) > 1) {
+        /* picked here, rather than by whichever band gets there first */
+        shadowGetKernels();
+
+        pthread_mutex_lock(&pool.lock);
+        pool.bands = &bands;
+        pool.nbands = nbands;
+        pool.next = pool.finished = 0;
+        pool.update++;
+        pthread_cond_broadcast(&pool.work);
+        shadowPoolBands();
+        while (pool.finished < pool.nbands)
+            pthread_cond_wait(&pool.done, &pool.lock);
+        pthread_mutex_unlock(&pool.lock);
+
+        for (int i = 0; i < nbands; i++)
+            RegionUninit(&bands.damage[i].damage);
+        return;
+    }
+#endif
+    (*pBuf->update) (pScreen, pBuf);
+}
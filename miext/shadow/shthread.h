@@ -0,0 +1,30 @@
+/* SPDX-License-Identifier: MIT OR X11
+ *
+ * @brief shadow updates on worker threads
+ *
+ * The damage is cut into horizontal bands of about the same number of
+ * pixels, and the update proc runs on each band at the same time: the
+ * screen's own thread takes one, workers of a pool shared by all screens
+ * the others. All of them are done before the update returns.
+ *
+ * Only drivers whose update and window procs can run concurrently, on
+ * different rows, ask for it with shadowSetThreads().
+ */
+#ifndef _XSERVER_SHADOW_THREAD_H
+#define _XSERVER_SHADOW_THREAD_H
+
+#include "shadow.h"
+
+/* most threads an update runs on, the screen's own one included */
+#define SHADOW_MAX_THREADS      16
+
+/* damage of fewer pixels isn't worth waking workers for */
+#define SHADOW_THREAD_MIN_PIXELS (256 * 256)
+
+/*
+ * pBuf->update on the damage of pBuf, on up to threads threads. Without
+ * threads support, or for small damage, just a call of it.
+ */
+void shadowUpdateThreaded(ScreenPtr pScreen, shadowBufPtr pBuf, int threads);
+
+#endif /* _XSERVER_SHADOW_THREAD_H */
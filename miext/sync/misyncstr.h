@@ -47,10 +47,25 @@ struct _SyncObject {
     Bool beingDestroyed;        /* in process of going away */
 };
 
+/* number of counter test types, XSyncPositiveTransition .. NegativeComparison */
+#define SYNC_TEST_TYPES         4
+
+/* a counter's triggers of one test type, ordered by test value */
+typedef struct _SyncTriggerIndex {
+    struct _SyncTriggerIndexEntry {
+        int64_t value;
+        struct _SyncTrigger *pTrigger;
+    } *entries;
+    int num;
+    int size;
+} SyncTriggerIndex;
+
 typedef struct _SyncCounter {
     SyncObject sync;            /* Common sync object data */
     int64_t value;              /* counter value */
     struct _SysCounterInfo *pSysCounterInfo; /* NULL if not a system counter */
+    SyncTriggerIndex triggers[SYNC_TEST_TYPES]; /* by test type */
+    int64_t checked_value;      /* value triggers were last checked at */
 } SyncCounter;
 
 struct _SyncFence {
@@ -71,6 +86,9 @@ struct _SyncTrigger {
                          int64_t newval);
     void (*TriggerFired)(struct _SyncTrigger *pTrigger);
     void (*CounterDestroyed)(struct _SyncTrigger *pTrigger);
+    Bool indexed;               /* in the counter's trigger index */
+    unsigned int index_type;    /* test type and value it is indexed under */
+    int64_t index_value;
 };
 
 typedef struct _SyncTriggerList {
@@ -55,6 +55,8 @@ SOFTWARE.
 #include <dix-config.h>
 
 #include <errno.h>
+#include <limits.h>
+#include <stdint.h>
 #include <stdio.h>
 #ifdef WIN32
 #include <X11/Xwinsock.h>
@@ -96,55 +98,235 @@ SOFTWARE.
 #include <X11/extensions/dpmsconst.h>
 #endif
 
+/*
+ * Armed timers live on a hierarchical timing wheel: WHEEL_LEVELS wheels of
+ * WHEEL_SIZE slots, level n slots being WHEEL_SIZE^n ms wide. A timer goes
+ * into the level matching how far ahead it expires, and gets moved down a
+ * level whenever the wheel clock reaches its slot there, so arming and
+ * cancelling are O(1) and finding the next expiry only looks at the slot
+ * bitmaps. Due timers are collected on the expired list, in expiry order.
+ *
+ * The wheel clock is a 64 bit version of GetTimeInMillis(), so wrapping
+ * of the 32 bit millisecond time doesn't need special casing anywhere.
+ */
+#define WHEEL_BITS      6
+#define WHEEL_SIZE      (1 << WHEEL_BITS)
+#define WHEEL_MASK      (WHEEL_SIZE - 1)
+#define WHEEL_LEVELS    6       /* 36 bits, timers are at most 2^31 ms ahead */
+
 struct _OsTimerRec {
     struct xorg_list list;
     CARD32 expires;
     CARD32 delta;
     OsTimerCallback callback;
     void *arg;
+    uint64_t when;              /* expires on the wheel clock */
+    short level;                /* wheel level, -1 while on the expired list */
+    short slot;
 };
 
+static struct {
+    uint64_t now;
+    int count;
+    uint64_t pending[WHEEL_LEVELS];     /* bitmap of non-empty slots */
+    struct xorg_list slots[WHEEL_LEVELS][WHEEL_SIZE];
+    struct xorg_list expired;
+} timers;
+
 static void DoTimer(OsTimerPtr timer, CARD32 now);
 static void DoTimers(CARD32 now);
-static void CheckAllTimers(void);
-static volatile struct xorg_list timers;
+static void CheckAllTimers(CARD32 now);
+
+static inline int
+highest_bit(uint64_t word)
+{
+#if __has_builtin(__builtin_clzll)
+    return 63 - __builtin_clzll(word);
+#else
+    int bit = 0;
+
+    while (word >>= 1)
+        bit++;
+    return bit;
+#endif
+}
+
+static inline int
+lowest_bit(uint64_t word)
+{
+#if __has_builtin(__builtin_ctzll)
+    return __builtin_ctzll(word);
+#else
+    int bit = 0;
 
-static inline OsTimerPtr
-first_timer(void)
+    while (!(word & 1)) {
+        word >>= 1;
+        bit++;
+    }
+    return bit;
+#endif
+}
+
+static inline uint64_t
+rotate_right(uint64_t word, int n)
 {
-    /* inline xorg_list_is_empty which can't handle volatile */
-    if (timers.next == &timers)
-        return NULL;
-    return xorg_list_first_entry(&timers, struct _OsTimerRec, list);
+    return n ? (word >> n) | (word << (64 - n)) : word;
+}
+
+static inline Bool timer_pending(OsTimerPtr timer) {
+    return !xorg_list_is_empty(&timer->list);
+}
+
+static void
+timer_enqueue(OsTimerPtr timer)
+{
+    timers.count++;
+
+    if (timer->when <= timers.now) {
+        OsTimerPtr prev;
+
+        /* usually due in order, so search from the end */
+        timer->level = -1;
+        for (prev = xorg_list_last_entry(&timers.expired, struct _OsTimerRec, list);
+             &prev->list != &timers.expired;
+             prev = xorg_list_last_entry(&prev->list, struct _OsTimerRec, list))
+            if (prev->when <= timer->when)
+                break;
+        xorg_list_add(&timer->list, &prev->list);
+    }
+    else {
+        int level = highest_bit(timer->when - timers.now) / WHEEL_BITS;
+        int slot = (timer->when >> (level * WHEEL_BITS)) & WHEEL_MASK;
+
+        timer->level = level;
+        timer->slot = slot;
+        xorg_list_append(&timer->list, &timers.slots[level][slot]);
+        timers.pending[level] |= (uint64_t) 1 << slot;
+    }
+}
+
+static void
+timer_dequeue(OsTimerPtr timer)
+{
+    if (!timer_pending(timer))
+        return;
+
+    timers.count--;
+    xorg_list_del(&timer->list);
+    if (timer->level >= 0 &&
+        xorg_list_is_empty(&timers.slots[timer->level][timer->slot]))
+        timers.pending[timer->level] &= ~((uint64_t) 1 << timer->slot);
+}
+
+/* wheel clock for a millisecond time at most 2^31 ms away from it */
+static inline uint64_t
+wheel_time(CARD32 millis)
+{
+    return timers.now + (int) (millis - (CARD32) timers.now);
 }
 
 /*
- * Compute timeout until next timer, running
- * any expired timers
+ * Move the wheel clock forward, taking the timers out of every slot it
+ * passes and filing them again: due ones on the expired list, the rest a
+ * level further down.
  */
-static int
-check_timers(void)
+static void
+wheel_advance(uint64_t now)
 {
-    OsTimerPtr timer;
+    struct xorg_list todo;
+    OsTimerPtr timer, tmp;
+
+    xorg_list_init(&todo);
+    for (int level = 0; level < WHEEL_LEVELS; level++) {
+        int shift = level * WHEEL_BITS;
+        uint64_t from = timers.now >> shift, to = now >> shift;
+        uint64_t passed;
+
+        /* higher levels can't have moved either */
+        if (from == to)
+            break;
 
-    if ((timer = first_timer()) != NULL) {
-        CARD32 now = GetTimeInMillis();
-        int timeout = timer->expires - now;
+        passed = ~(uint64_t) 0;
+        if (to - from < WHEEL_SIZE)
+            passed = rotate_right(((uint64_t) 1 << (to - from)) - 1,
+                                  (WHEEL_SIZE - (from + 1)) & WHEEL_MASK);
 
-        if (timeout <= 0) {
-            DoTimers(now);
-        } else {
-            /* Make sure the timeout is sane */
-            if (timeout < timer->delta + 250)
-                return timeout;
+        passed &= timers.pending[level];
+        while (passed) {
+            struct xorg_list *slot = &timers.slots[level][lowest_bit(passed)];
 
-            /* time has rewound.  reset the timers. */
-            CheckAllTimers();
+            passed &= passed - 1;
+            xorg_list_for_each_entry_safe(timer, tmp, slot, list) {
+                timer_dequeue(timer);
+                xorg_list_append(&timer->list, &todo);
+            }
         }
+    }
+
+    timers.now = now;
+    xorg_list_for_each_entry_safe(timer, tmp, &todo, list) {
+        xorg_list_del(&timer->list);
+        timer_enqueue(timer);
+    }
+}
 
+/*
+ * Milliseconds until the wheel needs to advance again, -1 without timers.
+ * For levels above 0 that's when the first timer moves a level down, so
+ * possibly earlier than it expires.
+ */
+static int
+wheel_timeout(void)
+{
+    uint64_t next = UINT64_MAX;
+
+    if (!xorg_list_is_empty(&timers.expired))
         return 0;
+    if (!timers.count)
+        return -1;
+
+    for (int level = 0; level < WHEEL_LEVELS; level++) {
+        int shift = level * WHEEL_BITS;
+        uint64_t from = (timers.now >> shift) + 1;
+        uint64_t when;
+
+        if (!timers.pending[level])
+            continue;
+
+        when = from + lowest_bit(rotate_right(timers.pending[level],
+                                              from & WHEEL_MASK));
+        next = min(next, when << shift);
     }
-    return -1;
+
+    return min(next - timers.now, INT_MAX);
+}
+
+/*
+ * Compute timeout until next timer, running
+ * any expired timers
+ */
+int
+check_timers(void)
+{
+    CARD32 now;
+    int timeout;
+
+    if (!timers.count)
+        return -1;
+
+    now = GetTimeInMillis();
+    input_lock();
+    if ((int) (now - (CARD32) timers.now) >= 0)
+        wheel_advance(wheel_time(now));
+    else
+        /* time has rewound.  reset the timers. */
+        CheckAllTimers(now);
+    timeout = wheel_timeout();
+    input_unlock();
+
+    if (timeout == 0)
+        DoTimers(now);
+    return timeout;
 }
 
 /*****************
@@ -240,29 +422,40 @@ AdjustWaitForDelay(void *waitTime, int newdelay)
         *timeoutp = newdelay;
 }
 
-static inline Bool timer_pending(OsTimerPtr timer) {
-    return !xorg_list_is_empty(&timer->list);
-}
-
-/* If time has rewound, re-run every affected timer.
- * Timers might drop out of the list, so we have to restart every time. */
+/*
+ * If time has rewound, re-run every timer which is now too far in the
+ * future, and file all the others relative to the new time.
+ */
 static void
-CheckAllTimers(void)
+CheckAllTimers(CARD32 now)
 {
-    OsTimerPtr timer;
-    CARD32 now;
-
-    input_lock();
- start:
-    now = GetTimeInMillis();
+    struct xorg_list todo;
+    OsTimerPtr timer, tmp;
 
-    xorg_list_for_each_entry(timer, &timers, list) {
-        if (timer->expires - now > timer->delta + 250) {
-            DoTimer(timer, now);
-            goto start;
+    xorg_list_init(&todo);
+    xorg_list_for_each_entry_safe(timer, tmp, &timers.expired, list) {
+        timer_dequeue(timer);
+        xorg_list_append(&timer->list, &todo);
+    }
+    for (int level = 0; level < WHEEL_LEVELS; level++) {
+        for (int slot = 0; slot < WHEEL_SIZE; slot++) {
+            xorg_list_for_each_entry_safe(timer, tmp,
+                                          &timers.slots[level][slot], list) {
+                timer_dequeue(timer);
+                xorg_list_append(&timer->list, &todo);
+            }
         }
     }
-    input_unlock();
+
+    timers.now = wheel_time(now);
+    xorg_list_for_each_entry_safe(timer, tmp, &todo, list) {
+        xorg_list_del(&timer->list);
+        if (timer->expires - now > timer->delta + 250)
+            timer->when = timers.now;
+        else
+            timer->when = wheel_time(timer->expires);
+        timer_enqueue(timer);
+    }
 }
 
 static void
@@ -270,7 +463,7 @@ DoTimer(OsTimerPtr timer, CARD32 now)
 {
     CARD32 newTime;
 
-    xorg_list_del(&timer->list);
+    timer_dequeue(timer);
     newTime = (*timer->callback) (timer, now, timer->arg);
     if (newTime)
         TimerSet(timer, 0, newTime, timer->callback, timer->arg);
@@ -279,14 +472,10 @@ DoTimer(OsTimerPtr timer, CARD32 now)
 static void
 DoTimers(CARD32 now)
 {
-    OsTimerPtr  timer;
-
     input_lock();
-    while ((timer = first_timer())) {
-        if ((int) (timer->expires - now) > 0)
-            break;
-        DoTimer(timer, now);
-    }
+    while (!xorg_list_is_empty(&timers.expired))
+        DoTimer(xorg_list_first_entry(&timers.expired,
+                                      struct _OsTimerRec, list), now);
     input_unlock();
 }
 
@@ -294,7 +483,6 @@ OsTimerPtr
 TimerSet(OsTimerPtr timer, int flags, CARD32 millis,
          OsTimerCallback func, void *arg)
 {
-    OsTimerPtr existing;
     CARD32 now = GetTimeInMillis();
 
     if (!timer) {
@@ -306,7 +494,7 @@ TimerSet(OsTimerPtr timer, int flags, CARD32 millis,
     else {
         input_lock();
         if (timer_pending(timer)) {
-            xorg_list_del(&timer->list);
+            timer_dequeue(timer);
             if (flags & TimerForceOld)
                 (void) (*timer->callback) (timer, now, timer->arg);
         }
@@ -326,16 +514,18 @@ TimerSet(OsTimerPtr timer, int flags, CARD32 millis,
     timer->arg = arg;
     input_lock();
 
-    /* Sort into list */
-    xorg_list_for_each_entry(existing, &timers, list)
-        if ((int) (existing->expires - millis) > 0)
-            break;
-    /* This even works at the end of the list -- existing->list will be timers */
-    xorg_list_append(&timer->list, &existing->list);
+    /* nothing advances an empty wheel, which may be far behind by now */
+    if (!timers.count)
+        timers.now += (CARD32) (now - (CARD32) timers.now);
 
     /* Check to see if the timer is ready to run now */
     if ((int) (millis - now) <= 0)
         DoTimer(timer, now);
+    else {
+        /* the wheel clock may lag behind now, count from now */
+        timer->when = wheel_time(now) + (millis - now);
+        timer_enqueue(timer);
+    }
 
     input_unlock();
     return timer;
@@ -360,7 +550,7 @@ TimerCancel(OsTimerPtr timer)
     if (!timer)
         return;
     input_lock();
-    xorg_list_del(&timer->list);
+    timer_dequeue(timer);
     input_unlock();
 }
 
@@ -381,13 +571,28 @@ TimerInit(void)
 
     if (!been_here) {
         been_here = TRUE;
-        xorg_list_init((struct xorg_list*) &timers);
+        xorg_list_init(&timers.expired);
+        for (int level = 0; level < WHEEL_LEVELS; level++)
+            for (int slot = 0; slot < WHEEL_SIZE; slot++)
+                xorg_list_init(&timers.slots[level][slot]);
     }
 
-    xorg_list_for_each_entry_safe(timer, tmp, &timers, list) {
+    xorg_list_for_each_entry_safe(timer, tmp, &timers.expired, list) {
         xorg_list_del(&timer->list);
         free(timer);
     }
+    for (int level = 0; level < WHEEL_LEVELS; level++) {
+        for (int slot = 0; slot < WHEEL_SIZE; slot++) {
+            xorg_list_for_each_entry_safe(timer, tmp,
+                                          &timers.slots[level][slot], list) {
+                xorg_list_del(&timer->list);
+                free(timer);
+            }
+        }
+        timers.pending[level] = 0;
+    }
+    timers.count = 0;
+    timers.now = GetTimeInMillis();
 }
 
 #ifdef DPMSExtension
@@ -6,6 +6,7 @@
 #ifndef _XSERVER_DIX_CLIENT_PRIV_H
 #define _XSERVER_DIX_CLIENT_PRIV_H
 
+#include <stdint.h>
 #include <sys/types.h>
 #include <X11/Xdefs.h>
 #include <X11/Xfuncproto.h>
@@ -45,6 +46,17 @@ Bool AddClientOnOpenFD(int fd);
 void ListenOnOpenFD(int fd, int noxauth);
 int ReadRequestFromClient(struct _Client *client);
 int WriteFdToClient(struct _Client *client, int fd, Bool do_close);
+
+/*
+ * like WriteToClient(), but takes over buf instead of copying it: larger
+ * buffers are queued and sent in place, release(buf) is called once
+ * they've been written out (or the client is gone).
+ */
+int WriteToClientBuffer(struct _Client *client, int count, void *buf,
+                        void (*release) (void *buf));
+
+/* total bytes copied into output buffers vs. sent without copying */
+void GetClientOutputStats(uint64_t *copied, uint64_t *in_place);
 Bool InsertFakeRequest(struct _Client *client, char *data, int count);
 void FlushAllOutput(void);
 void FlushIfCriticalOutputPending(void);
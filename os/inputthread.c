@@ -32,7 +32,11 @@
 #include <stdlib.h>
 #include <unistd.h>
 #include <pthread.h>
+#ifdef HAVE_SYS_EVENTFD_H
+#include <sys/eventfd.h>
+#endif
 
+#include "dix/dix_priv.h"
 #include "dix/input_priv.h"
 #include "os/ddx_priv.h"
 #include "os/log_priv.h"
@@ -73,7 +77,8 @@ typedef struct {
     struct xorg_list devs;
     struct ospoll *fds;
     int readPipe;
-    int writePipe;
+    int writePipe;              /* same as readPipe if it's an eventfd */
+    int wakeupPending;
     Bool changed;
     Bool running;
 } InputThreadInfo;
@@ -85,6 +90,22 @@ static int hotplugPipeWrite = -1;
 
 static int input_mutex_count;
 
+/* when the device read currently in progress started, under input_lock */
+static CARD64 inputReadTime;
+
+/* @return whether a wakeup was pending already */
+static inline Bool
+SetWakeupPending(Bool pending)
+{
+#ifdef __ATOMIC_ACQ_REL
+    return __atomic_exchange_n(&inputThreadInfo->wakeupPending, pending,
+                               __ATOMIC_ACQ_REL);
+#else
+    /* can't tell whether the main thread already got it, so always wake it */
+    return FALSE;
+#endif
+}
+
 #ifdef PTHREAD_RECURSIVE_MUTEX_INITIALIZER_NP
 static pthread_mutex_t input_mutex = PTHREAD_RECURSIVE_MUTEX_INITIALIZER_NP;
 #else
@@ -151,6 +172,30 @@ InputThreadFillPipe(int writeHead)
     } while (ret < 0 && ETEST(errno));
 }
 
+/**
+ * Kick the main thread to process the events generated since it last
+ * looked. Wakeups are coalesced: nothing is written while the main thread
+ * hasn't picked up the previous one yet.
+ */
+static void
+InputThreadWakeMain(void)
+{
+    if (SetWakeupPending(TRUE))
+        return;
+
+#ifdef HAVE_SYS_EVENTFD_H
+    if (inputThreadInfo->writePipe == inputThreadInfo->readPipe) {
+        int ret;
+
+        do {
+            ret = eventfd_write(inputThreadInfo->writePipe, 1);
+        } while (ret < 0 && ETEST(errno));
+        return;
+    }
+#endif
+    InputThreadFillPipe(inputThreadInfo->writePipe);
+}
+
 /**
  * Consume eventual notifications left by a thread.
  *
@@ -178,11 +223,20 @@ InputReady(int fd, int xevents, void *data)
     InputThreadDevice *dev = data;
 
     input_lock();
-    if (dev->state == device_state_running)
+    if (dev->state == device_state_running) {
+        inputReadTime = GetTimeInMicros();
         dev->readInputProc(fd, xevents, dev->readInputArgs);
+        inputReadTime = 0;
+    }
     input_unlock();
 }
 
+CARD64
+InputThreadReadTime(void)
+{
+    return inputReadTime;
+}
+
 /**
  * Register an input device in the threaded input facility
  *
@@ -377,7 +431,7 @@ InputThreadDoWork(void *arg)
 
         /* Kick main thread to process the generated input events and drain
          * events from hotplug pipe */
-        InputThreadFillPipe(inputThreadInfo->writePipe);
+        InputThreadWakeMain();
     }
 
     ospoll_remove(inputThreadInfo->fds, hotplugPipeRead);
@@ -388,7 +442,12 @@ InputThreadDoWork(void *arg)
 static void
 InputThreadNotifyPipe(int fd, int mask, void *data)
 {
+    /* drain first, then clear, so a later wakeup can't be swallowed. One
+     * skipped in between still left its events queued: wake up again. */
     InputThreadReadPipe(fd);
+    SetWakeupPending(FALSE);
+    if (InputCheckPending())
+        InputThreadWakeMain();
 }
 
 /**
@@ -404,8 +463,14 @@ InputThreadPreInit(void)
     if (!InputThreadEnable)
         return;
 
+#ifdef HAVE_SYS_EVENTFD_H
+    fds[0] = fds[1] = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (fds[0] < 0 && pipe(fds) < 0)
+        FatalError("input-thread: could not create pipe");
+#else
     if (pipe(fds) < 0)
         FatalError("input-thread: could not create pipe");
+#endif
 
      if (pipe(hotplugPipe) < 0)
         FatalError("input-thread: could not create pipe");
@@ -515,7 +580,8 @@ InputThreadFini(void)
 
     RemoveNotifyFd(inputThreadInfo->readPipe);
     close(inputThreadInfo->readPipe);
-    close(inputThreadInfo->writePipe);
+    if (inputThreadInfo->writePipe != inputThreadInfo->readPipe)
+        close(inputThreadInfo->writePipe);
     inputThreadInfo->readPipe = -1;
     inputThreadInfo->writePipe = -1;
 
@@ -544,6 +610,7 @@ void InputThreadPreInit(void) {}
 void InputThreadInit(void) {}
 void InputThreadFini(void) {}
 int in_input_thread(void) { return 0; }
+CARD64 InputThreadReadTime(void) { return 0; }
 
 int InputThreadRegisterDev(int fd,
                            NotifyFdProcPtr readInputProc,
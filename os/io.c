@@ -92,23 +92,52 @@ typedef struct _connectionInput {
     int lenLastReq;
     int size;
     unsigned int ignoreBytes;   /* bytes to ignore before the next request */
+    int volume;                 /* average bytes per read, for sizing */
+    Bool active;                /* read from since the last idle check */
 } ConnectionInput;
 
+/*
+ * Output which is sent straight from where it is instead of being copied
+ * into the output buffer first. It goes out after the first `offset`
+ * bytes of the output buffer, and is released once completely written.
+ */
+typedef struct _outputRef {
+    struct _outputRef *next;
+    int offset;                 /* position in the output buffer */
+    const char *data;
+    size_t len;                 /* bytes of data not yet written */
+    int pad;                    /* padding not yet written */
+    void (*release) (void *buf);
+    void *buf;                  /* passed to release */
+    Bool borrowed;              /* data still belongs to the caller */
+} OutputRef, *OutputRefPtr;
+
 typedef struct _connectionOutput {
     struct _connectionOutput *next;
     unsigned char *buf;
     int size;
     int count;
+    OutputRefPtr refs;          /* in order of their offset */
+    OutputRefPtr lastRef;
 } ConnectionOutput;
 
 static ConnectionInputPtr AllocateInputBuffer(void);
 static ConnectionOutputPtr AllocateOutputBuffer(void);
+static int FlushOutput(ClientPtr who, OsCommPtr oc);
+static int WriteOutput(ClientPtr who, int count, const void *buf,
+                       void (*release) (void *buf));
 
 static Bool CriticalOutputPending;
 static int timesThisConnection = 0;
 static ConnectionInputPtr FreeInputs = (ConnectionInputPtr) NULL;
 static ConnectionOutputPtr FreeOutputs = (ConnectionOutputPtr) NULL;
 static OsCommPtr AvailableInput = (OsCommPtr) NULL;
+static OsTimerPtr InputIdleTimer;
+static Bool InputIdleTimerArmed;
+
+/* bytes written to clients, copied into output buffers vs. sent in place */
+static uint64_t OutputBytesCopied;
+static uint64_t OutputBytesInPlace;
 
 #define get_req_len(req,cli) ((cli)->swapped ? \
 			      bswap_16((req)->length) : (req)->length)
@@ -122,6 +151,17 @@ static OsCommPtr AvailableInput = (OsCommPtr) NULL;
 #define BUFSIZE 16384
 #define BUFWATERMARK 32768
 
+/* input buffers of busy clients grow up to this, to read many requests at once */
+#define INPUT_BATCH_MAX (256 * 1024)
+
+/* grown input buffers of clients which didn't send anything for this long
+ * go back to BUFSIZE, in ms */
+#define INPUT_IDLE_TIMEOUT 5000
+
+/* passed in buffers smaller than this are cheaper to copy than to track */
+#define OUTPUT_REF_MIN 1024
+#define OUTPUT_IOV_MAX 64
+
 /*
  *   A lot of the code in this file manipulates a ConnectionInputPtr:
  *
@@ -150,6 +190,11 @@ static OsCommPtr AvailableInput = (OsCommPtr) NULL;
  *  needed = the length of the request that we're trying to
  *  read.  Watch out: needed sometimes counts bytes and sometimes
  *  counts CARD32's.
+ *
+ *  volume tracks how much a client sends per read. Clients sending
+ *  lots of requests get a bigger buffer, so a single read picks up a
+ *  whole batch, and keep it while they're busy instead of returning
+ *  it to FreeInputs each time it runs empty.
  */
 
 /*****************************************************************
@@ -209,9 +254,11 @@ static void
 NextAvailableInput(OsCommPtr oc)
 {
     if (AvailableInput) {
-        if (AvailableInput != oc) {
-            ConnectionInputPtr aci = AvailableInput->input;
+        ConnectionInputPtr aci = AvailableInput->input;
 
+        /* busy clients keep their buffer */
+        if (AvailableInput != oc && aci->volume < BUFSIZE / 2) {
+            aci->volume = 0;
             if (aci->size > BUFWATERMARK) {
                 free(aci->buffer);
                 free(aci);
@@ -226,6 +273,59 @@ NextAvailableInput(OsCommPtr oc)
     }
 }
 
+/* buffer size for a client reading `volume` bytes at once on average */
+static int
+InputBufferSize(int volume)
+{
+    int size = BUFSIZE;
+
+    while (size < 2 * volume && size < INPUT_BATCH_MAX)
+        size <<= 1;
+    return size;
+}
+
+/*
+ * Busy clients keep their grown input buffer between reads, and only
+ * reading shrinks it again. Clients which went quiet since the last check
+ * and have nothing left to read get a small one back here.
+ */
+static CARD32
+ShrinkIdleInputBuffers(OsTimerPtr timer, CARD32 now, void *arg)
+{
+    Bool grown = FALSE;
+
+    for (int i = 1; i < currentMaxClients; i++) {
+        ClientPtr client = clients[i];
+        OsCommPtr oc;
+        ConnectionInputPtr oci;
+        char *ibuf;
+
+        if (!client || client->clientGone || !(oc = client->osPrivate) ||
+            !(oci = oc->input) || oci->size <= BUFSIZE)
+            continue;
+
+        /* the last request stays in the buffer until the next read */
+        if (oci->active || oci->ignoreBytes || client->ignoreCount ||
+            ClientIsAsleep(client) ||
+            oci->bufcnt - (oci->bufptr - oci->buffer) > oci->lenLastReq ||
+            !(ibuf = realloc(oci->buffer, BUFSIZE))) {
+            oci->active = FALSE;
+            grown = TRUE;
+            continue;
+        }
+
+        oci->buffer = ibuf;
+        oci->bufptr = ibuf;
+        oci->size = BUFSIZE;
+        oci->bufcnt = 0;
+        oci->lenLastReq = 0;
+        oci->volume = 0;
+    }
+
+    InputIdleTimerArmed = grown;
+    return grown ? INPUT_IDLE_TIMEOUT : 0;
+}
+
 int
 ReadRequestFromClient(ClientPtr client)
 {
@@ -323,23 +423,32 @@ ReadRequestFromClient(ClientPtr client)
             oci->lenLastReq = gotnow;
             return needed;
         }
-        if ((gotnow == 0) || ((oci->bufptr - oci->buffer + needed) > oci->size)) {
-            /* no data, or the request is too big to fit in the buffer */
+        if ((gotnow == 0) || ((oci->bufptr - oci->buffer + needed) > oci->size) ||
+            (oci->size - oci->bufcnt < oci->size / 4)) {
+            /* no data, the request is too big to fit in the buffer, or
+             * there's too little room left to read a batch of requests */
+            int size = max(needed, InputBufferSize(oci->volume));
 
             if ((gotnow > 0) && (oci->bufptr != oci->buffer))
                 /* save the data we've already read */
                 memmove(oci->buffer, oci->bufptr, gotnow);
-            if (needed > oci->size) {
+            if (size > oci->size) {
                 /* make buffer bigger to accommodate request */
                 char *ibuf;
 
-                ibuf = (char *) realloc(oci->buffer, needed);
+                ibuf = (char *) realloc(oci->buffer, size);
                 if (!ibuf) {
                     YieldControlDeath();
                     return -1;
                 }
-                oci->size = needed;
+                oci->size = size;
                 oci->buffer = ibuf;
+                if (!InputIdleTimerArmed) {
+                    InputIdleTimer = TimerSet(InputIdleTimer, 0,
+                                              INPUT_IDLE_TIMEOUT,
+                                              ShrinkIdleInputBuffers, NULL);
+                    InputIdleTimerArmed = (InputIdleTimer != NULL);
+                }
             }
             oci->bufptr = oci->buffer;
             oci->bufcnt = gotnow;
@@ -367,16 +476,24 @@ ReadRequestFromClient(ClientPtr client)
             YieldControlDeath();
             return -1;
         }
+        /* a read filling the buffer means there was more to get */
+        if (result == oci->size - oci->bufcnt)
+            oci->volume += (2 * result - oci->volume) / 4;
+        else
+            oci->volume += (result - oci->volume) / 4;
         oci->bufcnt += result;
+        oci->active = TRUE;
         gotnow += result;
-        /* free up some space after huge requests */
+        /* free up some space after huge requests or when things calmed down */
         if ((oci->size > BUFWATERMARK) &&
-            (oci->bufcnt < BUFSIZE) && (needed < BUFSIZE)) {
+            (oci->bufcnt < BUFSIZE) && (needed < BUFSIZE) &&
+            (InputBufferSize(oci->volume) < oci->size)) {
             char *ibuf;
+            int size = InputBufferSize(oci->volume);
 
-            ibuf = (char *) realloc(oci->buffer, BUFSIZE);
+            ibuf = (char *) realloc(oci->buffer, size);
             if (ibuf) {
-                oci->size = BUFSIZE;
+                oci->size = size;
                 oci->buffer = ibuf;
                 oci->bufptr = ibuf + oci->bufcnt - gotnow;
             }
@@ -670,6 +787,114 @@ AbortClient(ClientPtr client)
     }
 }
 
+static void
+ReleaseOutputRef(OutputRefPtr ref)
+{
+    if (ref->release)
+        ref->release(ref->buf);
+    free(ref);
+}
+
+/* drop all pending output, e.g. when the client is going away */
+static void
+DiscardOutput(ConnectionOutputPtr oco)
+{
+    while (oco->refs) {
+        OutputRefPtr ref = oco->refs;
+
+        oco->refs = ref->next;
+        ReleaseOutputRef(ref);
+    }
+    oco->lastRef = NULL;
+    oco->count = 0;
+}
+
+/* remove `written` bytes from the front of the pending output */
+static void
+ConsumeOutput(ConnectionOutputPtr oco, size_t written)
+{
+    int staged = 0;
+
+    while (written) {
+        OutputRefPtr ref = oco->refs;
+        size_t chunk = (ref ? ref->offset : oco->count) - staged;
+
+        if (chunk) {
+            chunk = min(chunk, written);
+            staged += chunk;
+            written -= chunk;
+            continue;
+        }
+
+        chunk = min(ref->len, written);
+        ref->data += chunk;
+        ref->len -= chunk;
+        written -= chunk;
+        if (!ref->len) {
+            chunk = min((size_t) ref->pad, written);
+            ref->pad -= chunk;
+            written -= chunk;
+        }
+        if (!ref->len && !ref->pad) {
+            if (!(oco->refs = ref->next))
+                oco->lastRef = NULL;
+            ReleaseOutputRef(ref);
+        }
+    }
+
+    /* drop any references already written completely, e.g. empty ones */
+    while (oco->refs && oco->refs->offset == staged &&
+           !oco->refs->len && !oco->refs->pad) {
+        OutputRefPtr ref = oco->refs;
+
+        if (!(oco->refs = ref->next))
+            oco->lastRef = NULL;
+        ReleaseOutputRef(ref);
+    }
+
+    if (staged) {
+        oco->count -= staged;
+        memmove(oco->buf, oco->buf + staged, oco->count);
+        for (OutputRefPtr ref = oco->refs; ref; ref = ref->next)
+            ref->offset -= staged;
+    }
+}
+
+/*
+ * gather pending output into iov, limited to `limit` bytes.
+ * returns the number of iovec entries used.
+ */
+static int
+GatherOutput(ConnectionOutputPtr oco, struct iovec *iov, size_t limit)
+{
+    static char padding[3];
+    int niov = 0, staged = 0;
+    OutputRefPtr ref;
+
+#define GATHER(base, length) do {                       \
+        size_t l = min((size_t) (length), limit);       \
+        if (l) {                                        \
+            iov[niov].iov_base = (void *) (base);       \
+            iov[niov].iov_len = l;                      \
+            niov++;                                     \
+            limit -= l;                                 \
+        }                                               \
+    } while (0)
+
+    for (ref = oco->refs; ref && limit && niov <= OUTPUT_IOV_MAX - 3;
+         ref = ref->next) {
+        GATHER(oco->buf + staged, ref->offset - staged);
+        staged = ref->offset;
+        GATHER(ref->data, ref->len);
+        GATHER(padding, ref->pad);
+    }
+    if (!ref && limit)
+        GATHER(oco->buf + staged, oco->count - staged);
+
+#undef GATHER
+    return niov;
+}
+
 /*
  * try to make room in the output buffer:
  * if not enough room, try to flush first.
@@ -686,8 +911,8 @@ static bool OutputBufferMakeRoom(ClientPtr who, OsCommPtr oc, size_t sz)
     if (oco->count + needed <= oco->size)
         return true;
 
-    /* try flushing the buffer */
-    int ret = FlushClient(who, oc);
+    /* try flushing the buffer, keeping it attached to the client */
+    int ret = FlushOutput(who, oc);
     if (ret == -1) /* client was aborted */
         return false;
 
@@ -702,7 +927,7 @@ static bool OutputBufferMakeRoom(ClientPtr who, OsCommPtr oc, size_t sz)
     if (!newbuf) {
         AbortClient(who);
         dixMarkClientException(who);
-        oco->count = 0;
+        DiscardOutput(oco);
         return FALSE;
     }
 
@@ -711,6 +936,79 @@ static bool OutputBufferMakeRoom(ClientPtr who, OsCommPtr oc, size_t sz)
     return true;
 }
 
+static OutputRefPtr
+QueueOutputRef(ConnectionOutputPtr oco, const char *data, int count,
+               int padBytes, void (*release) (void *buf), void *buf)
+{
+    OutputRefPtr ref = calloc(1, sizeof(OutputRef));
+
+    if (!ref)
+        return NULL;
+
+    ref->offset = oco->count;
+    ref->data = data;
+    ref->len = count;
+    ref->pad = padBytes;
+    ref->release = release;
+    ref->buf = buf;
+
+    if (oco->lastRef)
+        oco->lastRef->next = ref;
+    else
+        oco->refs = ref;
+    oco->lastRef = ref;
+    return ref;
+}
+
+/*
+ * Large output which doesn't fit into the output buffer anymore is sent
+ * right from the caller's buffer. Only what the socket doesn't take now
+ * has to be copied, since the caller's buffer is gone once we return.
+ */
+static int
+WriteInPlace(ClientPtr who, OsCommPtr oc, const char *buf, int count,
+             int padBytes)
+{
+    ConnectionOutputPtr oco = oc->output;
+    OutputRefPtr ref = QueueOutputRef(oco, buf, count, padBytes, NULL, NULL);
+    char *copy;
+
+    if (!ref)
+        return 0;
+
+    ref->borrowed = TRUE;
+    NewOutputPending = TRUE;
+    output_pending_mark(who);
+    if (FlushOutput(who, oc) == -1)
+        return -1;
+
+    /* the borrowed reference can only be the last one still queued */
+    ref = oco->lastRef;
+    if (!ref || !ref->borrowed) {
+        OutputBytesInPlace += count;
+        return count;
+    }
+
+    ref->borrowed = FALSE;
+    OutputBytesInPlace += count - ref->len;
+    if (!ref->len)
+        return count;
+
+    copy = malloc(ref->len);
+    if (!copy) {
+        AbortClient(who);
+        dixMarkClientException(who);
+        DiscardOutput(oco);
+        return -1;
+    }
+    memcpy(copy, ref->data, ref->len);
+    ref->data = copy;
+    ref->release = free;
+    ref->buf = copy;
+    OutputBytesCopied += ref->len;
+    return count;
+}
+
 /*****************
  * WriteToClient
  *    Copies buf into ClientPtr.buf if it fits (with padding), else
@@ -720,24 +1018,58 @@ static bool OutputBufferMakeRoom(ClientPtr who, OsCommPtr oc, size_t sz)
  *    that are sending several chunks of data and want to break
  *    out of a loop on error.  Thus, we will leave the type of
  *    this routine as int.
+ *
+ * WriteToClientBuffer
+ *    Same, but takes over buf, which is sent without copying it and
+ *    handed to release() after it has been written.
  *****************/
 
 int
-WriteToClient(ClientPtr who, int count, const void *__buf)
+WriteToClient(ClientPtr who, int count, const void *buf)
+{
+    BUG_RETURN_VAL_MSG(in_input_thread(), 0,
+                       "******** %s called from input thread *********\n", __func__);
+
+    return WriteOutput(who, count, buf, NULL);
+}
+
+int
+WriteToClientBuffer(ClientPtr who, int count, void *buf,
+                    void (*release) (void *buf))
+{
+    int ret;
+
+    if (in_input_thread()) {
+        release(buf);
+        BUG_RETURN_VAL_MSG(TRUE, 0,
+                           "******** %s called from input thread *********\n", __func__);
+    }
+
+    if (count >= OUTPUT_REF_MIN)
+        return WriteOutput(who, count, buf, release);
+
+    ret = WriteOutput(who, count, buf, NULL);
+    release(buf);
+    return ret;
+}
+
+static int
+WriteOutput(ClientPtr who, int count, const void *__buf,
+            void (*release) (void *buf))
 {
     OsCommPtr oc;
     ConnectionOutputPtr oco;
     int padBytes;
     const char *buf = __buf;
 
-    BUG_RETURN_VAL_MSG(in_input_thread(), 0,
-                       "******** %s called from input thread *********\n", __func__);
-
 #ifdef DEBUG_COMMUNICATION
     Bool multicount = FALSE;
 #endif
-    if (!count || !who || who == serverClient || who->clientGone)
+    if (!count || !who || who == serverClient || who->clientGone) {
+        if (release)
+            release((void *) buf);
         return 0;
+    }
     oc = who->osPrivate;
     oco = oc->output;
 #ifdef DEBUG_COMMUNICATION
@@ -788,6 +1120,8 @@ WriteToClient(ClientPtr who, int count, const void *__buf)
         else if (!(oco = AllocateOutputBuffer())) {
             AbortClient(who);
             dixMarkClientException(who);
+            if (release)
+                release((void *) buf);
             return -1;
         }
         oc->output = oco;
@@ -843,18 +1177,40 @@ WriteToClient(ClientPtr who, int count, const void *__buf)
         }
     }
 
+    if (release) {
+        if (QueueOutputRef(oco, buf, count, padBytes, release, (void *) buf)) {
+            NewOutputPending = TRUE;
+            output_pending_mark(who);
+            OutputBytesInPlace += count;
+            return count;
+        }
+    }
+    else if (count >= OUTPUT_REF_MIN &&
+             oco->count + count + padBytes > oco->size) {
+        int ret = WriteInPlace(who, oc, buf, count, padBytes);
+
+        if (ret)
+            return ret;
+    }
+
     /* if we fail to make room, the client will be aborted */
-    if (!OutputBufferMakeRoom(who, oc, count))
+    if (!OutputBufferMakeRoom(who, oc, count)) {
+        if (release)
+            release((void *) buf);
         return -1;
+    }
 
     NewOutputPending = TRUE;
     output_pending_mark(who);
     memmove((char *) oco->buf + oco->count, buf, count);
     oco->count += count;
+    OutputBytesCopied += count;
     if (padBytes) {
         memset(oco->buf + oco->count, '\0', padBytes);
         oco->count += padBytes;
     }
+    if (release)
+        release((void *) buf);
     return count;
 }
 
@@ -868,8 +1224,8 @@ WriteToClient(ClientPtr who, int count, const void *__buf)
  *
  **********************/
 
-int
-FlushClient(ClientPtr who, OsCommPtr oc)
+static int
+FlushOutput(ClientPtr who, OsCommPtr oc)
 {
     ConnectionOutputPtr oco = oc->output;
     XtransConnInfo trans_conn = oc->trans_conn;
@@ -882,52 +1238,41 @@ FlushClient(ClientPtr who, OsCommPtr oc)
         /* uh, transport not connected ? can only kill the client :( */
         AbortClient(who);
         dixMarkClientException(who);
-        oco->count = 0;
+        DiscardOutput(oco);
         return -1;
     }
 
-    size_t written = 0;
-    size_t notWritten = oco->count;
-
     /* do nothing if we haven't anything to write */
-    if (!notWritten)
+    if (!oco->count && !oco->refs)
         return 0;
 
     if (FlushCallback)
         CallCallbacks(&FlushCallback, who);
 
-    size_t todo = notWritten; /* trying to write that much this time */
-    while (notWritten) {
+    size_t todo = SIZE_MAX; /* trying to write at most that much this time */
+    while (oco->count || oco->refs) {
+        struct iovec iov[OUTPUT_IOV_MAX];
+        int niov = GatherOutput(oco, iov, todo);
+        size_t gathered = 0;
+
+        for (int i = 0; i < niov; i++)
+            gathered += iov[i].iov_len;
+
         errno = 0;
-        size_t len = _XSERVTransWrite(trans_conn, (const char*)oco->buf + written, todo);
+        int len = _XSERVTransWritev(trans_conn, iov, niov);
         if (len >= 0) {
-            written += len;
-            notWritten -= len;
-            todo = notWritten;
+            ConsumeOutput(oco, len);
+            todo = SIZE_MAX;
         }
         else if (ETEST(errno)
 #ifdef EMSGSIZE                 /* check for another brain-damaged OS bug */
-                 || ((errno == EMSGSIZE) && (todo == 1))
+                 || ((errno == EMSGSIZE) && (gathered == 1))
 #endif
             ) {
             /* If we've arrived here, then the client is stuffed to the gills
                and not ready to accept more.  Make a note of it and buffer
                the rest. */
             output_pending_mark(who);
-
-            if (written < oco->count) {
-                if (written > 0) {
-                    oco->count -= written;
-                    memmove((char *) oco->buf,
-                            (char *) oco->buf + written, oco->count);
-                    written = 0;
-                }
-            }
-            else {
-                written -= oco->count;
-                oco->count = 0;
-            }
-
             ospoll_listen(server_poll, oc->fd, X_NOTIFY_WRITE);
 
             /* return only the amount explicitly requested */
@@ -936,19 +1281,33 @@ FlushClient(ClientPtr who, OsCommPtr oc)
 #ifdef EMSGSIZE                 /* check for another brain-damaged OS bug */
         else if (errno == EMSGSIZE) {
             /* making separate try with half of the size */
-            todo >>= 1;
+            todo = gathered >> 1;
         }
 #endif
         else {
             AbortClient(who);
             dixMarkClientException(who);
-            oco->count = 0;
+            DiscardOutput(oco);
             return -1;
         }
     }
 
+    return 0;
+}
+
+int
+FlushClient(ClientPtr who, OsCommPtr oc)
+{
+    ConnectionOutputPtr oco = oc->output;
+
+    if (FlushOutput(who, oc) == -1)
+        return -1;
+
+    /* keep the buffer if there's still output pending */
+    if (!oco || oco->count || oco->refs)
+        return 0;
+
     /* everything was flushed out */
-    oco->count = 0;
     output_pending_clear(who);
 
     if (oco->size > BUFWATERMARK) {
@@ -1018,9 +1377,12 @@ FreeOsBuffers(OsCommPtr oc)
             oci->bufcnt = 0;
             oci->lenLastReq = 0;
             oci->ignoreBytes = 0;
+            oci->volume = 0;
+            oci->active = FALSE;
         }
     }
     if ((oco = oc->output)) {
+        DiscardOutput(oco);
         if (FreeOutputs) {
             free(oco->buf);
             free(oco);
@@ -1028,7 +1390,6 @@ FreeOsBuffers(OsCommPtr oc)
         else {
             FreeOutputs = oco;
             oco->next = (ConnectionOutputPtr) NULL;
-            oco->count = 0;
         }
     }
 }
@@ -1044,9 +1405,25 @@ ResetOsBuffers(void)
         free(oci->buffer);
         free(oci);
     }
+    TimerFree(InputIdleTimer);
+    InputIdleTimer = NULL;
+    InputIdleTimerArmed = FALSE;
     while ((oco = FreeOutputs)) {
         FreeOutputs = oco->next;
         free(oco->buf);
         free(oco);
     }
+
+    if (OutputBytesCopied || OutputBytesInPlace)
+        LogMessageVerb(X_INFO, 3, "client output: %llu bytes copied, "
+                       "%llu bytes sent in place\n",
+                       (unsigned long long) OutputBytesCopied,
+                       (unsigned long long) OutputBytesInPlace);
+}
+
+void
+GetClientOutputStats(uint64_t *copied, uint64_t *in_place)
+{
+    *copied = OutputBytesCopied;
+    *in_place = OutputBytesInPlace;
 }
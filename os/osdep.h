@@ -119,6 +119,7 @@ extern Bool ComputeLocalClient(ClientPtr client);
 /* OsTimer functions */
 void TimerInit(void);
 Bool TimerForce(OsTimerPtr timer);
+int check_timers(void);
 
 #ifdef WIN32
 #include <X11/Xwinsock.h>
@@ -193,6 +194,30 @@ extern Bool CoreDump;
 extern Bool NoListenAll;
 extern Bool AllowByteSwappedClients;
 
+/*
+ * Accesses to memory shared with another thread or process without a lock:
+ * whoever sees a value through LoadAcquire() also sees everything written
+ * before it was stored by StoreRelease(). ReleaseFence() orders everything
+ * written before it before everything written after it. The fallback for
+ * compilers without the __atomic builtins (GCC < 4.7) uses full barriers.
+ */
+#ifdef __ATOMIC_ACQUIRE
+# define LoadAcquire(p)      __atomic_load_n((p), __ATOMIC_ACQUIRE)
+# define StoreRelease(p, v)  __atomic_store_n((p), (v), __ATOMIC_RELEASE)
+# define ReleaseFence()      __atomic_thread_fence(__ATOMIC_RELEASE)
+#else
+# define LoadAcquire(p) __extension__ ({                                \
+        __typeof__(*(p)) _v = *(volatile __typeof__(*(p)) *) (p);       \
+        __sync_synchronize();                                           \
+        _v;                                                             \
+    })
+# define StoreRelease(p, v) do {                                        \
+        __sync_synchronize();                                           \
+        *(volatile __typeof__(*(p)) *) (p) = (v);                       \
+    } while (0)
+# define ReleaseFence()      __sync_synchronize()
+#endif
+
 #if __has_builtin(__builtin_popcountl)
 # define Ones __builtin_popcountl
 #else
@@ -83,6 +83,7 @@ OR PERFORMANCE OF THIS SOFTWARE.
 #include <ctype.h>              /* for isspace */
 #include <stdarg.h>
 #include <stdlib.h>             /* for calloc() */
+#include <limits.h>
 
 #if defined(TCPCONN)
 #ifndef WIN32
@@ -286,7 +287,9 @@ UseMsg(void)
         ("-deferglyphs [none|all|16] defer loading of [no|all|16-bit] glyphs\n");
     ErrorF("-f #                   bell base (0-100)\n");
     ErrorF("-fakescreenfps #       fake screen default fps (1-600)\n");
+    ErrorF("-fontprewarm file      fonts to open at startup, one per line\n");
     ErrorF("-fp string             default font path\n");
+    ErrorF("-glyphcache #          software glyph cache size in KB, 0 for no limit\n");
     ErrorF("-help                  prints message with these options\n");
     ErrorF("+iglx                  Allow creating indirect GLX contexts\n");
     ErrorF("-iglx                  Prohibit creating indirect GLX contexts (default)\n");
@@ -542,6 +545,30 @@ ProcessCommandLine(int argc, char *argv[])
             else
                 UseMsg();
         }
+        else if (strcmp(argv[i], "-glyphcache") == 0) {
+            if (++i < argc) {
+                char *end;
+                long kb;
+
+                errno = 0;
+                kb = strtol(argv[i], &end, 10);
+                /* the budget is kept in bytes and must not wrap */
+                if (errno || end == argv[i] || *end != '\0' ||
+                    kb < 0 || kb > UINT_MAX / 1024) {
+                    UseMsg();
+                    FatalError("Bad glyph cache size, exiting: %s\n", argv[i]);
+                }
+                glyphCacheSize = (unsigned int) kb;
+            }
+            else
+                UseMsg();
+        }
+        else if (strcmp(argv[i], "-fontprewarm") == 0) {
+            if (++i < argc)
+                fontPrewarmFile = argv[i];
+            else
+                UseMsg();
+        }
         else if (strcmp(argv[i], "-fp") == 0) {
             if (++i < argc) {
                 defaultFontPath = argv[i];
@@ -21,35 +21,167 @@
  */
 #include <dix-config.h>
 
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#ifdef HAVE_SYS_TIMERFD_H
+#include <sys/timerfd.h>
+#endif
+
 #include "present_priv.h"
 #include "list.h"
 
-static struct xorg_list fake_vblank_queue;
+#define NSEC_PER_SEC    1000000000ULL
+
+/*
+ * The fake CRTC stands in for a real one on screens without vblank support,
+ * and for windows which are not on any CRTC. Vblank number msc happens at
+ * msc / fps seconds of the monotonic clock, computed exactly so MSC and UST
+ * never drift apart. All the events due at one MSC are notified together,
+ * from a single wakeup of a timerfd set to the nanosecond, or of an OsTimer
+ * where there is no timerfd.
+ */
+struct present_fake_crtc {
+    uint32_t                    fps;
+    struct xorg_list            queue;          /* sorted by msc */
+    uint64_t                    armed_msc;      /* 0 when not armed */
+    int                         timer_fd;
+    OsTimerPtr                  timer;
+};
 
 typedef struct present_fake_vblank {
     struct xorg_list            list;
     uint64_t                    event_id;
-    OsTimerPtr                  timer;
-    ScreenPtr                   screen;
+    uint64_t                    msc;
 } present_fake_vblank_rec, *present_fake_vblank_ptr;
 
+/* first nanosecond of vblank msc */
+static uint64_t
+present_fake_msc_to_ns(present_fake_crtc_ptr fake_crtc, uint64_t msc)
+{
+    uint32_t                    fps = fake_crtc->fps;
+
+    return msc / fps * NSEC_PER_SEC +
+        (msc % fps * NSEC_PER_SEC + fps - 1) / fps;
+}
+
+static uint64_t
+present_fake_ns_to_msc(present_fake_crtc_ptr fake_crtc, uint64_t ns)
+{
+    uint32_t                    fps = fake_crtc->fps;
+
+    return ns / NSEC_PER_SEC * fps + ns % NSEC_PER_SEC * fps / NSEC_PER_SEC;
+}
+
+/*
+ * Now, to the nanosecond where the clock has it: with microseconds
+ * truncated, a timerfd which fired right at the first nanosecond of a
+ * vblank would find it not reached yet, and be armed for it again.
+ */
+static uint64_t
+present_fake_now_ns(void)
+{
+#ifdef MONOTONIC_CLOCK
+    struct timespec             tp;
+
+    if (clock_gettime(CLOCK_MONOTONIC, &tp) == 0)
+        return tp.tv_sec * NSEC_PER_SEC + tp.tv_nsec;
+#endif
+    return GetTimeInMicros() * 1000;
+}
+
+/*
+ * Like a real CRTC, report the last vblank which happened and when it did
+ */
+void
+present_fake_crtc_get_ust_msc(present_fake_crtc_ptr fake_crtc,
+                              uint64_t *ust, uint64_t *msc)
+{
+    *msc = present_fake_ns_to_msc(fake_crtc, present_fake_now_ns());
+    *ust = present_fake_msc_to_ns(fake_crtc, *msc) / 1000;
+}
+
 int
 present_fake_get_ust_msc(ScreenPtr screen, uint64_t *ust, uint64_t *msc)
 {
     present_screen_priv_ptr screen_priv = present_screen_priv(screen);
 
-    *ust = GetTimeInMicros();
-    *msc = (*ust + screen_priv->fake_interval / 2) / screen_priv->fake_interval;
+    present_fake_crtc_get_ust_msc(screen_priv->fake_crtc, ust, msc);
     return Success;
 }
 
+static CARD32
+present_fake_do_timer(OsTimerPtr timer, CARD32 time, void *arg);
+
+/*
+ * Make sure we wake up for the first queued event
+ */
+static Bool
+present_fake_arm(present_fake_crtc_ptr fake_crtc)
+{
+    present_fake_vblank_ptr     first;
+    uint64_t                    when, now;
+
+    if (xorg_list_is_empty(&fake_crtc->queue))
+        return TRUE;
+
+    /* waking up early is fine, we just go back to sleep */
+    first = xorg_list_first_entry(&fake_crtc->queue, present_fake_vblank_rec, list);
+    if (fake_crtc->armed_msc && fake_crtc->armed_msc <= first->msc)
+        return TRUE;
+
+    when = present_fake_msc_to_ns(fake_crtc, first->msc);
+
+#ifdef HAVE_SYS_TIMERFD_H
+    if (fake_crtc->timer_fd >= 0) {
+        struct itimerspec its = {
+            .it_value = {
+                .tv_sec = when / NSEC_PER_SEC,
+                .tv_nsec = when % NSEC_PER_SEC,
+            },
+        };
+
+        if (timerfd_settime(fake_crtc->timer_fd, TFD_TIMER_ABSTIME, &its, NULL) < 0)
+            return FALSE;
+        fake_crtc->armed_msc = first->msc;
+        return TRUE;
+    }
+#endif
+
+    /* OsTimers count milliseconds, round up so we don't wake too early */
+    now = present_fake_now_ns();
+    fake_crtc->timer = TimerSet(fake_crtc->timer, 0,
+                                when > now ? (when - now + 999999) / 1000000 : 1,
+                                present_fake_do_timer, fake_crtc);
+    if (!fake_crtc->timer)
+        return FALSE;
+    fake_crtc->armed_msc = first->msc;
+    return TRUE;
+}
+
 static void
-present_fake_notify(ScreenPtr screen, uint64_t event_id)
+present_fake_fire(present_fake_crtc_ptr fake_crtc)
 {
-    uint64_t                    ust, msc;
+    present_fake_vblank_ptr     fake_vblank;
+    uint64_t                    ust, msc, event_id;
+
+    fake_crtc->armed_msc = 0;
+    present_fake_crtc_get_ust_msc(fake_crtc, &ust, &msc);
+
+    /* notifying queues and aborts other events, take them one at a time */
+    while (!xorg_list_is_empty(&fake_crtc->queue)) {
+        fake_vblank = xorg_list_first_entry(&fake_crtc->queue,
+                                            present_fake_vblank_rec, list);
+        if (fake_vblank->msc > msc)
+            break;
+
+        event_id = fake_vblank->event_id;
+        xorg_list_del(&fake_vblank->list);
+        free(fake_vblank);
+        present_event_notify(event_id, ust, msc);
+    }
 
-    present_fake_get_ust_msc(screen, &ust, &msc);
-    present_event_notify(event_id, ust, msc);
+    present_fake_arm(fake_crtc);
 }
 
 static CARD32
@@ -57,23 +189,30 @@ present_fake_do_timer(OsTimerPtr timer,
                       CARD32 time,
                       void *arg)
 {
-    present_fake_vblank_ptr     fake_vblank = arg;
-
-    present_fake_notify(fake_vblank->screen, fake_vblank->event_id);
-    xorg_list_del(&fake_vblank->list);
-    TimerFree(fake_vblank->timer);
-    free(fake_vblank);
+    present_fake_fire(arg);
     return 0;
 }
 
+#ifdef HAVE_SYS_TIMERFD_H
+static void
+present_fake_timer_notify(int fd, int ready, void *data)
+{
+    uint64_t                    expirations;
+
+    if (read(fd, &expirations, sizeof (expirations)) < 0 && errno == EAGAIN)
+        return;
+    present_fake_fire(data);
+}
+#endif
+
 void
-present_fake_abort_vblank(ScreenPtr screen, uint64_t event_id, uint64_t msc)
+present_fake_crtc_abort_vblank(present_fake_crtc_ptr fake_crtc,
+                               uint64_t event_id)
 {
     present_fake_vblank_ptr     fake_vblank, tmp;
 
-    xorg_list_for_each_entry_safe(fake_vblank, tmp, &fake_vblank_queue, list) {
+    xorg_list_for_each_entry_safe(fake_vblank, tmp, &fake_crtc->queue, list) {
         if (fake_vblank->event_id == event_id) {
-            TimerFree(fake_vblank->timer); /* TimerFree will call TimerCancel() */
             xorg_list_del(&fake_vblank->list);
             free (fake_vblank);
             break;
@@ -81,19 +220,26 @@ present_fake_abort_vblank(ScreenPtr screen, uint64_t event_id, uint64_t msc)
     }
 }
 
-int
-present_fake_queue_vblank(ScreenPtr     screen,
-                          uint64_t      event_id,
-                          uint64_t      msc)
+void
+present_fake_abort_vblank(ScreenPtr screen, uint64_t event_id, uint64_t msc)
 {
     present_screen_priv_ptr     screen_priv = present_screen_priv(screen);
-    uint64_t                    ust = msc * screen_priv->fake_interval;
-    uint64_t                    now = GetTimeInMicros();
-    INT32                       delay = ((int64_t) (ust - now)) / 1000;
-    present_fake_vblank_ptr     fake_vblank;
 
-    if (delay <= 0) {
-        present_fake_notify(screen, event_id);
+    present_fake_crtc_abort_vblank(screen_priv->fake_crtc, event_id);
+}
+
+int
+present_fake_crtc_queue_vblank(present_fake_crtc_ptr fake_crtc,
+                               uint64_t event_id,
+                               uint64_t msc)
+{
+    present_fake_vblank_ptr     fake_vblank, prev;
+    struct xorg_list            *pos;
+    uint64_t                    ust, crtc_msc;
+
+    present_fake_crtc_get_ust_msc(fake_crtc, &ust, &crtc_msc);
+    if (msc <= crtc_msc) {
+        present_event_notify(event_id, ust, crtc_msc);
         return Success;
     }
 
@@ -101,22 +247,83 @@ present_fake_queue_vblank(ScreenPtr     screen,
     if (!fake_vblank)
         return BadAlloc;
 
-    fake_vblank->screen = screen;
     fake_vblank->event_id = event_id;
-    fake_vblank->timer = TimerSet(NULL, 0, delay, present_fake_do_timer, fake_vblank);
-    if (!fake_vblank->timer) {
+    fake_vblank->msc = msc;
+
+    /* mostly for the next frame or so, look from the end */
+    for (pos = fake_crtc->queue.prev; pos != &fake_crtc->queue; pos = pos->prev) {
+        prev = xorg_list_entry(pos, present_fake_vblank_rec, list);
+        if (prev->msc <= msc)
+            break;
+    }
+    xorg_list_add(&fake_vblank->list, pos);
+
+    if (!present_fake_arm(fake_crtc)) {
+        xorg_list_del(&fake_vblank->list);
         free(fake_vblank);
         return BadAlloc;
     }
 
-    xorg_list_add(&fake_vblank->list, &fake_vblank_queue);
-
     return Success;
 }
 
-uint32_t FakeScreenFps = 0;
+int
+present_fake_queue_vblank(ScreenPtr     screen,
+                          uint64_t      event_id,
+                          uint64_t      msc)
+{
+    present_screen_priv_ptr     screen_priv = present_screen_priv(screen);
+
+    return present_fake_crtc_queue_vblank(screen_priv->fake_crtc, event_id, msc);
+}
+
+present_fake_crtc_ptr
+present_fake_crtc_create(uint32_t fps)
+{
+    present_fake_crtc_ptr       fake_crtc;
+
+    fake_crtc = calloc (1, sizeof (struct present_fake_crtc));
+    if (!fake_crtc)
+        return NULL;
+
+    fake_crtc->fps = fps;
+    fake_crtc->timer_fd = -1;
+    xorg_list_init(&fake_crtc->queue);
+
+#ifdef HAVE_SYS_TIMERFD_H
+    fake_crtc->timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    if (fake_crtc->timer_fd >= 0 &&
+        !SetNotifyFd(fake_crtc->timer_fd, present_fake_timer_notify,
+                     X_NOTIFY_READ, fake_crtc)) {
+        close(fake_crtc->timer_fd);
+        fake_crtc->timer_fd = -1;
+    }
+#endif
+
+    return fake_crtc;
+}
 
 void
+present_fake_crtc_destroy(present_fake_crtc_ptr fake_crtc)
+{
+    present_fake_vblank_ptr     fake_vblank, tmp;
+
+    xorg_list_for_each_entry_safe(fake_vblank, tmp, &fake_crtc->queue, list) {
+        xorg_list_del(&fake_vblank->list);
+        free(fake_vblank);
+    }
+
+    if (fake_crtc->timer_fd >= 0) {
+        RemoveNotifyFd(fake_crtc->timer_fd);
+        close(fake_crtc->timer_fd);
+    }
+    TimerFree(fake_crtc->timer);
+    free(fake_crtc);
+}
+
+uint32_t FakeScreenFps = 0;
+
+Bool
 present_fake_screen_init(ScreenPtr screen)
 {
     uint32_t                fake_fps;
@@ -136,11 +343,17 @@ present_fake_screen_init(ScreenPtr screen)
         else
             fake_fps = 60;
     }
-    screen_priv->fake_interval = 1000000 / fake_fps;
+
+    screen_priv->fake_crtc = present_fake_crtc_create(fake_fps);
+    return screen_priv->fake_crtc != NULL;
 }
 
 void
-present_fake_queue_init(void)
+present_fake_screen_fini(ScreenPtr screen)
 {
-    xorg_list_init(&fake_vblank_queue);
+    present_screen_priv_ptr screen_priv = present_screen_priv(screen);
+
+    if (screen_priv->fake_crtc)
+        present_fake_crtc_destroy(screen_priv->fake_crtc);
+    screen_priv->fake_crtc = NULL;
 }
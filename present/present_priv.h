@@ -54,6 +54,7 @@ extern int present_request;
 extern DevPrivateKeyRec present_screen_private_key;
 
 typedef struct present_fence *present_fence_ptr;
+typedef struct present_fake_crtc *present_fake_crtc_ptr;
 
 typedef struct present_notify present_notify_rec, *present_notify_ptr;
 
@@ -169,7 +170,7 @@ struct present_screen_priv {
     present_vblank_ptr          flip_pending;
     uint64_t                    unflip_event_id;
 
-    uint32_t                    fake_interval;
+    present_fake_crtc_ptr       fake_crtc;
 
     /* Currently active flipped pixmap and fence */
     RRCrtcPtr                   flip_crtc;
@@ -365,6 +366,24 @@ present_execute_post(present_vblank_ptr vblank, uint64_t ust, uint64_t crtc_msc)
 /*
  * present_fake.c
  */
+present_fake_crtc_ptr
+present_fake_crtc_create(uint32_t fps);
+
+void
+present_fake_crtc_destroy(present_fake_crtc_ptr fake_crtc);
+
+void
+present_fake_crtc_get_ust_msc(present_fake_crtc_ptr fake_crtc,
+                              uint64_t *ust, uint64_t *msc);
+
+int
+present_fake_crtc_queue_vblank(present_fake_crtc_ptr fake_crtc,
+                               uint64_t event_id, uint64_t msc);
+
+void
+present_fake_crtc_abort_vblank(present_fake_crtc_ptr fake_crtc,
+                               uint64_t event_id);
+
 int
 present_fake_get_ust_msc(ScreenPtr screen, uint64_t *ust, uint64_t *msc);
 
@@ -374,11 +393,11 @@ present_fake_queue_vblank(ScreenPtr screen, uint64_t event_id, uint64_t msc);
 void
 present_fake_abort_vblank(ScreenPtr screen, uint64_t event_id, uint64_t msc);
 
-void
+Bool
 present_fake_screen_init(ScreenPtr screen);
 
 void
-present_fake_queue_init(void);
+present_fake_screen_fini(ScreenPtr screen);
 
 /*
  * present_fence.c
@@ -65,6 +65,8 @@ static void present_close_screen(CallbackListPtr *pcbl, ScreenPtr screen, void *
     if (screen_priv->flip_destroy)
         screen_priv->flip_destroy(screen);
 
+    present_fake_screen_fini(screen);
+
     dixScreenUnhookClose(screen, present_close_screen);
     dixSetPrivate(&screen->devPrivates, &present_screen_private_key, NULL);
     free(screen_priv);
@@ -190,6 +192,20 @@ present_screen_priv_init(ScreenPtr screen)
     return screen_priv;
 }
 
+/* undo present_screen_priv_init() for a screen present can't run on */
+static void
+present_screen_priv_fini(ScreenPtr screen, present_screen_priv_ptr screen_priv)
+{
+    unwrap(screen_priv, screen, ClipNotify);
+    unwrap(screen_priv, screen, ConfigNotify);
+
+    dixScreenUnhookClose(screen, present_close_screen);
+    dixScreenUnhookWindowDestroy(screen, present_destroy_window);
+
+    dixSetPrivate(&screen->devPrivates, &present_screen_private_key, NULL);
+    free(screen_priv);
+}
+
 static int
 check_flip_visit(WindowPtr window, void *data)
 {
@@ -227,7 +243,10 @@ present_screen_init(ScreenPtr screen, present_screen_info_ptr info)
         screen_priv->info = info;
         present_scmd_init_mode_hooks(screen_priv);
 
-        present_fake_screen_init(screen);
+        if (!present_fake_screen_init(screen)) {
+            present_screen_priv_fini(screen, screen_priv);
+            return FALSE;
+        }
     }
 
     return TRUE;
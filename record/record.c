@@ -36,6 +36,10 @@ and Jim Haggerty of Metheus.
 
 #include <stdio.h>
 #include <assert.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include <X11/Xmd.h>
 #include <X11/extensions/recordproto.h>
 
@@ -60,6 +64,7 @@ and Jim Haggerty of Metheus.
 #include "cursor.h"
 
 #include "protocol-versions.h"
+#include "recordshm.h"
 
 static RESTYPE RTContext;       /* internal resource type for Record contexts */
 
@@ -68,6 +73,9 @@ static RESTYPE RTContext;       /* internal resource type for Record contexts */
  */
 #define REPLY_BUF_SIZE 1024
 
+/* where the capture ring starts in the memfd */
+#define RECORD_SHM_DATA_OFFSET 64
+
 /* Record Context structure */
 
 typedef struct {
@@ -81,6 +89,13 @@ typedef struct {
     int numBufBytes;            /* number of bytes in replyBuffer */
     char replyBuffer[REPLY_BUF_SIZE];   /* buffered recorded protocol */
     int inFlush;                /*  are we inside RecordFlushReplyBuffer */
+    xRecordShmHeader *pShm;     /* capture ring, if enabled with a memfd */
+    size_t shmMapSize;          /* size of the mapping at pShm */
+    CARD32 shmDataSize;         /* size of the ring, a power of two */
+    uint64_t shmHead;           /* end of what this dispatch cycle added */
+    uint64_t shmPublished;      /* head as the consumer sees it */
+    uint64_t shmLost;           /* bytes dropped so far */
+    Bool shmOverflow;           /* this dispatch cycle did not fit */
 } RecordContextRec, *RecordContextPtr;
 
 /*  RecordMinorOpRec - to hold minor opcode selections for extension requests
@@ -96,6 +111,16 @@ typedef union {
     } major;
 } RecordMinorOpRec, *RecordMinorOpPtr;
 
+/*  RecordBitmap - a set of 8 bit values (major opcodes, event types, error
+ *  codes) as a bitmap, so that the recording hooks can test membership
+ *  without going through the set ops.
+ */
+
+typedef CARD32 RecordBitmap[256 / 32];
+
+#define RecordIsMemberOfBitmap(_bits, _n) \
+    ((_bits)[(_n) >> 5] & ((CARD32) 1 << ((_n) & 31)))
+
 /*  RecordClientsAndProtocolRec, nicknamed RCAP - holds all the client and
  *  protocol selections passed in a single CreateContext or RegisterClients.
  *  Generally, a context will have one of these from the create and an
@@ -113,6 +138,11 @@ typedef struct _RecordClientsAndProtocolRec {
     RecordSetPtr pDeviceEventSet;       /* device events to record */
     RecordSetPtr pDeliveredEventSet;    /* delivered events to record */
     RecordSetPtr pErrorSet;     /* errors to record */
+    RecordBitmap requestMajorOps;       /* pRequestMajorOpSet as a bitmap */
+    RecordBitmap replyMajorOps; /* pReplyMajorOpSet as a bitmap */
+    RecordBitmap deviceEvents;  /* pDeviceEventSet as a bitmap */
+    RecordBitmap deliveredEvents;       /* pDeliveredEventSet as a bitmap */
+    RecordBitmap errors;        /* pErrorSet as a bitmap */
     XID *pClientIDs;            /* array of clients to record */
     short numClients;           /* number of clients in pClientIDs */
     short sizeClients;          /* size of pClientIDs array */
@@ -190,6 +220,9 @@ static int numContexts;         /* number of contexts in ppAllContexts */
  */
 static int numEnabledContexts;
 
+/* number of enabled contexts with a capture ring */
+static int numShmContexts;
+
 /* RecordFindContextOnAllContexts
  *
  * Arguments:
@@ -216,6 +249,46 @@ RecordFindContextOnAllContexts(RecordContextPtr pContext)
 
 /***************************************************************************/
 
+/* RecordShmWrite
+ *
+ * Arguments:
+ *	pContext is a context enabled with a capture ring.
+ *	data is a pointer to protocol data, and len is its length in bytes.
+ *
+ * Returns: nothing.
+ *
+ * Side Effects:
+ *	The data is added to the ring after whatever this dispatch cycle
+ *	added before, but is not visible to the consumer until
+ *	RecordShmPublish.  If it does not fit, the whole dispatch cycle is
+ *	dropped.
+ */
+static void
+RecordShmWrite(RecordContextPtr pContext, const void *data, int len)
+{
+    char *ring = (char *) pContext->pShm + RECORD_SHM_DATA_OFFSET;
+    CARD32 size = pContext->shmDataSize;
+    uint64_t used;
+    CARD32 offset, n;
+
+    if (!len)
+        return;
+
+    /* tail is up to the client, so don't trust it to be <= head */
+    used = pContext->shmHead - LoadAcquire(&pContext->pShm->tail);
+    if (pContext->shmOverflow || used > size || len > size - used) {
+        pContext->shmOverflow = TRUE;
+        pContext->shmHead += len;
+        return;
+    }
+
+    offset = pContext->shmHead & (size - 1);
+    n = min(len, size - offset);
+    memcpy(ring + offset, data, n);
+    memcpy(ring, (const char *) data + n, len - n);
+    pContext->shmHead += len;
+}                               /* RecordShmWrite */
+
 /* RecordFlushReplyBuffer
  *
  * Arguments:
@@ -230,7 +303,7 @@ RecordFindContextOnAllContexts(RecordContextPtr pContext)
  *	to the recording client, and the number of buffered bytes is set to
  *	zero.  If len1 is not zero, data1/len1 are then written to the
  *	recording client, and similarly for data2/len2 (written after
- *	data1/len1).
+ *	data1/len1).  Contexts with a capture ring write to the ring instead.
  */
 static void
 RecordFlushReplyBuffer(RecordContextPtr pContext,
@@ -239,6 +312,13 @@ RecordFlushReplyBuffer(RecordContextPtr pContext,
     if (!pContext->pRecordingClient || pContext->pRecordingClient->clientGone ||
         pContext->inFlush)
         return;
+    if (pContext->pShm) {
+        RecordShmWrite(pContext, pContext->replyBuffer, pContext->numBufBytes);
+        pContext->numBufBytes = 0;
+        RecordShmWrite(pContext, data1, len1);
+        RecordShmWrite(pContext, data2, len2);
+        return;
+    }
     ++pContext->inFlush;
     if (pContext->numBufBytes)
         WriteToClient(pContext->pRecordingClient, pContext->numBufBytes,
@@ -514,8 +594,7 @@ RecordARequest(ClientPtr client)
     for (i = 0; i < numEnabledContexts; i++) {
         pContext = ppAllContexts[i];
         pRCAP = RecordFindClientOnContext(pContext, client->clientAsMask, NULL);
-        if (pRCAP && pRCAP->pRequestMajorOpSet &&
-            RecordIsMemberOfSet(pRCAP->pRequestMajorOpSet, majorop)) {
+        if (pRCAP && RecordIsMemberOfBitmap(pRCAP->requestMajorOps, majorop)) {
             if (majorop <= 127) {       /* core request */
 
                 if (client->req_len == 0)
@@ -600,8 +679,8 @@ RecordAReply(CallbackListPtr *pcbl, void *nulldata, void *calldata)
                 if (!pri->bytesRemaining)
                     pContext->continuedReply = 0;
             }
-            else if (pri->startOfReply && pRCAP->pReplyMajorOpSet &&
-                     RecordIsMemberOfSet(pRCAP->pReplyMajorOpSet, majorop)) {
+            else if (pri->startOfReply &&
+                     RecordIsMemberOfBitmap(pRCAP->replyMajorOps, majorop)) {
                 if (majorop <= 127) {   /* core reply */
                     RecordAProtocolElement(pContext, client, XRecordFromServer,
                                            (void *) pri->replyData,
@@ -678,13 +757,13 @@ RecordADeliveredEventOrError(CallbackListPtr *pcbl, void *nulldata,
                 int recordit = 0;
 
                 if (pRCAP->pErrorSet) {
-                    recordit = RecordIsMemberOfSet(pRCAP->pErrorSet,
-                                                   ((xError *) (pev))->
-                                                   errorCode);
+                    recordit = RecordIsMemberOfBitmap(pRCAP->errors,
+                                                      ((xError *) (pev))->
+                                                      errorCode);
                 }
                 else if (pRCAP->pDeliveredEventSet) {
-                    recordit = RecordIsMemberOfSet(pRCAP->pDeliveredEventSet,
-                                                   pev->u.u.type & 0177);
+                    recordit = RecordIsMemberOfBitmap(pRCAP->deliveredEvents,
+                                                      pev->u.u.type & 0177);
                 }
                 if (recordit) {
                     xEvent swappedEvent;
@@ -712,7 +791,7 @@ RecordSendProtocolEvents(RecordClientsAndProtocolPtr pRCAP,
     int ev;                     /* event index */
 
     for (ev = 0; ev < count; ev++, pev++) {
-        if (RecordIsMemberOfSet(pRCAP->pDeviceEventSet, pev->u.u.type & 0177)) {
+        if (RecordIsMemberOfBitmap(pRCAP->deviceEvents, pev->u.u.type & 0177)) {
             xEvent swappedEvent;
             xEvent *pEvToRecord = pev;
 
@@ -745,9 +824,10 @@ RecordSendProtocolEvents(RecordClientsAndProtocolPtr pRCAP,
                                    XRecordFromServer, pEvToRecord,
                                    SIZEOF(xEvent), 0, 0);
             /* make sure device events get flushed in the absence
-             * of other client activity
+             * of other client activity; rings are published anyway
              */
-            SetCriticalOutputPending();
+            if (!pContext->pShm)
+                SetCriticalOutputPending();
         }
     }                           /* end for each event */
 
@@ -810,7 +890,8 @@ RecordADeviceEvent(CallbackListPtr *pcbl, void *nulldata, void *calldata)
  *
  * Side Effects:
  *	All buffered reply data of all enabled contexts is written to
- *	the recording clients.
+ *	the recording clients.  Contexts with a capture ring are left to
+ *	RecordShmBlockHandler.
  */
 static void
 RecordFlushAllContexts(CallbackListPtr *pcbl,
@@ -827,11 +908,67 @@ RecordFlushAllContexts(CallbackListPtr *pcbl,
          * check before calling hoping to save the function call cost
          * most of the time.
          */
-        if (pContext->numBufBytes)
+        if (pContext->numBufBytes && !pContext->pShm)
             RecordFlushReplyBuffer(ppAllContexts[eci], NULL, 0, NULL, 0);
     }
 }                               /* RecordFlushAllContexts */
 
+/* RecordShmPublish
+ *
+ * Arguments:
+ *	pContext is a context enabled with a capture ring.
+ *
+ * Returns: nothing.
+ *
+ * Side Effects:
+ *	Buffered reply data is written to the ring, and everything written
+ *	since the last call is made visible to the consumer, or dropped and
+ *	counted as lost if it did not fit.  Nothing happens in the middle
+ *	of a reply, so the consumer only ever sees whole replies.
+ */
+static void
+RecordShmPublish(RecordContextPtr pContext)
+{
+    xRecordShmHeader *pShm = pContext->pShm;
+
+    if (pContext->continuedReply)
+        return;
+
+    RecordFlushReplyBuffer(pContext, NULL, 0, NULL, 0);
+    if (pContext->shmOverflow) {
+        pContext->shmLost += pContext->shmHead - pContext->shmPublished;
+        pContext->shmHead = pContext->shmPublished;
+        pContext->shmOverflow = FALSE;
+        StoreRelease(&pShm->lost, pContext->shmLost);
+    }
+    else if (pContext->shmHead != pContext->shmPublished) {
+        pContext->shmPublished = pContext->shmHead;
+        StoreRelease(&pShm->head, pContext->shmHead);
+    }
+}                               /* RecordShmPublish */
+
+/* RecordShmBlockHandler
+ *
+ * Arguments:
+ *	blockData and timeout are unused.
+ *
+ * Returns: nothing.
+ *
+ * Side Effects:
+ *	The capture rings of all enabled contexts are published, once per
+ *	dispatch cycle.
+ */
+static void
+RecordShmBlockHandler(void *blockData, void *timeout)
+{
+    int eci;                    /* enabled context index */
+
+    for (eci = 0; eci < numEnabledContexts; eci++) {
+        if (ppAllContexts[eci]->pShm)
+            RecordShmPublish(ppAllContexts[eci]);
+    }
+}                               /* RecordShmBlockHandler */
+
 /* RecordInstallHooks
  *
  * Arguments:
@@ -1510,6 +1647,30 @@ RecordConvertRangesToIntervals(SetInfoPtr psi,
     return Success;
 }                               /* end RecordConvertRangesToIntervals */
 
+/* RecordConvertIntervalsToBitmap
+ *
+ * Arguments:
+ *	psi is a pointer to a SetInfoRec built by
+ *	  RecordConvertRangesToIntervals.
+ *	bits is the bitmap to fill in.
+ *
+ * Returns: nothing.
+ *
+ * Side Effects:
+ *	The bits of all values in the intervals of psi are set in bits.
+ */
+static void
+RecordConvertIntervalsToBitmap(SetInfoPtr psi, RecordBitmap bits)
+{
+    int i, j;
+
+    for (i = 0; i < psi->nintervals; i++) {
+        for (j = psi->intervals[i].first;
+             j <= min(psi->intervals[i].last, 255); j++)
+            bits[j >> 5] |= (CARD32) 1 << (j & 31);
+    }
+}                               /* RecordConvertIntervalsToBitmap */
+
 #define offset_of(_structure, _field) \
     ((char *)(& (_structure . _field)) - (char *)(&_structure))
 
@@ -1755,6 +1916,14 @@ RecordRegisterClients(RecordContextPtr pContext, ClientPtr client,
     else
         pRCAP->pDeliveredEventSet = NULL;
 
+    /* and the same again as bitmaps for the recording hooks */
+
+    RecordConvertIntervalsToBitmap(&si[REQ], pRCAP->requestMajorOps);
+    RecordConvertIntervalsToBitmap(&si[RI_REP], pRCAP->replyMajorOps);
+    RecordConvertIntervalsToBitmap(&si[RI_ERR], pRCAP->errors);
+    RecordConvertIntervalsToBitmap(&si[RI_DEV], pRCAP->deviceEvents);
+    RecordConvertIntervalsToBitmap(&si[RI_DLEV], pRCAP->deliveredEvents);
+
     if (nExtReqSets) {
         pRCAP->pRequestMinOpInfo = (RecordMinorOpPtr)
             ((char *) pRCAP + extReqSetsOffset);
@@ -2278,20 +2447,23 @@ ProcRecordGetContext(ClientPtr client)
     return err;
 }                               /* ProcRecordGetContext */
 
+/* RecordEnableContext
+ *
+ * Arguments:
+ *	client is the client that will receive the recorded protocol.
+ *	pContext is the context to enable, not enabled yet.
+ *
+ * Returns: Success, or the error of installing the recording hooks.
+ *
+ * Side Effects:
+ *	As for ProcRecordEnableContext.
+ */
 static int
-ProcRecordEnableContext(ClientPtr client)
+RecordEnableContext(ClientPtr client, RecordContextPtr pContext)
 {
-    RecordContextPtr pContext;
-
-    REQUEST(xRecordEnableContextReq);
     int i;
     RecordClientsAndProtocolPtr pRCAP;
 
-    REQUEST_SIZE_MATCH(xRecordGetContextReq);
-    VERIFY_CONTEXT(pContext, stuff->context, client);
-    if (pContext->pRecordingClient)
-        return BadMatch;        /* already enabled */
-
     /* install record hooks for each RCAP */
 
     for (pRCAP = pContext->pListOfRCAP; pRCAP; pRCAP = pRCAP->pNextRCAP) {
@@ -2336,8 +2508,145 @@ ProcRecordEnableContext(ClientPtr client)
     RecordAProtocolElement(pContext, NULL, XRecordStartOfData, NULL, 0, 0, 0);
     RecordFlushReplyBuffer(pContext, NULL, 0, NULL, 0);
     return Success;
+}                               /* RecordEnableContext */
+
+static int
+ProcRecordEnableContext(ClientPtr client)
+{
+    RecordContextPtr pContext;
+
+    REQUEST(xRecordEnableContextReq);
+
+    REQUEST_SIZE_MATCH(xRecordGetContextReq);
+    VERIFY_CONTEXT(pContext, stuff->context, client);
+    if (pContext->pRecordingClient)
+        return BadMatch;        /* already enabled */
+
+    return RecordEnableContext(client, pContext);
 }                               /* ProcRecordEnableContext */
 
+/* RecordShmSealed
+ *
+ * Arguments:
+ *	fd is a memfd passed by a client.
+ *
+ * Returns: TRUE if the client can no longer shrink it under our mapping.
+ *
+ * Side Effects: none.
+ */
+static Bool
+RecordShmSealed(int fd)
+{
+#ifdef F_GET_SEALS
+    int seals = fcntl(fd, F_GET_SEALS);
+
+    return seals >= 0 && (seals & F_SEAL_SHRINK);
+#else
+    return FALSE;
+#endif
+}                               /* RecordShmSealed */
+
+/* RecordEnableContextShm
+ *
+ * Arguments:
+ *	client is the client that owns the context and receives StartOfData
+ *	  and EndOfData.
+ *	context is the id of the context to enable.
+ *	fd is a memfd for the capture ring; it is closed in any case.
+ *
+ * Returns: Success, or an X error code.
+ *
+ * Side Effects:
+ *	As for ProcRecordEnableContext, except that the recorded protocol
+ *	goes into the capture ring, as described in recordshm.h.
+ */
+int
+RecordEnableContextShm(ClientPtr client, XID context, int fd)
+{
+    RecordContextPtr pContext;
+    xRecordShmHeader *pShm;
+    struct stat statb;
+    CARD32 dataSize;
+    size_t mapSize;
+    int err;
+
+    err = dixLookupResourceByType((void **) &pContext, context, RTContext,
+                                  client, DixUseAccess);
+    if (err != Success || pContext->pRecordingClient ||
+        !RecordShmSealed(fd) || fstat(fd, &statb) < 0 ||
+        statb.st_size < RECORD_SHM_MIN_SIZE) {
+        close(fd);
+        return err != Success ? err : BadMatch;
+    }
+
+    /* the largest power of two that fits, up to 1GB */
+    for (dataSize = RECORD_SHM_MIN_SIZE / 2;
+         dataSize < (1 << 30) &&
+         RECORD_SHM_DATA_OFFSET + 2 * (off_t) dataSize <= statb.st_size;
+         dataSize *= 2);
+    mapSize = RECORD_SHM_DATA_OFFSET + dataSize;
+
+    pShm = mmap(NULL, mapSize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (pShm == MAP_FAILED)
+        return BadAlloc;
+
+    /* StartOfData still goes over the wire */
+    err = RecordEnableContext(client, pContext);
+    if (err != Success) {
+        munmap(pShm, mapSize);
+        return err;
+    }
+
+    pShm->magic = RECORD_SHM_MAGIC;
+    pShm->version = RECORD_SHM_VERSION;
+    pShm->data_offset = RECORD_SHM_DATA_OFFSET;
+    pShm->data_size = dataSize;
+    pShm->tail = pShm->lost = 0;
+    StoreRelease(&pShm->head, 0);
+
+    pContext->pShm = pShm;
+    pContext->shmMapSize = mapSize;
+    pContext->shmDataSize = dataSize;
+    pContext->shmHead = pContext->shmPublished = pContext->shmLost = 0;
+    pContext->shmOverflow = FALSE;
+
+    if (numShmContexts++ == 0)
+        RegisterBlockAndWakeupHandlers(RecordShmBlockHandler,
+                                       (ServerWakeupHandlerProcPtr) NoopDDA,
+                                       NULL);
+    return Success;
+}                               /* RecordEnableContextShm */
+
+/* RecordShmUnmap
+ *
+ * Arguments:
+ *	pContext is a context enabled with a capture ring.
+ *
+ * Returns: nothing.
+ *
+ * Side Effects:
+ *	What is left is published, unless the recording client is gone,
+ *	and the ring is unmapped, so that the context writes to the
+ *	recording client again.
+ */
+static void
+RecordShmUnmap(RecordContextPtr pContext)
+{
+    if (!pContext->pRecordingClient->clientGone)
+        RecordShmPublish(pContext);
+
+    munmap(pContext->pShm, pContext->shmMapSize);
+    pContext->pShm = NULL;
+    pContext->numBufBytes = 0;
+    pContext->continuedReply = 0;
+
+    if (--numShmContexts == 0)
+        RemoveBlockAndWakeupHandlers(RecordShmBlockHandler,
+                                     (ServerWakeupHandlerProcPtr) NoopDDA,
+                                     NULL);
+}                               /* RecordShmUnmap */
+
 /* RecordDisableContext
  *
  * Arguments:
@@ -2347,8 +2656,9 @@ ProcRecordEnableContext(ClientPtr client)
  * Returns: nothing.
  *
  * Side Effects:
- *	If the context was enabled, it is disabled.  An EndOfData
- *	message is sent to the recording client.  Recording hooks for
+ *	If the context was enabled, it is disabled.  Its capture ring, if
+ *	any, is unmapped.  An EndOfData message is sent to the recording
+ *	client.  Recording hooks for
  *	this context are uninstalled.  The context is moved to the
  *	rear part of the ppAllContexts array.  numEnabledContexts is
  *	decremented.  Request processing for the formerly recording client
@@ -2362,6 +2672,8 @@ RecordDisableContext(RecordContextPtr pContext)
 
     if (!pContext->pRecordingClient)
         return;
+    if (pContext->pShm)
+        RecordShmUnmap(pContext);
     if (!pContext->pRecordingClient->clientGone) {
         RecordAProtocolElement(pContext, NULL, XRecordEndOfData, NULL, 0, 0, 0);
         RecordFlushReplyBuffer(pContext, NULL, 0, NULL, 0);
@@ -2790,7 +3102,7 @@ RecordExtensionInit(void)
         return;
 
     ppAllContexts = NULL;
-    numContexts = numEnabledContexts = numEnabledRCAPs = 0;
+    numContexts = numEnabledContexts = numEnabledRCAPs = numShmContexts = 0;
 
     if (!AddCallback(&ClientStateCallback, RecordAClientStateChange, NULL))
         return;
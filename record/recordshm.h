@@ -0,0 +1,53 @@
+/* SPDX-License-Identifier: MIT OR X11
+ *
+ * @brief shared memory capture ring of RECORD contexts
+ *
+ * RecordEnableContextShm() is RecordEnableContext with a memfd passed
+ * along. The RECORD protocol has no request for it, so it isn't reachable
+ * over the wire: it is there for code in the server, until recordproto
+ * defines one. The memfd must be at least RECORD_SHM_MIN_SIZE bytes and
+ * sealed against shrinking (F_SEAL_SHRINK).
+ *
+ * StartOfData and EndOfData still come as replies over the connection, as
+ * from RecordEnableContext. Everything in between goes into the ring
+ * instead: the very same replies, byte for byte, one after another and
+ * wrapping around at data_size, in the byte order of the recording client.
+ *
+ * The server writes the header when it maps the memfd, and then appends
+ * to the ring once per dispatch cycle, advancing head with release
+ * semantics. The consumer starts from tail == 0 and repeatedly:
+ *
+ *   1. loads head, with acquire semantics
+ *   2. reads the replies from data[tail % data_size] up to head
+ *   3. stores head to tail, with release semantics.
+ *
+ * The server never waits for the consumer: if a cycle does not fit in the
+ * space between head and tail, all of it is dropped and its size added to
+ * lost. Replies are never split that way, so the stream stays in sync.
+ *
+ * head, tail and lost are in host byte order.
+ */
+#ifndef _XSERVER_RECORD_SHM_H
+#define _XSERVER_RECORD_SHM_H
+
+#include <stdint.h>
+
+#include "include/dix.h"
+
+#define RECORD_SHM_MAGIC        0x64726352      /* "Rcrd" */
+#define RECORD_SHM_VERSION      1
+#define RECORD_SHM_MIN_SIZE     (64 * 1024)
+
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t data_offset;       /* of the ring, from the start of the memfd */
+    uint32_t data_size;         /* a power of two */
+    uint64_t head;              /* bytes ever added, server */
+    uint64_t tail;              /* bytes ever consumed, client */
+    uint64_t lost;              /* bytes ever dropped, server */
+} xRecordShmHeader;
+
+int RecordEnableContextShm(ClientPtr client, XID context, int fd);
+
+#endif /* _XSERVER_RECORD_SHM_H */
@@ -0,0 +1,201 @@
+/* SPDX-License-Identifier: MIT OR X11
+ *
+ * Atom table: MakeAtom(), NameForAtom() and ValidAtom() checked against
+ * a plain list of names searched linearly, the way the old tree did.
+ */
+
+/* Test relies on assert() */
+#undef NDEBUG
+
+#include <dix-config.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <X11/X.h>
+#include <X11/Xatom.h>
+
+#include "dix/atom_priv.h"
+
+#include "misc.h"
+#include "dix.h"
+#include "tests-common.h"
+
+/* enough to grow the hash table and the name chunks a few times */
+#define NAMES 5000
+
+static char *names[NAMES];
+static unsigned lens[NAMES];
+static int nnames;
+
+static Atom
+ref_lookup(const char *string, unsigned len)
+{
+    for (int i = 0; i < nnames; i++)
+        if (lens[i] == len && memcmp(names[i], string, len) == 0)
+            return XA_LAST_PREDEFINED + 1 + i;
+    return None;
+}
+
+static Atom
+ref_make(const char *string, unsigned len)
+{
+    Atom a = ref_lookup(string, len);
+
+    if (a != None)
+        return a;
+    assert(nnames < NAMES);
+    names[nnames] = strndup(string, len);
+    lens[nnames] = len;
+    return XA_LAST_PREDEFINED + 1 + nnames++;
+}
+
+static void
+ref_reset(void)
+{
+    for (int i = 0; i < nnames; i++)
+        free(names[i]);
+    nnames = 0;
+}
+
+/* short names over a small alphabet, so that many are prefixes of others */
+static unsigned
+random_name(char *buf)
+{
+    static const char alphabet[] = "AB_x";
+    unsigned len = 1 + rand() % 6;
+
+    for (unsigned i = 0; i < len; i++)
+        buf[i] = alphabet[rand() % 4];
+    buf[len] = '\0';
+    return len;
+}
+
+static void
+check_all(void)
+{
+    for (int i = 0; i < nnames; i++) {
+        Atom a = XA_LAST_PREDEFINED + 1 + i;
+
+        assert(ValidAtom(a));
+        assert(strlen(NameForAtom(a)) == lens[i]);
+        assert(memcmp(NameForAtom(a), names[i], lens[i]) == 0);
+        assert(MakeAtom(names[i], lens[i], FALSE) == a);
+    }
+    assert(!ValidAtom(XA_LAST_PREDEFINED + 1 + nnames));
+    assert(NameForAtom(XA_LAST_PREDEFINED + 1 + nnames) == NULL);
+}
+
+static void
+atom_predefined(void)
+{
+    InitAtoms();
+
+    assert(!ValidAtom(None));
+    assert(NameForAtom(None) == NULL);
+    assert(ValidAtom(XA_LAST_PREDEFINED));
+    assert(!ValidAtom(XA_LAST_PREDEFINED + 1));
+
+    assert(strcmp(NameForAtom(XA_PRIMARY), "PRIMARY") == 0);
+    assert(strcmp(NameForAtom(XA_WM_TRANSIENT_FOR), "WM_TRANSIENT_FOR") == 0);
+    assert(MakeAtom("WM_NAME", 7, FALSE) == XA_WM_NAME);
+    assert(MakeAtom("WM_NAME", 7, TRUE) == XA_WM_NAME);
+    /* a prefix of a predefined name is not that name */
+    assert(MakeAtom("WM_NAM", 6, FALSE) == None);
+    assert(MakeAtom("WM_NAMEX", 7, FALSE) == XA_WM_NAME);
+
+    FreeAllAtoms();
+}
+
+static void
+atom_random(void)
+{
+    char buf[8];
+
+    srand(3);
+    InitAtoms();
+
+    for (int i = 0; i < 20000; i++) {
+        unsigned len = random_name(buf);
+
+        if (rand() % 3 == 0) {
+            assert(MakeAtom(buf, len, FALSE) == ref_lookup(buf, len));
+            continue;
+        }
+        assert(MakeAtom(buf, len, TRUE) == ref_make(buf, len));
+    }
+    check_all();
+
+    /* distinct names, across several chunks of the atom -> name table */
+    for (int i = 0; nnames < NAMES; i++) {
+        unsigned len = snprintf(buf, sizeof(buf), "n%d", i);
+
+        assert(MakeAtom(buf, len, TRUE) == ref_make(buf, len));
+    }
+    check_all();
+
+    FreeAllAtoms();
+    ref_reset();
+}
+
+static void
+atom_long_names(void)
+{
+    size_t size = 40000;
+    char *big = malloc(size);
+    Atom small, a, b;
+
+    assert(big);
+    memset(big, 'q', size);
+
+    InitAtoms();
+
+    /* long names get arena blocks of their own, short ones keep filling
+     * the current block */
+    small = MakeAtom("short", 5, TRUE);
+    a = MakeAtom(big, size, TRUE);
+    b = MakeAtom(big, size / 2, TRUE);
+    assert(a == small + 1 && b == a + 1);
+    assert(MakeAtom("after", 5, TRUE) == b + 1);
+
+    assert(strlen(NameForAtom(a)) == size);
+    assert(strlen(NameForAtom(b)) == size / 2);
+    assert(MakeAtom(big, size, FALSE) == a);
+    assert(MakeAtom(big, size / 2, FALSE) == b);
+    assert(MakeAtom(big, size - 1, FALSE) == None);
+    assert(strcmp(NameForAtom(small), "short") == 0);
+    assert(strcmp(NameForAtom(b + 1), "after") == 0);
+
+    FreeAllAtoms();
+    free(big);
+}
+
+static void
+atom_reset(void)
+{
+    InitAtoms();
+    assert(MakeAtom("FOO", 3, TRUE) == XA_LAST_PREDEFINED + 1);
+
+    /* a server reset starts over with only the predefined atoms */
+    InitAtoms();
+    assert(MakeAtom("FOO", 3, FALSE) == None);
+    assert(!ValidAtom(XA_LAST_PREDEFINED + 1));
+    assert(MakeAtom("BAR", 3, TRUE) == XA_LAST_PREDEFINED + 1);
+    assert(strcmp(NameForAtom(XA_LAST_PREDEFINED + 1), "BAR") == 0);
+
+    FreeAllAtoms();
+    assert(MakeAtom("BAR", 3, FALSE) == None);
+}
+
+const testfunc_t*
+atom_test(void)
+{
+    static const testfunc_t testfuncs[] = {
+        atom_predefined,
+        atom_random,
+        atom_long_names,
+        atom_reset,
+        NULL,
+    };
+    return testfuncs;
+}
@@ -0,0 +1,123 @@
+/*
+ * Atom table: InternAtom storms as seen when many toolkit clients start
+ * up, each interning the same few hundred names plus some of their own.
+ */
+#include <dix-config.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <X11/X.h>
+
+#include "dix/atom_priv.h"
+#include "dix/dix_priv.h"
+#include "include/dix.h"
+
+#include "bench.h"
+
+#define TOOLKIT_ATOMS   400
+#define CLIENT_ATOMS    20
+#define NAME_LENGTH     40
+
+typedef struct {
+    char name[NAME_LENGTH];
+    int len;
+} BenchAtomName;
+
+/* names with long common prefixes, like the _NET_WM_* family */
+static BenchAtomName *
+make_names(const char *prefix, int n)
+{
+    BenchAtomName *names = calloc(n, sizeof(BenchAtomName));
+
+    for (int i = 0; i < n; i++)
+        names[i].len = snprintf(names[i].name, NAME_LENGTH, "%s_%s_%d",
+                                prefix, (i & 1) ? "STATE" : "ACTION", i);
+    return names;
+}
+
+static void
+bench_intern(int n)
+{
+    BenchAtomName *names = make_names("_NET_WM_BENCH", n);
+    BenchAtomName *misses = make_names("_NET_WM_BENCH_MISS", n);
+    int *order = calloc(n, sizeof(int));
+    Atom first = None;
+    uint64_t start;
+
+    for (int i = 0; i < n; i++)
+        order[i] = bench_random() % n;
+
+    InitAtoms();
+
+    start = bench_time_ns();
+    for (int i = 0; i < n; i++) {
+        Atom atom = MakeAtom(names[i].name, names[i].len, TRUE);
+
+        if (!first)
+            first = atom;
+    }
+    bench_report("atom", "intern_new", n, n, bench_time_ns() - start);
+
+    start = bench_time_ns();
+    for (int i = 0; i < n; i++)
+        MakeAtom(names[order[i]].name, names[order[i]].len, FALSE);
+    bench_report("atom", "lookup", n, n, bench_time_ns() - start);
+
+    start = bench_time_ns();
+    for (int i = 0; i < n; i++)
+        MakeAtom(misses[order[i]].name, misses[order[i]].len, FALSE);
+    bench_report("atom", "lookup_miss", n, n, bench_time_ns() - start);
+
+    start = bench_time_ns();
+    for (int i = 0; i < n; i++)
+        NameForAtom(first + order[i]);
+    bench_report("atom", "name_for_atom", n, n, bench_time_ns() - start);
+
+    free(order);
+    free(misses);
+    free(names);
+}
+
+static void
+bench_intern_storm(int nclients)
+{
+    BenchAtomName *toolkit = make_names("_NET_WM", TOOLKIT_ATOMS);
+    BenchAtomName *private = calloc(nclients * CLIENT_ATOMS,
+                                    sizeof(BenchAtomName));
+    uint64_t start, ops = 0;
+
+    for (int i = 0; i < nclients * CLIENT_ATOMS; i++)
+        private[i].len = snprintf(private[i].name, NAME_LENGTH,
+                                  "_CLIENT_%d_PRIVATE_%d",
+                                  i / CLIENT_ATOMS, i % CLIENT_ATOMS);
+
+    InitAtoms();
+
+    start = bench_time_ns();
+    for (int c = 0; c < nclients; c++) {
+        for (int i = 0; i < TOOLKIT_ATOMS; i++, ops++)
+            MakeAtom(toolkit[i].name, toolkit[i].len, TRUE);
+        for (int i = c * CLIENT_ATOMS; i < (c + 1) * CLIENT_ATOMS; i++, ops++)
+            MakeAtom(private[i].name, private[i].len, TRUE);
+    }
+    bench_report("atom", "intern_storm", nclients, ops,
+                 bench_time_ns() - start);
+
+    free(private);
+    free(toolkit);
+}
+
+void
+atom_bench(void)
+{
+    static const int counts[] = { 1000, 10000, 100000, 1000000 };
+    static const int nclients[] = { 16, 64, 256 };
+
+    for (int i = 0; i < ARRAY_SIZE(counts); i++)
+        bench_intern(counts[i]);
+    for (int i = 0; i < ARRAY_SIZE(nclients); i++)
+        bench_intern_storm(nclients[i]);
+
+    FreeAllAtoms();
+}
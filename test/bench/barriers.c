@@ -0,0 +1,345 @@
+/*
+ * Pointer barriers in a storm of relative motion, on three monitors side
+ * by side with panels and docks: dozens of barriers along each edge, all
+ * of them blocking. The pointer wandering about in the middle of the
+ * monitors and pressed against the edge between two of them, with the
+ * barrier index vs. the former walk of all barriers.
+ */
+#include <dix-config.h>
+
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "dix/dix_priv.h"
+#include "dix/input_priv.h"
+#include "dix/resource_priv.h"
+#include "include/dixstruct.h"
+#include "include/eventstr.h"
+#include "include/inputstr.h"
+#include "include/list.h"
+#include "include/scrnintstr.h"
+#include "include/windowstr.h"
+#include "Xi/xibarriers.h"
+
+#include "bench.h"
+
+#define MONITOR_WIDTH   1920
+#define MONITOR_HEIGHT  1080
+#define SCREEN_WIDTH    (3 * MONITOR_WIDTH)
+#define SCREEN_HEIGHT   MONITOR_HEIGHT
+#define PANEL_HEIGHT    32
+#define MOTIONS         (1 << 18)
+#define ROOT_ID         0x100
+
+static ClientRec bench_server_client, bench_client;
+static ScreenRec bench_screen;
+static WindowRec bench_root;
+static DeviceIntRec ptr_dev;
+static int deltas[MOTIONS][2];
+static int results[MOTIONS][2];
+
+/* the former barrier records, as far as a motion looked at them */
+struct former_device {
+    struct xorg_list entry;
+    int deviceid;
+    Bool hit;
+    Bool seen;
+};
+
+struct former_barrier {
+    struct PointerBarrier barrier;
+    struct xorg_list entry;
+    struct xorg_list per_device;
+    struct former_device device;
+};
+
+static struct xorg_list former_barriers;
+
+static void
+setup_barriers(void)
+{
+    serverClient = &bench_server_client;
+    InitClientResources(serverClient);
+
+    bench_client.index = 1;
+    bench_client.clientAsMask = ((Mask) 1) << CLIENTOFFSET;
+    clients[1] = &bench_client;
+
+    bench_screen.width = SCREEN_WIDTH;
+    bench_screen.height = SCREEN_HEIGHT;
+    bench_screen.root = &bench_root;
+    screenInfo.screens[0] = &bench_screen;
+    screenInfo.numScreens = 1;
+
+    bench_root.drawable.type = DRAWABLE_WINDOW;
+    bench_root.drawable.id = ROOT_ID;
+    bench_root.drawable.pScreen = &bench_screen;
+    bench_root.drawable.width = SCREEN_WIDTH;
+    bench_root.drawable.height = SCREEN_HEIGHT;
+    AddResource(ROOT_ID, X11_RESTYPE_WINDOW, &bench_root);
+
+    ptr_dev.id = 2;
+    ptr_dev.type = MASTER_POINTER;
+    inputInfo.devices = &ptr_dev;
+
+    XIBarrierInit();
+}
+
+static void
+add_barrier(int i, int x1, int y1, int x2, int y2)
+{
+    xXFixesCreatePointerBarrierReq req = {
+        .barrier = bench_client.clientAsMask + i,
+        .window = ROOT_ID,
+        .x1 = x1,
+        .y1 = y1,
+        .x2 = x2,
+        .y2 = y2,
+    };
+    struct former_barrier *former = calloc(1, sizeof(*former));
+
+    XICreatePointerBarrier(&bench_client, &req);
+
+    former->barrier = (struct PointerBarrier) {
+        .x1 = min(x1, x2), .x2 = max(x1, x2),
+        .y1 = min(y1, y2), .y2 = max(y1, y2),
+    };
+    xorg_list_init(&former->per_device);
+    former->device.deviceid = ptr_dev.id;
+    xorg_list_add(&former->device.entry, &former->per_device);
+    xorg_list_add(&former->entry, &former_barriers);
+}
+
+/*
+ * n barriers of 32 to 160 pixels: half along the edges of the monitors,
+ * half along the panels at their tops and the docks at their bottoms
+ */
+static void
+create_barriers(int n)
+{
+    xorg_list_init(&former_barriers);
+    InitClientResources(&bench_client);
+
+    for (int i = 0; i < n; i++) {
+        int len = 32 + bench_random() % 129;
+
+        if (i & 1) {
+            int x = (bench_random() % 4) * MONITOR_WIDTH;
+            int y = bench_random() % (SCREEN_HEIGHT - len);
+
+            add_barrier(i, x, y, x, y + len);
+        }
+        else {
+            int y = (bench_random() & 1) ? PANEL_HEIGHT :
+                SCREEN_HEIGHT - PANEL_HEIGHT;
+            int x = bench_random() % (SCREEN_WIDTH - len);
+
+            add_barrier(i, x, y, x + len, y);
+        }
+    }
+}
+
+static void
+free_barriers(void)
+{
+    struct former_barrier *former, *tmp;
+
+    FreeClientResources(&bench_client);
+    xorg_list_for_each_entry_safe(former, tmp, &former_barriers, entry)
+        free(former);
+}
+
+/* what barrier_inside_hit_box() does for barriers blocking both ways */
+static Bool
+former_inside_hit_box(const struct PointerBarrier *b, int x, int y)
+{
+    if (b->x1 == b->x2)
+        return x >= b->x1 - 2 && x <= b->x2 + 2 && y >= b->y1 && y <= b->y2;
+    return x >= b->x1 && x <= b->x2 && y >= b->y1 - 2 && y <= b->y2 + 2;
+}
+
+static struct former_device *
+former_get_device(struct former_barrier *c, int deviceid)
+{
+    struct former_device *p;
+
+    xorg_list_for_each_entry(p, &c->per_device, entry) {
+        if (p->deviceid == deviceid)
+            return p;
+    }
+    return NULL;
+}
+
+/* barrier_find_nearest(), as it was */
+static struct former_barrier *
+former_find_nearest(int dir, int x1, int y1, int x2, int y2)
+{
+    struct former_barrier *c, *nearest = NULL;
+    double min_distance = INT_MAX;
+
+    xorg_list_for_each_entry(c, &former_barriers, entry) {
+        struct former_device *pbd;
+        double distance;
+
+        pbd = former_get_device(c, ptr_dev.id);
+        if (!pbd || pbd->seen)
+            continue;
+        if (!barrier_is_blocking_direction(&c->barrier, dir))
+            continue;
+        if (barrier_is_blocking(&c->barrier, x1, y1, x2, y2, &distance) &&
+            min_distance > distance) {
+            min_distance = distance;
+            nearest = c;
+        }
+    }
+    return nearest;
+}
+
+/* input_constrain_cursor(), as it was, less the events */
+static void
+former_constrain(int current_x, int current_y, int *x, int *y)
+{
+    struct former_barrier *c;
+    int dir = barrier_get_direction(current_x, current_y, *x, *y);
+
+    while (dir != 0) {
+        struct former_device *pbd;
+
+        c = former_find_nearest(dir, current_x, current_y, *x, *y);
+        if (!c)
+            break;
+        pbd = former_get_device(c, ptr_dev.id);
+        pbd->seen = TRUE;
+        pbd->hit = TRUE;
+
+        barrier_clamp_to_barrier(&c->barrier, dir, x, y);
+        if (c->barrier.x1 == c->barrier.x2) {
+            dir &= ~(BarrierNegativeX | BarrierPositiveX);
+            current_x = *x;
+        }
+        else {
+            dir &= ~(BarrierNegativeY | BarrierPositiveY);
+            current_y = *y;
+        }
+    }
+
+    xorg_list_for_each_entry(c, &former_barriers, entry) {
+        struct former_device *pbd = former_get_device(c, ptr_dev.id);
+
+        pbd->seen = FALSE;
+        if (pbd->hit && !former_inside_hit_box(&c->barrier, *x, *y))
+            pbd->hit = FALSE;
+    }
+}
+
+/*
+ * Relative motion of up to 16 pixels, either anywhere or pushing left,
+ * with a jump back to the edge between the first two monitors whenever
+ * the pointer got away from it.
+ */
+static void
+make_deltas(Bool press)
+{
+    for (int i = 0; i < MOTIONS; i++) {
+        deltas[i][0] = (int) (bench_random() % 33) - 16;
+        deltas[i][1] = (int) (bench_random() % 33) - 16;
+        if (press)
+            deltas[i][0] = -abs(deltas[i][0]) / 2;
+    }
+}
+
+static void
+start_position(Bool press, int *x, int *y)
+{
+    *x = press ? MONITOR_WIDTH + 4 : SCREEN_WIDTH / 2;
+    *y = SCREEN_HEIGHT / 2;
+}
+
+/* kept on the screen, like miPointerSetPosition() does */
+static void
+next_position(Bool press, int *x, int *y)
+{
+    *x = max(0, min(*x, SCREEN_WIDTH - 1));
+    *y = max(0, min(*y, SCREEN_HEIGHT - 1));
+    if (press && *x < MONITOR_WIDTH - 64)
+        *x = MONITOR_WIDTH + 4;
+}
+
+static void
+run_motion(const char *name, int n, Bool press, InternalEvent *events)
+{
+    char label[32];
+    int x, y, nevents, mismatches = 0;
+    uint64_t start, elapsed;
+
+    make_deltas(press);
+
+    start_position(press, &x, &y);
+    start = bench_time_ns();
+    for (int i = 0; i < MOTIONS; i++) {
+        input_constrain_cursor(&ptr_dev, &bench_screen, x, y,
+                               x + deltas[i][0], y + deltas[i][1],
+                               &x, &y, &nevents, events);
+        next_position(press, &x, &y);
+        results[i][0] = x;
+        results[i][1] = y;
+    }
+    elapsed = bench_time_ns() - start;
+    snprintf(label, sizeof(label), "%s_index", name);
+    bench_report("barriers", label, n, MOTIONS, elapsed);
+
+    start_position(press, &x, &y);
+    start = bench_time_ns();
+    for (int i = 0; i < MOTIONS; i++) {
+        int to_x = x + deltas[i][0], to_y = y + deltas[i][1];
+
+        former_constrain(x, y, &to_x, &to_y);
+        x = to_x;
+        y = to_y;
+        next_position(press, &x, &y);
+        if (x != results[i][0] || y != results[i][1])
+            mismatches++;
+    }
+    elapsed = bench_time_ns() - start;
+    snprintf(label, sizeof(label), "%s_walk", name);
+    bench_report("barriers", label, n, MOTIONS, elapsed);
+
+    if (mismatches)
+        printf("# barriers %s %d: %d positions differ\n", name, n, mismatches);
+
+    /* away from all of them, so none is left hit */
+    x = SCREEN_WIDTH / 2;
+    y = SCREEN_HEIGHT / 2;
+    input_constrain_cursor(&ptr_dev, &bench_screen, x, y, x, y, &x, &y,
+                           &nevents, events);
+}
+
+static void
+bench_barriers(int n)
+{
+    /* a hit and a leave event for each, at most */
+    InternalEvent *events = calloc(2 * n + 2, sizeof(InternalEvent));
+
+    create_barriers(n);
+    run_motion("motion", n, FALSE, events);
+    run_motion("press", n, TRUE, events);
+    free_barriers();
+    free(events);
+}
+
+void
+barriers_bench(void)
+{
+    setup_barriers();
+
+    bench_barriers(16);
+    bench_barriers(64);
+    bench_barriers(256);
+    bench_barriers(1024);
+
+    XIBarrierReset();
+    inputInfo.devices = NULL;
+    screenInfo.numScreens = 0;
+    screenInfo.screens[0] = NULL;
+}
@@ -0,0 +1,97 @@
+#include <dix-config.h>
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "bench.h"
+
+static const struct {
+    const char *name;
+    benchfunc_t func;
+} benchmarks[] = {
+    { "atom", atom_bench },
+    { "barriers", barriers_bench },
+    { "composite", composite_bench },
+    { "damage", damage_bench },
+#ifdef LDWRAP_BENCH
+    { "events", events_bench },
+#endif
+    { "fb", fb_bench },
+    { "glyphs", glyphs_bench },
+    { "grabs", grabs_bench },
+#ifdef LDWRAP_BENCH
+    { "present", present_bench },
+#endif
+    { "property", property_bench },
+#ifdef LDWRAP_BENCH
+    { "record", record_bench },
+#endif
+    { "region", region_bench },
+    { "resource", resource_bench },
+    { "schedule", schedule_bench },
+    { "shadow", shadow_bench },
+    { "sync", sync_bench },
+    { "timer", timer_bench },
+    { "window", window_bench },
+};
+
+static uint32_t bench_seed = 0x12345678;
+
+uint64_t
+bench_time_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+void
+bench_report(const char *suite, const char *name, long param,
+             uint64_t iterations, uint64_t elapsed_ns)
+{
+    printf("%s\t%s\t%ld\t%llu\t%.2f\n", suite, name, param,
+           (unsigned long long) iterations,
+           iterations ? (double) elapsed_ns / iterations : 0.0);
+    fflush(stdout);
+}
+
+uint32_t
+bench_random(void)
+{
+    /* xorshift32 */
+    bench_seed ^= bench_seed << 13;
+    bench_seed ^= bench_seed >> 17;
+    bench_seed ^= bench_seed << 5;
+    return bench_seed;
+}
+
+int
+main(int argc, char **argv)
+{
+    int ran = 0;
+
+    printf("# suite\tname\tparam\titerations\tns/op\n");
+
+    for (int i = 0; i < sizeof(benchmarks) / sizeof(benchmarks[0]); i++) {
+        if (argc > 1) {
+            int wanted = 0;
+
+            for (int a = 1; a < argc; a++)
+                if (strcmp(argv[a], benchmarks[i].name) == 0)
+                    wanted = 1;
+            if (!wanted)
+                continue;
+        }
+        benchmarks[i].func();
+        ran++;
+    }
+
+    if (!ran) {
+        fprintf(stderr, "no such benchmark\n");
+        return 1;
+    }
+
+    return 0;
+}
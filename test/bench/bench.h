@@ -0,0 +1,43 @@
+#ifndef BENCH_H
+#define BENCH_H
+
+#include <stdint.h>
+
+/*
+ * Every benchmark reports one line per measured configuration:
+ *
+ *   <suite> <name> <param> <iterations> <ns per op>
+ *
+ * tab separated, so results can be collected and compared by scripts.
+ */
+
+typedef void (*benchfunc_t)(void);
+
+uint64_t bench_time_ns(void);
+
+void bench_report(const char *suite, const char *name, long param,
+                  uint64_t iterations, uint64_t elapsed_ns);
+
+/* cheap deterministic PRNG, so every run exercises the same pattern */
+uint32_t bench_random(void);
+
+void atom_bench(void);
+void barriers_bench(void);
+void composite_bench(void);
+void damage_bench(void);
+void events_bench(void);
+void fb_bench(void);
+void glyphs_bench(void);
+void grabs_bench(void);
+void present_bench(void);
+void property_bench(void);
+void record_bench(void);
+void region_bench(void);
+void resource_bench(void);
+void schedule_bench(void);
+void shadow_bench(void);
+void sync_bench(void);
+void timer_bench(void);
+void window_bench(void);
+
+#endif /* BENCH_H */
@@ -0,0 +1,292 @@
+/*
+ * Interactive resize of a redirected window, as a compositing window
+ * manager does it: a drag of the bottom right corner and one of the top
+ * left corner, replayed through the composite backing pixmap code on fb
+ * pixmaps. Slack and pooled pixmaps vs. the former new pixmap on every
+ * ConfigureWindow.
+ */
+#include <dix-config.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "composite/compint.h"
+#include "fb/fb.h"
+#include "include/os.h"
+#include "os/osdep.h"
+
+#include "bench.h"
+
+#define DRAG_STEPS      600             /* 10 s of motion at 60 Hz */
+#define SCREEN_WIDTH    1920
+#define SCREEN_HEIGHT   1080
+#define DEPTH           24
+#define BPP             32
+
+static ScreenRec bench_screen;
+static WindowRec bench_root;
+static WindowPtr bench_window;
+static PixmapPtr screen_pixmap, window_pixmap;
+static GCRec bench_gc;
+static int pixmaps_created;
+
+static PixmapPtr
+bench_create_pixmap(ScreenPtr pScreen, int width, int height, int depth,
+                    unsigned usage_hint)
+{
+    pixmaps_created++;
+    return fbCreatePixmap(pScreen, width, height, depth, usage_hint);
+}
+
+static PixmapPtr
+bench_get_window_pixmap(WindowPtr pWin)
+{
+    return pWin == &bench_root ? screen_pixmap : window_pixmap;
+}
+
+static void
+bench_set_window_pixmap(WindowPtr pWin, PixmapPtr pPixmap)
+{
+    if (pWin != &bench_root)
+        window_pixmap = pPixmap;
+}
+
+/* copy the overlap of a w x h area, in pixmap coordinates */
+static void
+copy_pixmap(PixmapPtr pSrc, int src_x, int src_y, PixmapPtr pDst,
+            int dst_x, int dst_y, int w, int h)
+{
+    w = min(w, min(pSrc->drawable.width - src_x, pDst->drawable.width - dst_x));
+    h = min(h, min(pSrc->drawable.height - src_y,
+                   pDst->drawable.height - dst_y));
+
+    for (int y = 0; y < h; y++)
+        memcpy((CARD8 *) pDst->devPrivate.ptr +
+               (dst_y + y) * pDst->devKind + dst_x * 4,
+               (CARD8 *) pSrc->devPrivate.ptr +
+               (src_y + y) * pSrc->devKind + src_x * 4, max(w, 0) * 4);
+}
+
+/* only ever copies from the root window to a window pixmap */
+static RegionPtr
+bench_copy_area(DrawablePtr pSrc, DrawablePtr pDst, GCPtr pGC,
+                int src_x, int src_y, int w, int h, int dst_x, int dst_y)
+{
+    copy_pixmap(screen_pixmap, src_x, src_y, (PixmapPtr) pDst, dst_x, dst_y,
+                w, h);
+    return NULL;
+}
+
+static void
+bench_validate_gc(GCPtr pGC, unsigned long changes, DrawablePtr pDrawable)
+{
+}
+
+static void
+bench_change_gc(GCPtr pGC, unsigned long mask)
+{
+}
+
+static const GCFuncs bench_gc_funcs = {
+    .ValidateGC = bench_validate_gc,
+    .ChangeGC = bench_change_gc,
+};
+
+static const GCOps bench_gc_ops = {
+    .CopyArea = bench_copy_area,
+};
+
+static void
+setup_screen(void)
+{
+    CompScreenPtr cs = calloc(1, sizeof(CompScreenRec));
+    BoxRec box = { 0, 0, SCREEN_WIDTH, SCREEN_HEIGHT };
+
+    dixRegisterPrivateKey(&CompScreenPrivateKeyRec, PRIVATE_SCREEN, 0);
+    dixRegisterPrivateKey(&CompWindowPrivateKeyRec, PRIVATE_WINDOW, 0);
+    dixInitScreenSpecificPrivates(&bench_screen);
+    dixAllocatePrivates(&bench_screen.devPrivates, PRIVATE_SCREEN);
+    TimerInit();
+
+    bench_screen.width = SCREEN_WIDTH;
+    bench_screen.height = SCREEN_HEIGHT;
+    bench_screen.CreatePixmap = bench_create_pixmap;
+    bench_screen.DestroyPixmap = fbDestroyPixmap;
+    bench_screen.ModifyPixmapHeader = miModifyPixmapHeader;
+    bench_screen.GetWindowPixmap = bench_get_window_pixmap;
+    bench_screen.SetWindowPixmap = bench_set_window_pixmap;
+    PixmapScreenInit(&bench_screen);
+
+    bench_gc.pScreen = &bench_screen;
+    bench_gc.depth = DEPTH;
+    bench_gc.funcs = &bench_gc_funcs;
+    bench_gc.ops = (GCOps *) &bench_gc_ops;
+    bench_screen.GCperDepth[0] = &bench_gc;
+
+    cs->poolPixmaps = TRUE;
+    dixSetPrivate(&bench_screen.devPrivates, CompScreenPrivateKey, cs);
+
+    screen_pixmap = fbCreatePixmap(&bench_screen, SCREEN_WIDTH, SCREEN_HEIGHT,
+                                   DEPTH, 0);
+    for (int i = 0; i < SCREEN_HEIGHT * screen_pixmap->devKind; i++)
+        ((CARD8 *) screen_pixmap->devPrivate.ptr)[i] = bench_random();
+
+    bench_root.drawable.type = DRAWABLE_WINDOW;
+    bench_root.drawable.pScreen = &bench_screen;
+    bench_root.drawable.depth = DEPTH;
+    bench_root.drawable.width = SCREEN_WIDTH;
+    bench_root.drawable.height = SCREEN_HEIGHT;
+    RegionInit(&bench_root.winSize, &box, 1);
+}
+
+static void
+map_window(int x, int y, int w, int h)
+{
+    CompWindowPtr cw = calloc(1, sizeof(CompWindowRec));
+
+    bench_window = dixAllocateScreenObjectWithPrivates(&bench_screen,
+                                                       WindowRec,
+                                                       PRIVATE_WINDOW);
+    bench_window->drawable.type = DRAWABLE_WINDOW;
+    bench_window->drawable.pScreen = &bench_screen;
+    bench_window->drawable.depth = DEPTH;
+    bench_window->drawable.bitsPerPixel = BPP;
+    bench_window->drawable.x = x;
+    bench_window->drawable.y = y;
+    bench_window->drawable.width = w;
+    bench_window->drawable.height = h;
+    bench_window->parent = &bench_root;
+    bench_window->redirectDraw = RedirectDrawManual;
+    RegionNull(&bench_window->winSize);
+    RegionNull(&bench_window->borderSize);
+    RegionNull(&bench_window->borderClip);
+
+    cw->update = CompositeRedirectManual;
+    RegionNull(&cw->borderClip);
+    dixSetPrivate(&bench_window->devPrivates, CompWindowPrivateKey, cw);
+    compAllocPixmap(bench_window);
+}
+
+static void
+unmap_window(void)
+{
+    CompWindowPtr cw = GetCompWindow(bench_window);
+
+    compReleasePixmap(&bench_screen, window_pixmap, &cw->pixmapSize);
+    compFlushPixmapPool(&bench_screen);
+    RegionUninit(&cw->borderClip);
+    free(cw);
+    RegionUninit(&bench_window->winSize);
+    RegionUninit(&bench_window->borderSize);
+    RegionUninit(&bench_window->borderClip);
+    dixFreeObjectWithPrivates(bench_window, PRIVATE_WINDOW);
+}
+
+/*
+ * Next step of the drag: up to 8 pixels larger for the first half, then
+ * smaller again. The opposite corner stays at 200, 100 or 1000, 700, so
+ * the window stays on the screen.
+ */
+static void
+drag(int step, int *x, int *y, int *w, int *h, Bool top_left)
+{
+    int dir = step < DRAG_STEPS / 2 ? 1 : -1;
+    int new_w = *w + dir * (int) (bench_random() % 9);
+    int new_h = *h + dir * (int) (bench_random() % 9);
+
+    new_w = max(min(new_w, 1000), 200);
+    new_h = max(min(new_h, 700), 150);
+    if (top_left) {
+        *x -= new_w - *w;
+        *y -= new_h - *h;
+    }
+    *w = new_w;
+    *h = new_h;
+}
+
+/*
+ * what compReallocPixmap() used to do on each step: a new pixmap, filled
+ * with the parent and then the old bits, as compCopyWindow() does
+ */
+static void
+bench_realloc(const char *name, Bool top_left)
+{
+    int x = 600, y = 400, w = 400, h = 300;
+    PixmapPtr pPixmap, pOld;
+    uint64_t start;
+
+    pixmaps_created = 0;
+    pPixmap = bench_create_pixmap(&bench_screen, w, h, DEPTH, 0);
+    copy_pixmap(screen_pixmap, x, y, pPixmap, 0, 0, w, h);
+
+    start = bench_time_ns();
+    for (int i = 0; i < DRAG_STEPS; i++) {
+        int old_x = x, old_y = y;
+
+        drag(i, &x, &y, &w, &h, top_left);
+        pOld = pPixmap;
+        pPixmap = bench_create_pixmap(&bench_screen, w, h, DEPTH,
+                                      CREATE_PIXMAP_USAGE_BACKING_PIXMAP);
+        copy_pixmap(screen_pixmap, x, y, pPixmap, 0, 0, w, h);
+        copy_pixmap(pOld, max(x - old_x, 0), max(y - old_y, 0), pPixmap,
+                    max(old_x - x, 0), max(old_y - y, 0), w, h);
+        dixDestroyPixmap(pOld, 0);
+    }
+    bench_report("composite", name, DRAG_STEPS, DRAG_STEPS,
+                 bench_time_ns() - start);
+    printf("# %s: %d pixmaps allocated\n", name, pixmaps_created);
+
+    dixDestroyPixmap(pPixmap, 0);
+}
+
+/* compConfigNotify() and compResizeWindow() on each step */
+static void
+bench_pool(const char *name, Bool top_left)
+{
+    int x = 600, y = 400, w = 400, h = 300;
+    CompWindowPtr cw;
+    uint64_t start;
+
+    pixmaps_created = 0;
+    map_window(x, y, w, h);
+    cw = GetCompWindow(bench_window);
+
+    start = bench_time_ns();
+    for (int i = 0; i < DRAG_STEPS; i++) {
+        drag(i, &x, &y, &w, &h, top_left);
+        compReallocPixmap(bench_window, x, y, w, h, 0);
+
+        bench_window->drawable.x = x;
+        bench_window->drawable.y = y;
+        bench_window->drawable.width = w;
+        bench_window->drawable.height = h;
+        if (cw->pOldPixmap) {
+            copy_pixmap(cw->pOldPixmap, max(x - cw->oldx, 0),
+                        max(y - cw->oldy, 0), window_pixmap,
+                        max(cw->oldx - x, 0), max(cw->oldy - y, 0), w, h);
+            compReleasePixmap(&bench_screen, cw->pOldPixmap,
+                              &cw->oldPixmapSize);
+            cw->pOldPixmap = NullPixmap;
+        }
+        compFinishReallocPixmap(bench_window);
+    }
+    bench_report("composite", name, DRAG_STEPS, DRAG_STEPS,
+                 bench_time_ns() - start);
+    printf("# %s: %d pixmaps allocated\n", name, pixmaps_created);
+
+    unmap_window();
+}
+
+void
+composite_bench(void)
+{
+    setup_screen();
+
+    bench_realloc("realloc_bottom_right", FALSE);
+    bench_pool("pool_bottom_right", FALSE);
+    bench_realloc("realloc_top_left", TRUE);
+    bench_pool("pool_top_left", TRUE);
+
+    dixDestroyPixmap(screen_pixmap, 0);
+}
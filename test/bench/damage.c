@@ -0,0 +1,156 @@
+/*
+ * Damage accumulation of many small, scattered drawing ops (text and
+ * widget repaints) between two flushes, with full precision regions vs.
+ * coalescing at various box limits.
+ */
+#include <dix-config.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "include/regionstr.h"
+#include "include/scrnintstr.h"
+#include "miext/damage/damagestr.h"
+
+#include "bench.h"
+
+#define DAMAGE_FRAMES       200
+#define DAMAGE_OPS          2000    /* per frame */
+#define DAMAGE_WIDTH        1920
+#define DAMAGE_HEIGHT       1080
+
+static BoxRec *
+make_ops(int n)
+{
+    BoxRec *ops = calloc(n, sizeof(BoxRec));
+
+    for (int i = 0; i < n; i++) {
+        /* mostly glyph sized boxes, now and then a larger widget */
+        int w = (bench_random() & 15) ? 6 + bench_random() % 8 :
+                                        20 + bench_random() % 200;
+        int h = (bench_random() & 15) ? 13 : 10 + bench_random() % 60;
+
+        ops[i].x1 = bench_random() % (DAMAGE_WIDTH - w);
+        ops[i].y1 = bench_random() % (DAMAGE_HEIGHT - h);
+        ops[i].x2 = ops[i].x1 + w;
+        ops[i].y2 = ops[i].y1 + h;
+    }
+    return ops;
+}
+
+static uint64_t
+region_area(RegionPtr pRegion)
+{
+    BoxPtr pBox = RegionRects(pRegion);
+    uint64_t area = 0;
+
+    for (int i = 0; i < RegionNumRects(pRegion); i++)
+        area += (uint64_t) (pBox[i].x2 - pBox[i].x1) * (pBox[i].y2 - pBox[i].y1);
+    return area;
+}
+
+static void
+bench_coalesce(const BoxRec *ops, int max_boxes, uint64_t *exact_area)
+{
+    DamageRec damage = { 0 };
+    uint64_t elapsed = 0, area = 0, boxes = 0;
+
+    RegionNull(&damage.damage);
+    RegionNull(&damage.pendingDamage);
+    damage.damageLevel = DamageReportNone;
+    DamageSetCoalesce(&damage, max_boxes, 0);
+
+    for (int f = 0; f < DAMAGE_FRAMES; f++) {
+        const BoxRec *frame = ops + f * DAMAGE_OPS;
+        uint64_t start = bench_time_ns();
+
+        for (int i = 0; i < DAMAGE_OPS; i++) {
+            RegionRec op;
+
+            RegionInit(&op, (BoxPtr) &frame[i], 1);
+            DamageReportDamage(&damage, &op);
+            RegionUninit(&op);
+        }
+        elapsed += bench_time_ns() - start;
+
+        /* what the consumer gets to repaint this frame */
+        boxes += RegionNumRects(&damage.damage);
+        area += region_area(&damage.damage);
+        DamageEmpty(&damage);
+    }
+
+    bench_report("damage", max_boxes ? "coalesce" : "exact", max_boxes,
+                 (uint64_t) DAMAGE_FRAMES * DAMAGE_OPS, elapsed);
+
+    if (!max_boxes)
+        *exact_area = area;
+    printf("# damage max boxes %d: %.1f boxes per flush, %.1f%% overdraw\n",
+           max_boxes, (double) boxes / DAMAGE_FRAMES,
+           *exact_area ? 100.0 * (area - *exact_area) / *exact_area : 0.0);
+
+    RegionUninit(&damage.damage);
+    RegionUninit(&damage.pendingDamage);
+}
+
+static void
+report_delta(DamagePtr pDamage, RegionPtr pRegion, void *closure)
+{
+    RegionUnion(closure, closure, pRegion);
+}
+
+/* with DeltaRegion reports, all the coalesced damage has to be reported */
+static void
+check_delta(const BoxRec *ops, int max_boxes)
+{
+    DamageRec damage = { 0 };
+    RegionRec reported;
+    int mismatches = 0;
+
+    RegionNull(&damage.damage);
+    RegionNull(&damage.pendingDamage);
+    RegionNull(&reported);
+    damage.damageLevel = DamageReportDeltaRegion;
+    damage.damageReport = report_delta;
+    damage.closure = &reported;
+    DamageSetCoalesce(&damage, max_boxes, 0);
+
+    for (int f = 0; f < DAMAGE_FRAMES; f++) {
+        const BoxRec *frame = ops + f * DAMAGE_OPS;
+
+        for (int i = 0; i < DAMAGE_OPS; i++) {
+            RegionRec op;
+
+            RegionInit(&op, (BoxPtr) &frame[i], 1);
+            DamageReportDamage(&damage, &op);
+            RegionUninit(&op);
+        }
+
+        if (!RegionEqual(&reported, &damage.damage))
+            mismatches++;
+        RegionEmpty(&reported);
+        DamageEmpty(&damage);
+    }
+
+    if (mismatches)
+        printf("# damage delta max boxes %d: %d frames not fully reported\n",
+               max_boxes, mismatches);
+
+    RegionUninit(&reported);
+    RegionUninit(&damage.damage);
+    RegionUninit(&damage.pendingDamage);
+}
+
+void
+damage_bench(void)
+{
+    static const int limits[] = { 0, 1024, 256, 64, 16 };
+    BoxRec *ops = make_ops(DAMAGE_FRAMES * DAMAGE_OPS);
+    uint64_t exact_area = 0;
+
+    for (int i = 0; i < ARRAY_SIZE(limits); i++)
+        bench_coalesce(ops, limits[i], &exact_area);
+    for (int i = 1; i < ARRAY_SIZE(limits); i++)
+        check_delta(ops, limits[i]);
+
+    free(ops);
+}
@@ -0,0 +1,203 @@
+/*
+ * Core event delivery: DeliverEventsToWindow() for pointer motion on a
+ * window with N clients selecting for it, and the early out for a window
+ * nobody selected the event on. Also with one client in 8 selecting for
+ * motion and the others for keys, through the cached clients of the window
+ * vs. the former walk of all of them.
+ */
+#include <dix-config.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "dix/dix_priv.h"
+#include "dix/resource_priv.h"
+#include "include/dixstruct.h"
+#include "include/inputstr.h"
+#include "include/windowstr.h"
+#include "Xext/xace.h"
+
+#include "bench.h"
+
+#define EVENT_ROUNDS    200000
+
+#define WINDOW_ID(client)   ((XID) (client) << CLIENTOFFSET | 1)
+
+static uint64_t written;
+
+/* linked with -Wl,-wrap,WriteToClient: count what would go out */
+int __wrap_WriteToClient(ClientPtr client, int count, const void *buf);
+
+int
+__wrap_WriteToClient(ClientPtr client, int count, const void *buf)
+{
+    written += count;
+    return count;
+}
+
+static DeviceIntRec ptr_dev, kbd_dev;
+static SpriteInfoRec ptr_info, kbd_info;
+static ValuatorClassRec valuator;
+static ClientRec bench_clients[MAXCLIENTS];
+
+static void
+setup_devices(void)
+{
+    ptr_dev.type = MASTER_POINTER;
+    ptr_dev.spriteInfo = &ptr_info;
+    ptr_dev.valuator = &valuator;
+    ptr_info.spriteOwner = TRUE;
+    ptr_info.paired = &kbd_dev;
+
+    /* no key class, so XKB leaves the events alone */
+    kbd_dev.type = MASTER_KEYBOARD;
+    kbd_dev.spriteInfo = &kbd_info;
+    kbd_info.paired = &ptr_dev;
+}
+
+static void
+setup_clients(int n)
+{
+    for (int i = 1; i <= n; i++) {
+        ClientPtr client = &bench_clients[i];
+
+        client->index = i;
+        client->clientAsMask = (XID) i << CLIENTOFFSET;
+        client->clientPtr = &ptr_dev;
+        clients[i] = client;
+    }
+}
+
+static void
+teardown_clients(int n)
+{
+    for (int i = 1; i <= n; i++)
+        clients[i] = NULL;
+}
+
+/*
+ * window owned by client 1, clients 2..n select through OtherClients, for
+ * mask or, if sparse, only one in 8 of them and the others for keys
+ */
+static WindowPtr
+make_window(int n, Mask mask, Bool sparse)
+{
+    WindowPtr pWin = calloc(1, sizeof(WindowRec));
+
+    pWin->drawable.type = DRAWABLE_WINDOW;
+    pWin->drawable.id = WINDOW_ID(1);
+    pWin->eventMask = mask;
+    pWin->optional = calloc(1, sizeof(WindowOptRec));
+
+    for (int i = n; i > 1; i--) {
+        OtherClientsPtr other = calloc(1, sizeof(OtherClients));
+
+        other->resource = WINDOW_ID(i);
+        other->mask = (sparse && i % 8) ? KeyPressMask : mask;
+        other->next = pWin->optional->otherClients;
+        pWin->optional->otherClients = other;
+        pWin->optional->otherEventMasks |= other->mask;
+    }
+    return pWin;
+}
+
+static void
+free_window(WindowPtr pWin)
+{
+    OtherClientsPtr other, next;
+
+    for (other = pWin->optional->otherClients; other; other = next) {
+        next = other->next;
+        free(other);
+    }
+    DeliveryCacheFree(pWin);
+    free(pWin->optional);
+    free(pWin);
+}
+
+/*
+ * DeliverEventsToWindow(), as it was for core events less the grab: the
+ * owner, then all other clients tried, the filter left to TryClientEvents()
+ * (there's no barrier event to check)
+ */
+static void
+former_deliver(WindowPtr pWin, xEvent *event, Mask filter)
+{
+    ClientPtr owner = dixClientForWindow(pWin);
+
+    if (!IsInterferingGrab(owner, &ptr_dev, event) &&
+        !XaceHookReceiveAccess(owner, pWin, event, 1))
+        TryClientEvents(owner, &ptr_dev, event, 1, pWin->eventMask, filter,
+                        NullGrab);
+
+    for (OtherClientsPtr other = wOtherClients(pWin); other;
+         other = other->next) {
+        ClientPtr client = dixClientForOtherClients(other);
+
+        if (IsInterferingGrab(client, &ptr_dev, event))
+            continue;
+        if (!XaceHookReceiveAccess(client, pWin, event, 1))
+            TryClientEvents(client, &ptr_dev, event, 1, other->mask, filter,
+                            NullGrab);
+    }
+}
+
+static void
+bench_deliver(const char *name, int n, Mask selected, Bool sparse)
+{
+    WindowPtr pWin;
+    xEvent event = { 0 };
+    uint64_t start;
+
+    setup_clients(n);
+    pWin = make_window(n, selected, sparse);
+
+    event.u.u.type = MotionNotify;
+    event.u.keyButtonPointer.event = pWin->drawable.id;
+
+    written = 0;
+    start = bench_time_ns();
+    for (int i = 0; i < EVENT_ROUNDS; i++) {
+        event.u.keyButtonPointer.rootX = i & 0x3ff;
+        DeliverEventsToWindow(&ptr_dev, pWin, &event, 1,
+                              PointerMotionMask, NullGrab);
+    }
+    bench_report("events", name, n, EVENT_ROUNDS, bench_time_ns() - start);
+    printf("# events %s %d clients: %.1f bytes written per event\n",
+           name, n, (double) written / EVENT_ROUNDS);
+
+    if (sparse) {
+        uint64_t cached = written;
+        char label[32];
+
+        written = 0;
+        start = bench_time_ns();
+        for (int i = 0; i < EVENT_ROUNDS; i++) {
+            event.u.keyButtonPointer.rootX = i & 0x3ff;
+            former_deliver(pWin, &event, PointerMotionMask);
+        }
+        snprintf(label, sizeof(label), "%s_walk", name);
+        bench_report("events", label, n, EVENT_ROUNDS,
+                     bench_time_ns() - start);
+        if (written != cached)
+            printf("# events %s %d clients: the walk wrote %.1f bytes "
+                   "per event\n", name, n, (double) written / EVENT_ROUNDS);
+    }
+
+    free_window(pWin);
+    teardown_clients(n);
+}
+
+void
+events_bench(void)
+{
+    static const int counts[] = { 1, 8, 64, 256 };
+
+    setup_devices();
+
+    for (int i = 0; i < ARRAY_SIZE(counts); i++) {
+        bench_deliver("deliver", counts[i], PointerMotionMask, FALSE);
+        bench_deliver("skip", counts[i], KeyPressMask, FALSE);
+        bench_deliver("sparse", counts[i], PointerMotionMask, TRUE);
+    }
+}
@@ -0,0 +1,170 @@
+/*
+ * fb rendering: fbBlt() and fbSolid() as used by CopyArea and solid fills,
+ * and fbComposite() with the common Render ops, on square areas of
+ * various sizes.
+ */
+#include <dix-config.h>
+
+#include <stdlib.h>
+
+#include "fb/fb.h"
+#include "fb/fbpict.h"
+#include "include/pixmapstr.h"
+#include "include/scrnintstr.h"
+#include "render/picturestr.h"
+
+#include "bench.h"
+
+#define FB_SIZE     1024
+#define FB_PIXELS   (1 << 26)   /* per configuration */
+
+static ScreenRec bench_screen;
+
+static void
+bench_source_validate(DrawablePtr pDrawable, int x, int y, int width,
+                      int height, unsigned int subWindowMode)
+{
+}
+
+static PixmapPtr
+make_pixmap(int depth, int bpp)
+{
+    PixmapPtr pPixmap = calloc(1, sizeof(PixmapRec));
+    int stride = BitmapBytePad(FB_SIZE * bpp);
+
+    pPixmap->drawable.type = DRAWABLE_PIXMAP;
+    pPixmap->drawable.pScreen = &bench_screen;
+    pPixmap->drawable.depth = depth;
+    pPixmap->drawable.bitsPerPixel = bpp;
+    pPixmap->drawable.width = FB_SIZE;
+    pPixmap->drawable.height = FB_SIZE;
+    pPixmap->devKind = stride;
+    /* one spare row for the unaligned blt reading past the last one */
+    pPixmap->devPrivate.ptr = calloc(FB_SIZE + 1, stride);
+
+    for (int i = 0; i < FB_SIZE * stride; i++)
+        ((CARD8 *) pPixmap->devPrivate.ptr)[i] = bench_random();
+    return pPixmap;
+}
+
+static void
+free_pixmap(PixmapPtr pPixmap)
+{
+    free(pPixmap->devPrivate.ptr);
+    free(pPixmap);
+}
+
+static PicturePtr
+make_picture(PixmapPtr pPixmap, PictFormatShort format, RegionPtr clip)
+{
+    PicturePtr pPicture = calloc(1, sizeof(PictureRec));
+
+    pPicture->pDrawable = &pPixmap->drawable;
+    pPicture->format = format;
+    pPicture->pCompositeClip = clip;
+    return pPicture;
+}
+
+static int
+rounds_for(int size)
+{
+    return max(FB_PIXELS / (size * size), 64);
+}
+
+static void
+bench_blt(PixmapPtr src, PixmapPtr dst, const char *name, int size, int bpp,
+          int srcX)
+{
+    FbStride stride = src->devKind / sizeof(FbBits);
+    int rounds = rounds_for(size);
+    uint64_t start = bench_time_ns();
+
+    for (int i = 0; i < rounds; i++) {
+        int y = i % (FB_SIZE - size + 1);
+
+        fbBlt((FbBits *) src->devPrivate.ptr + y * stride, stride, srcX * bpp,
+              (FbBits *) dst->devPrivate.ptr + y * stride, stride, 0,
+              size * bpp, size, GXcopy, FB_ALLONES, bpp, FALSE, FALSE);
+    }
+    bench_report("fb", name, size, rounds, bench_time_ns() - start);
+}
+
+static void
+bench_solid(PixmapPtr dst, int size)
+{
+    FbStride stride = dst->devKind / sizeof(FbBits);
+    int rounds = rounds_for(size);
+    uint64_t start = bench_time_ns();
+
+    for (int i = 0; i < rounds; i++) {
+        int y = i % (FB_SIZE - size + 1);
+
+        fbSolid((FbBits *) dst->devPrivate.ptr + y * stride, stride, 0, 32,
+                size * 32, size, 0, i);
+    }
+    bench_report("fb", "solid", size, rounds, bench_time_ns() - start);
+}
+
+static void
+bench_composite(const char *name, CARD8 op, PicturePtr pSrc, PicturePtr pMask,
+                PicturePtr pDst, int size)
+{
+    int rounds = rounds_for(size);
+    uint64_t start = bench_time_ns();
+
+    for (int i = 0; i < rounds; i++) {
+        int y = i % (FB_SIZE - size + 1);
+
+        fbComposite(op, pSrc, pMask, pDst, 0, y, 0, y, 0, y, size, size);
+    }
+    bench_report("fb", name, size, rounds, bench_time_ns() - start);
+}
+
+void
+fb_bench(void)
+{
+    static const int sizes[] = { 16, 128, 1024 };
+    BoxRec box = { 0, 0, FB_SIZE, FB_SIZE };
+    PixmapPtr argb, xrgb, dst, a8, src8, dst8;
+    PicturePtr pArgb, pXrgb, pDst, pA8;
+    RegionRec clip;
+
+    bench_screen.SourceValidate = bench_source_validate;
+
+    argb = make_pixmap(32, 32);
+    xrgb = make_pixmap(24, 32);
+    dst = make_pixmap(24, 32);
+    a8 = make_pixmap(8, 8);
+    src8 = make_pixmap(8, 8);
+    dst8 = make_pixmap(8, 8);
+
+    RegionInit(&clip, &box, 1);
+    pArgb = make_picture(argb, PICT_a8r8g8b8, NULL);
+    pXrgb = make_picture(xrgb, PICT_x8r8g8b8, NULL);
+    pDst = make_picture(dst, PICT_x8r8g8b8, &clip);
+    pA8 = make_picture(a8, PICT_a8, NULL);
+
+    for (int i = 0; i < ARRAY_SIZE(sizes); i++) {
+        int size = sizes[i];
+
+        bench_blt(xrgb, dst, "blt", size, 32, 0);
+        bench_blt(src8, dst8, "blt_8bpp_unaligned", size, 8, 3);
+        bench_solid(dst, size);
+        bench_composite("composite_src", PictOpSrc, pXrgb, NULL, pDst, size);
+        bench_composite("composite_over", PictOpOver, pArgb, NULL, pDst, size);
+        bench_composite("composite_over_mask", PictOpOver, pArgb, pA8, pDst,
+                        size);
+    }
+
+    free(pArgb);
+    free(pXrgb);
+    free(pDst);
+    free(pA8);
+    RegionUninit(&clip);
+    free_pixmap(argb);
+    free_pixmap(xrgb);
+    free_pixmap(dst);
+    free_pixmap(a8);
+    free_pixmap(src8);
+    free_pixmap(dst8);
+}
@@ -0,0 +1,128 @@
+/*
+ * Text rendering through the fb glyph cache: runs of CJK sized glyphs
+ * drawn from a skewed distribution (a few very common glyphs and a long
+ * tail), composited with pixman, under various cache budgets.
+ */
+#include <dix-config.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <pixman.h>
+
+#include "dix/dix_priv.h"
+#include "fb/fbpict_priv.h"
+
+#include "bench.h"
+
+#define GLYPH_RUNS      20000
+#define GLYPH_RUN_LEN   64
+#define GLYPH_SIZE      24
+#define GLYPH_DISTINCT  20000
+
+static PictFormatRec glyph_format;
+
+static GlyphPtr *
+make_glyphs(int n)
+{
+    GlyphPtr *glyphs = calloc(n, sizeof(GlyphPtr));
+
+    for (int i = 0; i < n; i++) {
+        glyphs[i] = calloc(1, sizeof(GlyphRec));
+        glyphs[i]->info.width = GLYPH_SIZE;
+        glyphs[i]->info.height = GLYPH_SIZE;
+        glyphs[i]->info.xOff = GLYPH_SIZE;
+    }
+    return glyphs;
+}
+
+/* cubing a uniform value skews it towards the common glyphs */
+static int
+pick_glyph(int n)
+{
+    double r = (bench_random() & 0xffffff) / (double) 0x1000000;
+
+    return (int) (r * r * r * n);
+}
+
+static void
+bench_budget(GlyphPtr *glyphs, unsigned int budget_kb,
+             pixman_image_t *glyph_image, pixman_image_t *src,
+             pixman_image_t *dst)
+{
+    pixman_glyph_t run[GLYPH_RUN_LEN];
+    FbGlyphCacheStatsRec before, after;
+    uint64_t start;
+
+    glyphCacheSize = budget_kb;
+    fbGlyphCacheGetStats(&before);
+
+    start = bench_time_ns();
+    for (int r = 0; r < GLYPH_RUNS; r++) {
+        pixman_glyph_cache_t *cache = fbGlyphCacheFreeze();
+
+        for (int i = 0; i < GLYPH_RUN_LEN; i++) {
+            GlyphPtr glyph = glyphs[pick_glyph(GLYPH_DISTINCT)];
+            const void *g = fbGlyphCacheLookup(glyph);
+
+            if (!g)
+                g = fbGlyphCacheInsert(glyph, &glyph_format, glyph_image);
+
+            run[i].x = (i % 40) * GLYPH_SIZE;
+            run[i].y = (r % 30) * GLYPH_SIZE;
+            run[i].glyph = g;
+        }
+
+        pixman_composite_glyphs_no_mask(PIXMAN_OP_OVER, src, dst,
+                                        0, 0, 0, 0, cache,
+                                        GLYPH_RUN_LEN, run);
+        fbGlyphCacheThaw();
+    }
+
+    bench_report("glyphs", "render", budget_kb,
+                 (uint64_t) GLYPH_RUNS * GLYPH_RUN_LEN,
+                 bench_time_ns() - start);
+
+    fbGlyphCacheGetStats(&after);
+    printf("# glyphs budget %u KB: %.1f%% hits, %u glyphs in %zu KB\n",
+           budget_kb,
+           100.0 * (after.hits - before.hits) /
+           ((after.hits - before.hits) + (after.misses - before.misses)),
+           after.glyphs, after.bytes / 1024);
+
+    /* every glyph counted must still be in pixman's cache */
+    fbGlyphCacheFreeze();
+    for (int i = 0; i < GLYPH_DISTINCT; i++)
+        fbGlyphCacheLookup(glyphs[i]);
+    fbGlyphCacheThaw();
+    fbGlyphCacheGetStats(&before);
+    if (before.glyphs != after.glyphs)
+        printf("# glyphs budget %u KB: %u glyphs counted but gone\n",
+               budget_kb, after.glyphs - before.glyphs);
+
+    fbDestroyGlyphCache();
+}
+
+void
+glyphs_bench(void)
+{
+    static const unsigned int budgets[] = { 0, 8192, 2048, 512 };
+    GlyphPtr *glyphs = make_glyphs(GLYPH_DISTINCT);
+    pixman_color_t white = { 0xffff, 0xffff, 0xffff, 0xffff };
+    pixman_image_t *glyph_image, *src, *dst;
+
+    glyph_image = pixman_image_create_bits(PIXMAN_a8, GLYPH_SIZE, GLYPH_SIZE,
+                                           NULL, 0);
+    src = pixman_image_create_solid_fill(&white);
+    dst = pixman_image_create_bits(PIXMAN_x8r8g8b8, 40 * GLYPH_SIZE,
+                                   30 * GLYPH_SIZE, NULL, 0);
+
+    for (int i = 0; i < ARRAY_SIZE(budgets); i++)
+        bench_budget(glyphs, budgets[i], glyph_image, src, dst);
+
+    pixman_image_unref(dst);
+    pixman_image_unref(src);
+    pixman_image_unref(glyph_image);
+    for (int i = 0; i < GLYPH_DISTINCT; i++)
+        free(glyphs[i]);
+    free(glyphs);
+}
@@ -0,0 +1,192 @@
+/*
+ * Passive grabs on the root window of a desktop with a window manager and a
+ * hotkey daemon: N key grabs, every hotkey with and without NumLock and
+ * CapsLock, and a few grabs of any key. Key presses while typing, which
+ * none of them matches, and hotkeys, with the grab index vs. the former
+ * walk of all grabs.
+ */
+#include <dix-config.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <X11/X.h>
+
+#include "dix/dix_priv.h"
+#include "dix/dixgrabs_priv.h"
+#include "dix/eventconvert.h"
+#include "dix/exevents_priv.h"
+#include "include/dixstruct.h"
+#include "include/eventstr.h"
+#include "include/inputstr.h"
+#include "include/windowstr.h"
+#include "xkb/xkbsrv_priv.h"
+
+#include "bench.h"
+
+#define GRAB_ROUNDS     200000
+#define HOTKEY_MODS     Mod4Mask
+#define ANYKEY_GRABS    8
+#define MIN_KEYCODE     8
+
+static const unsigned int lock_mods[] = {
+    0, LockMask, Mod2Mask, LockMask | Mod2Mask
+};
+
+static ClientRec bench_server_client, bench_client;
+static DeviceIntRec kbd_dev;
+static KeyClassRec kbd_key;
+static XkbSrvInfoRec kbd_xkbi;
+static int keys[GRAB_ROUNDS];
+static GrabPtr results[GRAB_ROUNDS];
+
+static void
+setup_grabs(void)
+{
+    serverClient = &bench_server_client;
+    InitClientResources(serverClient);
+
+    bench_client.index = 1;
+    bench_client.clientAsMask = ((Mask) 1) << CLIENTOFFSET;
+    clients[1] = &bench_client;
+
+    kbd_dev.id = 3;
+    kbd_dev.type = MASTER_KEYBOARD;
+    kbd_dev.key = &kbd_key;
+    kbd_key.xkbInfo = &kbd_xkbi;
+    inputInfo.devices = &kbd_dev;
+}
+
+static void
+add_grab(WindowPtr root, int key, unsigned int modifiers)
+{
+    GrabMask mask = { .core = KeyPressMask };
+    GrabParameters param = {
+        .grabtype = CORE,
+        .this_device_mode = GrabModeAsync,
+        .other_devices_mode = GrabModeAsync,
+        .modifiers = modifiers,
+    };
+    GrabPtr grab = CreateGrab(&bench_client, &kbd_dev, &kbd_dev, root, CORE,
+                              &mask, &param, KeyPress, key, NULL, NULL);
+
+    AddPassiveGrabToList(&bench_client, grab);
+}
+
+/* n grabs: hotkeys on the first (n - 8) / 4 keys and Ctrl+Alt, Super+Shift
+ * with any key, all of them with each combination of the locks */
+static WindowPtr
+make_root(int n)
+{
+    WindowPtr root = calloc(1, sizeof(WindowRec));
+
+    root->drawable.type = DRAWABLE_WINDOW;
+    root->optional = calloc(1, sizeof(WindowOptRec));
+    InitClientResources(&bench_client);
+
+    for (int i = 0; i < ARRAY_SIZE(lock_mods); i++) {
+        add_grab(root, AnyKey, ControlMask | Mod1Mask | lock_mods[i]);
+        add_grab(root, AnyKey, Mod4Mask | ShiftMask | lock_mods[i]);
+    }
+    for (int k = 0; k < (n - ANYKEY_GRABS) / ARRAY_SIZE(lock_mods); k++)
+        for (int i = 0; i < ARRAY_SIZE(lock_mods); i++)
+            add_grab(root, MIN_KEYCODE + k, HOTKEY_MODS | lock_mods[i]);
+    return root;
+}
+
+static void
+free_root(WindowPtr root)
+{
+    FreeClientResources(&bench_client);
+    PassiveGrabIndexFree(root);
+    free(root->optional);
+    free(root);
+}
+
+/*
+ * CheckPassiveGrabsOnWindow(), as it was, without activating: every grab
+ * on the list compared to the key press at each level, until one matches
+ */
+static GrabPtr
+former_check(WindowPtr root, int key)
+{
+    GrabRec tmp = {
+        .window = root,
+        .device = &kbd_dev,
+        .detail.exact = key,
+        .modifiersDetail.exact = kbd_xkbi.state.grab_mods,
+    };
+    static const enum InputLevel levels[] = { XI2, XI, CORE };
+
+    for (GrabPtr grab = wPassiveGrabs(root); grab; grab = grab->next) {
+        tmp.modifierDevice = grab->modifierDevice;
+        for (int l = 0; l < ARRAY_SIZE(levels); l++) {
+            tmp.grabtype = levels[l];
+            tmp.type = levels[l] == XI2 ? GetXI2Type(ET_KeyPress) :
+                levels[l] == XI ? GetXIType(ET_KeyPress) :
+                GetCoreType(ET_KeyPress);
+            if (tmp.type && GrabMatchesSecond(&tmp, grab, levels[l] == CORE))
+                return grab;
+        }
+    }
+    return NULL;
+}
+
+static void
+run_presses(const char *name, int n, WindowPtr root, unsigned int mods)
+{
+    InternalEvent event = { 0 };
+    char label[32];
+    int mismatches = 0, hotkeys = (n - ANYKEY_GRABS) / ARRAY_SIZE(lock_mods);
+    uint64_t start;
+
+    /* hotkeys of the grabbed keys, typing all over the keyboard */
+    for (int i = 0; i < GRAB_ROUNDS; i++)
+        keys[i] = MIN_KEYCODE + bench_random() %
+            (mods & HOTKEY_MODS ? hotkeys : 256 - MIN_KEYCODE);
+    kbd_xkbi.state.grab_mods = mods;
+    event.any.type = ET_KeyPress;
+    event.device_event.deviceid = kbd_dev.id;
+
+    start = bench_time_ns();
+    for (int i = 0; i < GRAB_ROUNDS; i++) {
+        event.device_event.detail.key = keys[i];
+        results[i] = CheckPassiveGrabsOnWindow(root, &kbd_dev, &event, TRUE,
+                                               FALSE);
+    }
+    snprintf(label, sizeof(label), "%s_index", name);
+    bench_report("grabs", label, n, GRAB_ROUNDS, bench_time_ns() - start);
+
+    start = bench_time_ns();
+    for (int i = 0; i < GRAB_ROUNDS; i++)
+        if (former_check(root, keys[i]) != results[i])
+            mismatches++;
+    snprintf(label, sizeof(label), "%s_walk", name);
+    bench_report("grabs", label, n, GRAB_ROUNDS, bench_time_ns() - start);
+
+    if (mismatches)
+        printf("# grabs %s %d: %d presses found another grab\n", name, n,
+               mismatches);
+}
+
+static void
+bench_grabs(int n)
+{
+    WindowPtr root = make_root(n);
+
+    run_presses("type", n, root, Mod2Mask);
+    run_presses("hotkey", n, root, HOTKEY_MODS | Mod2Mask);
+    free_root(root);
+}
+
+void
+grabs_bench(void)
+{
+    setup_grabs();
+
+    bench_grabs(40);
+    bench_grabs(200);
+    bench_grabs(1000);
+
+    inputInfo.devices = NULL;
+    clients[1] = NULL;
+}
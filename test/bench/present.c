@@ -0,0 +1,223 @@
+/*
+ * Present frame pacing on a headless screen: N clients, each rendering for
+ * part of a frame and then presenting for the next vblank, as GL apps and
+ * video players on Xvfb do. Fake CRTC vs. the former OsTimer per queued
+ * event, in server wakeups and in how late and how unevenly frames
+ * complete.
+ */
+#include <dix-config.h>
+
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "include/dix.h"
+#include "include/os.h"
+#include "os/osdep.h"
+#include "present/present_priv.h"
+
+#include "bench.h"
+
+#define PRESENT_FPS     60
+#define PRESENT_FRAMES  120
+#define FRAME_NS        (1000000000ULL / PRESENT_FPS)
+#define OSTIMER_INTERVAL (1000000 / PRESENT_FPS)
+
+typedef struct {
+    uint64_t msc;               /* next frame */
+    uint64_t render_done;       /* ns, 0 while waiting for the vblank */
+    CARD32 expires;             /* ms, former fake vblank timer */
+    uint64_t last_complete;
+} BenchPresentClient;
+
+static BenchPresentClient *present_clients;
+static int num_clients;
+
+static uint64_t frames, late_ns, intervals, uneven_ns, wakeups;
+
+/* frame for vblank msc, which was at ust, completed */
+static void
+frame_complete(int c, uint64_t ust, uint64_t msc)
+{
+    BenchPresentClient *client = &present_clients[c];
+    uint64_t now = bench_time_ns();
+    uint64_t vblank = ust * 1000;
+
+    frames++;
+    late_ns += now > vblank ? now - vblank : vblank - now;
+    if (client->last_complete) {
+        uint64_t interval = now - client->last_complete;
+
+        intervals++;
+        uneven_ns += interval > FRAME_NS ? interval - FRAME_NS :
+                                           FRAME_NS - interval;
+    }
+    client->last_complete = now;
+
+    /* render the next frame, to be shown at the following vblank */
+    client->msc = msc + 1;
+    client->render_done = now + bench_random() % (FRAME_NS / 2);
+}
+
+/* linked with -Wl,-wrap,present_event_notify: the fake CRTC reports here */
+void __wrap_present_event_notify(uint64_t event_id, uint64_t ust, uint64_t msc);
+
+void
+__wrap_present_event_notify(uint64_t event_id, uint64_t ust, uint64_t msc)
+{
+    frame_complete(event_id - 1, ust, msc);
+}
+
+static uint64_t
+start_clients(int n, uint64_t msc)
+{
+    uint64_t now = bench_time_ns();
+
+    num_clients = n;
+    present_clients = calloc(n, sizeof(BenchPresentClient));
+    for (int c = 0; c < n; c++) {
+        present_clients[c].msc = msc + 1;
+        present_clients[c].render_done = now + bench_random() % FRAME_NS;
+    }
+    frames = late_ns = intervals = uneven_ns = wakeups = 0;
+    return now + PRESENT_FRAMES * FRAME_NS;
+}
+
+/* milliseconds until the first client is done rendering */
+static int
+render_timeout(uint64_t now, uint64_t end)
+{
+    uint64_t next = end;
+
+    for (int c = 0; c < num_clients; c++)
+        if (present_clients[c].render_done)
+            next = min(next, present_clients[c].render_done);
+    return next > now ? (next - now + 999999) / 1000000 : 0;
+}
+
+static void
+report(const char *late, const char *uneven, int n)
+{
+    bench_report("present", late, n, frames, late_ns);
+    bench_report("present", uneven, n, intervals, uneven_ns);
+    printf("# %s: %llu wakeups for %d frames at %d Hz\n", late,
+           (unsigned long long) wakeups, PRESENT_FRAMES, PRESENT_FPS);
+    free(present_clients);
+}
+
+/* what present_fake_get_ust_msc() used to do */
+static uint64_t
+ostimer_msc(uint64_t ust)
+{
+    return (ust + OSTIMER_INTERVAL / 2) / OSTIMER_INTERVAL;
+}
+
+static void
+ostimer_notify(int c)
+{
+    uint64_t msc = ostimer_msc(GetTimeInMicros());
+
+    /* the vblank it ought to have been notified at */
+    frame_complete(c, msc * OSTIMER_INTERVAL, msc);
+}
+
+/* what present_fake_queue_vblank() used to do */
+static void
+ostimer_queue(int c)
+{
+    uint64_t now = GetTimeInMicros();
+    uint64_t ust = present_clients[c].msc * OSTIMER_INTERVAL;
+    INT32 delay = ((int64_t) (ust - now)) / 1000;
+
+    if (delay <= 0)
+        ostimer_notify(c);
+    else
+        present_clients[c].expires = GetTimeInMillis() + delay;
+}
+
+static void
+bench_ostimer(int n)
+{
+    uint64_t end = start_clients(n, ostimer_msc(GetTimeInMicros())), now;
+
+    while ((now = bench_time_ns()) < end) {
+        CARD32 ms = GetTimeInMillis();
+        Bool fired = FALSE;
+        int timeout;
+
+        for (int c = 0; c < n; c++) {
+            BenchPresentClient *client = &present_clients[c];
+
+            if (client->render_done && client->render_done <= now) {
+                client->render_done = 0;
+                ostimer_queue(c);
+            }
+        }
+
+        /* expired timers run together, as in DoTimers() */
+        for (int c = 0; c < n; c++) {
+            BenchPresentClient *client = &present_clients[c];
+
+            if (client->expires && (int) (ms - client->expires) >= 0) {
+                client->expires = 0;
+                ostimer_notify(c);
+                fired = TRUE;
+            }
+        }
+        if (fired)
+            wakeups++;
+
+        timeout = render_timeout(now, end);
+        for (int c = 0; c < n; c++)
+            if (present_clients[c].expires)
+                timeout = min(timeout,
+                              max((int) (present_clients[c].expires - ms), 0));
+        poll(NULL, 0, timeout);
+    }
+
+    report("ostimer_late", "ostimer_uneven", n);
+}
+
+static void
+bench_fake_crtc(int n)
+{
+    present_fake_crtc_ptr fake_crtc = present_fake_crtc_create(PRESENT_FPS);
+    uint64_t ust, msc, end, now;
+
+    present_fake_crtc_get_ust_msc(fake_crtc, &ust, &msc);
+    end = start_clients(n, msc);
+
+    while ((now = bench_time_ns()) < end) {
+        for (int c = 0; c < n; c++) {
+            BenchPresentClient *client = &present_clients[c];
+
+            if (client->render_done && client->render_done <= now) {
+                client->render_done = 0;
+                present_fake_crtc_queue_vblank(fake_crtc, c + 1, client->msc);
+            }
+        }
+
+        /* the fake CRTC's timer is the only fd */
+        if (ospoll_wait(server_poll, render_timeout(now, end)) > 0)
+            wakeups++;
+    }
+
+    present_fake_crtc_destroy(fake_crtc);
+    report("fake_crtc_late", "fake_crtc_uneven", n);
+}
+
+void
+present_bench(void)
+{
+    static const int counts[] = { 10, 100 };
+
+    server_poll = ospoll_create();
+
+    for (int i = 0; i < ARRAY_SIZE(counts); i++) {
+        bench_ostimer(counts[i]);
+        bench_fake_crtc(counts[i]);
+    }
+
+    ospoll_destroy(server_poll);
+    server_poll = NULL;
+}
@@ -0,0 +1,112 @@
+/*
+ * Property traffic on a root window carrying many properties: lookups
+ * as done by GetProperty, replacing values, and delete / re-create churn.
+ */
+#include <dix-config.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <X11/X.h>
+#include <X11/Xatom.h>
+
+#include "dix/atom_priv.h"
+#include "dix/dix_priv.h"
+#include "dix/property_priv.h"
+#include "include/dix.h"
+#include "include/dixstruct.h"
+#include "include/property.h"
+#include "include/windowstr.h"
+
+#include "bench.h"
+
+#define PROPERTY_ROUNDS 200000
+
+static ClientRec bench_client;
+static ScreenRec bench_screen;
+
+static Atom *
+make_property_atoms(int n, const char *prefix)
+{
+    Atom *atoms = calloc(n, sizeof(Atom));
+    char name[64];
+
+    for (int i = 0; i < n; i++) {
+        int len = snprintf(name, sizeof(name), "%s_%d", prefix, i);
+
+        atoms[i] = MakeAtom(name, len, TRUE);
+    }
+    return atoms;
+}
+
+static void
+bench_properties(int n)
+{
+    WindowPtr pWin = calloc(1, sizeof(WindowRec));
+    Atom *atoms = make_property_atoms(n, "_NET_BENCH_PROPERTY");
+    Atom *missing = make_property_atoms(n, "_NET_BENCH_MISSING");
+    CARD32 value = 0;
+    PropertyPtr pProp;
+    uint64_t start;
+
+    pWin->drawable.pScreen = &bench_screen;
+    pWin->optional = calloc(1, sizeof(WindowOptRec));
+
+    for (int i = 0; i < n; i++)
+        dixChangeWindowProperty(&bench_client, pWin, atoms[i], XA_CARDINAL,
+                                32, PropModeReplace, 1, &value, FALSE);
+
+    start = bench_time_ns();
+    for (int i = 0; i < PROPERTY_ROUNDS; i++)
+        dixLookupProperty(&pProp, pWin, atoms[bench_random() % n],
+                          &bench_client, DixReadAccess);
+    bench_report("property", "get", n, PROPERTY_ROUNDS,
+                 bench_time_ns() - start);
+
+    start = bench_time_ns();
+    for (int i = 0; i < PROPERTY_ROUNDS; i++)
+        dixLookupProperty(&pProp, pWin, missing[bench_random() % n],
+                          &bench_client, DixReadAccess);
+    bench_report("property", "get_miss", n, PROPERTY_ROUNDS,
+                 bench_time_ns() - start);
+
+    start = bench_time_ns();
+    for (int i = 0; i < PROPERTY_ROUNDS; i++) {
+        value = i;
+        dixChangeWindowProperty(&bench_client, pWin,
+                                atoms[bench_random() % n], XA_CARDINAL,
+                                32, PropModeReplace, 1, &value, TRUE);
+    }
+    bench_report("property", "replace", n, PROPERTY_ROUNDS,
+                 bench_time_ns() - start);
+
+    start = bench_time_ns();
+    for (int i = 0; i < PROPERTY_ROUNDS; i++) {
+        Atom atom = atoms[bench_random() % n];
+
+        DeleteProperty(&bench_client, pWin, atom);
+        dixChangeWindowProperty(&bench_client, pWin, atom, XA_CARDINAL,
+                                32, PropModeReplace, 1, &value, TRUE);
+    }
+    bench_report("property", "delete_create", n, PROPERTY_ROUNDS,
+                 bench_time_ns() - start);
+
+    DeleteAllWindowProperties(pWin);
+    free(pWin->optional);
+    free(pWin);
+    free(missing);
+    free(atoms);
+}
+
+void
+property_bench(void)
+{
+    static const int counts[] = { 8, 32, 128, 512, 2048 };
+
+    InitAtoms();
+    bench_client.index = 1;
+
+    for (int i = 0; i < ARRAY_SIZE(counts); i++)
+        bench_properties(counts[i]);
+
+    FreeAllAtoms();
+}
@@ -0,0 +1,298 @@
+/*
+ * RECORD capture of a busy client, as xmacro, xnee or a screen reader
+ * do it: requests and delivered events dispatched in cycles, with no
+ * context, with a context writing to the recording client and with one
+ * writing to a shared memory ring. And the filter test on each of them,
+ * bitmaps vs. the former set lookups.
+ */
+#include <dix-config.h>
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <X11/X.h>
+#include <X11/Xproto.h>
+#include <X11/extensions/recordproto.h>
+
+#include "dix/dix_priv.h"
+#include "dix/dixstruct_priv.h"
+#include "dix/resource_priv.h"
+#include "miext/extinit_priv.h"
+#include "include/dix.h"
+#include "include/dixstruct.h"
+#include "include/extnsionst.h"
+#include "include/inputstr.h"
+#include "include/os.h"
+#include "os/osdep.h"
+#include "record/recordshm.h"
+#include "record/set.h"
+
+#include "bench.h"
+
+#define RECORD_ELEMENTS (1 << 20)
+#define RECORD_LOOKUPS  (1 << 22)
+#define RING_SIZE       (1 << 20)
+#define CONTEXT_ID(c)   ((c).clientAsMask | 1)
+
+static ClientRec bench_server_client;
+static ClientRec recording_client, recorded_client;
+static OsCommRec recording_oc;
+static DeviceIntRec ptr_dev, kbd_dev;
+static SpriteInfoRec ptr_info, kbd_info;
+static int record_major;
+
+static void
+setup_client(ClientPtr client, int index)
+{
+    client->index = index;
+    client->clientAsMask = (XID) index << CLIENTOFFSET;
+    client->clientState = ClientStateRunning;
+    client->requestVector = ProcVector;
+    client->clientPtr = &ptr_dev;
+    xorg_list_init(&client->ready);
+    xorg_list_init(&client->output_pending);
+    dixAllocatePrivates(&client->devPrivates, PRIVATE_CLIENT);
+    InitClientResources(client);
+    clients[index] = client;
+}
+
+static void
+setup_record(void)
+{
+    /* no key class, so XKB leaves the events alone */
+    ptr_dev.type = MASTER_POINTER;
+    ptr_dev.spriteInfo = &ptr_info;
+    ptr_info.paired = &kbd_dev;
+    kbd_dev.type = MASTER_KEYBOARD;
+    kbd_dev.spriteInfo = &kbd_info;
+    kbd_info.paired = &ptr_dev;
+
+    serverClient = &bench_server_client;
+    InitClientResources(serverClient);
+    RecordExtensionInit();
+    record_major = CheckExtension(RECORD_NAME)->base;
+
+    setup_client(&recording_client, 1);
+    recording_client.osPrivate = &recording_oc;
+    setup_client(&recorded_client, 2);
+}
+
+static int
+record_request(void *request, int len)
+{
+    recording_client.requestBuffer = request;
+    recording_client.req_len = bytes_to_int32(len);
+    return ProcVector[record_major] (&recording_client);
+}
+
+/*
+ * all core requests and delivered core events of the recorded client,
+ * as xmacro asks for them
+ */
+static void
+create_context(void)
+{
+    struct {
+        xRecordCreateContextReq req;
+        XID client;
+        xRecordRange range;
+    } request = {
+        .req = {
+            .reqType = record_major,
+            .recordReqType = X_RecordCreateContext,
+            .length = bytes_to_int32(sizeof(request)),
+            .context = CONTEXT_ID(recording_client),
+            .nClients = 1,
+            .nRanges = 1,
+        },
+        .client = recorded_client.clientAsMask,
+        .range = {
+            .coreRequestsFirst = X_CreateWindow,
+            .coreRequestsLast = X_NoOperation,
+            .deliveredEventsFirst = KeyPress,
+            .deliveredEventsLast = MappingNotify,
+        },
+    };
+
+    record_request(&request, sizeof(request));
+}
+
+static void
+context_request(int minor)
+{
+    xRecordEnableContextReq request = {
+        .reqType = record_major,
+        .recordReqType = minor,
+        .length = bytes_to_int32(sizeof(request)),
+        .context = CONTEXT_ID(recording_client),
+    };
+
+    record_request(&request, sizeof(request));
+}
+
+/*
+ * elements of the recorded client, half requests and half events, with
+ * the server going back to WaitForSomething() every cycle elements
+ */
+static void
+dispatch(const char *name, int cycle, xRecordShmHeader *ring)
+{
+    struct {
+        xReq req;
+        CARD32 data[7];
+    } request = {
+        .req = {
+            .reqType = X_NoOperation,
+            .length = bytes_to_int32(sizeof(request)),
+        },
+    };
+    xEvent event = { .u.u.type = MotionNotify };
+    int timeout = 0;
+    uint64_t start;
+
+    start = bench_time_ns();
+    for (int i = 0; i < RECORD_ELEMENTS; i += 2) {
+        recorded_client.requestBuffer = &request;
+        recorded_client.req_len = request.req.length;
+        recorded_client.majorOp = X_NoOperation;
+        recorded_client.sequence++;
+        (*recorded_client.requestVector[X_NoOperation]) (&recorded_client);
+
+        event.u.keyButtonPointer.rootX = i;
+        WriteEventsToClient(&recorded_client, 1, &event);
+
+        if ((i + 2) % cycle == 0) {
+            /* what FlushAllOutput() and WaitForSomething() call */
+            CallCallbacks(&FlushCallback, NULL);
+            BlockHandler(&timeout);
+
+            /* the consumer keeps up */
+            if (ring)
+                ring->tail = ring->head;
+        }
+    }
+    bench_report("record", name, cycle, RECORD_ELEMENTS,
+                 bench_time_ns() - start);
+}
+
+static void
+bench_none(int cycle)
+{
+    dispatch("none", cycle, NULL);
+}
+
+static void
+bench_wire(int cycle)
+{
+    context_request(X_RecordEnableContext);
+    dispatch("wire", cycle, NULL);
+    context_request(X_RecordDisableContext);
+    mark_client_not_ready(&recording_client);
+}
+
+static void
+bench_shm(int cycle)
+{
+#ifdef HAVE_MEMFD_CREATE
+    xRecordShmHeader *ring;
+    int shm_fd;
+
+    shm_fd = memfd_create("record-bench", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+    if (shm_fd < 0 || ftruncate(shm_fd, RING_SIZE) < 0 ||
+        fcntl(shm_fd, F_ADD_SEALS, F_SEAL_SHRINK) < 0) {
+        printf("# shm: no sealed memfd\n");
+        return;
+    }
+    ring = mmap(NULL, RING_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED,
+                shm_fd, 0);
+
+    if (RecordEnableContextShm(&recording_client, CONTEXT_ID(recording_client),
+                               dup(shm_fd)) != Success) {
+        printf("# shm: capture ring refused\n");
+        munmap(ring, RING_SIZE);
+        close(shm_fd);
+        return;
+    }
+    dispatch("shm", cycle, ring);
+    printf("# shm: %llu bytes recorded, %llu lost\n",
+           (unsigned long long) ring->head,
+           (unsigned long long) ring->lost);
+    context_request(X_RecordDisableContext);
+    mark_client_not_ready(&recording_client);
+
+    munmap(ring, RING_SIZE);
+    close(shm_fd);
+#else
+    printf("# shm: no memfd_create()\n");
+#endif
+}
+
+/*
+ * the hooks' filter test on event types, for event selections of n
+ * intervals: what they used to ask the sets vs. a bitmap test
+ */
+static void
+bench_lookup(int n)
+{
+    RecordSetInterval *intervals = calloc(n, sizeof(RecordSetInterval));
+    CARD32 bits[256 / 32] = { 0 };
+    uint8_t *types = malloc(RECORD_LOOKUPS);
+    RecordSetPtr pSet;
+    unsigned long hits = 0;
+    uint64_t start;
+
+    for (int i = 0; i < n; i++) {
+        intervals[i].first = KeyPress + i * (LASTEvent / n);
+        intervals[i].last = intervals[i].first + LASTEvent / (2 * n);
+        for (int j = intervals[i].first; j <= intervals[i].last; j++)
+            bits[j >> 5] |= (CARD32) 1 << (j & 31);
+    }
+    pSet = RecordCreateSet(intervals, n, NULL, 0);
+    for (int i = 0; i < RECORD_LOOKUPS; i++)
+        types[i] = bench_random() & 0177;
+
+    start = bench_time_ns();
+    for (int i = 0; i < RECORD_LOOKUPS; i++)
+        hits += !!RecordIsMemberOfSet(pSet, types[i]);
+    bench_report("record", "set_lookup", n, RECORD_LOOKUPS,
+                 bench_time_ns() - start);
+
+    start = bench_time_ns();
+    for (int i = 0; i < RECORD_LOOKUPS; i++)
+        hits -= !!(bits[types[i] >> 5] & ((CARD32) 1 << (types[i] & 31)));
+    bench_report("record", "bitmap_lookup", n, RECORD_LOOKUPS,
+                 bench_time_ns() - start);
+
+    /* both must agree */
+    if (hits)
+        printf("# lookup: set and bitmap disagree\n");
+
+    RecordDestroySet(pSet);
+    free(types);
+    free(intervals);
+}
+
+void
+record_bench(void)
+{
+    static const int cycles[] = { 2, 64, 1024 };
+    static const int intervals[] = { 1, 8 };
+
+    setup_record();
+    create_context();
+
+    for (int i = 0; i < ARRAY_SIZE(cycles); i++) {
+        bench_none(cycles[i]);
+        bench_wire(cycles[i]);
+        bench_shm(cycles[i]);
+    }
+    printf("# wire: what WriteToClient() copies is not included\n");
+
+    for (int i = 0; i < ARRAY_SIZE(intervals); i++)
+        bench_lookup(intervals[i]);
+
+    FreeClientResources(&recording_client);
+}
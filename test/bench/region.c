@@ -0,0 +1,68 @@
+/*
+ * Region arithmetic as done for clipping and damage: union, intersect and
+ * subtract of two regions made of N scattered rectangles each.
+ */
+#include <dix-config.h>
+
+#include <stdlib.h>
+
+#include "include/dix.h"
+#include "include/regionstr.h"
+
+#include "bench.h"
+
+#define REGION_ROUNDS   2000
+#define REGION_WIDTH    1920
+#define REGION_HEIGHT   1080
+
+static void
+make_region(RegionPtr pRegion, int n)
+{
+    BoxPtr boxes = calloc(n, sizeof(BoxRec));
+
+    for (int i = 0; i < n; i++) {
+        int w = 8 + bench_random() % 120, h = 8 + bench_random() % 80;
+
+        boxes[i].x1 = bench_random() % (REGION_WIDTH - w);
+        boxes[i].y1 = bench_random() % (REGION_HEIGHT - h);
+        boxes[i].x2 = boxes[i].x1 + w;
+        boxes[i].y2 = boxes[i].y1 + h;
+    }
+    RegionInitBoxes(pRegion, boxes, n);
+    free(boxes);
+}
+
+static void
+bench_op(const char *name, int n, RegionPtr a, RegionPtr b,
+         Bool (*op) (RegionPtr, RegionPtr, RegionPtr))
+{
+    RegionRec result;
+    uint64_t start;
+
+    RegionNull(&result);
+    start = bench_time_ns();
+    for (int i = 0; i < REGION_ROUNDS; i++)
+        op(&result, a, b);
+    bench_report("region", name, n, REGION_ROUNDS, bench_time_ns() - start);
+    RegionUninit(&result);
+}
+
+void
+region_bench(void)
+{
+    static const int counts[] = { 4, 64, 1024 };
+
+    for (int i = 0; i < ARRAY_SIZE(counts); i++) {
+        RegionRec a, b;
+
+        make_region(&a, counts[i]);
+        make_region(&b, counts[i]);
+
+        bench_op("union", counts[i], &a, &b, RegionUnion);
+        bench_op("intersect", counts[i], &a, &b, RegionIntersect);
+        bench_op("subtract", counts[i], &a, &b, RegionSubtract);
+
+        RegionUninit(&a);
+        RegionUninit(&b);
+    }
+}
@@ -0,0 +1,140 @@
+/*
+ * Per client resource table: AddResource, lookups and FreeResource with
+ * up to a million resources held by a single client.
+ */
+#include <dix-config.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "dix/resource_priv.h"
+#include "include/dix.h"
+#include "include/dixstruct.h"
+#include "include/resource.h"
+
+#include "bench.h"
+
+static ClientRec bench_server_client;
+static ClientRec bench_client;
+static RESTYPE bench_type;
+
+static int
+bench_delete(void *value, XID id)
+{
+    return Success;
+}
+
+static void
+setup_resources(void)
+{
+    serverClient = &bench_server_client;
+    InitClientResources(serverClient);
+    bench_type = CreateNewResourceType(bench_delete, "BenchResource");
+
+    bench_client.index = 1;
+    bench_client.clientAsMask = ((Mask) 1) << CLIENTOFFSET;
+    clients[1] = &bench_client;
+}
+
+static void
+bench_count(int n)
+{
+    XID base = bench_client.clientAsMask;
+    uint64_t start;
+    void *value;
+
+    InitClientResources(&bench_client);
+
+    start = bench_time_ns();
+    for (int i = 0; i < n; i++)
+        AddResource(base + i, bench_type, (void *) (intptr_t) (i + 1));
+    bench_report("resource", "add", n, n, bench_time_ns() - start);
+
+    start = bench_time_ns();
+    for (int i = 0; i < n; i++)
+        dixLookupResourceByType(&value, base + bench_random() % n, bench_type,
+                                NULL, DixReadAccess);
+    bench_report("resource", "lookup_type", n, n, bench_time_ns() - start);
+
+    start = bench_time_ns();
+    for (int i = 0; i < n; i++)
+        dixLookupResourceByClass(&value, base + bench_random() % n, RC_ANY,
+                                 NULL, DixReadAccess);
+    bench_report("resource", "lookup_class", n, n, bench_time_ns() - start);
+
+    start = bench_time_ns();
+    for (int i = 0; i < n; i++)
+        dixLookupResourceByType(&value, base + n + i, bench_type,
+                                NULL, DixReadAccess);
+    bench_report("resource", "lookup_miss", n, n, bench_time_ns() - start);
+
+    /* free in the order apps typically do, interleaved with new ones */
+    start = bench_time_ns();
+    for (int i = 0; i < n; i++) {
+        FreeResource(base + i, X11_RESTYPE_NONE);
+        if (i & 1)
+            AddResource(base + n + i, bench_type, NULL);
+    }
+    bench_report("resource", "free_churn", n, n, bench_time_ns() - start);
+
+    start = bench_time_ns();
+    FreeClientResources(&bench_client);
+    bench_report("resource", "free_client", n, n / 2, bench_time_ns() - start);
+}
+
+static int walk_adds, walk_failed;
+
+/* the first resource visited adds walk_adds more, like a callback might */
+static void
+add_while_walking(void *value, XID id, void *cdata)
+{
+    XID base = bench_client.clientAsMask + 64;
+
+    for (int i = 0; i < walk_adds; i++)
+        if (!AddResource(base + i, bench_type, (void *) (intptr_t) (i + 1)))
+            walk_failed++;
+    walk_adds = 0;
+}
+
+/* resources added during a walk get in, even if the table has to grow */
+static void
+bench_walk(int n)
+{
+    XID base = bench_client.clientAsMask;
+    int missing = 0;
+    uint64_t start;
+    void *value;
+
+    InitClientResources(&bench_client);
+    for (int i = 0; i < 64; i++)
+        AddResource(base + i, bench_type, NULL);
+
+    walk_adds = n;
+    walk_failed = 0;
+    start = bench_time_ns();
+    FindClientResourcesByType(&bench_client, bench_type, add_while_walking,
+                              NULL);
+    bench_report("resource", "add_walking", n, n, bench_time_ns() - start);
+
+    for (int i = 0; i < n; i++)
+        if (dixLookupResourceByType(&value, base + 64 + i, bench_type, NULL,
+                                    DixReadAccess) != Success)
+            missing++;
+    if (walk_failed || missing)
+        printf("# resource add_walking %d: %d adds failed, %d missing\n", n,
+               walk_failed, missing);
+
+    FreeClientResources(&bench_client);
+}
+
+void
+resource_bench(void)
+{
+    static const int counts[] = { 1000, 10000, 100000, 1000000 };
+
+    setup_resources();
+    for (int i = 0; i < ARRAY_SIZE(counts); i++)
+        bench_count(counts[i]);
+    for (int i = 0; i < ARRAY_SIZE(counts); i++)
+        bench_walk(counts[i]);
+}
@@ -0,0 +1,149 @@
+/*
+ * Smart scheduler client selection with N clients ready at once,
+ * ready queue vs. the former linear scan over all ready clients.
+ */
+#include <dix-config.h>
+
+#include <stdlib.h>
+
+#include "dix/dixstruct_priv.h"
+#include "dix/readyqueue_priv.h"
+#include "include/dix.h"
+
+#include "bench.h"
+
+#define SCHEDULE_ROUNDS 200000
+
+static int last_index[SMART_MAX_PRIORITY - SMART_MIN_PRIORITY + 1];
+
+static ClientPtr
+linear_select(ClientPtr *ready, int nready, long now, long idle)
+{
+    ClientPtr best = NULL;
+    int bestRobin = 0;
+
+    for (int i = 0; i < nready; i++) {
+        ClientPtr pClient = ready[i];
+        int robin;
+
+        if ((now - pClient->smart_stop_tick) >= idle) {
+            if (pClient->smart_priority < 0)
+                pClient->smart_priority++;
+        }
+
+        robin = (pClient->index -
+                 last_index[pClient->smart_priority - SMART_MIN_PRIORITY]) & 0xff;
+
+        if (!best ||
+            pClient->priority > best->priority ||
+            (pClient->priority == best->priority &&
+             (pClient->smart_priority > best->smart_priority ||
+              (pClient->smart_priority == best->smart_priority && robin > bestRobin))))
+        {
+            best = pClient;
+            bestRobin = robin;
+        }
+    }
+    return best;
+}
+
+static ClientPtr *
+setup_clients(int n)
+{
+    ClientPtr *ready = calloc(n, sizeof(ClientPtr));
+
+    for (int i = 0; i < n; i++) {
+        ClientPtr client = calloc(1, sizeof(ClientRec));
+
+        client->index = i + 1;
+        client->smart_priority = -(int) (bench_random() % 8);
+        client->smart_stop_tick = 0;
+        clients[client->index] = client;
+        ready[i] = client;
+    }
+
+    for (int i = 0; i < ARRAY_SIZE(last_index); i++)
+        last_index[i] = 0;
+
+    return ready;
+}
+
+static void
+teardown_clients(ClientPtr *ready, int n)
+{
+    for (int i = 0; i < n; i++) {
+        clients[ready[i]->index] = NULL;
+        free(ready[i]);
+    }
+    free(ready);
+}
+
+/* what Dispatch() does to the client after its time slice */
+static void
+client_ran(ClientPtr client, long now)
+{
+    last_index[client->smart_priority - SMART_MIN_PRIORITY] = client->index;
+    if ((bench_random() & 3) == 0 && client->smart_priority > SMART_MIN_PRIORITY)
+        client->smart_priority--;
+    client->smart_stop_tick = now;
+}
+
+static void
+bench_linear(int n)
+{
+    ClientPtr *ready = setup_clients(n);
+    uint64_t start = bench_time_ns();
+
+    for (long now = 1; now <= SCHEDULE_ROUNDS; now++) {
+        ClientPtr client = linear_select(ready, n, now, 10);
+
+        client_ran(client, now);
+    }
+
+    bench_report("schedule", "linear", n, SCHEDULE_ROUNDS,
+                 bench_time_ns() - start);
+    teardown_clients(ready, n);
+}
+
+static void
+bench_ready_queue(int n)
+{
+    ClientPtr *ready = setup_clients(n);
+    uint64_t start;
+
+    ready_queue_init();
+    for (int i = 0; i < n; i++)
+        ready_queue_add(ready[i]);
+
+    start = bench_time_ns();
+    for (long now = 1; now <= SCHEDULE_ROUNDS; now++) {
+        ClientPtr client = ready_queue_select(now, 10, last_index);
+
+        client_ran(client, now);
+        ready_queue_update(client);
+
+        /* clients drain their requests and come back */
+        if ((bench_random() & 7) == 0) {
+            ClientPtr other = ready[bench_random() % n];
+
+            ready_queue_remove(other);
+            ready_queue_add(other);
+        }
+    }
+
+    bench_report("schedule", "ready_queue", n, SCHEDULE_ROUNDS,
+                 bench_time_ns() - start);
+    ready_queue_init();
+    teardown_clients(ready, n);
+}
+
+void
+schedule_bench(void)
+{
+    static const int counts[] = { 1, 16, 64, 256, 1024, MAXCLIENTS - 1 };
+
+    for (int i = 0; i < ARRAY_SIZE(counts); i++) {
+        bench_linear(counts[i]);
+        bench_ready_queue(counts[i]);
+    }
+}
@@ -0,0 +1,251 @@
+/*
+ * ShadowFB updates of a 4K screen, as on virtual GPUs and BMC consoles:
+ * the whole screen and a scatter of small boxes copied from the shadow to
+ * a linear framebuffer, packed, converted to 24 bpp and rotated, and the
+ * double shadow compare of modesetting. Each kernel variant the CPU has
+ * vs. the former generic code, and the updates cut in bands across 1 to
+ * as many threads as there are CPUs.
+ */
+#include <dix-config.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "miext/shadow/shadow.h"
+#include "miext/shadow/shsimd.h"
+#include "miext/shadow/shthread.h"
+#include "include/os.h"
+#include "include/pixmapstr.h"
+#include "include/scrnintstr.h"
+
+#include "bench.h"
+
+#define SCREEN_WIDTH    3840
+#define SCREEN_HEIGHT   2160
+#define FB_ROWS         SCREEN_WIDTH    /* rotated by 90 or 270 */
+#define FB_STRIDE       (SCREEN_WIDTH * 4)
+#define SCATTER_BOXES   64
+#define UPDATE_PIXELS   (64 * 1024 * 1024)  /* per configuration */
+
+static ScreenRec bench_screen;
+static PixmapRec shadow_pixmap;
+static DamageRec bench_damage;
+static shadowBufRec bench_buf;
+static CARD32 *shadow_bits, *old_bits;
+static CARD8 *framebuffer;
+static Bool linear;
+
+/*
+ * The framebuffer, as one linear window or, to run the generic code, as a
+ * window per row with a gap after each, so they don't look linear.
+ */
+static void *
+bench_window(ScreenPtr pScreen, CARD32 row, CARD32 offset, int mode,
+             CARD32 *size, void *closure)
+{
+    if (linear) {
+        *size = FB_STRIDE;
+        return framebuffer + row * FB_STRIDE + offset;
+    }
+    *size = FB_STRIDE - offset;
+    return framebuffer + row * (FB_STRIDE + 64) + offset;
+}
+
+static void
+setup_shadow(void)
+{
+    size_t pixels = (size_t) SCREEN_WIDTH * SCREEN_HEIGHT;
+
+    shadow_bits = malloc(pixels * 4);
+    old_bits = malloc(pixels * 4);
+    framebuffer = calloc(FB_ROWS, FB_STRIDE + 64);
+    for (size_t i = 0; i < pixels; i++)
+        shadow_bits[i] = old_bits[i] = bench_random();
+
+    bench_screen.width = SCREEN_WIDTH;
+    bench_screen.height = SCREEN_HEIGHT;
+
+    shadow_pixmap.drawable.type = DRAWABLE_PIXMAP;
+    shadow_pixmap.drawable.pScreen = &bench_screen;
+    shadow_pixmap.drawable.width = SCREEN_WIDTH;
+    shadow_pixmap.drawable.height = SCREEN_HEIGHT;
+    shadow_pixmap.drawable.depth = 24;
+    shadow_pixmap.drawable.bitsPerPixel = 32;
+    shadow_pixmap.devKind = SCREEN_WIDTH * 4;
+    shadow_pixmap.devPrivate.ptr = shadow_bits;
+
+    bench_buf.pDamage = &bench_damage;
+    bench_buf.pPixmap = &shadow_pixmap;
+    bench_buf.window = bench_window;
+    RegionNull(&bench_damage.damage);
+}
+
+/* the whole screen, or boxes of up to 256x256 all over it */
+static long
+set_damage(int nbox)
+{
+    BoxRec boxes[SCATTER_BOXES];
+    RegionPtr region;
+    long pixels = 0;
+
+    if (nbox == 1) {
+        boxes[0] = (BoxRec) { 0, 0, SCREEN_WIDTH, SCREEN_HEIGHT };
+    }
+    else {
+        for (int i = 0; i < nbox; i++) {
+            boxes[i].x1 = bench_random() % (SCREEN_WIDTH - 256);
+            boxes[i].y1 = bench_random() % (SCREEN_HEIGHT - 256);
+            boxes[i].x2 = boxes[i].x1 + 1 + bench_random() % 256;
+            boxes[i].y2 = boxes[i].y1 + 1 + bench_random() % 256;
+        }
+    }
+
+    RegionEmpty(&bench_damage.damage);
+    for (int i = 0; i < nbox; i++) {
+        RegionRec box;
+
+        RegionInit(&box, &boxes[i], 1);
+        RegionUnion(&bench_damage.damage, &bench_damage.damage, &box);
+        RegionUninit(&box);
+    }
+
+    region = &bench_damage.damage;
+    for (int i = 0; i < RegionNumRects(region); i++) {
+        BoxPtr box = RegionRects(region) + i;
+
+        pixels += (long) (box->x2 - box->x1) * (box->y2 - box->y1);
+    }
+    return pixels;
+}
+
+static void
+run_update(const char *op, const char *variant, int nbox, long pixels,
+           ShadowUpdateProc update)
+{
+    char name[64];
+    int rounds = max(UPDATE_PIXELS / pixels, 1);
+    uint64_t start;
+
+    start = bench_time_ns();
+    for (int i = 0; i < rounds; i++)
+        (*update) (&bench_screen, &bench_buf);
+    snprintf(name, sizeof(name), "%s_%s", op, variant);
+    bench_report("shadow", name, nbox, (uint64_t) rounds * pixels,
+                 bench_time_ns() - start);
+}
+
+/*
+ * what msUpdatePacked() does with a double shadow, on the damage: a
+ * compare of every row, with one row in 16 changed
+ */
+static void
+compare_update(ScreenPtr pScreen, shadowBufPtr pBuf)
+{
+    RegionPtr damage = DamageRegion(pBuf->pDamage);
+    int nbox = RegionNumRects(damage);
+    BoxPtr pbox = RegionRects(damage);
+
+    for (; nbox--; pbox++) {
+        int width = (pbox->x2 - pbox->x1) * 4;
+
+        for (int y = pbox->y1; y < pbox->y2; y++) {
+            size_t offset = (size_t) y * SCREEN_WIDTH + pbox->x1;
+
+            if (!(y & 15))
+                old_bits[offset] ^= 1;
+            shadowCopyChanged(old_bits + offset, shadow_bits + offset, width);
+        }
+    }
+}
+
+static void
+bench_updates(int nbox)
+{
+    static const struct {
+        const char *op;
+        ShadowUpdateProc update;
+    } rotations[] = {
+        { "rotate90", shadowUpdateRotate32_90 },
+        { "rotate180", shadowUpdateRotate32_180 },
+        { "rotate270", shadowUpdateRotate32_270 },
+    };
+    long pixels = set_damage(nbox);
+
+    linear = TRUE;
+    run_update("packed", "memcpy", nbox, pixels, shadowUpdatePacked);
+
+    /* the same rotations, by the former code */
+    linear = FALSE;
+    for (int r = 0; r < ARRAY_SIZE(rotations); r++)
+        run_update(rotations[r].op, "generic", nbox, pixels,
+                   rotations[r].update);
+
+    linear = TRUE;
+    for (int v = 0; shadowKernelVariants[v]; v++) {
+        const char *variant = shadowKernelVariants[v]->name;
+
+        if (!shadowKernelsSupported(shadowKernelVariants[v])) {
+            printf("# %s: not supported by this CPU\n", variant);
+            continue;
+        }
+        shadowKernels = shadowKernelVariants[v];
+
+        run_update("32to24", variant, nbox, pixels, shadowUpdate32to24);
+        for (int r = 0; r < ARRAY_SIZE(rotations); r++)
+            run_update(rotations[r].op, variant, nbox, pixels,
+                       rotations[r].update);
+        run_update("compare", variant, nbox, pixels, compare_update);
+    }
+    shadowKernels = NULL;
+}
+
+/* full screen damage, with the best kernels */
+static void
+bench_threads(void)
+{
+    static const struct {
+        const char *name;
+        ShadowUpdateProc update;
+    } ops[] = {
+        { "packed_threads", shadowUpdatePacked },
+        { "32to24_threads", shadowUpdate32to24 },
+        { "rotate90_threads", shadowUpdateRotate32_90 },
+    };
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    long pixels = set_damage(1);
+    int rounds = max(UPDATE_PIXELS / pixels, 1);
+
+    linear = TRUE;
+    for (int o = 0; o < ARRAY_SIZE(ops); o++) {
+        bench_buf.update = ops[o].update;
+        for (int threads = 1; threads <= min(cpus, SHADOW_MAX_THREADS);
+             threads *= 2) {
+            uint64_t start = bench_time_ns();
+
+            for (int i = 0; i < rounds; i++)
+                shadowUpdateThreaded(&bench_screen, &bench_buf, threads);
+            bench_report("shadow", ops[o].name, threads,
+                         (uint64_t) rounds * pixels, bench_time_ns() - start);
+        }
+    }
+    printf("# threads: %ld CPUs\n", cpus);
+}
+
+void
+shadow_bench(void)
+{
+    setup_shadow();
+
+    bench_updates(1);
+    bench_updates(SCATTER_BOXES);
+    printf("# c: 32to24 and compare as before, rotations without the "
+           "window calls\n");
+    bench_threads();
+
+    RegionUninit(&bench_damage.damage);
+    free(framebuffer);
+    free(old_bits);
+    free(shadow_bits);
+}
@@ -0,0 +1,158 @@
+/*
+ * XSync alarms on an idle time counter: N alarms from idle daemons,
+ * screen lockers and the like, and the counter changing as the user
+ * goes idle and comes back. Trigger index vs. the former check of every
+ * trigger on each change.
+ */
+#include <dix-config.h>
+
+#include <stdlib.h>
+#include <X11/X.h>
+#include <X11/Xproto.h>
+#include <X11/extensions/syncproto.h>
+
+#include "dix/resource_priv.h"
+#include "miext/extinit_priv.h"
+#include "include/dix.h"
+#include "include/dixstruct.h"
+#include "include/extnsionst.h"
+#include "include/resource.h"
+#include "Xext/syncsrv.h"
+
+#include "bench.h"
+
+#define SYNC_ROUNDS     200000
+#define SYNC_STEP       50              /* ms between idle time updates */
+#define SYNC_MAX_IDLE   (15 * 60 * 1000)
+
+static ClientRec bench_server_client;
+static ClientRec bench_client;
+static int sync_major;
+
+static void
+bench_query_value(void *pCounter, int64_t *pValue_return)
+{
+    *pValue_return = ((SyncCounter *) pCounter)->value;
+}
+
+static void
+bench_bracket_values(void *pCounter, int64_t *pbracket_less,
+                     int64_t *pbracket_greater)
+{
+}
+
+static void
+setup_sync(void)
+{
+    serverClient = &bench_server_client;
+    InitClientResources(serverClient);
+    SyncExtensionInit();
+    sync_major = CheckExtension(SYNC_NAME)->base;
+
+    bench_client.index = 1;
+    bench_client.clientAsMask = ((Mask) 1) << CLIENTOFFSET;
+    clients[1] = &bench_client;
+}
+
+/* XSyncCreateAlarm() without events, as it comes from the client */
+static void
+create_alarm(XID id, SyncCounter *pCounter, int test_type, int64_t value)
+{
+    struct {
+        xSyncCreateAlarmReq req;
+        CARD32 values[7];
+    } request = {
+        .req = {
+            .reqType = sync_major,
+            .syncReqType = X_SyncCreateAlarm,
+            .length = bytes_to_int32(sizeof(request)),
+            .id = id,
+            .valueMask = XSyncCACounter | XSyncCAValue | XSyncCATestType |
+                         XSyncCADelta | XSyncCAEvents,
+        },
+        .values = {
+            pCounter->sync.id, value >> 32, value, test_type, 0, 0, xFalse
+        },
+    };
+
+    bench_client.requestBuffer = &request;
+    bench_client.req_len = request.req.length;
+    ProcVector[sync_major] (&bench_client);
+}
+
+/* what SyncChangeCounter() used to do: check every trigger */
+static void
+scan_triggers(SyncCounter *pCounter, int64_t newval)
+{
+    int64_t oldval = pCounter->value;
+
+    pCounter->value = newval;
+    for (SyncTriggerList *ptl = pCounter->sync.pTriglist; ptl; ptl = ptl->next)
+        (*ptl->pTrigger->CheckTrigger) (ptl->pTrigger, oldval);
+}
+
+static void
+bench_alarms(int n)
+{
+    SyncCounter *pCounter;
+    int64_t idle = 0, active = 0;
+    uint64_t start;
+
+    pCounter = SyncCreateSystemCounter("BENCH-IDLETIME", 0, 4,
+                                       XSyncCounterUnrestricted,
+                                       bench_query_value,
+                                       bench_bracket_values);
+    InitClientResources(&bench_client);
+
+    /*
+     * Idle timeouts between 1s and 10min, half of them with a second
+     * alarm for the user coming back.
+     */
+    start = bench_time_ns();
+    for (int i = 0; i < n; i++) {
+        int64_t timeout = 1000 + bench_random() % (10 * 60 * 1000);
+
+        if (i & 1)
+            create_alarm(bench_client.clientAsMask + i + 1, pCounter,
+                         XSyncNegativeTransition, timeout - 1);
+        else
+            create_alarm(bench_client.clientAsMask + i + 1, pCounter,
+                         XSyncPositiveTransition, timeout);
+    }
+    bench_report("sync", "create_alarm", n, n, bench_time_ns() - start);
+
+    start = bench_time_ns();
+    for (int i = 0; i < SYNC_ROUNDS; i++) {
+        idle = (idle >= active) ? 0 : idle + SYNC_STEP;
+        if (!idle)
+            active = bench_random() % SYNC_MAX_IDLE;
+        scan_triggers(pCounter, idle);
+    }
+    bench_report("sync", "scan", n, SYNC_ROUNDS, bench_time_ns() - start);
+
+    pCounter->value = 0;
+    idle = active = 0;
+    start = bench_time_ns();
+    for (int i = 0; i < SYNC_ROUNDS; i++) {
+        idle = (idle >= active) ? 0 : idle + SYNC_STEP;
+        if (!idle)
+            active = bench_random() % SYNC_MAX_IDLE;
+        SyncChangeCounter(pCounter, idle);
+    }
+    bench_report("sync", "change_counter", n, SYNC_ROUNDS,
+                 bench_time_ns() - start);
+
+    FreeClientResources(&bench_client);
+    SyncDestroySystemCounter(pCounter);
+}
+
+void
+sync_bench(void)
+{
+    static const int counts[] = { 16, 256, 1024, 4096 };
+
+    setup_sync();
+
+    for (int i = 0; i < ARRAY_SIZE(counts); i++)
+        bench_alarms(counts[i]);
+}
@@ -0,0 +1,136 @@
+/*
+ * OsTimer arm, rearm and cancel with N timers pending at once (idle,
+ * screen saver, DPMS, key repeat, per client timeouts...), timer wheel
+ * vs. the former sorted list.
+ */
+#include <dix-config.h>
+
+#include <stdlib.h>
+
+#include "include/dix.h"
+#include "include/list.h"
+#include "include/os.h"
+#include "os/osdep.h"
+
+#include "bench.h"
+
+#define TIMER_ROUNDS    200000
+#define TIMER_MAX_DELAY (10 * 60 * 1000)
+
+typedef struct {
+    struct xorg_list list;
+    CARD32 expires;
+} ListTimerRec;
+
+static struct xorg_list list_timers;
+
+/* what TimerSet() used to do: keep the list sorted by expiry */
+static void
+list_set(ListTimerRec *timer, CARD32 now, CARD32 millis)
+{
+    ListTimerRec *existing;
+
+    if (!xorg_list_is_empty(&timer->list))
+        xorg_list_del(&timer->list);
+
+    timer->expires = now + millis;
+    xorg_list_for_each_entry(existing, &list_timers, list) {
+        if ((int) (existing->expires - timer->expires) > 0)
+            break;
+    }
+    xorg_list_append(&timer->list, &existing->list);
+}
+
+static void
+list_cancel(ListTimerRec *timer)
+{
+    xorg_list_del(&timer->list);
+}
+
+static CARD32
+bench_timer_callback(OsTimerPtr timer, CARD32 now, void *arg)
+{
+    return 0;
+}
+
+static CARD32
+random_delay(void)
+{
+    /* mostly short timeouts, some long ones */
+    return (bench_random() & 3) ? 1000 + bench_random() % 10000 :
+                                  1000 + bench_random() % TIMER_MAX_DELAY;
+}
+
+static void
+bench_list(int n)
+{
+    ListTimerRec *timers = calloc(n, sizeof(ListTimerRec));
+    CARD32 now = GetTimeInMillis();
+    uint64_t start;
+
+    xorg_list_init(&list_timers);
+    for (int i = 0; i < n; i++)
+        xorg_list_init(&timers[i].list);
+
+    start = bench_time_ns();
+    for (int i = 0; i < n; i++)
+        list_set(&timers[i], now, random_delay());
+    bench_report("timer", "list_arm", n, n, bench_time_ns() - start);
+
+    start = bench_time_ns();
+    for (int i = 0; i < TIMER_ROUNDS; i++)
+        list_set(&timers[bench_random() % n], now, random_delay());
+    bench_report("timer", "list_rearm", n, TIMER_ROUNDS,
+                 bench_time_ns() - start);
+
+    start = bench_time_ns();
+    for (int i = 0; i < n; i++)
+        list_cancel(&timers[i]);
+    bench_report("timer", "list_cancel", n, n, bench_time_ns() - start);
+
+    free(timers);
+}
+
+static void
+bench_wheel(int n)
+{
+    OsTimerPtr *timers = calloc(n, sizeof(OsTimerPtr));
+    uint64_t start;
+
+    TimerInit();
+
+    start = bench_time_ns();
+    for (int i = 0; i < n; i++)
+        timers[i] = TimerSet(NULL, 0, random_delay(), bench_timer_callback,
+                             NULL);
+    bench_report("timer", "wheel_arm", n, n, bench_time_ns() - start);
+
+    start = bench_time_ns();
+    for (int i = 0; i < TIMER_ROUNDS; i++) {
+        int t = bench_random() % n;
+
+        TimerSet(timers[t], 0, random_delay(), bench_timer_callback, NULL);
+    }
+    bench_report("timer", "wheel_rearm", n, TIMER_ROUNDS,
+                 bench_time_ns() - start);
+
+    start = bench_time_ns();
+    for (int i = 0; i < n; i++)
+        TimerCancel(timers[i]);
+    bench_report("timer", "wheel_cancel", n, n, bench_time_ns() - start);
+
+    for (int i = 0; i < n; i++)
+        TimerFree(timers[i]);
+    free(timers);
+}
+
+void
+timer_bench(void)
+{
+    static const int counts[] = { 16, 256, 1024, 10000 };
+
+    for (int i = 0; i < ARRAY_SIZE(counts); i++) {
+        bench_list(counts[i]);
+        bench_wheel(counts[i]);
+    }
+}
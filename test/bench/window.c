@@ -0,0 +1,334 @@
+/*
+ * Clip list maintenance: raising a top level window and revalidating the
+ * tree with miValidateTree(), on deep window hierarchies (toolkit widget
+ * nesting) and on wide ones (lots of overlapping top levels). And pointer
+ * hit testing in a motion storm over many top levels, with the child
+ * index vs. the former sibling walk, also with a window being dragged.
+ */
+#include <dix-config.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "mi/mi_priv.h"
+#include "include/inputstr.h"
+#include "include/scrnintstr.h"
+#include "include/windowstr.h"
+
+#include "bench.h"
+
+#define WINDOW_RAISES   20000
+#define TRACE_MOTIONS   (1 << 18)
+#define DRAG_MOTIONS    4       /* per ConfigureWindow of the dragged one */
+#define SCREEN_WIDTH    1920
+#define SCREEN_HEIGHT   1080
+
+static ScreenRec bench_screen;
+static WindowRec bench_root;
+
+static void
+bench_window_exposures(WindowPtr pWin, RegionPtr prgn)
+{
+}
+
+static void
+bench_paint_window(WindowPtr pWin, RegionPtr region, int what)
+{
+}
+
+static void
+setup_screen(void)
+{
+    BoxRec box = { 0, 0, SCREEN_WIDTH, SCREEN_HEIGHT };
+
+    bench_screen.width = SCREEN_WIDTH;
+    bench_screen.height = SCREEN_HEIGHT;
+    bench_screen.MarkWindow = miMarkWindow;
+    bench_screen.WindowExposures = bench_window_exposures;
+    bench_screen.PaintWindow = bench_paint_window;
+    bench_screen.root = &bench_root;
+
+    bench_root.drawable.type = DRAWABLE_WINDOW;
+    bench_root.drawable.pScreen = &bench_screen;
+    bench_root.drawable.width = SCREEN_WIDTH;
+    bench_root.drawable.height = SCREEN_HEIGHT;
+    bench_root.optional = calloc(1, sizeof(WindowOptRec));
+    bench_root.mapped = bench_root.realized = bench_root.viewable = TRUE;
+    RegionInit(&bench_root.winSize, &box, 1);
+    RegionInit(&bench_root.borderSize, &box, 1);
+    RegionInit(&bench_root.clipList, &box, 1);
+    RegionInit(&bench_root.borderClip, &box, 1);
+}
+
+/* new mapped child, stacked below its existing siblings */
+static WindowPtr
+add_window(WindowPtr pParent, int x, int y, int w, int h)
+{
+    WindowPtr pWin = calloc(1, sizeof(WindowRec));
+
+    pWin->drawable.type = DRAWABLE_WINDOW;
+    pWin->drawable.pScreen = &bench_screen;
+    pWin->drawable.x = pParent->drawable.x + x;
+    pWin->drawable.y = pParent->drawable.y + y;
+    pWin->drawable.width = w;
+    pWin->drawable.height = h;
+    pWin->origin.x = x;
+    pWin->origin.y = y;
+    pWin->parent = pParent;
+    pWin->borderIsPixel = TRUE;
+    pWin->visibility = VisibilityNotViewable;
+    pWin->mapped = pWin->realized = pWin->viewable = TRUE;
+    RegionNull(&pWin->clipList);
+    RegionNull(&pWin->borderClip);
+    SetWinSize(pWin);
+    SetBorderSize(pWin);
+
+    pWin->prevSib = pParent->lastChild;
+    if (pParent->lastChild)
+        pParent->lastChild->nextSib = pWin;
+    else
+        pParent->firstChild = pWin;
+    pParent->lastChild = pWin;
+    if (!pParent->optional)
+        pParent->optional = calloc(1, sizeof(WindowOptRec));
+    pParent->optional->childCount++;
+
+    return pWin;
+}
+
+static void
+free_children(WindowPtr pParent)
+{
+    WindowPtr pWin, pNext;
+
+    for (pWin = pParent->firstChild; pWin; pWin = pNext) {
+        pNext = pWin->nextSib;
+        free_children(pWin);
+        RegionUninit(&pWin->winSize);
+        RegionUninit(&pWin->borderSize);
+        RegionUninit(&pWin->clipList);
+        RegionUninit(&pWin->borderClip);
+        miChildIndexFree(pWin);
+        free(pWin->optional);
+        free(pWin);
+    }
+    pParent->firstChild = pParent->lastChild = NULL;
+    miChildIndexFree(pParent);
+    if (pParent->optional)
+        pParent->optional->childCount = 0;
+}
+
+static void
+mark_tree(WindowPtr pWin)
+{
+    miMarkWindow(pWin);
+    for (WindowPtr pChild = pWin->firstChild; pChild; pChild = pChild->nextSib)
+        mark_tree(pChild);
+}
+
+static void
+validate_all(void)
+{
+    /* start over from a bare root, as after the previous tree was unmapped */
+    RegionCopy(&bench_root.clipList, &bench_root.winSize);
+    mark_tree(&bench_root);
+    miValidateTree(&bench_root, NULL, VTOther);
+    miHandleValidateExposures(&bench_root);
+}
+
+/* what ReflectStackChange() does for XRaiseWindow() on a top level */
+static void
+raise_window(WindowPtr pWin)
+{
+    WindowPtr pParent = pWin->parent;
+
+    if (pParent->firstChild == pWin)
+        return;
+
+    pWin->prevSib->nextSib = pWin->nextSib;
+    if (pWin->nextSib)
+        pWin->nextSib->prevSib = pWin->prevSib;
+    else
+        pParent->lastChild = pWin->prevSib;
+    pWin->prevSib = NULL;
+    pWin->nextSib = pParent->firstChild;
+    pParent->firstChild->prevSib = pWin;
+    pParent->firstChild = pWin;
+
+    if (miMarkOverlappedWindows(pWin, pWin, NULL)) {
+        miValidateTree(pParent, pWin, VTStack);
+        miHandleValidateExposures(pParent);
+    }
+}
+
+static void
+bench_raises(const char *name, long param, WindowPtr *toplevels, int n)
+{
+    uint64_t start;
+
+    validate_all();
+
+    start = bench_time_ns();
+    for (int i = 0; i < WINDOW_RAISES; i++)
+        raise_window(toplevels[bench_random() % n]);
+    bench_report("window", name, param, WINDOW_RAISES, bench_time_ns() - start);
+
+    free_children(&bench_root);
+}
+
+/*
+ * 8 cascaded top levels, each nesting `depth` levels of containers with
+ * a leaf widget next to every container.
+ */
+static void
+bench_deep(int depth)
+{
+    WindowPtr toplevels[8];
+
+    for (int i = 0; i < ARRAY_SIZE(toplevels); i++) {
+        WindowPtr pWin = add_window(&bench_root, 40 + i * 60, 30 + i * 40,
+                                    800, 600);
+
+        toplevels[i] = pWin;
+        for (int d = 0; d < depth; d++) {
+            int w = pWin->drawable.width, h = pWin->drawable.height;
+
+            add_window(pWin, w / 2, 0, w / 2, 20);
+            pWin = add_window(pWin, 2, 20, max(w / 2 + w / 4, 4),
+                              max(h - 22, 4));
+        }
+    }
+
+    bench_raises("raise_deep", depth, toplevels, ARRAY_SIZE(toplevels));
+}
+
+/* n top levels of random size and position, no children */
+static void
+bench_wide(int n)
+{
+    WindowPtr *toplevels = calloc(n, sizeof(WindowPtr));
+
+    for (int i = 0; i < n; i++) {
+        int w = 100 + bench_random() % 400, h = 80 + bench_random() % 300;
+
+        toplevels[i] = add_window(&bench_root,
+                                  bench_random() % (SCREEN_WIDTH - w),
+                                  bench_random() % (SCREEN_HEIGHT - h), w, h);
+    }
+
+    bench_raises("raise_wide", n, toplevels, n);
+    free(toplevels);
+}
+
+/* what miSpriteTrace() did: the first sibling that has the point, down */
+static WindowPtr
+walk_trace(int x, int y)
+{
+    WindowPtr pDeepest = &bench_root, pWin = bench_root.firstChild;
+
+    while (pWin) {
+        if (pWin->mapped &&
+            x >= pWin->drawable.x &&
+            x < pWin->drawable.x + pWin->drawable.width &&
+            y >= pWin->drawable.y &&
+            y < pWin->drawable.y + pWin->drawable.height) {
+            pDeepest = pWin;
+            pWin = pWin->firstChild;
+        }
+        else
+            pWin = pWin->nextSib;
+    }
+    return pDeepest;
+}
+
+/*
+ * n frames of random size and position, each with a client window and a
+ * few widgets in it, and a 1000 Hz mouse wandering across them
+ */
+static void
+bench_trace(int n)
+{
+    SpriteRec sprite = { 0 };
+    int *xs = malloc(TRACE_MOTIONS * sizeof(int));
+    int *ys = malloc(TRACE_MOTIONS * sizeof(int));
+    WindowPtr *found = malloc(TRACE_MOTIONS * sizeof(WindowPtr));
+    WindowPtr dragged;
+    int x = SCREEN_WIDTH / 2, y = SCREEN_HEIGHT / 2, wrong = 0;
+    uint64_t start;
+
+    for (int i = 0; i < n; i++) {
+        int w = 100 + bench_random() % 400, h = 80 + bench_random() % 300;
+        WindowPtr frame, client;
+
+        frame = add_window(&bench_root, bench_random() % (SCREEN_WIDTH - w),
+                           bench_random() % (SCREEN_HEIGHT - h), w, h);
+        client = add_window(frame, 4, 24, w - 8, h - 28);
+        for (int j = 0; j < 4; j++)
+            add_window(client, 0, j * (h - 28) / 4, w - 8, (h - 28) / 4);
+    }
+    dragged = bench_root.firstChild;
+
+    for (int i = 0; i < TRACE_MOTIONS; i++) {
+        x = min(max(x + (int) (bench_random() % 17) - 8, 0), SCREEN_WIDTH - 1);
+        y = min(max(y + (int) (bench_random() % 17) - 8, 0), SCREEN_HEIGHT - 1);
+        xs[i] = x;
+        ys[i] = y;
+    }
+
+    sprite.spriteTraceSize = 10;
+    sprite.spriteTrace = calloc(sprite.spriteTraceSize, sizeof(WindowPtr));
+    sprite.spriteTrace[0] = &bench_root;
+
+    start = bench_time_ns();
+    for (int i = 0; i < TRACE_MOTIONS; i++)
+        found[i] = walk_trace(xs[i], ys[i]);
+    bench_report("window", "trace_walk", n, TRACE_MOTIONS,
+                 bench_time_ns() - start);
+
+    start = bench_time_ns();
+    for (int i = 0; i < TRACE_MOTIONS; i++) {
+        sprite.spriteTraceGood = 1;
+        if (miSpriteTrace(&sprite, xs[i], ys[i]) != found[i])
+            wrong++;
+    }
+    bench_report("window", "trace_index", n, TRACE_MOTIONS,
+                 bench_time_ns() - start);
+
+    /* what ConfigureWindow() does to the index for each step of a drag */
+    start = bench_time_ns();
+    for (int i = 0; i < TRACE_MOTIONS; i++) {
+        if (i % DRAG_MOTIONS == 0)
+            miChildIndexInvalidate(dragged->parent);
+        sprite.spriteTraceGood = 1;
+        miSpriteTrace(&sprite, xs[i], ys[i]);
+    }
+    bench_report("window", "trace_index_drag", n, TRACE_MOTIONS,
+                 bench_time_ns() - start);
+
+    if (wrong)
+        printf("# trace: index and walk disagree %d times\n", wrong);
+
+    free(sprite.spriteTrace);
+    free(found);
+    free(ys);
+    free(xs);
+    free_children(&bench_root);
+}
+
+void
+window_bench(void)
+{
+    static const int depths[] = { 4, 16, 64 };
+    static const int counts[] = { 16, 256, 1024 };
+
+    setup_screen();
+
+    for (int i = 0; i < ARRAY_SIZE(depths); i++)
+        bench_deep(depths[i]);
+    for (int i = 0; i < ARRAY_SIZE(counts); i++)
+        bench_wide(counts[i]);
+    for (int i = 0; i < ARRAY_SIZE(counts); i++)
+        bench_trace(counts[i]);
+    printf("# trace_index_drag: a ConfigureWindow() every %d motions\n",
+           DRAG_MOTIONS);
+}
@@ -0,0 +1,71 @@
+/* SPDX-License-Identifier: MIT OR X11
+ *
+ * @brief redirecting windows wider than a pixmap can be
+ *
+ * A window wider than 32767 pixels has no backing pixmap. Redirecting,
+ * mapping and drawing on it must fail cleanly rather than handing out
+ * a smaller pixmap with the header of a bigger one.
+ */
+
+/* Test relies on assert() */
+#undef NDEBUG
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <xcb/composite.h>
+
+#define WIDE    40000
+#define HIGH    64
+
+static void
+test_redirect(xcb_connection_t *c, xcb_screen_t *screen, uint8_t update)
+{
+    xcb_window_t win = xcb_generate_id(c);
+    xcb_gcontext_t gc = xcb_generate_id(c);
+    xcb_rectangle_t rect = { 0, 0, WIDE, HIGH };
+    xcb_get_input_focus_reply_t *reply;
+
+    xcb_create_window(c, XCB_COPY_FROM_PARENT, win, screen->root,
+                      0, 0, WIDE, HIGH, 0, XCB_WINDOW_CLASS_INPUT_OUTPUT,
+                      screen->root_visual, 0, NULL);
+    xcb_composite_redirect_window(c, win, update);
+    xcb_map_window(c, win);
+    xcb_create_gc(c, gc, win, XCB_GC_FOREGROUND, &screen->white_pixel);
+    xcb_poly_fill_rectangle(c, win, gc, 1, &rect);
+    xcb_free_gc(c, gc);
+    xcb_destroy_window(c, win);
+
+    /* the server is still there */
+    reply = xcb_get_input_focus_reply(c, xcb_get_input_focus(c), NULL);
+    assert(reply);
+    free(reply);
+    assert(!xcb_connection_has_error(c));
+}
+
+int
+main(int argc, char **argv)
+{
+    xcb_connection_t *c = xcb_connect(NULL, NULL);
+    const xcb_query_extension_reply_t *ext;
+    xcb_composite_query_version_reply_t *version;
+    xcb_screen_t *screen;
+
+    assert(!xcb_connection_has_error(c));
+    ext = xcb_get_extension_data(c, &xcb_composite_id);
+    if (!ext->present) {
+        printf("No Composite present\n");
+        exit(77);
+    }
+    version = xcb_composite_query_version_reply(c,
+        xcb_composite_query_version(c, 0, 4), NULL);
+    free(version);
+
+    screen = xcb_setup_roots_iterator(xcb_get_setup(c)).data;
+
+    test_redirect(c, screen, XCB_COMPOSITE_REDIRECT_MANUAL);
+    test_redirect(c, screen, XCB_COMPOSITE_REDIRECT_AUTOMATIC);
+
+    xcb_disconnect(c);
+    return 0;
+}
@@ -0,0 +1,386 @@
+/* SPDX-License-Identifier: MIT OR X11
+ *
+ * Event delivery: with enough selecting clients, a window keeps the
+ * clients that want an event, per event kind and device. After random
+ * core, XI1 and XI2 selections, changes and clients going away, every
+ * event must reach the same clients, in the same order, as with the old
+ * walk over all clients on the window.
+ */
+
+/* Test relies on assert() */
+#undef NDEBUG
+
+#include <dix-config.h>
+
+#include <stdlib.h>
+#include <X11/X.h>
+#include <X11/extensions/XI2.h>
+#include <X11/extensions/XI2proto.h>
+
+#include "dix/dix_priv.h"
+#include "dix/exevents_priv.h"
+#include "dix/extension_priv.h"
+#include "dix/input_priv.h"
+#include "dix/resource_priv.h"
+
+#include "dixstruct.h"
+#include "inputstr.h"
+#include "windowstr.h"
+#include "tests-common.h"
+
+#define FIRST_CLIENT    100
+#define CLIENTS         24
+#define ROUNDS          3000
+#define LOG_SIZE        (4 * CLIENTS)
+
+/* events.c says CantBeFiltered: for the owner only */
+#define OWNER_ONLY      NoEventMask
+
+/* an XI1 event type no real one collides with, it only takes the filter */
+#define XI1_EVENT       (EXTENSION_EVENT_BASE | 0x3f)
+
+DECLARE_WRAP_FUNCTION(WriteToClient, void, ClientPtr client, int len, void *data);
+DECLARE_WRAP_FUNCTION(AddResource, Bool, XID id, RESTYPE type, void *value);
+
+static ClientRec test_clients[CLIENTS];
+static DeviceIntRec master, keyboard, slave, all_devices, all_master_devices;
+static SpriteInfoRec master_info, keyboard_info;
+static ValuatorClassRec master_valuator, slave_valuator;
+static DeviceIntPtr saved_all_devices, saved_all_master_devices;
+static WindowRec win;
+
+/* clients written to, in order */
+static int written[LOG_SIZE];
+static int nwritten;
+
+static void
+record_write(ClientPtr client, int len, void *data)
+{
+    assert(nwritten < LOG_SIZE);
+    written[nwritten++] = client->index;
+}
+
+/* nothing ever looks the selections up by id */
+static Bool
+add_resource(XID id, RESTYPE type, void *value)
+{
+    return TRUE;
+}
+
+static void
+setup(void)
+{
+    master.id = 2;
+    master.type = MASTER_POINTER;
+    master.spriteInfo = &master_info;
+    master.valuator = &master_valuator;
+    master_info.spriteOwner = TRUE;
+    master_info.paired = &keyboard;
+    /* no key class, so XKB leaves the events alone */
+    keyboard.id = 3;
+    keyboard.type = MASTER_KEYBOARD;
+    keyboard.spriteInfo = &keyboard_info;
+    keyboard_info.paired = &master;
+    /* far enough from the master to share its sets in the cache */
+    slave.id = 10;
+    slave.type = SLAVE;
+    slave.valuator = &slave_valuator;
+    all_devices.id = XIAllDevices;
+    all_master_devices.id = XIAllMasterDevices;
+    saved_all_devices = inputInfo.all_devices;
+    saved_all_master_devices = inputInfo.all_master_devices;
+    inputInfo.all_devices = &all_devices;
+    inputInfo.all_master_devices = &all_master_devices;
+
+    for (int i = 0; i < CLIENTS; i++) {
+        ClientPtr client = &test_clients[i];
+
+        client->index = FIRST_CLIENT + i;
+        client->clientAsMask = (XID) client->index << CLIENTOFFSET;
+        client->clientPtr = &master;
+        assert(InitClientResources(client));
+        clients[client->index] = client;
+    }
+
+    /* a root window, owned by the first client */
+    win.drawable.type = DRAWABLE_WINDOW;
+    win.drawable.id = test_clients[0].clientAsMask | 1;
+    win.optional = calloc(1, sizeof(WindowOptRec));
+    assert(win.optional);
+
+    wrapped_WriteToClient = record_write;
+    wrapped_AddResource = add_resource;
+}
+
+static void
+teardown(void)
+{
+    OtherClientsPtr other;
+    OtherInputMasks *inputMasks;
+
+    while ((other = wOtherClients(&win)))
+        OtherClientGone(&win, other->resource);
+    while ((inputMasks = wOtherInputMasks(&win)) && inputMasks->inputClients)
+        InputClientGone(&win, inputMasks->inputClients->resource);
+    DeliveryCacheFree(&win);
+    free(win.optional);
+    memset(&win, 0, sizeof(win));
+
+    for (int i = 0; i < CLIENTS; i++) {
+        FreeClientResources(&test_clients[i]);
+        clients[FIRST_CLIENT + i] = NULL;
+    }
+
+    inputInfo.all_devices = saved_all_devices;
+    inputInfo.all_master_devices = saved_all_master_devices;
+    wrapped_WriteToClient = NULL;
+    wrapped_AddResource = NULL;
+}
+
+static Bool
+is_core(xEvent *ev)
+{
+    return !(ev->u.u.type & EXTENSION_EVENT_BASE) &&
+        ev->u.u.type != GenericEvent;
+}
+
+/* DeliverEventsToWindow() as it was, there being no grabs and no hooks:
+ * the owner for core events, then each client on the list, with its own
+ * mask */
+static void
+walk_deliver(DeviceIntPtr dev, xEvent *ev, Mask filter)
+{
+    OtherInputMasks *inputMasks = wOtherInputMasks(&win);
+    InputClients *iclients;
+
+    if (is_core(ev) || filter == OWNER_ONLY) {
+        if (filter != OWNER_ONLY &&
+            !((wOtherEventMasks(&win) | win.eventMask) & filter))
+            return;
+        TryClientEvents(dixClientForWindow(&win), dev, ev, 1, win.eventMask,
+                        filter, NullGrab);
+        if (filter == OWNER_ONLY)
+            return;
+    }
+
+    if (is_core(ev))
+        iclients = (InputClients *) wOtherClients(&win);
+    else if (ev->u.u.type == GenericEvent) {
+        if (!WindowXI2MaskIsset(dev, &win, ev))
+            return;
+        iclients = inputMasks->inputClients;
+    }
+    else {
+        if (!inputMasks || !(inputMasks->inputEvents[dev->id] & filter))
+            return;
+        iclients = inputMasks->inputClients;
+    }
+
+    for (; iclients; iclients = iclients->next)
+        TryClientEvents(dixClientForInputClients(iclients), dev, ev, 1,
+                        GetEventMask(dev, ev, iclients), filter, NullGrab);
+}
+
+static void
+check_event(DeviceIntPtr dev, xEvent *ev, Mask filter)
+{
+    int expected[LOG_SIZE], nexpected, rc;
+
+    nwritten = 0;
+    master_valuator.motionHintWindow = slave_valuator.motionHintWindow = NULL;
+    walk_deliver(dev, ev, filter);
+    memcpy(expected, written, nwritten * sizeof(int));
+    nexpected = nwritten;
+
+    nwritten = 0;
+    master_valuator.motionHintWindow = slave_valuator.motionHintWindow = NULL;
+    rc = DeliverEventsToWindow(dev, &win, ev, 1, filter, NullGrab);
+
+    assert(nwritten == nexpected);
+    assert(memcmp(written, expected, nwritten * sizeof(int)) == 0);
+    assert((rc > 0) == (nwritten > 0));
+}
+
+/* none of these activates a grab or takes a single client only */
+static const struct {
+    int type;
+    Mask filter;
+} core_events[] = {
+    { KeyPress, KeyPressMask },
+    { KeyRelease, KeyReleaseMask },
+    { ButtonRelease, ButtonReleaseMask },
+    { MotionNotify, PointerMotionMask },
+    { EnterNotify, EnterWindowMask },
+    { FocusIn, FocusChangeMask },
+    { PropertyNotify, PropertyChangeMask },
+    { ClientMessage, OWNER_ONLY },
+};
+
+static const int xi2_events[] = {
+    XI_KeyPress, XI_KeyRelease, XI_ButtonRelease, XI_Motion, XI_Enter,
+    XI_FocusIn, XI_RawKeyPress, XI_RawMotion, XI_TouchBegin, XI_TouchUpdate,
+};
+
+static Mask
+random_core_mask(void)
+{
+    static const Mask masks[] = {
+        KeyPressMask, KeyReleaseMask, ButtonReleaseMask, PointerMotionMask,
+        EnterWindowMask, FocusChangeMask, PropertyChangeMask,
+        StructureNotifyMask,
+    };
+    Mask mask = 0;
+
+    for (int i = 0; i < ARRAY_SIZE(masks); i++)
+        if (rand() % 3 == 0)
+            mask |= masks[i];
+    return mask;
+}
+
+static void
+select_core(ClientPtr client)
+{
+    Mask mask = random_core_mask();
+
+    /* deselecting goes through the resource, do what it does */
+    if (!mask && client != dixClientForWindow(&win)) {
+        for (OtherClientsPtr other = wOtherClients(&win); other;
+             other = other->next)
+            if (SameClient(other, client)) {
+                OtherClientGone(&win, other->resource);
+                break;
+            }
+        return;
+    }
+    assert(EventSelectForWindow(&win, client, mask) == Success);
+}
+
+static DeviceIntPtr
+random_device(void)
+{
+    switch (rand() % 4) {
+    case 0:
+        return &master;
+    case 1:
+        return &slave;
+    case 2:
+        return &all_devices;
+    default:
+        return &all_master_devices;
+    }
+}
+
+static void
+select_xi1(ClientPtr client)
+{
+    DeviceIntPtr dev = rand() % 2 ? &master : &slave;
+    Mask mask = 0;
+
+    for (int i = 0; i < 8; i++)
+        if (rand() % 3 == 0)
+            mask |= 1 << (rand() % 20);
+    assert(SelectForWindow(dev, &win, client, mask, 0) == Success);
+}
+
+static void
+select_xi2(ClientPtr client)
+{
+    unsigned char mask[XIMaskLen(XI_LASTEVENT)] = { 0 };
+    int len = rand() % 5 ? sizeof(mask) : 0;
+
+    for (int i = 0; i < ARRAY_SIZE(xi2_events); i++)
+        if (rand() % 3 == 0)
+            SetBit(mask, xi2_events[i]);
+    assert(XISetEventMask(random_device(), &win, client, len, mask) ==
+           Success);
+}
+
+static void
+input_client_gone(ClientPtr client)
+{
+    OtherInputMasks *inputMasks = wOtherInputMasks(&win);
+
+    if (!inputMasks)
+        return;
+    for (InputClientsPtr other = inputMasks->inputClients; other;
+         other = other->next)
+        if (SameClient(other, client)) {
+            InputClientGone(&win, other->resource);
+            return;
+        }
+}
+
+static void
+send_events(void)
+{
+    xEvent ev;
+
+    for (int i = 0; i < ARRAY_SIZE(core_events); i++) {
+        memset(&ev, 0, sizeof(ev));
+        ev.u.u.type = core_events[i].type;
+        ev.u.keyButtonPointer.event = win.drawable.id;
+        check_event(&master, &ev, core_events[i].filter);
+    }
+
+    for (int i = 0; i < 4; i++) {
+        memset(&ev, 0, sizeof(ev));
+        ev.u.u.type = XI1_EVENT;
+        check_event(i % 2 ? &master : &slave, &ev, 1 << (rand() % 20));
+    }
+
+    for (int i = 0; i < ARRAY_SIZE(xi2_events); i++) {
+        xGenericEvent *gev = (xGenericEvent *) &ev;
+        DeviceIntPtr dev = i % 2 ? &master : &slave;
+
+        memset(&ev, 0, sizeof(ev));
+        gev->type = GenericEvent;
+        gev->extension = EXTENSION_MAJOR_XINPUT;
+        gev->evtype = xi2_events[i];
+        check_event(dev, &ev, GetEventFilter(dev, &ev));
+    }
+}
+
+static void
+delivery_random(void)
+{
+    srand(24);
+    setup();
+
+    for (int round = 0; round < ROUNDS; round++) {
+        /* for a while, only a few clients change their selections */
+        int n = round % 500 < 100 ? 4 : CLIENTS;
+        ClientPtr client = &test_clients[rand() % n];
+
+        switch (rand() % 5) {
+        case 0:
+            select_core(client);
+            break;
+        case 1:
+            select_xi1(client);
+            break;
+        case 2:
+            select_xi2(client);
+            break;
+        case 3:
+            if (rand() % 4 == 0)
+                input_client_gone(client);
+            break;
+        default:
+            /* the same events again, as the cache expects */
+            break;
+        }
+        send_events();
+    }
+
+    teardown();
+}
+
+const testfunc_t*
+delivery_test(void)
+{
+    static const testfunc_t testfuncs[] = {
+        delivery_random,
+        NULL,
+    };
+    return testfuncs;
+}
@@ -0,0 +1,418 @@
+/* SPDX-License-Identifier: MIT OR X11
+ *
+ * Passive grabs: with enough of them on a window, a key or button press
+ * only looks at the grabs of its detail and of any key or button. After
+ * random core and XI2 grabs, with and without AnyKey and AnyModifier,
+ * ungrabs cutting holes into them and grabs going away, every press must
+ * find the same grabs, in the same order, as the old walk over the list.
+ */
+
+/* Test relies on assert() */
+#undef NDEBUG
+
+#include <dix-config.h>
+
+#include <stdlib.h>
+#include <string.h>
+#include <X11/X.h>
+#include <X11/extensions/XI2.h>
+
+#include "dix/dix_priv.h"
+#include "dix/dixgrabs_priv.h"
+#include "dix/eventconvert.h"
+#include "dix/exevents_priv.h"
+#include "dix/inpututils_priv.h"
+#include "dix/resource_priv.h"
+#include "xkb/xkbsrv_priv.h"
+
+#include "dixstruct.h"
+#include "eventstr.h"
+#include "inputstr.h"
+#include "windowstr.h"
+#include "tests-common.h"
+
+#define FIRST_CLIENT    100
+#define CLIENTS         3
+#define ROUNDS          3000
+#define MAX_GRABS       120
+#define MIN_KEYCODE     8
+
+static ClientRec server_client, test_clients[CLIENTS];
+static ClientPtr saved_server_client;
+static DeviceIntRec kbd_dev, all_devices, all_master_devices;
+static DeviceIntPtr saved_devices, saved_all_devices, saved_all_master_devices;
+static KeyClassRec kbd_key;
+static XkbSrvInfoRec kbd_xkbi;
+static XI2Mask *xi2mask;
+static WindowRec root;
+
+static void
+setup(void)
+{
+    saved_server_client = serverClient;
+    serverClient = &server_client;
+    assert(InitClientResources(serverClient));
+
+    for (int i = 0; i < CLIENTS; i++) {
+        ClientPtr client = &test_clients[i];
+
+        client->index = FIRST_CLIENT + i;
+        client->clientAsMask = (XID) client->index << CLIENTOFFSET;
+        assert(InitClientResources(client));
+        clients[client->index] = client;
+    }
+
+    kbd_dev.id = 3;
+    kbd_dev.type = MASTER_KEYBOARD;
+    kbd_dev.key = &kbd_key;
+    kbd_key.xkbInfo = &kbd_xkbi;
+    all_devices.id = XIAllDevices;
+    all_master_devices.id = XIAllMasterDevices;
+    saved_devices = inputInfo.devices;
+    saved_all_devices = inputInfo.all_devices;
+    saved_all_master_devices = inputInfo.all_master_devices;
+    inputInfo.devices = &kbd_dev;
+    inputInfo.all_devices = &all_devices;
+    inputInfo.all_master_devices = &all_master_devices;
+
+    xi2mask = xi2mask_new();
+    assert(xi2mask);
+    xi2mask_set(xi2mask, XIAllDevices, XI_KeyPress);
+
+    root.drawable.type = DRAWABLE_WINDOW;
+    root.optional = calloc(1, sizeof(WindowOptRec));
+    assert(root.optional);
+}
+
+static void
+teardown(void)
+{
+    /* the grabs go with their clients */
+    for (int i = 0; i < CLIENTS; i++) {
+        FreeClientResources(&test_clients[i]);
+        clients[FIRST_CLIENT + i] = NULL;
+    }
+    assert(!wPassiveGrabs(&root));
+    assert(wPassiveGrabCount(&root) == 0);
+    PassiveGrabIndexFree(&root);
+    free(root.optional);
+    memset(&root, 0, sizeof(root));
+
+    xi2mask_free(&xi2mask);
+    inputInfo.devices = saved_devices;
+    inputInfo.all_devices = saved_all_devices;
+    inputInfo.all_master_devices = saved_all_master_devices;
+    FreeClientResources(serverClient);
+    serverClient = saved_server_client;
+}
+
+static GrabPtr
+create_grab(ClientPtr client, enum InputLevel grabtype, DeviceIntPtr dev,
+            Bool button, unsigned int detail, unsigned int modifiers)
+{
+    GrabMask mask = {
+        .core = button ? ButtonPressMask : KeyPressMask,
+    };
+    GrabParameters param = {
+        .grabtype = grabtype,
+        .this_device_mode = GrabModeAsync,
+        .other_devices_mode = GrabModeAsync,
+        .modifiers = modifiers,
+    };
+    int type;
+    GrabPtr grab;
+
+    if (grabtype == XI2) {
+        mask.xi2mask = xi2mask;
+        type = button ? XI_ButtonPress : XI_KeyPress;
+    }
+    else
+        type = button ? ButtonPress : KeyPress;
+
+    grab = CreateGrab(client, dev, &kbd_dev, &root, grabtype, &mask, &param,
+                      type, detail, NULL, NULL);
+    assert(grab);
+    /* XI2 buttons go past what a KeyCode holds */
+    grab->detail.exact = detail;
+    return grab;
+}
+
+static GrabPtr
+add_grab(ClientPtr client, enum InputLevel grabtype, DeviceIntPtr dev,
+         Bool button, unsigned int detail, unsigned int modifiers)
+{
+    GrabPtr grab = create_grab(client, grabtype, dev, button, detail,
+                               modifiers);
+    int rc = AddPassiveGrabToList(client, grab);
+
+    /* another client's grab may be in the way */
+    assert(rc == Success || rc == BadAccess);
+    return rc == Success ? grab : NULL;
+}
+
+static void
+ungrab(ClientPtr client, enum InputLevel grabtype, DeviceIntPtr dev,
+       Bool button, unsigned int detail, unsigned int modifiers)
+{
+    GrabPtr grab = create_grab(client, grabtype, dev, button, detail,
+                               modifiers);
+
+    assert(DeletePassiveGrabFromList(grab));
+    FreeGrab(grab);
+}
+
+/* the grabs on the list matching a press, at any level, in list order */
+static int
+walk_matches(WindowPtr pWin, Bool button, unsigned int detail,
+             GrabPtr *matches, Bool indexed)
+{
+    static const enum InputLevel levels[] = { XI2, XI, CORE };
+    int evtype = button ? ET_ButtonPress : ET_KeyPress;
+    GrabRec tmp = {
+        .window = pWin,
+        .device = &kbd_dev,
+        .detail.exact = detail,
+        .modifiersDetail.exact = kbd_xkbi.state.grab_mods,
+    };
+    PassiveGrabIter iter;
+    GrabPtr grab;
+    int n = 0, pos = -1;
+
+    if (indexed)
+        PassiveGrabsFirst(pWin, detail, &iter);
+    else
+        iter = (PassiveGrabIter) { .next = wPassiveGrabs(pWin) };
+
+    while ((grab = PassiveGrabsNext(&iter))) {
+        int p = 0;
+
+        /* never a grab twice, never out of list order */
+        for (GrabPtr g = wPassiveGrabs(pWin); g != grab; g = g->next) {
+            assert(g);
+            p++;
+        }
+        assert(p > pos);
+        pos = p;
+
+        tmp.modifierDevice = grab->modifierDevice;
+        for (int l = 0; l < ARRAY_SIZE(levels); l++) {
+            tmp.grabtype = levels[l];
+            tmp.type = levels[l] == XI2 ? GetXI2Type(evtype) :
+                levels[l] == XI ? GetXIType(evtype) : GetCoreType(evtype);
+            if (tmp.type && GrabMatchesSecond(&tmp, grab, levels[l] == CORE)) {
+                matches[n++] = grab;
+                break;
+            }
+        }
+    }
+    return n;
+}
+
+static GrabPtr
+check_press(Bool button, unsigned int detail, unsigned int mods)
+{
+    /* ungrabs may split grabs, past MAX_GRABS */
+    int size = wPassiveGrabCount(&root) + 1;
+    GrabPtr *expected = calloc(size, sizeof(GrabPtr));
+    GrabPtr *matches = calloc(size, sizeof(GrabPtr));
+    InternalEvent event = { 0 };
+    int nexpected, n;
+    GrabPtr grab;
+
+    assert(expected && matches);
+    kbd_xkbi.state.grab_mods = mods;
+
+    /* AnyKey is not an event detail, but it walks the whole list */
+    assert(walk_matches(&root, button, AnyKey, matches, TRUE) ==
+           walk_matches(&root, button, AnyKey, expected, FALSE));
+
+    nexpected = walk_matches(&root, button, detail, expected, FALSE);
+    n = walk_matches(&root, button, detail, matches, TRUE);
+    assert(n == nexpected);
+    assert(memcmp(matches, expected, n * sizeof(GrabPtr)) == 0);
+
+    /* and the first one is the one that gets activated */
+    event.any.type = button ? ET_ButtonPress : ET_KeyPress;
+    event.device_event.deviceid = kbd_dev.id;
+    event.device_event.detail.key = detail;
+    grab = CheckPassiveGrabsOnWindow(&root, &kbd_dev, &event, TRUE, FALSE);
+    assert(grab == (nexpected ? expected[0] : NULL));
+
+    free(matches);
+    free(expected);
+    return grab;
+}
+
+static unsigned int
+random_detail(void)
+{
+    return rand() % 6 ? MIN_KEYCODE + rand() % (256 - MIN_KEYCODE) : AnyKey;
+}
+
+static unsigned int
+random_modifiers(enum InputLevel grabtype)
+{
+    static const unsigned int mods[] = {
+        0, ShiftMask, LockMask, ControlMask, Mod1Mask | ControlMask,
+        Mod2Mask, Mod4Mask, Mod4Mask | Mod2Mask, Mod4Mask | LockMask,
+    };
+
+    if (rand() % 5 == 0)
+        return grabtype == XI2 ? XIAnyModifier : AnyModifier;
+    return mods[rand() % ARRAY_SIZE(mods)];
+}
+
+static DeviceIntPtr
+random_device(enum InputLevel grabtype)
+{
+    if (grabtype != XI2)
+        return &kbd_dev;
+    switch (rand() % 3) {
+    case 0:
+        return &kbd_dev;
+    case 1:
+        return &all_devices;
+    default:
+        return &all_master_devices;
+    }
+}
+
+static void
+free_random_grab(void)
+{
+    int n = wPassiveGrabCount(&root);
+    GrabPtr grab = wPassiveGrabs(&root);
+
+    if (!n)
+        return;
+    for (n = rand() % n; n; n--)
+        grab = grab->next;
+    FreeResource(grab->resource, X11_RESTYPE_NONE);
+}
+
+static void
+grabs_random(void)
+{
+    srand(25);
+    setup();
+
+    for (int round = 0; round < ROUNDS; round++) {
+        /* mostly one client, so that ungrabs find what to cut */
+        ClientPtr client = &test_clients[rand() % 4 ? 0 : 1 + rand() % 2];
+        enum InputLevel grabtype = rand() % 2 ? CORE : XI2;
+        DeviceIntPtr dev = random_device(grabtype);
+        Bool button = rand() % 4 == 0;
+        /* around the index threshold for a while, then well past it */
+        int max = round % 1000 < 300 ? 20 : MAX_GRABS;
+
+        switch (rand() % 4) {
+        case 0:
+        case 1:
+            if (wPassiveGrabCount(&root) < max)
+                add_grab(client, grabtype, dev, button, random_detail(),
+                         random_modifiers(grabtype));
+            else
+                free_random_grab();
+            break;
+        case 2:
+            /* an XI2 grab of any key and modifier can't be split, its copy
+             * would take the event mask for its XI2 mask */
+            ungrab(client, grabtype, dev, button, random_detail(),
+                   grabtype == XI2 ? XIAnyModifier : random_modifiers(CORE));
+            break;
+        default:
+            free_random_grab();
+            break;
+        }
+
+        for (int i = 0; i < 8; i++)
+            check_press(rand() % 4 == 0,
+                        MIN_KEYCODE + rand() % (256 - MIN_KEYCODE),
+                        random_modifiers(CORE) & 0xff);
+    }
+
+    teardown();
+}
+
+static void
+grabs_any_key(void)
+{
+    ClientPtr client = &test_clients[0];
+    GrabPtr any, hotkeys[20], grab;
+
+    setup();
+
+    /* a grab of everything, oldest so it's last, and hotkeys in front */
+    any = add_grab(client, CORE, &kbd_dev, FALSE, AnyKey, AnyModifier);
+    for (int i = 0; i < ARRAY_SIZE(hotkeys); i++)
+        hotkeys[i] = add_grab(client, CORE, &kbd_dev, FALSE, 10 + i,
+                              Mod4Mask);
+    assert(wPassiveGrabCount(&root) == 21);
+
+    assert(check_press(FALSE, 15, Mod4Mask) == hotkeys[5]);
+    assert(check_press(FALSE, 15, ControlMask) == any);
+    assert(check_press(FALSE, 200, Mod4Mask) == any);
+
+    /*
+     * Ungrabbing Super+15 takes the hotkey, takes 15 out of the grab of any
+     * key and gives 15 its own grab in front, with any modifier but Super.
+     */
+    ungrab(client, CORE, &kbd_dev, FALSE, 15, Mod4Mask);
+    assert(wPassiveGrabCount(&root) == 21);
+    grab = wPassiveGrabs(&root);
+    assert(grab != any && grab->detail.exact == 15);
+    assert(check_press(FALSE, 15, Mod4Mask) == NULL);
+    assert(check_press(FALSE, 15, ControlMask) == grab);
+    assert(check_press(FALSE, 16, Mod4Mask) == hotkeys[6]);
+    assert(check_press(FALSE, 16, ControlMask) == any);
+
+    /* ungrabbing any key with Control cuts Control out of all of them */
+    ungrab(client, CORE, &kbd_dev, FALSE, AnyKey, ControlMask);
+    assert(check_press(FALSE, 15, ControlMask) == NULL);
+    assert(check_press(FALSE, 16, ControlMask) == NULL);
+    assert(check_press(FALSE, 16, ShiftMask) == any);
+
+    /* below the threshold, the list walk finds the same */
+    for (int i = 7; i < ARRAY_SIZE(hotkeys); i++)
+        FreeResource(hotkeys[i]->resource, X11_RESTYPE_NONE);
+    assert(check_press(FALSE, 16, Mod4Mask) == hotkeys[6]);
+    assert(check_press(FALSE, 15, ShiftMask) == grab);
+
+    teardown();
+}
+
+static void
+grabs_buttons(void)
+{
+    ClientPtr client = &test_clients[0];
+    GrabPtr grabs[4 * 5], any;
+
+    setup();
+
+    /* XI2 buttons past 255, some of them sharing a bucket with a key */
+    any = add_grab(client, XI2, &all_devices, TRUE, XIAnyButton,
+                   XIAnyModifier);
+    for (int i = 0; i < ARRAY_SIZE(grabs); i++)
+        grabs[i] = add_grab(client, XI2, &kbd_dev, TRUE, 44 + (i % 4) * 256,
+                            i / 4);
+    add_grab(client, CORE, &kbd_dev, FALSE, 44, AnyModifier);
+
+    for (int i = 0; i < ARRAY_SIZE(grabs); i++)
+        assert(check_press(TRUE, 44 + (i % 4) * 256, i / 4) == grabs[i]);
+    assert(check_press(TRUE, 44 + 4 * 256, 0) == any);
+    assert(check_press(TRUE, 300, Mod4Mask) == any);
+
+    teardown();
+}
+
+const testfunc_t*
+grabs_test(void)
+{
+    static const testfunc_t testfuncs[] = {
+        grabs_random,
+        grabs_any_key,
+        grabs_buttons,
+        NULL,
+    };
+    return testfuncs;
+}
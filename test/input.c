@@ -1782,7 +1782,7 @@ dix_double_fp_conversion(void)
 }
 
 /* The mieq test verifies that events added to the queue come out in the same
- * order that they went in.
+ * order that they went in, also when they come from different devices.
  */
 static uint32_t mieq_test_event_last_processed;
 
@@ -1793,34 +1793,41 @@ mieq_test_event_handler(int screenNum, InternalEvent *ie, DeviceIntPtr dev)
 
     assert(e->type == ET_RawMotion);
     assert(e->flags > mieq_test_event_last_processed);
+    assert(e->deviceid == dev->id);
     mieq_test_event_last_processed = e->flags;
 }
 
 static void
 _mieq_test_generate_events(uint32_t start, uint32_t count)
 {
-    static DeviceIntRec dev;
+    static DeviceIntRec devs[3];
     static SpriteInfoRec spriteInfo;
     static SpriteRec sprite;
 
-    memset(&dev, 0, sizeof(dev));
+    memset(devs, 0, sizeof(devs));
     memset(&spriteInfo, 0, sizeof(spriteInfo));
     memset(&sprite, 0, sizeof(sprite));
-    dev.spriteInfo = &spriteInfo;
     spriteInfo.sprite = &sprite;
 
-    dev.enabled = 1;
+    for (int i = 0; i < ARRAY_SIZE(devs); i++) {
+        devs[i].id = i + 2;
+        devs[i].spriteInfo = &spriteInfo;
+        devs[i].enabled = 1;
+    }
 
     count += start;
     while (start < count) {
+        /* mostly from the first device, as in a burst of motion */
+        DeviceIntPtr dev = &devs[(start % 5) < 3 ? 0 : start % 5 - 2];
         RawDeviceEvent e = { 0 };
         e.header = ET_Internal;
         e.type = ET_RawMotion;
         e.length = sizeof(e);
         e.time = GetTimeInMillis();
         e.flags = start;
+        e.deviceid = dev->id;
 
-        mieqEnqueue(&dev, (InternalEvent *) &e);
+        mieqEnqueue(dev, (InternalEvent *) &e);
 
         start++;
     }
@@ -1837,30 +1844,172 @@ mieq_test(void)
     mieqInit();
     mieqSetHandler(ET_RawMotion, mieq_test_event_handler);
 
-    /* Enough to fit the buffer but trigger a grow */
+    /* Enough to make each device's queue grow */
     mieq_test_generate_events(180);
-
-    /* We should resize to 512 now */
     mieqProcessInputEvents();
 
-    /* Some should now get dropped */
+    /* Grow them again while the old rings still hold events */
     mieq_test_generate_events(500);
-
-    /* Tell us how many got dropped, 1024 now */
-    mieqProcessInputEvents();
-
-    /* Now make it 2048 */
     mieq_test_generate_events(900);
     mieqProcessInputEvents();
 
-    /* Now make it 4096 (max) */
-    mieq_test_generate_events(1950);
+    /* Up to the maximum, some should now get dropped */
+    mieq_test_generate_events(7000);
     mieqProcessInputEvents();
 
     /* Now overflow one last time with the maximal queue and reach the verbosity limit */
-    mieq_test_generate_events(10000);
+    mieq_test_generate_events(20000);
+    mieqProcessInputEvents();
+
+    assert(!InputCheckPending());
+
+    mieqFini();
+}
+
+/* Motion coalescing merges queued motion of a device with "Coalesce Motion"
+ * into the next one, across its raw events but nothing else.
+ */
+static struct {
+    int type;
+    Time time;
+    double x, z;
+    Bool has_z;
+} mieq_coalesce_processed[32];
+static int mieq_coalesce_nprocessed;
+
+static void
+mieq_coalesce_handler(int screenNum, InternalEvent *ie, DeviceIntPtr dev)
+{
+    int n = mieq_coalesce_nprocessed++;
+
+    assert(n < ARRAY_SIZE(mieq_coalesce_processed));
+    mieq_coalesce_processed[n].type = ie->any.type;
+    mieq_coalesce_processed[n].time = ie->any.time;
+    if (ie->any.type == ET_Motion) {
+        DeviceEvent *e = &ie->device_event;
+
+        mieq_coalesce_processed[n].x = e->valuators.data[0];
+        mieq_coalesce_processed[n].has_z = BitIsOn(e->valuators.mask, 2);
+        mieq_coalesce_processed[n].z = e->valuators.data[2];
+    }
+}
+
+static void
+mieq_coalesce_enqueue(DeviceIntPtr dev, int type, Time time, double x)
+{
+    InternalEvent ev;
+
+    memset(&ev, 0, sizeof(ev));
+    if (type == ET_RawMotion) {
+        ev.raw_event.header = ET_Internal;
+        ev.raw_event.type = type;
+        ev.raw_event.length = sizeof(RawDeviceEvent);
+        ev.raw_event.time = time;
+        ev.raw_event.deviceid = dev->id;
+    }
+    else {
+        ev.device_event.header = ET_Internal;
+        ev.device_event.type = type;
+        ev.device_event.length = sizeof(DeviceEvent);
+        ev.device_event.time = time;
+        ev.device_event.deviceid = dev->id;
+        ev.device_event.sourceid = dev->id;
+        if (type == ET_Motion) {
+            SetBit(ev.device_event.valuators.mask, 0);
+            ev.device_event.valuators.data[0] = x;
+        }
+    }
+    mieqEnqueue(dev, &ev);
+}
+
+static void
+mieq_coalesce_test(void)
+{
+    static const struct {
+        int type;
+        Time time;
+    } expected[] = {
+        { ET_RawMotion, 1 }, { ET_RawMotion, 2 }, { ET_RawMotion, 3 },
+        { ET_Motion, 3 },       /* 1 and 2 merged into it */
+        { ET_ButtonPress, 4 },
+        { ET_RawMotion, 5 },
+        { ET_Motion, 5 },       /* the other device's came in between */
+        { ET_Motion, 6 },
+        { ET_RawMotion, 7 }, { ET_Motion, 7 },
+        { ET_RawMotion, 8 }, { ET_Motion, 8 },     /* not asked for */
+        { ET_RawMotion, 9 }, { ET_Motion, 9 },
+    };
+    DeviceIntRec devs[2];
+    SpriteInfoRec spriteInfo;
+    SpriteRec sprite;
+    InternalEvent ev;
+    DeviceIntPtr a = &devs[0], b = &devs[1];
+
+    memset(devs, 0, sizeof(devs));
+    memset(&spriteInfo, 0, sizeof(spriteInfo));
+    memset(&sprite, 0, sizeof(sprite));
+    spriteInfo.sprite = &sprite;
+    for (int i = 0; i < ARRAY_SIZE(devs); i++) {
+        devs[i].id = i + 2;
+        devs[i].spriteInfo = &spriteInfo;
+        devs[i].enabled = TRUE;
+    }
+    a->coalesceMotion = TRUE;
+
+    mieqInit();
+    mieqSetHandler(ET_RawMotion, mieq_coalesce_handler);
+    mieqSetHandler(ET_Motion, mieq_coalesce_handler);
+    mieqSetHandler(ET_ButtonPress, mieq_coalesce_handler);
+    mieq_coalesce_nprocessed = 0;
+
+    mieq_coalesce_enqueue(a, ET_RawMotion, 1, 0);
+    /* an axis only the first motion has */
+    memset(&ev, 0, sizeof(ev));
+    ev.device_event.header = ET_Internal;
+    ev.device_event.type = ET_Motion;
+    ev.device_event.length = sizeof(DeviceEvent);
+    ev.device_event.time = 1;
+    ev.device_event.deviceid = ev.device_event.sourceid = a->id;
+    SetBit(ev.device_event.valuators.mask, 0);
+    SetBit(ev.device_event.valuators.mask, 2);
+    ev.device_event.valuators.data[0] = 10;
+    ev.device_event.valuators.data[2] = 5;
+    mieqEnqueue(a, &ev);
+    for (int t = 2; t <= 3; t++) {
+        mieq_coalesce_enqueue(a, ET_RawMotion, t, 0);
+        mieq_coalesce_enqueue(a, ET_Motion, t, t * 10);
+    }
+    mieq_coalesce_enqueue(a, ET_ButtonPress, 4, 0);
+    mieq_coalesce_enqueue(a, ET_RawMotion, 5, 0);
+    mieq_coalesce_enqueue(a, ET_Motion, 5, 50);
+    mieq_coalesce_enqueue(b, ET_Motion, 6, 60);
+    mieq_coalesce_enqueue(a, ET_RawMotion, 7, 0);
+    mieq_coalesce_enqueue(a, ET_Motion, 7, 70);
+    for (int t = 8; t <= 9; t++) {
+        mieq_coalesce_enqueue(b, ET_RawMotion, t, 0);
+        mieq_coalesce_enqueue(b, ET_Motion, t, t * 10);
+    }
     mieqProcessInputEvents();
 
+    assert(mieq_coalesce_nprocessed == ARRAY_SIZE(expected));
+    for (int i = 0; i < ARRAY_SIZE(expected); i++) {
+        assert(mieq_coalesce_processed[i].type == expected[i].type);
+        assert(mieq_coalesce_processed[i].time == expected[i].time);
+        if (expected[i].type == ET_Motion)
+            assert(mieq_coalesce_processed[i].x == expected[i].time * 10);
+    }
+    /* the axis of the first motion made it */
+    assert(mieq_coalesce_processed[3].has_z);
+    assert(mieq_coalesce_processed[3].z == 5);
+    assert(!mieq_coalesce_processed[6].has_z);
+
+    assert(a->coalescedMotion == 2);
+    assert(b->coalescedMotion == 0);
+    assert(!InputCheckPending());
+
+    mieqSetHandler(ET_RawMotion, NULL);
+    mieqSetHandler(ET_Motion, NULL);
+    mieqSetHandler(ET_ButtonPress, NULL);
     mieqFini();
 }
 
@@ -1951,6 +2100,7 @@ input_test(void)
         dix_get_master,
         input_option_test,
         mieq_test,
+        mieq_coalesce_test,
         NULL,
     };
 
@@ -0,0 +1,257 @@
+/* SPDX-License-Identifier: MIT OR X11
+ *
+ * Window properties: once a window has enough properties, lookups go
+ * through an atom keyed index. Random changes and deletes are checked
+ * against a walk of the window's property list and against a model of
+ * the list as the old tree kept it, newest property first.
+ */
+
+/* Test relies on assert() */
+#undef NDEBUG
+
+#include <dix-config.h>
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <X11/X.h>
+#include <X11/Xatom.h>
+
+#include "dix/atom_priv.h"
+#include "dix/dix_priv.h"
+#include "dix/property_priv.h"
+
+#include "dix.h"
+#include "dixstruct.h"
+#include "propertyst.h"
+#include "windowstr.h"
+#include "tests-common.h"
+
+#define ATOMS 300
+
+static ClientRec client;
+static ScreenRec screen;
+static Atom atoms[ATOMS];
+
+/* property names on the window, newest first, and their single value */
+static Atom model[ATOMS];
+static CARD32 model_value[ATOMS];
+static int nmodel;
+
+static void
+setup(void)
+{
+    char name[32];
+
+    InitAtoms();
+    client.index = 1;
+    for (int i = 0; i < ATOMS; i++) {
+        int len = snprintf(name, sizeof(name), "_TEST_PROPERTY_%d", i);
+
+        atoms[i] = MakeAtom(name, len, TRUE);
+    }
+    nmodel = 0;
+}
+
+static WindowPtr
+make_window(void)
+{
+    WindowPtr pWin = calloc(1, sizeof(WindowRec));
+
+    assert(pWin);
+    pWin->drawable.pScreen = &screen;
+    pWin->optional = calloc(1, sizeof(WindowOptRec));
+    assert(pWin->optional);
+    return pWin;
+}
+
+static void
+free_window(WindowPtr pWin)
+{
+    DeleteAllWindowProperties(pWin);
+    assert(!pWin->properties);
+    free(pWin->optional);
+    free(pWin);
+}
+
+static int
+model_find(Atom name)
+{
+    for (int i = 0; i < nmodel; i++)
+        if (model[i] == name)
+            return i;
+    return -1;
+}
+
+static void
+model_set(Atom name, CARD32 value)
+{
+    int i = model_find(name);
+
+    if (i < 0) {
+        memmove(model + 1, model, nmodel * sizeof(Atom));
+        memmove(model_value + 1, model_value, nmodel * sizeof(CARD32));
+        model[0] = name;
+        nmodel++;
+        i = 0;
+    }
+    model_value[i] = value;
+}
+
+static void
+model_delete(Atom name)
+{
+    int i = model_find(name);
+
+    if (i < 0)
+        return;
+    nmodel--;
+    memmove(model + i, model + i + 1, (nmodel - i) * sizeof(Atom));
+    memmove(model_value + i, model_value + i + 1, (nmodel - i) * sizeof(CARD32));
+}
+
+static void
+check_window(WindowPtr pWin)
+{
+    PropertyPtr pProp = pWin->properties;
+
+    for (int i = 0; i < nmodel; i++, pProp = pProp->next) {
+        assert(pProp);
+        assert(pProp->propertyName == model[i]);
+        assert(pProp->size == 1);
+        assert(*(CARD32 *) pProp->data == model_value[i]);
+    }
+    assert(!pProp);
+
+    for (int i = 0; i < ATOMS; i++) {
+        int j = model_find(atoms[i]);
+        int rc = dixLookupProperty(&pProp, pWin, atoms[i], &client,
+                                   DixReadAccess);
+
+        if (j < 0) {
+            assert(rc == BadMatch);
+            assert(!pProp);
+        }
+        else {
+            assert(rc == Success);
+            assert(pProp->propertyName == atoms[i]);
+            assert(*(CARD32 *) pProp->data == model_value[j]);
+        }
+    }
+}
+
+static void
+change_property(WindowPtr pWin, Atom name, CARD32 value)
+{
+    int rc = dixChangeWindowProperty(&client, pWin, name, XA_CARDINAL, 32,
+                                     PropModeReplace, 1, &value, FALSE);
+
+    assert(rc == Success);
+    model_set(name, value);
+}
+
+static void
+delete_property(WindowPtr pWin, Atom name)
+{
+    assert(DeleteProperty(&client, pWin, name) == Success);
+    model_delete(name);
+}
+
+static void
+property_grow_shrink(void)
+{
+    WindowPtr pWin;
+
+    setup();
+    pWin = make_window();
+
+    /* up past the point the index is built, and back down past the point
+     * it is dropped, a few times */
+    for (int round = 0; round < 3; round++) {
+        for (int i = 0; i < 40; i++) {
+            change_property(pWin, atoms[i], round * 100 + i);
+            check_window(pWin);
+        }
+        for (int i = 0; i < 40; i += 2) {
+            delete_property(pWin, atoms[i]);
+            check_window(pWin);
+        }
+        for (int i = 39; i > 0; i -= 2) {
+            delete_property(pWin, atoms[i]);
+            check_window(pWin);
+        }
+        assert(!pWin->properties);
+    }
+
+    /* deleting what is not there changes nothing */
+    delete_property(pWin, atoms[0]);
+    check_window(pWin);
+
+    free_window(pWin);
+    FreeAllAtoms();
+}
+
+static void
+property_random(void)
+{
+    WindowPtr pWin;
+
+    setup();
+    pWin = make_window();
+    srand(4);
+
+    for (int i = 0; i < 20000; i++) {
+        /* a narrow name range keeps the count around the index thresholds
+         * for a while, a wide one grows the index */
+        int range = (i / 2000) % 2 ? 24 : ATOMS;
+        Atom name = atoms[rand() % range];
+
+        if (rand() % 2)
+            change_property(pWin, name, rand());
+        else
+            delete_property(pWin, name);
+        if (i % 7 == 0)
+            check_window(pWin);
+    }
+    check_window(pWin);
+
+    free_window(pWin);
+    FreeAllAtoms();
+}
+
+static void
+property_delete_all(void)
+{
+    WindowPtr pWin;
+
+    setup();
+    pWin = make_window();
+
+    for (int i = 0; i < 100; i++)
+        change_property(pWin, atoms[i], i);
+    check_window(pWin);
+
+    /* the window can start over with a fresh set */
+    DeleteAllWindowProperties(pWin);
+    nmodel = 0;
+    check_window(pWin);
+    for (int i = 50; i < 150; i++)
+        change_property(pWin, atoms[i], i);
+    check_window(pWin);
+
+    free_window(pWin);
+    FreeAllAtoms();
+}
+
+const testfunc_t*
+property_test(void)
+{
+    static const testfunc_t testfuncs[] = {
+        property_grow_shrink,
+        property_random,
+        property_delete_all,
+        NULL,
+    };
+    return testfuncs;
+}
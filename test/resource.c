@@ -0,0 +1,429 @@
+/* SPDX-License-Identifier: MIT OR X11
+ *
+ * Per client resource table: resources sharing an id, free order, and
+ * what callbacks may do to the table while it is being walked.
+ *
+ * Each case runs twice: once on a quiet table, and once from within a
+ * walk over the client's resources, which first adds enough others that
+ * everything added while walking goes to a deferred table, and that one
+ * has to grow.
+ */
+
+/* Test relies on assert() */
+#undef NDEBUG
+
+#include <dix-config.h>
+
+#include <stdint.h>
+#include <string.h>
+
+#include "dix/resource_priv.h"
+
+#include "dix.h"
+#include "dixstruct.h"
+#include "resource.h"
+#include "tests-common.h"
+
+/* more than fit in the first deferred table */
+#define GROW_COUNT 200
+
+static ClientRec server_client;
+static ClientRec client;
+static RESTYPE type_a, type_b, type_filler, type_walk, type_noretain;
+
+static intptr_t freed[16 * GROW_COUNT];
+static int nfreed;
+
+/* resources the next noretain delete functions add */
+static int readd_count;
+static int readd_calls;
+
+static int
+resource_delete(void *value, XID id)
+{
+    assert(nfreed < ARRAY_SIZE(freed));
+    freed[nfreed++] = (intptr_t) value;
+    return Success;
+}
+
+static XID
+client_id(int i)
+{
+    return client.clientAsMask | i;
+}
+
+static int
+noretain_delete(void *value, XID id)
+{
+    resource_delete(value, id);
+    if (readd_calls > 0) {
+        readd_calls--;
+        for (int i = 0; i < readd_count; i++)
+            assert(AddResource(client_id(5000 + i), type_a,
+                               (void *) (intptr_t) (5000 + i)));
+        /* this one must go in the next round */
+        assert(AddResource(client_id(4999), type_noretain,
+                           (void *) (intptr_t) 4999));
+    }
+    return Success;
+}
+
+static void
+resource_init(void)
+{
+    serverClient = &server_client;
+    assert(InitClientResources(serverClient));
+    type_a = CreateNewResourceType(resource_delete, "TestA");
+    type_b = CreateNewResourceType(resource_delete, "TestB");
+    type_filler = CreateNewResourceType(resource_delete, "TestFiller");
+    type_walk = CreateNewResourceType(resource_delete, "TestWalk");
+    type_noretain = CreateNewResourceType(noretain_delete, "TestNoRetain") |
+        RC_NEVERRETAIN;
+    assert(type_a && type_b && type_filler && type_walk && type_noretain);
+
+    client.index = 1;
+    client.clientAsMask = ((Mask) 1) << CLIENTOFFSET;
+    clients[1] = &client;
+    assert(InitClientResources(&client));
+}
+
+static void *
+lookup(XID id, RESTYPE type)
+{
+    void *value;
+
+    if (dixLookupResourceByType(&value, id, type, NULL,
+                                DixReadAccess) != Success)
+        return NULL;
+    return value;
+}
+
+static void *
+lookup_class(XID id, RESTYPE rclass)
+{
+    void *value;
+
+    if (dixLookupResourceByClass(&value, id, rclass, NULL,
+                                 DixReadAccess) != Success)
+        return NULL;
+    return value;
+}
+
+static void
+add(XID id, RESTYPE type, intptr_t value)
+{
+    assert(AddResource(id, type, (void *) value));
+}
+
+typedef void (*scenario_t)(void);
+
+static scenario_t walk_scenario;
+static int walk_calls;
+static int fillers_seen;
+
+static void
+count_filler(void *value, XID id, void *cdata)
+{
+    fillers_seen++;
+}
+
+static void
+walk_once(void *value, XID id, void *cdata)
+{
+    if (walk_calls++)
+        return;
+    for (int i = 0; i < GROW_COUNT; i++)
+        add(client_id(10000 + i), type_filler, 10000 + i);
+    walk_scenario();
+    /* the table mustn't move under the walk, check it's all still there */
+    for (int i = 0; i < GROW_COUNT; i++)
+        assert(lookup(client_id(10000 + i), type_filler) ==
+               (void *) (intptr_t) (10000 + i));
+    /* a nested walk sees the ones put aside too, each once */
+    fillers_seen = 0;
+    FindClientResourcesByType(&client, type_filler, count_filler, NULL);
+    assert(fillers_seen == GROW_COUNT);
+}
+
+/* run a scenario on a quiet table, and again while walking it */
+static void
+run_scenario(scenario_t scenario, scenario_t check_after)
+{
+    scenario();
+    check_after();
+
+    FreeClientResources(&client);
+    assert(InitClientResources(&client));
+    nfreed = 0;
+
+    add(client_id(1), type_walk, 1);
+    walk_scenario = scenario;
+    walk_calls = 0;
+    FindClientResourcesByType(&client, type_walk, walk_once, NULL);
+    assert(walk_calls == 1);
+    /* again, now that the walk is done and the deferred table taken in */
+    check_after();
+    for (int i = 0; i < GROW_COUNT; i++)
+        assert(lookup(client_id(10000 + i), type_filler) ==
+               (void *) (intptr_t) (10000 + i));
+}
+
+#define DUP_ID client_id(100)
+
+static void
+duplicates_scenario(void)
+{
+    add(DUP_ID, type_a, 1);
+    add(DUP_ID, type_b, 2);
+    add(DUP_ID, type_a, 3);
+
+    assert(lookup(DUP_ID, type_a) == (void *) 3);
+    assert(lookup(DUP_ID, type_b) == (void *) 2);
+    assert(lookup_class(DUP_ID, RC_ANY) == (void *) 3);
+}
+
+static void
+duplicates_check(void)
+{
+    assert(lookup(DUP_ID, type_a) == (void *) 3);
+    assert(lookup(DUP_ID, type_b) == (void *) 2);
+    assert(lookup_class(DUP_ID, RC_ANY) == (void *) 3);
+
+    nfreed = 0;
+    FreeResourceByType(DUP_ID, type_a, FALSE);
+    assert(nfreed == 1 && freed[0] == 3);
+    assert(lookup(DUP_ID, type_a) == (void *) 1);
+    assert(lookup_class(DUP_ID, RC_ANY) == (void *) 2);
+
+    /* a newer one shadows the older ones again */
+    add(DUP_ID, type_a, 4);
+    assert(lookup(DUP_ID, type_a) == (void *) 4);
+    assert(lookup_class(DUP_ID, RC_ANY) == (void *) 4);
+
+    FreeResourceByType(DUP_ID, type_b, FALSE);
+    assert(lookup(DUP_ID, type_b) == NULL);
+    assert(lookup(DUP_ID, type_a) == (void *) 4);
+    FreeResourceByType(DUP_ID, type_a, FALSE);
+    assert(lookup(DUP_ID, type_a) == (void *) 1);
+    FreeResourceByType(DUP_ID, type_a, FALSE);
+    assert(lookup_class(DUP_ID, RC_ANY) == NULL);
+}
+
+/**
+ * With several resources on one id, lookups find the most recently added
+ * one of the type, and the others show again once it's freed.
+ */
+static void
+resource_duplicates(void)
+{
+    resource_init();
+    run_scenario(duplicates_scenario, duplicates_check);
+}
+
+#define ORDER_ID client_id(200)
+
+static void
+free_order_scenario(void)
+{
+    add(ORDER_ID, type_a, 1);
+    add(ORDER_ID, type_b, 2);
+    add(ORDER_ID, type_a, 3);
+    add(ORDER_ID, type_b, 4);
+    add(client_id(201), type_a, 5);
+}
+
+static void
+free_order_check(void)
+{
+    nfreed = 0;
+    FreeResource(ORDER_ID, X11_RESTYPE_NONE);
+    assert(nfreed == 4);
+    for (int i = 0; i < 4; i++)
+        assert(freed[i] == 4 - i);
+    assert(lookup_class(ORDER_ID, RC_ANY) == NULL);
+    assert(lookup(client_id(201), type_a) == (void *) 5);
+
+    /* the skipped type is freed without calling its delete function */
+    add(ORDER_ID, type_a, 6);
+    add(ORDER_ID, type_b, 7);
+    add(ORDER_ID, type_a, 8);
+    nfreed = 0;
+    FreeResource(ORDER_ID, type_a);
+    assert(nfreed == 1 && freed[0] == 7);
+    assert(lookup_class(ORDER_ID, RC_ANY) == NULL);
+}
+
+/**
+ * FreeResource frees all resources on an id, most recently added first.
+ */
+static void
+resource_free_order(void)
+{
+    resource_init();
+    run_scenario(free_order_scenario, free_order_check);
+}
+
+#define WALKED 100
+
+static char visited[WALKED + 1];
+static int walk_every, walk_adds;
+static Bool walk_share;
+/* value expected on client_id(1000 + k), 0 for none */
+static intptr_t walk_added[(WALKED + 1) * (GROW_COUNT / 10)];
+
+static void
+walk_add_lookup_free(void *value, XID id, void *cdata)
+{
+    intptr_t v = (intptr_t) value;
+
+    /* resources added below may or may not be visited, but only once */
+    assert(v >= 1 && v <= WALKED);
+    assert(!visited[v]);
+    visited[v] = 1;
+    if (v % walk_every)
+        return;
+
+    for (int i = 0; i < walk_adds; i++) {
+        int k = v * walk_adds + i;
+
+        add(client_id(1000 + k), type_b, -k);
+        walk_added[k] = -k;
+        assert(lookup(client_id(1000 + k), type_b) == (void *) (intptr_t) -k);
+        if (i & 1) {
+            FreeResource(client_id(1000 + k), X11_RESTYPE_NONE);
+            walk_added[k] = 0;
+            assert(lookup(client_id(1000 + k), type_b) == NULL);
+        }
+    }
+
+    /* free one not visited yet, and one added by an earlier visit */
+    if (v < WALKED) {
+        FreeResource(client_id(v + 1), X11_RESTYPE_NONE);
+        visited[v + 1] = 2;
+    }
+    if (v > walk_every) {
+        int k = (v - walk_every) * walk_adds;
+
+        FreeResource(client_id(1000 + k), X11_RESTYPE_NONE);
+        walk_added[k] = 0;
+    }
+
+    /* and one sharing the id of the one we're at */
+    if (walk_share) {
+        add(id, type_b, v);
+        assert(lookup(id, type_b) == value);
+        assert(lookup(id, type_a) == value);
+    }
+}
+
+static void
+add_during_walk(int every, int adds, Bool share)
+{
+    memset(visited, 0, sizeof(visited));
+    memset(walk_added, 0, sizeof(walk_added));
+    walk_every = every;
+    walk_adds = adds;
+    walk_share = share;
+    for (int v = 1; v <= WALKED; v++)
+        add(client_id(v), type_a, v);
+
+    FindClientResourcesByType(&client, type_a, walk_add_lookup_free, NULL);
+
+    for (int v = 1; v <= WALKED; v++) {
+        void *value = (void *) (intptr_t) v;
+
+        assert(visited[v]);
+        if (visited[v] == 2) {
+            assert(lookup_class(client_id(v), RC_ANY) == NULL);
+            continue;
+        }
+        assert(lookup(client_id(v), type_a) == value);
+        assert(lookup_class(client_id(v), RC_ANY) == value);
+        if (share && v % every == 0) {
+            assert(lookup(client_id(v), type_b) == value);
+            FreeResourceByType(client_id(v), type_b, FALSE);
+            assert(lookup_class(client_id(v), RC_ANY) == value);
+        }
+        assert(lookup(client_id(v), type_b) == NULL);
+    }
+    for (int k = 0; k < (WALKED + 1) * adds; k++)
+        assert(lookup(client_id(1000 + k), type_b) ==
+               (void *) walk_added[k]);
+}
+
+/**
+ * Resources added while walking can be looked up and freed right away,
+ * the walk visits each resource at most once and skips freed ones, and
+ * it's all still there once the walk is done.
+ */
+static void
+resource_add_during_walk(void)
+{
+    resource_init();
+    /* few enough to fit in the table */
+    add_during_walk(10, 2, FALSE);
+
+    FreeClientResources(&client);
+    assert(InitClientResources(&client));
+    /* more than that, and some the table can't take while walking */
+    add_during_walk(1, GROW_COUNT / 10, TRUE);
+}
+
+static void
+free_class_readd(int count)
+{
+    readd_count = count;
+    readd_calls = 1;
+    nfreed = 0;
+
+    add(client_id(1), type_a, 1);
+    for (int i = 0; i < 10; i++)
+        add(client_id(10 + i), type_noretain, 10 + i);
+
+    FreeClientNeverRetainResources(&client);
+
+    /* all the never retain ones, including the one the callback added */
+    assert(nfreed == 11);
+    for (int i = 0; i < 10; i++)
+        assert(lookup(client_id(10 + i), type_noretain) == NULL);
+    assert(lookup(client_id(4999), type_noretain) == NULL);
+    assert(lookup(client_id(1), type_a) == (void *) 1);
+    for (int i = 0; i < count; i++)
+        assert(lookup(client_id(5000 + i), type_a) ==
+               (void *) (intptr_t) (5000 + i));
+
+    /* and everything when the client goes, whatever the callbacks add */
+    readd_calls = 2;
+    add(client_id(20), type_noretain, 20);
+    FreeClientResources(&client);
+    assert(lookup_class(client_id(1), RC_ANY) == NULL);
+    assert(lookup_class(client_id(4999), RC_ANY) == NULL);
+    assert(lookup_class(client_id(5000), RC_ANY) == NULL);
+}
+
+/**
+ * FreeClientNeverRetainResources and FreeClientResources free what the
+ * delete functions add while they're walking the table, too.
+ */
+static void
+resource_free_class_readd(void)
+{
+    resource_init();
+    free_class_readd(1);
+
+    assert(InitClientResources(&client));
+    free_class_readd(GROW_COUNT);
+}
+
+const testfunc_t*
+resource_test(void)
+{
+    static const testfunc_t testfuncs[] = {
+        resource_duplicates,
+        resource_free_order,
+        resource_add_during_walk,
+        resource_free_class_readd,
+        NULL,
+    };
+    return testfuncs;
+}
@@ -0,0 +1,407 @@
+/* SPDX-License-Identifier: MIT OR X11
+ *
+ * Shadow update kernels: every variant the CPU has against the plain C
+ * ones, and the rotated updates through a linear framebuffer against the
+ * generic code, on a screen of odd size with boxes at odd places.
+ */
+
+/* Test relies on assert() */
+#undef NDEBUG
+
+#include <dix-config.h>
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "miext/shadow/shadow.h"
+#include "miext/shadow/shsimd.h"
+#include "include/pixmapstr.h"
+#include "include/scrnintstr.h"
+
+#include "tests-common.h"
+
+#define SCREEN_WIDTH    61
+#define SCREEN_HEIGHT   37
+#define FB_ROWS         SCREEN_WIDTH    /* rotated by 90 or 270 */
+#define FB_GAP          64
+#define NBOX            6
+#define POISON          0xa5
+
+/* how the framebuffer rows are laid out */
+enum fb_layout {
+    FB_LINEAR,          /* one after the other */
+    FB_GAPPED,          /* with a gap after each, for the generic code */
+    FB_GAPPED_LATE,     /* linear for the first two, gapped afterwards */
+};
+
+static ScreenRec test_screen;
+static PixmapRec shadow_pixmap;
+static DamageRec test_damage;
+static shadowBufRec test_buf;
+static CARD32 shadow_bits[SCREEN_WIDTH * SCREEN_HEIGHT];
+static CARD8 *framebuffer, *reference;
+static size_t fb_bytes;
+static CARD32 fb_stride;        /* in bytes */
+static enum fb_layout layout;
+static uint32_t seed = 1;
+
+static uint32_t
+test_random(void)
+{
+    seed ^= seed << 13;
+    seed ^= seed >> 17;
+    seed ^= seed << 5;
+    return seed;
+}
+
+static void
+fill_random(void *p, size_t bytes)
+{
+    CARD8 *b = p;
+
+    while (bytes--)
+        *b++ = test_random();
+}
+
+static CARD8 *
+fb_row(CARD8 *fb, CARD32 row)
+{
+    switch (layout) {
+    case FB_GAPPED:
+        return fb + row * (fb_stride + FB_GAP);
+    case FB_GAPPED_LATE:
+        return fb + row * fb_stride + (row >= 2 ? FB_GAP : 0);
+    default:
+        return fb + row * fb_stride;
+    }
+}
+
+static void *
+test_window(ScreenPtr pScreen, CARD32 row, CARD32 offset, int mode,
+            CARD32 *size, void *closure)
+{
+    if (layout == FB_LINEAR) {
+        *size = fb_stride;
+        return framebuffer + row * fb_stride + offset;
+    }
+    *size = fb_stride - offset;
+    return fb_row(framebuffer, row) + offset;
+}
+
+static void
+setup_shadow(void)
+{
+    fill_random(shadow_bits, sizeof(shadow_bits));
+
+    test_screen.width = SCREEN_WIDTH;
+    test_screen.height = SCREEN_HEIGHT;
+
+    shadow_pixmap.drawable.type = DRAWABLE_PIXMAP;
+    shadow_pixmap.drawable.pScreen = &test_screen;
+    shadow_pixmap.drawable.width = SCREEN_WIDTH;
+    shadow_pixmap.drawable.height = SCREEN_HEIGHT;
+    shadow_pixmap.drawable.depth = 24;
+    shadow_pixmap.drawable.bitsPerPixel = 32;
+    shadow_pixmap.devKind = SCREEN_WIDTH * 4;
+    shadow_pixmap.devPrivate.ptr = shadow_bits;
+
+    test_buf.pDamage = &test_damage;
+    test_buf.pPixmap = &shadow_pixmap;
+    test_buf.window = test_window;
+
+    /* room for the widest rows, padded, and a gap after each */
+    fb_bytes = FB_ROWS * ((SCREEN_WIDTH + 3) * 4 + FB_GAP);
+    framebuffer = malloc(fb_bytes);
+    reference = malloc(fb_bytes);
+    assert(framebuffer && reference);
+}
+
+static void
+teardown_shadow(void)
+{
+    RegionUninit(&test_damage.damage);
+    free(reference);
+    free(framebuffer);
+    shadowKernels = NULL;
+}
+
+/*
+ * One box per band of rows, at odd x and of odd sizes; the first reaches
+ * the left edge and the last the right one, or the other way round.
+ */
+static void
+set_damage(int round)
+{
+    BoxRec boxes[NBOX];
+    Bool ret;
+    int y = 0;
+
+    for (int i = 0; i < NBOX; i++) {
+        int h = 1 + test_random() % (SCREEN_HEIGHT / NBOX - 1);
+        int x1 = 1 + test_random() % (SCREEN_WIDTH / 2);
+        int x2 = x1 + 1 + test_random() % (SCREEN_WIDTH - x1 - 1);
+
+        if (i == 0)
+            x1 = (round & 1) ? 0 : x1;
+        if (i == NBOX - 1)
+            x2 = (round & 1) ? x2 : SCREEN_WIDTH;
+        boxes[i] = (BoxRec) { x1, y, x2, y + h };
+        y += h + test_random() % 2;
+    }
+    if (round & 2)
+        boxes[NBOX - 1].y2 = SCREEN_HEIGHT;
+
+    RegionUninit(&test_damage.damage);
+    ret = RegionInitBoxes(&test_damage.damage, boxes, NBOX);
+    assert(ret);
+}
+
+static void
+compare_kernels(const ShadowKernelsRec *c, const ShadowKernelsRec *k)
+{
+    CARD32 src[160], dst[2][160];
+    CARD8 bytes[2][320], changed[2][320];
+
+    fill_random(src, sizeof(src));
+
+    /* packed to 24 bpp at every alignment of source and destination */
+    for (int width = 0; width <= 70; width++) {
+        for (int s = 0; s < 4; s++) {
+            for (int d = 0; d < 16; d++) {
+                memset(bytes, POISON, sizeof(bytes));
+                c->convert32to24(bytes[0] + d, src + s, width);
+                k->convert32to24(bytes[1] + d, src + s, width);
+                assert(memcmp(bytes[0], bytes[1], sizeof(bytes[0])) == 0);
+            }
+        }
+    }
+
+    /* reversed, from the last pixel of the source back */
+    for (int width = 0; width <= 70; width++) {
+        for (int s = 0; s < 4; s++) {
+            for (int d = 0; d < 4; d++) {
+                memset(dst, POISON, sizeof(dst));
+                c->reverse32(dst[0] + d, src + s + 80, width);
+                k->reverse32(dst[1] + d, src + s + 80, width);
+                assert(memcmp(dst[0], dst[1], sizeof(dst[0])) == 0);
+            }
+        }
+    }
+
+    /* four columns to rows, walking the source down and up */
+    for (int width = 0; width <= 20; width++) {
+        for (int s = 0; s < 4; s++) {
+            for (int d = 0; d < 4; d++) {
+                for (int dir = -1; dir <= 1; dir += 2) {
+                    long srcStride = dir * 7;
+                    long dstStride = -dir * 23;
+                    const CARD32 *from = src + s + (dir < 0 ? 140 : 0);
+                    int to = d + (dir > 0 ? 3 * 23 : 0);
+
+                    memset(dst, POISON, sizeof(dst));
+                    c->transpose32(dst[0] + to, dstStride, from, srcStride,
+                                   width);
+                    k->transpose32(dst[1] + to, dstStride, from, srcStride,
+                                   width);
+                    assert(memcmp(dst[0], dst[1], sizeof(dst[0])) == 0);
+                }
+            }
+        }
+    }
+
+    /* compare and copy, with no change, or one at the start, end or any */
+    for (int n = 0; n <= 140; n++) {
+        for (int off = 0; off < 8; off++) {
+            for (int where = -1; where < 3 && where < n; where++) {
+                const CARD8 *from = (CARD8 *) src + off;
+                int at = where == 0 ? 0 :
+                         where == 1 ? n - 1 : test_random() % max(n, 1);
+                Bool ret[2];
+
+                for (int i = 0; i < 2; i++) {
+                    memset(changed[i], POISON, sizeof(changed[i]));
+                    memcpy(changed[i] + off, from, n);
+                    if (where >= 0)
+                        changed[i][off + at] ^= 1 << (at & 7);
+                }
+                ret[0] = c->copyChanged(changed[0] + off, from, n);
+                ret[1] = k->copyChanged(changed[1] + off, from, n);
+                assert(ret[0] == ret[1]);
+                assert(ret[0] == (where >= 0));
+                assert(memcmp(changed[0], changed[1],
+                              sizeof(changed[0])) == 0);
+                assert(memcmp(changed[1] + off, from, n) == 0);
+            }
+        }
+    }
+}
+
+static void
+shadow_kernels(void)
+{
+    const ShadowKernelsRec *c = shadowKernelVariants[0];
+
+    for (int v = 1; shadowKernelVariants[v]; v++) {
+        if (!shadowKernelsSupported(shadowKernelVariants[v]))
+            continue;
+        compare_kernels(c, shadowKernelVariants[v]);
+    }
+}
+
+/* where pixel x, y of the shadow goes, rotated, as the generic code has it */
+static void
+rotated(int rotate, int x, int y, int *row, int *col)
+{
+    switch (rotate) {
+    case SHADOW_ROTATE_90:
+        *row = SCREEN_WIDTH - 1 - x;
+        *col = y;
+        break;
+    case SHADOW_ROTATE_180:
+        *row = SCREEN_HEIGHT - 1 - y;
+        *col = SCREEN_WIDTH - 1 - x;
+        break;
+    case SHADOW_ROTATE_270:
+        *row = x;
+        *col = SCREEN_HEIGHT - 1 - y;
+        break;
+    default:
+        *row = y;
+        *col = x;
+        break;
+    }
+}
+
+static void
+run_update(ShadowUpdateProc update, CARD8 *fb, int randr)
+{
+    CARD8 *saved = framebuffer;
+
+    memset(fb, POISON, fb_bytes);
+    framebuffer = fb;
+    test_buf.randr = randr;
+    (*update) (&test_screen, &test_buf);
+    framebuffer = saved;
+}
+
+/* the damaged pixels rotated into fb and nothing else touched */
+static void
+check_rotated(const CARD8 *fb, int rotate)
+{
+    RegionPtr damage = &test_damage.damage;
+    int rows = rotate & (SHADOW_ROTATE_90 | SHADOW_ROTATE_270) ?
+        SCREEN_WIDTH : SCREEN_HEIGHT;
+    CARD8 *expect = malloc(fb_bytes);
+
+    assert(expect);
+    memset(expect, POISON, fb_bytes);
+    for (int i = 0; i < RegionNumRects(damage); i++) {
+        BoxPtr box = RegionRects(damage) + i;
+
+        for (int y = box->y1; y < box->y2; y++) {
+            for (int x = box->x1; x < box->x2; x++) {
+                int row, col;
+
+                rotated(rotate, x, y, &row, &col);
+                assert(row >= 0 && row < rows);
+                memcpy(fb_row(expect, row) + col * 4,
+                       &shadow_bits[y * SCREEN_WIDTH + x], 4);
+            }
+        }
+    }
+    assert(memcmp(expect, fb, fb_bytes) == 0);
+    free(expect);
+}
+
+static void
+shadow_rotate(void)
+{
+    static const struct {
+        int rotate;
+        ShadowUpdateProc update;
+    } rotations[] = {
+        { SHADOW_ROTATE_0, shadowUpdatePacked },
+        { SHADOW_ROTATE_90, shadowUpdateRotate32_90 },
+        { SHADOW_ROTATE_180, shadowUpdateRotate32_180 },
+        { SHADOW_ROTATE_270, shadowUpdateRotate32_270 },
+    };
+
+    setup_shadow();
+    for (int r = 0; r < ARRAY_SIZE(rotations); r++) {
+        int rotate = rotations[r].rotate;
+        int pixels = rotate & (SHADOW_ROTATE_90 | SHADOW_ROTATE_270) ?
+            SCREEN_HEIGHT : SCREEN_WIDTH;
+        ShadowUpdateProc update = rotations[r].update;
+
+        for (int pad = 0; pad <= 3; pad += 3) {
+            fb_stride = (pixels + pad) * 4;
+
+            for (int round = 0; round < 8; round++) {
+                set_damage(round);
+
+                /* the former code, which a gapped framebuffer still gets */
+                layout = FB_GAPPED;
+                run_update(rotate == SHADOW_ROTATE_0 ?
+                           shadowUpdateRotate32 : update, reference, 0);
+                check_rotated(reference, rotate);
+
+                for (int v = 0; shadowKernelVariants[v]; v++) {
+                    if (!shadowKernelsSupported(shadowKernelVariants[v]))
+                        continue;
+                    shadowKernels = shadowKernelVariants[v];
+
+                    for (layout = FB_LINEAR; layout <= FB_GAPPED_LATE;
+                         layout++) {
+                        run_update(update, framebuffer, 0);
+                        check_rotated(framebuffer, rotate);
+                        if (layout == FB_GAPPED)
+                            assert(memcmp(reference, framebuffer,
+                                          fb_bytes) == 0);
+                        run_update(shadowUpdateRotatePacked, framebuffer,
+                                   rotate);
+                        check_rotated(framebuffer, rotate);
+                    }
+                }
+            }
+        }
+    }
+    teardown_shadow();
+}
+
+static void
+shadow_32to24(void)
+{
+    setup_shadow();
+    layout = FB_LINEAR;
+    for (int pad = 0; pad <= 5; pad += 5) {
+        fb_stride = SCREEN_WIDTH * 3 + pad;
+
+        for (int round = 0; round < 8; round++) {
+            set_damage(round);
+            shadowKernels = shadowKernelVariants[0];
+            run_update(shadowUpdate32to24, reference, 0);
+
+            for (int v = 1; shadowKernelVariants[v]; v++) {
+                if (!shadowKernelsSupported(shadowKernelVariants[v]))
+                    continue;
+                shadowKernels = shadowKernelVariants[v];
+                run_update(shadowUpdate32to24, framebuffer, 0);
+                assert(memcmp(reference, framebuffer, fb_bytes) == 0);
+            }
+        }
+    }
+    teardown_shadow();
+}
+
+const testfunc_t*
+shadow_test(void)
+{
+    static const testfunc_t testfuncs[] = {
+        shadow_kernels,
+        shadow_rotate,
+        shadow_32to24,
+        NULL,
+    };
+    return testfuncs;
+}
@@ -0,0 +1,305 @@
+/* SPDX-License-Identifier: MIT OR X11
+ *
+ * Counter triggers: SyncChangeCounter() only checks the triggers whose
+ * test values the change crossed. Random alarms and awaits with several
+ * conditions on two counters are checked against the rule the old walk
+ * over all triggers followed: every trigger that became true fires once,
+ * unless firing another one deleted it first. That includes awaits
+ * deleting their other conditions, alarms deleting other alarms, and
+ * alarms changing the other counter from within the walk.
+ */
+
+/* Test relies on assert() */
+#undef NDEBUG
+
+#include <dix-config.h>
+
+#include <stdlib.h>
+#include <X11/X.h>
+#include <X11/extensions/syncconst.h>
+
+#include "dixstruct.h"
+#include "scrnintstr.h"
+#include "syncsrv.h"
+#include "misyncstr.h"
+#include "tests-common.h"
+
+#define COUNTERS        2
+#define TRIGGERS        96
+#define ROUNDS          5000
+
+typedef struct {
+    SyncTrigger trigger;
+    Bool on;                    /* on its counter */
+    int await;                  /* await it is a condition of, -1 for alarms */
+    int64_t delta;              /* alarms: step when fired, 0 to stop */
+    Bool chain;                 /* alarms: change the other counter when fired */
+    int expected;               /* change it has to fire in, or 0 */
+} TestTriggerRec;
+
+typedef struct {
+    int conditions;             /* left on counters */
+    int done;                   /* change that completed it, or 0 */
+} TestAwaitRec;
+
+static ClientRec client;
+static SyncCounter counters[COUNTERS];
+static TestTriggerRec triggers[TRIGGERS];
+static TestAwaitRec awaits[TRIGGERS];
+
+static int changes;             /* last change started */
+static int active[COUNTERS];    /* change running on each counter, or 0 */
+
+static void change_counter(int c, int64_t newval);
+
+static int
+counter_of(TestTriggerRec *t)
+{
+    return (SyncCounter *) t->trigger.pSync - counters;
+}
+
+static Bool
+positive(SyncTrigger *pTrigger)
+{
+    return pTrigger->test_type == XSyncPositiveTransition ||
+           pTrigger->test_type == XSyncPositiveComparison;
+}
+
+/* the conditions of Xext/sync.c, for a change from oldval to value */
+static Bool
+condition(SyncTrigger *pTrigger, int64_t oldval, int64_t value)
+{
+    int64_t test = pTrigger->test_value;
+
+    switch (pTrigger->test_type) {
+    case XSyncPositiveTransition:
+        return oldval < test && value >= test;
+    case XSyncNegativeTransition:
+        return oldval > test && value <= test;
+    case XSyncPositiveComparison:
+        return value >= test;
+    default:
+        return value <= test;
+    }
+}
+
+static Bool
+check_trigger(SyncTrigger *pTrigger, int64_t oldval)
+{
+    return condition(pTrigger, oldval, ((SyncCounter *) pTrigger->pSync)->value);
+}
+
+static void
+add_trigger(TestTriggerRec *t)
+{
+    assert(!t->on);
+    assert(SyncAddTriggerToSyncObject(&t->trigger) == Success);
+    t->on = TRUE;
+}
+
+static void
+remove_trigger(TestTriggerRec *t)
+{
+    assert(t->on);
+    SyncDeleteTriggerFromSyncObject(&t->trigger);
+    t->on = FALSE;
+    if (t->await >= 0)
+        awaits[t->await].conditions--;
+}
+
+static void
+trigger_fired(SyncTrigger *pTrigger)
+{
+    TestTriggerRec *t = (TestTriggerRec *) pTrigger;
+    int c = counter_of(t);
+    int64_t value = counters[c].value;
+
+    /* not deleted, and due in the change running on its counter */
+    assert(t->on);
+    assert(t->expected && t->expected == active[c]);
+    t->expected = 0;
+
+    if (t->await >= 0) {
+        /* like SyncAwaitTriggerFired(): the await is done, and all of its
+         * conditions go, on either counter */
+        assert(!awaits[t->await].done);
+        awaits[t->await].done = active[c];
+        for (int i = 0; i < TRIGGERS; i++)
+            if (triggers[i].on && triggers[i].await == t->await)
+                remove_trigger(&triggers[i]);
+        return;
+    }
+
+    /* like SyncAlarmTriggerFired(): step past the counter value, or stop */
+    remove_trigger(t);
+    if (t->delta) {
+        do
+            pTrigger->test_value += t->delta;
+        while (positive(pTrigger) ? value >= pTrigger->test_value :
+                                    value <= pTrigger->test_value);
+        add_trigger(t);
+    }
+
+    /* a client going away with its alarms */
+    if (rand() % 8 == 0) {
+        TestTriggerRec *other = &triggers[rand() % TRIGGERS];
+
+        if (other != t && other->on && other->await < 0) {
+            remove_trigger(other);
+            other->expected = 0;
+        }
+    }
+
+    if (t->chain)
+        change_counter(!c, counters[!c].value + rand() % 41 - 20);
+}
+
+static void
+change_counter(int c, int64_t newval)
+{
+    int64_t oldval = counters[c].value;
+    int change = ++changes;
+
+    assert(!active[c]);
+    for (int i = 0; i < TRIGGERS; i++) {
+        TestTriggerRec *t = &triggers[i];
+
+        if (t->on && counter_of(t) == c &&
+            condition(&t->trigger, oldval, newval))
+            t->expected = change;
+    }
+
+    active[c] = change;
+    SyncChangeCounter(&counters[c], newval);
+    active[c] = 0;
+    assert(counters[c].value == newval);
+
+    for (int i = 0; i < TRIGGERS; i++) {
+        TestTriggerRec *t = &triggers[i];
+
+        /* what hasn't fired is a condition of an await that another
+         * condition completed, during this change or one it caused */
+        if (t->expected == change) {
+            assert(t->await >= 0 && !t->on);
+            assert(awaits[t->await].done >= change);
+            t->expected = 0;
+        }
+
+        /* a comparison left true would fire on every later change */
+        if (t->on && counter_of(t) == c &&
+            (t->trigger.test_type == XSyncPositiveComparison ||
+             t->trigger.test_type == XSyncNegativeComparison))
+            assert(!check_trigger(&t->trigger, oldval));
+    }
+}
+
+static void
+init_trigger(TestTriggerRec *t, int c, int await)
+{
+    SyncTrigger *pTrigger = &t->trigger;
+    int64_t value = counters[c].value;
+    int64_t offset = 1 + rand() % 100;
+
+    pTrigger->pSync = &counters[c].sync;
+    pTrigger->test_type = rand() % SYNC_TEST_TYPES;
+    pTrigger->CheckTrigger = check_trigger;
+    pTrigger->TriggerFired = trigger_fired;
+
+    /* comparisons start out false, or they would have fired right away */
+    switch (pTrigger->test_type) {
+    case XSyncPositiveComparison:
+        pTrigger->test_value = value + offset;
+        break;
+    case XSyncNegativeComparison:
+        pTrigger->test_value = value - offset;
+        break;
+    default:
+        pTrigger->test_value = value + offset - 50;
+        break;
+    }
+
+    t->await = await;
+    t->delta = 0;
+    t->chain = FALSE;
+    if (await < 0) {
+        if (rand() % 4)
+            t->delta = positive(pTrigger) ? 1 + rand() % 40 : -1 - rand() % 40;
+        t->chain = c == 0 && rand() % 8 == 0;
+    }
+    else
+        awaits[await].conditions++;
+
+    add_trigger(t);
+}
+
+/* fill the free slots with new alarms and awaits */
+static void
+add_triggers(void)
+{
+    int i = 0;
+
+    for (;;) {
+        int await = -1, n = 1;
+
+        while (i < TRIGGERS && triggers[i].on)
+            i++;
+        if (i == TRIGGERS)
+            return;
+
+        if (rand() % 2) {
+            for (await = 0; awaits[await].conditions; await++)
+                ;
+            awaits[await].done = 0;
+            n = 1 + rand() % 3;
+        }
+
+        for (; n && i < TRIGGERS; i++) {
+            if (!triggers[i].on) {
+                init_trigger(&triggers[i], rand() % COUNTERS, await);
+                n--;
+            }
+        }
+    }
+}
+
+static void
+sync_trigger_random(void)
+{
+    srand(12);
+
+    for (int c = 0; c < COUNTERS; c++) {
+        /* client counters, system counters also compute brackets */
+        counters[c].sync.client = &client;
+        counters[c].sync.type = SYNC_COUNTER;
+        counters[c].value = counters[c].checked_value = c * 1000;
+    }
+
+    for (int round = 0; round < ROUNDS; round++) {
+        int c = rand() % COUNTERS;
+        int64_t step = rand() % 10 ? rand() % 61 - 30 : rand() % 2001 - 1000;
+
+        add_triggers();
+        change_counter(c, counters[c].value + step);
+    }
+
+    for (int i = 0; i < TRIGGERS; i++)
+        if (triggers[i].on)
+            remove_trigger(&triggers[i]);
+    for (int c = 0; c < COUNTERS; c++) {
+        assert(!counters[c].sync.pTriglist);
+        for (int type = 0; type < SYNC_TEST_TYPES; type++) {
+            assert(counters[c].triggers[type].num == 0);
+            free(counters[c].triggers[type].entries);
+        }
+    }
+}
+
+const testfunc_t*
+sync_trigger_test(void)
+{
+    static const testfunc_t testfuncs[] = {
+        sync_trigger_random,
+        NULL,
+    };
+    return testfuncs;
+}
@@ -11,11 +11,18 @@ main(int argc, char **argv)
     run_test(string_test);
 
 #ifdef XORG_TESTS
+    run_test(atom_test);
     run_test(fixes_test);
+    run_test(grabs_test);
     run_test(input_test);
     run_test(misc_test);
+    run_test(property_test);
+    run_test(resource_test);
+    run_test(shadow_test);
     run_test(signal_logging_test);
+    run_test(sync_trigger_test);
     run_test(touch_test);
+    run_test(window_test);
     run_test(xfree86_test);
     run_test(xkb_test);
     run_test(xtest_test);
@@ -38,6 +45,9 @@ main(int argc, char **argv)
     run_test(protocol_xiwarppointer_test);
     run_test(protocol_eventconvert_test);
     run_test(xi2_test);
+
+    run_test(delivery_test);
+    run_test(timer_test);
 #endif
 
 #endif /* XORG_TESTS */
@@ -23,14 +23,23 @@ extern int verbose;
 
 typedef void (*testfunc_t)(void);
 
+const testfunc_t* atom_test(void);
+const testfunc_t* delivery_test(void);
 const testfunc_t* fixes_test(void);
+const testfunc_t* grabs_test(void);
 const testfunc_t* hashtabletest_test(void);
 const testfunc_t* input_test(void);
 const testfunc_t* list_test(void);
 const testfunc_t* misc_test(void);
+const testfunc_t* property_test(void);
+const testfunc_t* resource_test(void);
+const testfunc_t* shadow_test(void);
 const testfunc_t* signal_logging_test(void);
 const testfunc_t* string_test(void);
+const testfunc_t* sync_trigger_test(void);
+const testfunc_t* timer_test(void);
 const testfunc_t* touch_test(void);
+const testfunc_t* window_test(void);
 const testfunc_t* xfree86_test(void);
 const testfunc_t* xkb_test(void);
 const testfunc_t* xtest_test(void);
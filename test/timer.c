@@ -0,0 +1,348 @@
+/* SPDX-License-Identifier: MIT OR X11
+ *
+ * OsTimer on the timing wheel, driven by a fake clock: every timer must
+ * run when the old sorted list would have run it. That is never early,
+ * right on time when the clock moves by the returned timeouts, in expiry
+ * order when several are due, and with the old rules when time rewinds.
+ */
+
+/* Test relies on assert() */
+#undef NDEBUG
+
+#include <dix-config.h>
+
+#include <limits.h>
+#include <stdlib.h>
+
+#include "os/osdep.h"
+
+#include "os.h"
+#include "tests-common.h"
+
+#define TIMERS 200
+
+typedef struct {
+    OsTimerPtr timer;
+    Bool armed;
+    CARD32 expires;
+    CARD32 delta;
+    CARD32 rearm;               /* what the callback returns ... */
+    int repeat;                 /* ... this many times */
+} TestTimerRec;
+
+static TestTimerRec timers[TIMERS];
+static CARD32 fake_now;
+
+/* checks on timers run by check_timers() */
+static Bool exact;
+static Bool forcing;
+static int fired;
+static CARD32 last_expires;
+
+static CARD32
+fake_time(void)
+{
+    return fake_now;
+}
+
+WRAP_FUNCTION(GetTimeInMillis, CARD32, void)
+{
+    IMPLEMENT_WRAP_FUNCTION_WITH_RETURN(GetTimeInMillis);
+}
+
+static CARD32
+timer_callback(OsTimerPtr timer, CARD32 now, void *arg)
+{
+    TestTimerRec *t = arg;
+    CARD32 rearm = 0;
+
+    assert(t->timer == timer);
+    assert(t->armed);
+    assert(now == fake_now);
+
+    if (!forcing) {
+        /* never early, and on time if the clock moved by the timeout */
+        assert((int) (now - t->expires) >= 0);
+        if (exact)
+            assert(now == t->expires);
+        if (fired)
+            assert((int) (t->expires - last_expires) >= 0);
+        last_expires = t->expires;
+        fired++;
+    }
+
+    t->armed = FALSE;
+    if (t->repeat > 0) {
+        t->repeat--;
+        rearm = t->rearm;
+    }
+    if (rearm) {
+        t->armed = TRUE;
+        t->expires = now + rearm;
+        t->delta = rearm;
+    }
+    return rearm;
+}
+
+static void
+arm(TestTimerRec *t, CARD32 delay, Bool absolute)
+{
+    t->armed = TRUE;
+    t->expires = fake_now + delay;
+    t->delta = delay;
+    t->timer = TimerSet(t->timer, absolute ? TimerAbsolute : 0,
+                        absolute ? fake_now + delay : delay,
+                        timer_callback, t);
+    assert(t->timer);
+}
+
+static void
+cancel(TestTimerRec *t)
+{
+    TimerCancel(t->timer);
+    t->armed = FALSE;
+}
+
+static void
+force(TestTimerRec *t)
+{
+    Bool armed = t->armed;
+
+    forcing = TRUE;
+    assert(TimerForce(t->timer) == armed);
+    forcing = FALSE;
+}
+
+/* run the due timers and return the timeout, as WaitForSomething does */
+static int
+run_timers(void)
+{
+    int due = 0, timeout;
+    Bool any = FALSE;
+    CARD32 next = UINT_MAX;
+
+    for (int i = 0; i < TIMERS; i++)
+        if (timers[i].armed && (int) (fake_now - timers[i].expires) >= 0)
+            due++;
+
+    fired = 0;
+    timeout = check_timers();
+    if (timeout == 0)
+        timeout = check_timers();
+    assert(fired == due);
+
+    for (int i = 0; i < TIMERS; i++) {
+        if (!timers[i].armed)
+            continue;
+        assert((int) (timers[i].expires - fake_now) > 0);
+        any = TRUE;
+        if (timers[i].expires - fake_now < next)
+            next = timers[i].expires - fake_now;
+    }
+
+    /* the wheel may wake up early to move timers a level down */
+    if (any)
+        assert(timeout > 0 && timeout <= next);
+    else
+        assert(timeout == -1);
+    return timeout;
+}
+
+/* move the clock by the returned timeouts until no timer is left */
+static void
+run_all_exact(void)
+{
+    int timeout, steps = 0;
+
+    while ((timeout = run_timers()) > 0) {
+        assert(++steps < 100000);
+        fake_now += timeout;
+        exact = TRUE;
+    }
+    exact = FALSE;
+}
+
+static void
+setup(CARD32 now)
+{
+    fake_now = now;
+    wrapped_GetTimeInMillis = fake_time;
+    TimerInit();
+}
+
+static void
+teardown(void)
+{
+    for (int i = 0; i < TIMERS; i++) {
+        TimerFree(timers[i].timer);
+        timers[i].timer = NULL;
+        timers[i].armed = FALSE;
+    }
+    wrapped_GetTimeInMillis = NULL;
+}
+
+static void
+timer_levels(void)
+{
+    static const CARD32 delays[] = {
+        1, 2, 63, 64, 65, 4095, 4096, 4097, 262143, 262144, 262145,
+        (1 << 24) - 1, 1 << 24, (1 << 24) + 1, (1 << 30) - 1, 1 << 30,
+        (1 << 30) + 1, INT_MAX,
+    };
+
+    /* shortly before the 32 bit millisecond counter wraps */
+    setup(UINT_MAX - 5000);
+
+    for (int i = 0; i < ARRAY_SIZE(delays); i++)
+        arm(&timers[i], delays[i], i % 2);
+    run_all_exact();
+
+    /* again, with each timer rearming itself once from its callback */
+    for (int i = 0; i < ARRAY_SIZE(delays); i++) {
+        timers[i].rearm = delays[ARRAY_SIZE(delays) - 1 - i];
+        timers[i].repeat = 1;
+        arm(&timers[i], delays[i], FALSE);
+    }
+    run_all_exact();
+
+    teardown();
+}
+
+static CARD32
+random_delay(void)
+{
+    switch (rand() % 6) {
+    case 0:
+        return 1 + rand() % 64;
+    case 1:
+        return 1 + rand() % 4096;
+    case 2:
+        return 1 + rand() % 262144;
+    case 3:
+        return 1 + rand() % (1 << 24);
+    case 4:
+        return 1 + rand() % INT_MAX;
+    default:
+        return 1 + rand() % 20;
+    }
+}
+
+static void
+timer_random(void)
+{
+    setup(UINT_MAX - 100000);
+    srand(11);
+
+    for (int i = 0; i < 50000; i++) {
+        TestTimerRec *t = &timers[rand() % TIMERS];
+        int op = rand() % 10;
+        int timeout;
+
+        if (op < 5) {
+            t->rearm = random_delay();
+            t->repeat = rand() % 5 ? 0 : 1 + rand() % 3;
+            arm(t, random_delay(), rand() % 4 == 0);
+        }
+        else if (op < 7 && t->timer)
+            cancel(t);
+        else if (op < 8 && t->timer)
+            force(t);
+
+        timeout = run_timers();
+
+        /* mostly to the next timeout, sometimes past due timers, which
+         * then have to catch up, in expiry order */
+        exact = timeout > 0 && rand() % 3;
+        if (exact)
+            fake_now += timeout;
+        else if (rand() % 50)
+            fake_now += rand() % 5000;
+        else
+            fake_now += rand() % (1 << 28);
+    }
+    exact = FALSE;
+
+    for (int i = 0; i < TIMERS; i++)
+        timers[i].repeat = 0;
+    run_all_exact();
+    teardown();
+}
+
+static void
+timer_catch_up(void)
+{
+    setup(1000);
+    srand(5);
+
+    for (int i = 0; i < TIMERS; i++)
+        arm(&timers[i], random_delay() % (1 << 29) + 1, FALSE);
+
+    /* the server was stopped: everything is due at once */
+    fake_now += 1 << 30;
+    assert(run_timers() == -1);
+
+    /* nothing moves an empty wheel; a long while later, timers still run
+     * on time */
+    for (int i = 0; i < 10; i++) {
+        fake_now += INT_MAX;
+        assert(run_timers() == -1);
+    }
+    arm(&timers[0], 10, FALSE);
+    arm(&timers[1], 100000, TRUE);
+    run_all_exact();
+
+    teardown();
+}
+
+static void
+timer_rewind(void)
+{
+    CARD32 start = 100000;
+    TestTimerRec *a = &timers[0], *b = &timers[1], *c = &timers[2];
+
+    setup(start);
+
+    arm(a, 1000, FALSE);
+    fake_now = start + 900;
+    run_timers();
+    arm(b, 5000, FALSE);
+    arm(c, 50, FALSE);
+
+    /*
+     * Time goes back by 600ms. The first timer, c, is now further off
+     * than its delay plus 250ms, so all timers are checked. c and b run
+     * right away. a is only 700ms away, less than its delay plus 250ms,
+     * and keeps its time.
+     */
+    fake_now = start + 300;
+    c->expires = b->expires = fake_now;
+    run_timers();
+    assert(!b->armed && !c->armed && a->armed);
+    run_all_exact();
+    assert(fake_now == start + 1000);
+
+    /* a timer rearmed from its callback after a rewind runs on time */
+    c->rearm = 300;
+    c->repeat = 1;
+    arm(c, 10000, FALSE);
+    fake_now -= 20000;
+    c->expires = fake_now;
+    run_timers();
+    assert(c->armed && c->expires == fake_now + 300);
+    run_all_exact();
+
+    teardown();
+}
+
+const testfunc_t*
+timer_test(void)
+{
+    static const testfunc_t testfuncs[] = {
+        timer_levels,
+        timer_random,
+        timer_catch_up,
+        timer_rewind,
+        NULL,
+    };
+    return testfuncs;
+}
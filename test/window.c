@@ -0,0 +1,287 @@
+/* SPDX-License-Identifier: MIT OR X11
+ *
+ * Pointer hit testing: miChildAt() answers from a grid index once a
+ * window has enough children. After random restacks, maps, unmaps and
+ * moves, done the way dix does them, it must find the same child as the
+ * old walk over the siblings, topmost first, on every level.
+ */
+
+/* Test relies on assert() */
+#undef NDEBUG
+
+#include <dix-config.h>
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "dix/window_priv.h"
+#include "mi/mi_priv.h"
+
+#include "dix.h"
+#include "dixstruct.h"
+#include "scrnintstr.h"
+#include "window.h"
+#include "windowstr.h"
+#include "tests-common.h"
+
+#define SCREEN_WIDTH    1920
+#define SCREEN_HEIGHT   1080
+#define TOPLEVELS       300
+#define WINDOWS         (TOPLEVELS * 11)
+
+static ClientRec client;
+static ScreenRec screen;
+static WindowRec root;
+static WindowPtr windows[WINDOWS];
+static int nwindows;
+
+/* what miSpriteTrace() did before the index */
+static WindowPtr
+walk_children(WindowPtr pParent, int x, int y)
+{
+    for (WindowPtr pWin = pParent->firstChild; pWin; pWin = pWin->nextSib) {
+        int bw = wBorderWidth(pWin);
+
+        if (pWin->mapped && !pWin->unhittable &&
+            x >= pWin->drawable.x - bw &&
+            x < pWin->drawable.x + (int) pWin->drawable.width + bw &&
+            y >= pWin->drawable.y - bw &&
+            y < pWin->drawable.y + (int) pWin->drawable.height + bw)
+            return pWin;
+    }
+    return NullWindow;
+}
+
+/* new child on top of its siblings, counted like CreateWindow() does */
+static WindowPtr
+add_window(WindowPtr pParent, int x, int y, int w, int h, int bw)
+{
+    WindowPtr pWin = calloc(1, sizeof(WindowRec));
+
+    assert(pWin && nwindows < WINDOWS);
+    assert(MakeWindowOptional(pParent));
+
+    pWin->drawable.type = DRAWABLE_WINDOW;
+    pWin->drawable.pScreen = &screen;
+    pWin->drawable.x = pParent->drawable.x + x + bw;
+    pWin->drawable.y = pParent->drawable.y + y + bw;
+    pWin->drawable.width = w;
+    pWin->drawable.height = h;
+    pWin->origin.x = x + bw;
+    pWin->origin.y = y + bw;
+    pWin->borderWidth = bw;
+    pWin->cursorIsNone = TRUE;
+    pWin->parent = pParent;
+
+    pWin->nextSib = pParent->firstChild;
+    if (pParent->firstChild)
+        pParent->firstChild->prevSib = pWin;
+    else
+        pParent->lastChild = pWin;
+    pParent->firstChild = pWin;
+    pParent->optional->childCount++;
+    miChildIndexInvalidate(pParent);
+
+    windows[nwindows++] = pWin;
+    return pWin;
+}
+
+static void
+setup(void)
+{
+    root.drawable.type = DRAWABLE_WINDOW;
+    root.drawable.pScreen = &screen;
+    root.drawable.width = SCREEN_WIDTH;
+    root.drawable.height = SCREEN_HEIGHT;
+    root.optional = calloc(1, sizeof(WindowOptRec));
+    root.mapped = TRUE;
+    screen.root = &root;
+
+    /* top levels, some with a few children of their own and some with
+     * more than enough for an index; all partly on screen at most */
+    for (int i = 0; i < TOPLEVELS; i++) {
+        int w = 1 + rand() % 500, h = 1 + rand() % 400;
+        WindowPtr pWin = add_window(&root, rand() % 2000 - 40,
+                                    rand() % 1100 - 20, w, h, rand() % 3);
+        int children = i % 3 ? 0 : (i % 2 ? 4 : 24);
+
+        for (int j = 0; j < children; j++)
+            add_window(pWin, rand() % w - 10, rand() % h - 10,
+                       1 + rand() % 100, 1 + rand() % 100, rand() % 2);
+    }
+
+    for (int i = 0; i < nwindows; i++)
+        if (rand() % 8)
+            MapWindow(windows[i], &client);
+}
+
+static void
+teardown(void)
+{
+    for (int i = 0; i < nwindows; i++) {
+        miChildIndexFree(windows[i]);
+        free(windows[i]->optional);
+        free(windows[i]);
+    }
+    nwindows = 0;
+    miChildIndexFree(&root);
+    free(root.optional);
+    memset(&root, 0, sizeof(root));
+}
+
+/* trace the pointer down the tree, both ways */
+static void
+check_point(int x, int y)
+{
+    WindowPtr pParent = &root;
+
+    for (;;) {
+        WindowPtr pWin = miChildAt(pParent, x, y);
+
+        assert(pWin == walk_children(pParent, x, y));
+        if (!pWin)
+            return;
+        pParent = pWin;
+    }
+}
+
+static void
+check_points(int n)
+{
+    for (int i = 0; i < n; i++)
+        check_point(rand() % (SCREEN_WIDTH + 100) - 50,
+                    rand() % (SCREEN_HEIGHT + 100) - 50);
+
+    /* and the edges of some border boxes */
+    for (int i = 0; i < n / 4; i++) {
+        WindowPtr pWin = windows[rand() % nwindows];
+        int bw = wBorderWidth(pWin);
+        int x1 = pWin->drawable.x - bw, y1 = pWin->drawable.y - bw;
+        int x2 = pWin->drawable.x + pWin->drawable.width + bw;
+        int y2 = pWin->drawable.y + pWin->drawable.height + bw;
+
+        check_point(x1, y1);
+        check_point(x1 - 1, y1);
+        check_point(x2 - 1, y2 - 1);
+        check_point(x2, y2 - 1);
+        check_point(x2 - 1, y2);
+    }
+}
+
+/* what ConfigureWindow() does for a move: the parent's index is stale,
+ * the window's own stays valid since it is relative */
+static void
+move_window(WindowPtr pWin, int dx, int dy)
+{
+    WindowPtr stack[WINDOWS];
+    int n = 0;
+
+    miChildIndexInvalidate(pWin->parent);
+    pWin->origin.x += dx;
+    pWin->origin.y += dy;
+    stack[n++] = pWin;
+    while (n) {
+        WindowPtr pChild = stack[--n];
+
+        pChild->drawable.x += dx;
+        pChild->drawable.y += dy;
+        for (pChild = pChild->firstChild; pChild; pChild = pChild->nextSib)
+            stack[n++] = pChild;
+    }
+}
+
+static void
+window_child_index(void)
+{
+    srand(21);
+    setup();
+    check_points(4000);
+
+    for (int round = 0; round < 300; round++) {
+        for (int i = 0; i < 5; i++) {
+            WindowPtr pWin = windows[rand() % nwindows];
+            WindowPtr pSib = windows[rand() % nwindows];
+
+            switch (rand() % 6) {
+            case 0:
+                /* raise */
+                if (pWin != pWin->parent->firstChild)
+                    MoveWindowInStack(pWin, pWin->parent->firstChild);
+                break;
+            case 1:
+                /* lower, or put above some sibling */
+                MoveWindowInStack(pWin, pSib->parent == pWin->parent &&
+                                  pSib != pWin ? pSib : NullWindow);
+                break;
+            case 2:
+                MapWindow(pWin, &client);
+                break;
+            case 3:
+                UnmapWindow(pWin, FALSE);
+                break;
+            case 4:
+                move_window(pWin, rand() % 200 - 100, rand() % 200 - 100);
+                break;
+            default:
+                /* checked on the candidates, no need to rebuild */
+                pWin->unhittable = rand() % 4 == 0;
+                break;
+            }
+        }
+        check_points(200);
+    }
+
+    teardown();
+}
+
+static void
+window_child_index_stack(void)
+{
+    WindowPtr top[TOPLEVELS];
+
+    /* the same box for all of them: the topmost mapped one wins */
+    root.drawable.type = DRAWABLE_WINDOW;
+    root.drawable.pScreen = &screen;
+    root.drawable.width = SCREEN_WIDTH;
+    root.drawable.height = SCREEN_HEIGHT;
+    root.optional = calloc(1, sizeof(WindowOptRec));
+    root.mapped = TRUE;
+    screen.root = &root;
+
+    for (int i = 0; i < 32; i++) {
+        top[i] = add_window(&root, 100, 100, 200, 200, 0);
+        MapWindow(top[i], &client);
+    }
+    assert(miChildAt(&root, 150, 150) == top[31]);
+
+    UnmapWindow(top[31], FALSE);
+    assert(miChildAt(&root, 150, 150) == top[30]);
+
+    MoveWindowInStack(top[0], root.firstChild);
+    assert(miChildAt(&root, 150, 150) == top[0]);
+
+    MoveWindowInStack(top[0], NullWindow);
+    assert(miChildAt(&root, 150, 150) == top[30]);
+
+    MapWindow(top[31], &client);
+    assert(miChildAt(&root, 150, 150) == top[31]);
+
+    for (int i = 31; i > 0; i--)
+        UnmapWindow(top[i], FALSE);
+    assert(miChildAt(&root, 150, 150) == top[0]);
+    assert(miChildAt(&root, 99, 150) == NullWindow);
+    assert(miChildAt(&root, 300, 150) == NullWindow);
+
+    teardown();
+}
+
+const testfunc_t*
+window_test(void)
+{
+    static const testfunc_t testfuncs[] = {
+        window_child_index,
+        window_child_index_stack,
+        NULL,
+    };
+    return testfuncs;
+}
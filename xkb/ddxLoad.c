@@ -31,6 +31,13 @@ THE USE OR PERFORMANCE OF THIS SOFTWARE.
 #include <stdio.h>
 #include <stdlib.h>
 #include <ctype.h>
+#ifndef WIN32
+#include <dirent.h>
+#include <fcntl.h>
+#include <ftw.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
 #include <X11/X.h>
 #include <X11/Xos.h>
 #include <X11/Xproto.h>
@@ -41,6 +48,7 @@ THE USE OR PERFORMANCE OF THIS SOFTWARE.
 #include "dix/dix_priv.h"
 #include "os/log_priv.h"
 #include "os/osdep.h"
+#include "os/xsha1.h"
 #include "xkb/xkbfile_priv.h"
 #include "xkb/xkbfmisc_priv.h"
 #include "xkb/xkbrules_priv.h"
@@ -64,7 +72,21 @@ THE USE OR PERFORMANCE OF THIS SOFTWARE.
 static unsigned
 LoadXKM(unsigned want, unsigned need, const char *keymap, XkbDescPtr *xkbRtrn);
 
-static void
+/**
+ * Callback invoked by XkbRunXkbComp. Write to out to talk to xkbcomp.
+ */
+typedef void (*xkbcomp_buffer_callback)(FILE *out, void *userdata);
+
+static unsigned
+XkbCompileKeymapCached(xkbcomp_buffer_callback callback, void *userdata,
+                       unsigned want, unsigned need, XkbDescPtr *xkbRtrn,
+                       char *nameRtrn, int nameRtrnLen);
+
+/**
+ * Find the directory for compiled keymaps. Returns FALSE if there is no
+ * private one and /tmp has to do.
+ */
+static Bool
 OutputDirectory(char *outdir, size_t size)
 {
     const char *directory = NULL;
@@ -96,14 +118,11 @@ OutputDirectory(char *outdir, size_t size)
     if (r < 0 || r >= size) {
         assert(strlen("/tmp/") < size);
         strcpy(outdir, "/tmp/");
+        return FALSE;
     }
+    return TRUE;
 }
 
-/**
- * Callback invoked by XkbRunXkbComp. Write to out to talk to xkbcomp.
- */
-typedef void (*xkbcomp_buffer_callback)(FILE *out, void *userdata);
-
 /**
  * Start xkbcomp, let the callback write into xkbcomp's stdin. When done,
  * return a strdup'd copy of the file name we've written to.
@@ -230,42 +249,13 @@ xkb_write_keymap_for_names_cb(FILE *out, void *userdata)
     XkbKeymapNamesCtx *ctx = userdata;
 #ifdef DEBUG
     if (xkbDebugFlags) {
-        ErrorF("[xkb] XkbDDXCompileKeymapByNames compiling keymap:\n");
+        ErrorF("[xkb] XkbDDXLoadKeymapByNames compiling keymap:\n");
         XkbWriteXKBKeymapForNames(stderr, ctx->names, ctx->xkb, ctx->want, ctx->need);
     }
 #endif
     XkbWriteXKBKeymapForNames(out, ctx->names, ctx->xkb, ctx->want, ctx->need);
 }
 
-static Bool
-XkbDDXCompileKeymapByNames(XkbDescPtr xkb,
-                           XkbComponentNamesPtr names,
-                           unsigned want,
-                           unsigned need, char *nameRtrn, int nameRtrnLen)
-{
-    char *keymap;
-    Bool rc = FALSE;
-    XkbKeymapNamesCtx ctx = {
-        .xkb = xkb,
-        .names = names,
-        .want = want,
-        .need = need
-    };
-
-    keymap = RunXkbComp(xkb_write_keymap_for_names_cb, &ctx);
-
-    if (keymap) {
-        if(nameRtrn)
-            strlcpy(nameRtrn, keymap, nameRtrnLen);
-
-        free(keymap);
-        rc = TRUE;
-    } else if (nameRtrn)
-        *nameRtrn = '\0';
-
-    return rc;
-}
-
 typedef struct {
     const char *keymap;
     size_t len;
@@ -285,50 +275,51 @@ XkbDDXLoadKeymapFromString(DeviceIntPtr keybd,
                           unsigned int need,
                           XkbDescPtr *xkbRtrn)
 {
-    unsigned int have;
-    char *map_name;
     XkbKeymapString map = {
         .keymap = keymap,
         .len = keymap_length
     };
 
-    *xkbRtrn = NULL;
-
-    map_name = RunXkbComp(xkb_write_keymap_string_cb, &map);
-    if (!map_name) {
-        LogMessage(X_ERROR, "XKB: Couldn't compile keymap\n");
-        return 0;
-    }
+    return XkbCompileKeymapCached(xkb_write_keymap_string_cb, &map,
+                                  want, need, xkbRtrn, NULL, 0);
+}
 
-    have = LoadXKM(want, need, map_name, xkbRtrn);
-    free(map_name);
+/**
+ * Path of the compiled keymap file mapName in the output directory. Returns
+ * FALSE if the output directory is just /tmp, or the path is too long.
+ */
+static Bool
+XkmPath(const char *mapName, char *buf, size_t size)
+{
+    char xkm_output_dir[PATH_MAX];
+    Bool private = OutputDirectory(xkm_output_dir, sizeof(xkm_output_dir));
 
-    return have;
+    if ((XkbBaseDirectory != NULL) && (xkm_output_dir[0] != '/')
+#ifdef WIN32
+        && (!isalpha(xkm_output_dir[0]) || xkm_output_dir[1] != ':')
+#endif
+        ) {
+        if (snprintf(buf, size, "%s/%s%s.xkm", XkbBaseDirectory,
+                     xkm_output_dir, mapName) >= size)
+            buf[0] = '\0';
+    }
+    else {
+        if (snprintf(buf, size, "%s%s.xkm", xkm_output_dir, mapName)
+            >= size)
+            buf[0] = '\0';
+    }
+    return private && buf[0] != '\0';
 }
 
 static FILE *
 XkbDDXOpenConfigFile(const char *mapName, char *fileNameRtrn, int fileNameRtrnLen)
 {
-    char buf[PATH_MAX], xkm_output_dir[PATH_MAX];
+    char buf[PATH_MAX];
     FILE *file;
 
     buf[0] = '\0';
     if (mapName != NULL) {
-        OutputDirectory(xkm_output_dir, sizeof(xkm_output_dir));
-        if ((XkbBaseDirectory != NULL) && (xkm_output_dir[0] != '/')
-#ifdef WIN32
-            && (!isalpha(xkm_output_dir[0]) || xkm_output_dir[1] != ':')
-#endif
-            ) {
-            if (snprintf(buf, PATH_MAX, "%s/%s%s.xkm", XkbBaseDirectory,
-                         xkm_output_dir, mapName) >= PATH_MAX)
-                buf[0] = '\0';
-        }
-        else {
-            if (snprintf(buf, PATH_MAX, "%s%s.xkm", xkm_output_dir, mapName)
-                >= PATH_MAX)
-                buf[0] = '\0';
-        }
+        XkmPath(mapName, buf, PATH_MAX);
         if (buf[0] != '\0')
             file = fopen(buf, "rb");
         else
@@ -371,6 +362,503 @@ LoadXKM(unsigned want, unsigned need, const char *keymap, XkbDescPtr *xkbRtrn)
     return (need | want) & (~missing);
 }
 
+/*
+ * Compiled keymap cache. Running xkbcomp takes tens to hundreds of
+ * milliseconds, and mostly it compiles the same few keymaps over and over:
+ * at every server start, for every hotplugged keyboard. So compiled keymaps
+ * are kept by a hash of the xkbcomp input and the modification time and
+ * size of every file in the XKB data directories, in memory for the
+ * server's lifetime and on disk, next to where xkbcomp writes them anyway,
+ * to be shared by later servers. Only the most recently used
+ * XKM_CACHE_FILES are kept on disk, and none with -noxkbcache.
+ */
+#ifndef WIN32
+
+#define XKM_CACHE_ENTRIES   8
+#define XKM_CACHE_FILES     32
+#define XKM_CACHE_KEY_SIZE  20
+#define XKM_CACHE_PREFIX    "xkbcomp-"
+#define XKM_CACHE_NAME_LEN  (sizeof(XKM_CACHE_PREFIX) - 1 + 2 * XKM_CACHE_KEY_SIZE)
+
+typedef struct {
+    unsigned char key[XKM_CACHE_KEY_SIZE];
+    void *data;
+    size_t size;
+    Bool mapped;
+} XkmCacheEntry;
+
+/* most recently used first */
+static XkmCacheEntry xkm_cache[XKM_CACHE_ENTRIES];
+
+/* where xkbcomp reads the keymap components from */
+static const char *xkb_data_dirs[] = {
+    "rules", "keycodes", "types", "compat", "symbols", "geometry", "keymap"
+};
+
+typedef struct {
+    char *path;
+    time_t mtime;
+    off_t size;
+} XkmCacheSource;
+
+/* the files XkmCacheAddSource() found, nftw() has no user data */
+static struct {
+    XkmCacheSource *files;
+    size_t nfiles, size;
+    Bool failed;
+} xkm_sources;
+
+static int
+XkmCacheAddSource(const char *path, const struct stat *st, int type,
+                  struct FTW *ftw)
+{
+    XkmCacheSource *file;
+
+    if (type != FTW_F)
+        return 0;
+
+    if (xkm_sources.nfiles == xkm_sources.size) {
+        size_t size = xkm_sources.size ? xkm_sources.size * 2 : 1024;
+
+        file = reallocarray(xkm_sources.files, size, sizeof(*file));
+        if (!file) {
+            xkm_sources.failed = TRUE;
+            return -1;
+        }
+        xkm_sources.files = file;
+        xkm_sources.size = size;
+    }
+
+    file = &xkm_sources.files[xkm_sources.nfiles];
+    if (!(file->path = strdup(path))) {
+        xkm_sources.failed = TRUE;
+        return -1;
+    }
+    file->mtime = st->st_mtime;
+    file->size = st->st_size;
+    xkm_sources.nfiles++;
+    return 0;
+}
+
+static int
+XkmCacheSourceCompare(const void *a, const void *b)
+{
+    return strcmp(((const XkmCacheSource *) a)->path,
+                  ((const XkmCacheSource *) b)->path);
+}
+
+/*
+ * Every file xkbcomp could read: editing one in place changes neither
+ * the name nor the mtime of its directory, so each one is stat'ed, a few
+ * milliseconds for a full xkeyboard-config against the tens to hundreds
+ * a compile takes.
+ */
+static Bool
+XkmCacheHashSources(void *ctx)
+{
+    char path[PATH_MAX];
+    Bool ok;
+
+    x_sha1_update(ctx, (void *) XkbBaseDirectory,
+                  strlen(XkbBaseDirectory) + 1);
+
+    /* what isn't there or can't be read, xkbcomp can't read either */
+    for (int i = 0; !xkm_sources.failed && i < ARRAY_SIZE(xkb_data_dirs); i++)
+        if (snprintf(path, sizeof(path), "%s/%s", XkbBaseDirectory,
+                     xkb_data_dirs[i]) < sizeof(path))
+            (void) nftw(path, XkmCacheAddSource, 16, 0);
+    ok = !xkm_sources.failed;
+
+    if (ok) {
+        qsort(xkm_sources.files, xkm_sources.nfiles,
+              sizeof(*xkm_sources.files), XkmCacheSourceCompare);
+        for (size_t i = 0; i < xkm_sources.nfiles; i++) {
+            XkmCacheSource *file = &xkm_sources.files[i];
+
+            x_sha1_update(ctx, file->path, strlen(file->path) + 1);
+            x_sha1_update(ctx, &file->mtime, sizeof(file->mtime));
+            x_sha1_update(ctx, &file->size, sizeof(file->size));
+        }
+    }
+
+    for (size_t i = 0; i < xkm_sources.nfiles; i++)
+        free(xkm_sources.files[i].path);
+    free(xkm_sources.files);
+    memset(&xkm_sources, 0, sizeof(xkm_sources));
+    return ok;
+}
+
+static Bool
+XkmCacheKey(const char *source, size_t len, unsigned char key[XKM_CACHE_KEY_SIZE])
+{
+    static const char version[] = "xkm-cache-3";
+    struct stat st = { 0 };
+    char path[PATH_MAX];
+    void *ctx;
+
+    if (len > INT_MAX)
+        return FALSE;
+
+    if (!(ctx = x_sha1_init()))
+        return FALSE;
+    x_sha1_update(ctx, (void *) version, sizeof(version));
+
+    if (XkbBaseDirectory && !XkmCacheHashSources(ctx)) {
+        x_sha1_final(ctx, key);
+        return FALSE;
+    }
+
+    if (XkbBinDirectory &&
+        snprintf(path, sizeof(path), "%s/xkbcomp",
+                 XkbBinDirectory) < sizeof(path))
+        (void) stat(path, &st);
+    x_sha1_update(ctx, &st.st_mtime, sizeof(st.st_mtime));
+    x_sha1_update(ctx, &st.st_size, sizeof(st.st_size));
+    x_sha1_update(ctx, (void *) source, len);
+    return x_sha1_final(ctx, key);
+}
+
+static void
+XkmCacheName(const unsigned char key[XKM_CACHE_KEY_SIZE], char *name)
+{
+    strcpy(name, XKM_CACHE_PREFIX);
+    for (int i = 0; i < XKM_CACHE_KEY_SIZE; i++)
+        sprintf(name + strlen(XKM_CACHE_PREFIX) + 2 * i, "%02x", key[i]);
+}
+
+static Bool
+XkmCacheIsFileName(const char *name)
+{
+    return strncmp(name, XKM_CACHE_PREFIX, strlen(XKM_CACHE_PREFIX)) == 0 &&
+        strspn(name + strlen(XKM_CACHE_PREFIX), "0123456789abcdef") ==
+            2 * XKM_CACHE_KEY_SIZE &&
+        strcmp(name + XKM_CACHE_NAME_LEN, ".xkm") == 0;
+}
+
+typedef struct {
+    time_t mtime;
+    char name[XKM_CACHE_NAME_LEN + sizeof(".xkm")];
+} XkmCacheFile;
+
+static int
+XkmCacheFileNewer(const void *a, const void *b)
+{
+    time_t ma = ((const XkmCacheFile *) a)->mtime;
+    time_t mb = ((const XkmCacheFile *) b)->mtime;
+
+    return ma > mb ? -1 : ma < mb;
+}
+
+/*
+ * Remove all but the XKM_CACHE_FILES most recently used cached keymaps
+ * from the directory of path. Using one touches its file.
+ */
+static void
+XkmCachePrune(const char *path)
+{
+    char dirname[PATH_MAX], *slash;
+    XkmCacheFile *files = NULL;
+    size_t nfiles = 0, size = 0;
+    struct dirent *ent;
+    DIR *dir;
+
+    if (strlcpy(dirname, path, sizeof(dirname)) >= sizeof(dirname) ||
+        !(slash = strrchr(dirname, '/')))
+        return;
+    slash[1] = '\0';
+    if (!(dir = opendir(dirname)))
+        return;
+
+    while ((ent = readdir(dir))) {
+        struct stat st;
+
+        if (!XkmCacheIsFileName(ent->d_name) ||
+            fstatat(dirfd(dir), ent->d_name, &st, AT_SYMLINK_NOFOLLOW) != 0 ||
+            !S_ISREG(st.st_mode) || st.st_uid != geteuid())
+            continue;
+
+        if (nfiles == size) {
+            XkmCacheFile *grown;
+
+            size = size ? size * 2 : 2 * XKM_CACHE_FILES;
+            if (!(grown = reallocarray(files, size, sizeof(*files))))
+                break;
+            files = grown;
+        }
+        files[nfiles].mtime = st.st_mtime;
+        strcpy(files[nfiles].name, ent->d_name);
+        nfiles++;
+    }
+
+    if (nfiles > XKM_CACHE_FILES) {
+        qsort(files, nfiles, sizeof(*files), XkmCacheFileNewer);
+        for (size_t i = XKM_CACHE_FILES; i < nfiles; i++)
+            (void) unlinkat(dirfd(dir), files[i].name, 0);
+    }
+    free(files);
+    closedir(dir);
+}
+
+static void
+XkmCacheFree(XkmCacheEntry *entry)
+{
+    if (entry->mapped)
+        munmap(entry->data, entry->size);
+    else
+        free(entry->data);
+    memset(entry, 0, sizeof(*entry));
+}
+
+/* returns the new entry, always the first one */
+static XkmCacheEntry *
+XkmCacheInsert(const unsigned char *key, void *data, size_t size, Bool mapped)
+{
+    XkmCacheEntry *last = &xkm_cache[XKM_CACHE_ENTRIES - 1];
+
+    if (last->data)
+        XkmCacheFree(last);
+    memmove(&xkm_cache[1], &xkm_cache[0],
+            (XKM_CACHE_ENTRIES - 1) * sizeof(XkmCacheEntry));
+
+    memcpy(xkm_cache[0].key, key, XKM_CACHE_KEY_SIZE);
+    xkm_cache[0].data = data;
+    xkm_cache[0].size = size;
+    xkm_cache[0].mapped = mapped;
+    return &xkm_cache[0];
+}
+
+static XkmCacheEntry *
+XkmCacheLookup(const unsigned char *key)
+{
+    for (int i = 0; i < XKM_CACHE_ENTRIES && xkm_cache[i].data; i++) {
+        if (memcmp(xkm_cache[i].key, key, XKM_CACHE_KEY_SIZE) == 0) {
+            XkmCacheEntry entry = xkm_cache[i];
+
+            memmove(&xkm_cache[1], &xkm_cache[0], i * sizeof(XkmCacheEntry));
+            xkm_cache[0] = entry;
+            return &xkm_cache[0];
+        }
+    }
+    return NULL;
+}
+
+/* drop the first entry, and its file if it is bad */
+static void
+XkmCacheDrop(Bool unlink_file)
+{
+    char name[PATH_MAX], path[PATH_MAX];
+
+    if (unlink_file) {
+        XkmCacheName(xkm_cache[0].key, name);
+        if (XkmPath(name, path, sizeof(path)))
+            (void) unlink(path);
+    }
+
+    XkmCacheFree(&xkm_cache[0]);
+    memmove(&xkm_cache[0], &xkm_cache[1],
+            (XKM_CACHE_ENTRIES - 1) * sizeof(XkmCacheEntry));
+    memset(&xkm_cache[XKM_CACHE_ENTRIES - 1], 0, sizeof(XkmCacheEntry));
+}
+
+/* map a keymap compiled by an earlier server, if we can trust the file */
+static XkmCacheEntry *
+XkmCacheMapFile(const unsigned char *key)
+{
+    char name[PATH_MAX], path[PATH_MAX];
+    struct stat st;
+    void *data;
+    int fd;
+
+    if (!XkbKeymapDiskCache)
+        return NULL;
+
+    XkmCacheName(key, name);
+    if (!XkmPath(name, path, sizeof(path)))
+        return NULL;
+
+    fd = open(path, O_RDONLY | O_NOFOLLOW | O_CLOEXEC);
+    if (fd < 0)
+        return NULL;
+
+    if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode) ||
+        st.st_uid != geteuid() || (st.st_mode & (S_IWGRP | S_IWOTH)) ||
+        st.st_size == 0) {
+        close(fd);
+        return NULL;
+    }
+
+    data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (data != MAP_FAILED)
+        (void) futimens(fd, NULL);      /* used, for XkmCachePrune() */
+    close(fd);
+    if (data == MAP_FAILED)
+        return NULL;
+
+    return XkmCacheInsert(key, data, st.st_size, TRUE);
+}
+
+/* run xkbcomp, and keep what it wrote under the cache name */
+static XkmCacheEntry *
+XkmCacheCompile(const unsigned char *key, const char *source, size_t len)
+{
+    XkbKeymapString map = { .keymap = source, .len = len };
+    char name[PATH_MAX], path[PATH_MAX], fileName[PATH_MAX];
+    char *keymap;
+    FILE *file;
+    struct stat st;
+    void *data = NULL;
+
+    keymap = RunXkbComp(xkb_write_keymap_string_cb, &map);
+    if (!keymap) {
+        LogMessage(X_ERROR, "XKB: Couldn't compile keymap\n");
+        return NULL;
+    }
+
+    file = XkbDDXOpenConfigFile(keymap, fileName, PATH_MAX);
+    free(keymap);
+    if (!file) {
+        LogMessage(X_ERROR, "Couldn't open compiled keymap file %s\n",
+                   fileName);
+        return NULL;
+    }
+
+    if (fstat(fileno(file), &st) == 0 && st.st_size > 0 &&
+        (data = malloc(st.st_size)) &&
+        fread(data, st.st_size, 1, file) != 1) {
+        free(data);
+        data = NULL;
+    }
+    fclose(file);
+
+    XkmCacheName(key, name);
+    if (!data || !XkbKeymapDiskCache || !XkmPath(name, path, sizeof(path)) ||
+        rename(fileName, path) != 0)
+        (void) unlink(fileName);
+    else
+        XkmCachePrune(path);
+
+    if (!data) {
+        LogMessage(X_ERROR, "Error reading keymap %s\n", fileName);
+        return NULL;
+    }
+    return XkmCacheInsert(key, data, st.st_size, FALSE);
+}
+
+static unsigned
+XkmCacheRead(XkmCacheEntry *entry, unsigned want, unsigned need,
+             XkbDescPtr *xkbRtrn)
+{
+    FILE *file;
+    unsigned missing;
+
+    file = fmemopen(entry->data, entry->size, "rb");
+    if (!file)
+        return 0;
+    missing = XkmReadFile(file, need, want, xkbRtrn);
+    fclose(file);
+
+    if (*xkbRtrn == NULL)
+        return 0;
+    return (need | want) & (~missing);
+}
+
+#endif /* WIN32 */
+
+/**
+ * Compile the keymap source the callback writes and load the result, from
+ * the cache of compiled keymaps if it has been compiled before.
+ */
+static unsigned
+XkbCompileKeymapCached(xkbcomp_buffer_callback callback, void *userdata,
+                       unsigned want, unsigned need, XkbDescPtr *xkbRtrn,
+                       char *nameRtrn, int nameRtrnLen)
+{
+    unsigned have;
+    char *keymap;
+
+    *xkbRtrn = NULL;
+
+#ifndef WIN32
+    {
+        CARD64 start = GetTimeInMicros();
+        unsigned char key[XKM_CACHE_KEY_SIZE];
+        char name[PATH_MAX];
+        const char *how = "memory";
+        XkmCacheEntry *entry;
+        char *source = NULL;
+        size_t len = 0;
+        FILE *out;
+
+        if ((out = open_memstream(&source, &len))) {
+            (*callback)(out, userdata);
+            if (fclose(out) != 0 || !XkmCacheKey(source, len, key)) {
+                free(source);
+                source = NULL;
+            }
+        }
+
+        if (source) {
+            entry = XkmCacheLookup(key);
+            if (!entry && (entry = XkmCacheMapFile(key)))
+                how = "disk";
+            if (entry) {
+                have = XkmCacheRead(entry, want, need, xkbRtrn);
+                if (!*xkbRtrn) {
+                    LogMessage(X_WARNING, "XKB: Dropping bad cached keymap\n");
+                    XkmCacheDrop(TRUE);
+                    entry = NULL;
+                }
+            }
+            if (!entry) {
+                how = NULL;
+                entry = XkmCacheCompile(key, source, len);
+                if (entry) {
+                    have = XkmCacheRead(entry, want, need, xkbRtrn);
+                    if (!*xkbRtrn) {
+                        LogMessage(X_ERROR, "Error loading keymap\n");
+                        XkmCacheDrop(TRUE);
+                    }
+                }
+            }
+            free(source);
+
+            if (!*xkbRtrn) {
+                if (nameRtrn)
+                    *nameRtrn = '\0';
+                return 0;
+            }
+
+            XkmCacheName(key, name);
+            if (nameRtrn)
+                strlcpy(nameRtrn, name, nameRtrnLen);
+            if (how)
+                LogMessageVerb(X_INFO, 3, "XKB: Keymap cache hit (%s) for %s, "
+                               "%.1f ms\n", how, name,
+                               (GetTimeInMicros() - start) / 1000.0);
+            else
+                LogMessageVerb(X_INFO, 3, "XKB: Keymap cache miss for %s, "
+                               "compiled in %.1f ms\n", name,
+                               (GetTimeInMicros() - start) / 1000.0);
+            return have;
+        }
+    }
+#endif
+
+    keymap = RunXkbComp(callback, userdata);
+    if (!keymap) {
+        LogMessage(X_ERROR, "XKB: Couldn't compile keymap\n");
+        if (nameRtrn)
+            *nameRtrn = '\0';
+        return 0;
+    }
+
+    if (nameRtrn)
+        strlcpy(nameRtrn, keymap, nameRtrnLen);
+    have = LoadXKM(want, need, keymap, xkbRtrn);
+    free(keymap);
+    return have;
+}
+
 unsigned
 XkbDDXLoadKeymapByNames(DeviceIntPtr keybd,
                         XkbComponentNamesPtr names,
@@ -379,6 +867,11 @@ XkbDDXLoadKeymapByNames(DeviceIntPtr keybd,
                         XkbDescPtr *xkbRtrn, char *nameRtrn, int nameRtrnLen)
 {
     XkbDescPtr xkb;
+    XkbKeymapNamesCtx ctx = {
+        .names = names,
+        .want = want,
+        .need = need
+    };
 
     *xkbRtrn = NULL;
     if ((keybd == NULL) || (keybd->key == NULL) ||
@@ -393,13 +886,10 @@ XkbDDXLoadKeymapByNames(DeviceIntPtr keybd,
                    keybd && keybd->name ? keybd->name : "(unnamed keyboard)");
         return 0;
     }
-    else if (!XkbDDXCompileKeymapByNames(xkb, names, want, need,
-                                         nameRtrn, nameRtrnLen)) {
-        LogMessage(X_ERROR, "XKB: Couldn't compile keymap\n");
-        return 0;
-    }
 
-    return LoadXKM(want, need, nameRtrn, xkbRtrn);
+    ctx.xkb = xkb;
+    return XkbCompileKeymapCached(xkb_write_keymap_for_names_cb, &ctx,
+                                  want, need, xkbRtrn, nameRtrn, nameRtrnLen);
 }
 
 Bool
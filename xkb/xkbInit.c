@@ -82,6 +82,7 @@ THE USE OR PERFORMANCE OF THIS SOFTWARE.
 
 const char *XkbBaseDirectory = XKB_BASE_DIRECTORY;
 const char *XkbBinDirectory = XKB_BIN_DIRECTORY;
+Bool XkbKeymapDiskCache = TRUE;
 static int XkbWantAccessX = 0;
 
 static char *XkbRulesDflt = NULL;
@@ -799,6 +800,10 @@ XkbProcessArguments(int argc, char *argv[], int i)
         }
         return j;
     }
+    if (strcmp(argv[i], "-noxkbcache") == 0) {
+        XkbKeymapDiskCache = FALSE;
+        return 1;
+    }
     if ((strcmp(argv[i], "-ardelay") == 0) || (strcmp(argv[i], "-ar1") == 0)) { /* -ardelay int */
         if (++i >= argc)
             UseMsg();
@@ -824,4 +829,5 @@ XkbUseMsg(void)
     ErrorF("                       enable/disable accessx key sequences\n");
     ErrorF("-ardelay               set XKB autorepeat delay\n");
     ErrorF("-arinterval            set XKB autorepeat interval\n");
+    ErrorF("-noxkbcache            don't keep compiled keymaps on disk\n");
 }
@@ -187,6 +187,7 @@ extern int XkbEventBase;
 extern int XkbKeyboardErrorCode;
 extern const char *XkbBaseDirectory;
 extern const char *XkbBinDirectory;
+extern Bool XkbKeymapDiskCache;
 extern CARD32 xkbDebugFlags;
 
 /* AccessX functions */